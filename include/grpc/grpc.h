@@ -26,6 +26,8 @@ extern "C" {
 typedef struct grpc_channel grpc_channel;
 typedef struct grpc_server grpc_server;
 typedef struct grpc_call grpc_call;
+typedef struct grpc_resource_quota grpc_resource_quota;
+typedef struct grpc_executor grpc_executor;
 typedef struct grpc_completion_queue grpc_completion_queue;
 typedef struct grpc_metadata grpc_metadata;
 typedef struct grpc_byte_buffer grpc_byte_buffer;
@@ -67,7 +69,8 @@ typedef enum {
 /* Completion queue types */
 typedef enum {
     GRPC_CQ_NEXT = 0,
-    GRPC_CQ_PLUCK = 1
+    GRPC_CQ_PLUCK = 1,
+    GRPC_CQ_CALLBACK = 2   /* See grpc_completion_queue_create_for_callback() */
 } grpc_completion_type;
 
 /* Completion queue event */
@@ -77,6 +80,14 @@ typedef struct {
     void *tag;
 } grpc_event;
 
+/* Tag of a callback completion queue: run with the operation's success */
+typedef struct grpc_completion_queue_functor {
+    void (*functor_run)(struct grpc_completion_queue_functor *functor, int ok);
+} grpc_completion_queue_functor;
+
+/* Task run by a grpc_executor */
+typedef void (*grpc_executor_fn)(void *arg);
+
 /* Metadata entry */
 struct grpc_metadata {
     const char *key;
@@ -91,11 +102,12 @@ typedef struct {
     grpc_metadata *metadata;
 } grpc_metadata_array;
 
-/* Byte buffer */
+/* Byte buffer (reference counted, see grpc_byte_buffer_ref) */
 struct grpc_byte_buffer {
     uint8_t *data;
     size_t length;
     size_t capacity;
+    int refcount;
 };
 
 /* Time specification */
@@ -119,6 +131,62 @@ typedef struct {
     grpc_arg *args;
 } grpc_channel_args;
 
+/* Channel argument keys */
+
+/** Enable MSG_ZEROCOPY sends for large DATA frames (integer, 0 or 1) */
+#define GRPC_ARG_TCP_TX_ZEROCOPY_ENABLED "grpc.experimental.tcp_tx_zerocopy_enabled"
+/** Minimum DATA frame payload size sent with MSG_ZEROCOPY (integer, bytes) */
+#define GRPC_ARG_TCP_TX_ZEROCOPY_SEND_BYTES_THRESHOLD \
+    "grpc.experimental.tcp_tx_zerocopy_send_bytes_threshold"
+/** Server: send GOAWAY once a connection is this old (integer, ms, +/-10% jitter) */
+#define GRPC_ARG_MAX_CONNECTION_AGE_MS "grpc.max_connection_age_ms"
+/** Server: time allowed for calls to finish after an age GOAWAY (integer, ms) */
+#define GRPC_ARG_MAX_CONNECTION_AGE_GRACE_MS "grpc.max_connection_age_grace_ms"
+/** Server: send GOAWAY after a connection had no streams for this long (integer, ms) */
+#define GRPC_ARG_MAX_CONNECTION_IDLE_MS "grpc.max_connection_idle_ms"
+/** Server: time grpc_server_shutdown_and_notify waits for in-flight streams (integer, ms) */
+#define GRPC_ARG_SERVER_SHUTDOWN_GRACE_MS "grpc.server_shutdown_grace_ms"
+/** Server: listen(2) backlog of added ports (integer, connections, default
+ *  SOMAXCONN; the kernel caps it at net.core.somaxconn) */
+#define GRPC_ARG_SERVER_LISTEN_BACKLOG "grpc.server.listen_backlog"
+/** Server: run each connection's reader on the NUMA node whose CPU took the
+ *  connection's packets (SO_INCOMING_CPU), so the connection's memory stays
+ *  next to the NIC queue serving it (integer, 0 or 1, default 0) */
+#define GRPC_ARG_SERVER_NUMA_LOCAL_CONNECTIONS "grpc.server.numa_local_connections"
+/** Largest header list accepted from the peer, SETTINGS_MAX_HEADER_LIST_SIZE
+ *  (integer, bytes, default 16384); larger header blocks reset the stream */
+#define GRPC_ARG_MAX_METADATA_SIZE "grpc.max_metadata_size"
+/** Exchange frames over shared-memory rings on unix: connections (integer,
+ *  bytes per direction, 0 disables; the client and the server must both set it) */
+#define GRPC_ARG_SHM_TRANSPORT_RING_BYTES "grpc.experimental.shm_transport_ring_bytes"
+/** Server: starting per-method concurrency limit (integer, calls, 0 disables
+ *  admission control); calls over the limit fail with RESOURCE_EXHAUSTED */
+#define GRPC_ARG_SERVER_CONCURRENCY_LIMIT "grpc.server.concurrency_limit"
+/** Server: ceiling for the adaptive concurrency limit (integer, calls, default 1000) */
+#define GRPC_ARG_SERVER_MAX_CONCURRENCY_LIMIT "grpc.server.max_concurrency_limit"
+/** Server: queueing delay above which a method's limit shrinks (integer, ms, default 5) */
+#define GRPC_ARG_SERVER_QUEUE_DELAY_TARGET_MS "grpc.server.queue_delay_target_ms"
+/** Server: how often each method's limit is adjusted (integer, ms, default 100) */
+#define GRPC_ARG_SERVER_QUEUE_DELAY_INTERVAL_MS "grpc.server.queue_delay_interval_ms"
+/** Client: HTTP/2 connections a channel opens to its target (integer, default 1);
+ *  each call goes to the connection with the fewest active streams */
+#define GRPC_ARG_CHANNEL_CONNECTIONS "grpc.channel.connections"
+/** Client: connections a channel may grow to when every stream slot of the
+ *  least loaded connection is taken or its writers keep waiting on each other
+ *  (integer, default GRPC_ARG_CHANNEL_CONNECTIONS, i.e. no growth) */
+#define GRPC_ARG_CHANNEL_MAX_CONNECTIONS "grpc.channel.max_connections"
+/** Client: how calls are spread over the addresses the target resolves to
+ *  (string, "pick_first" (default) or "round_robin"). Targets are "host:port"
+ *  or "dns:///host:port" (DNS lookup), "ipv4:addr:port[,addr:port...]"
+ *  (fixed list) or unix: paths */
+#define GRPC_ARG_LB_POLICY_NAME "grpc.lb_policy_name"
+/** Client: extra attempts (hedges and retries) a channel may make, as a
+ *  percentage of its calls (integer, default 10) */
+#define GRPC_ARG_RETRY_BUDGET_PERCENT "grpc.retry_budget_percent"
+/** Client: extra attempts a channel may make in a burst before the
+ *  percentage applies (integer, default 10) */
+#define GRPC_ARG_RETRY_BUDGET_MAX_TOKENS "grpc.retry_budget_max_tokens"
+
 /* SSL/TLS credentials */
 typedef struct grpc_channel_credentials grpc_channel_credentials;
 typedef struct grpc_server_credentials grpc_server_credentials;
@@ -130,6 +198,101 @@ typedef struct {
     const char *cert_chain;   /* PEM encoded certificate chain */
 } grpc_ssl_pem_key_cert_pair;
 
+/* Credentials of the process on the other end of a unix: connection */
+typedef struct {
+    int32_t pid;   /* -1 where the platform does not report it */
+    uint32_t uid;
+    uint32_t gid;
+} grpc_peer_cred;
+
+/* Decides whether a local peer may connect; return false to reject */
+typedef bool (*grpc_peer_cred_filter)(const grpc_peer_cred *cred, void *user_data);
+
+/* Batch operation types (see grpc_call_start_batch) */
+typedef enum {
+    GRPC_OP_SEND_INITIAL_METADATA = 0,
+    GRPC_OP_SEND_MESSAGE = 1,
+    GRPC_OP_SEND_CLOSE_FROM_CLIENT = 2,
+    GRPC_OP_SEND_STATUS_FROM_SERVER = 3,
+    GRPC_OP_RECV_INITIAL_METADATA = 4,
+    GRPC_OP_RECV_MESSAGE = 5,
+    GRPC_OP_RECV_STATUS_ON_CLIENT = 6,
+    GRPC_OP_RECV_CLOSE_ON_SERVER = 7
+} grpc_op_type;
+
+/* Flags of a GRPC_OP_SEND_INITIAL_METADATA operation (grpc_op.flags) */
+/** Queue the call until a backend is ready instead of failing it with
+ *  GRPC_STATUS_UNAVAILABLE; its batches complete once it has been sent,
+ *  or fail at its deadline */
+#define GRPC_INITIAL_METADATA_WAIT_FOR_READY ((uint32_t)0x00000020)
+
+/* One operation of a batch */
+typedef struct {
+    grpc_op_type op;
+    uint32_t flags;
+    union {
+        struct {
+            size_t count;
+            grpc_metadata *metadata;
+        } send_initial_metadata;
+        struct {
+            grpc_byte_buffer *send_message;   /* Still owned by the caller */
+        } send_message;
+        struct {
+            size_t trailing_metadata_count;
+            grpc_metadata *trailing_metadata;
+            grpc_status_code status;
+            const char *status_details;       /* May be NULL */
+        } send_status_from_server;
+        struct {
+            grpc_metadata_array *recv_initial_metadata;
+        } recv_initial_metadata;
+        struct {
+            grpc_byte_buffer **recv_message;  /* NULL once the peer has closed */
+        } recv_message;
+        struct {
+            grpc_metadata_array *trailing_metadata;
+            grpc_status_code *status;
+            char **status_details;            /* Free with free() */
+        } recv_status_on_client;
+        struct {
+            int *cancelled;
+        } recv_close_on_server;
+    } data;
+} grpc_op;
+
+/* Incoming call details filled by grpc_server_request_call */
+typedef struct {
+    char *method;
+    char *host;
+    grpc_timespec deadline;
+} grpc_call_details;
+
+/* Hedging of an idempotent method (see grpc_channel_set_method_hedging_policy) */
+typedef struct {
+    int max_attempts;                 /* Attempts per call, original included (1-5) */
+    int hedging_delay_ms;             /* Wait for a response before the next attempt */
+    bool adaptive_delay;              /* Use the method's observed p95 once known */
+    uint32_t non_fatal_status_codes;  /* Bit (1u << code) for each status that starts
+                                       * the next attempt at once instead of ending the call */
+} grpc_hedging_policy;
+
+/* Retries of a method (see grpc_channel_set_method_retry_policy) */
+typedef struct {
+    int max_attempts;                 /* Attempts per call, original included (1-5) */
+    int initial_backoff_ms;           /* Bound of the random delay before the first retry */
+    int max_backoff_ms;               /* Ceiling of the bound as it grows */
+    double backoff_multiplier;        /* Growth of the bound after each retry (at least 1) */
+    uint32_t retryable_status_codes;  /* Bit (1u << code) for each status that is retried */
+} grpc_retry_policy;
+
+/* Micro-batching of small unary calls (see grpc_channel_set_method_batching_policy) */
+typedef struct {
+    int max_calls;                    /* Calls per batch; a full batch is sent at once */
+    size_t max_bytes;                 /* Requests per batch, in bytes (0: no limit) */
+    int window_ms;                    /* Longest the first call waits for others to join */
+} grpc_batching_policy;
+
 /* ========================================================================
  * Library Initialization
  * ======================================================================== */
@@ -157,6 +320,20 @@ void grpc_shutdown(void);
  */
 grpc_completion_queue *grpc_completion_queue_create(grpc_completion_type type);
 
+/**
+ * @brief Create a completion queue that runs its tags instead of queueing them
+ *
+ * Every tag posted to the queue must be a grpc_completion_queue_functor,
+ * and its functor_run is called on one of the executor's threads. Handlers
+ * started this way never run on, or hold up, transport threads. Tags
+ * posted once the executor is shutting down are held by the queue and run
+ * with ok=0 by grpc_completion_queue_shutdown() or _destroy().
+ * grpc_completion_queue_next() is not used with such a queue.
+ * @param executor Pool that runs the callbacks; must outlive the queue
+ * @return Pointer to the created completion queue, or NULL on error
+ */
+grpc_completion_queue *grpc_completion_queue_create_for_callback(grpc_executor *executor);
+
 /**
  * @brief Get the next event from the completion queue
  * @param cq The completion queue
@@ -183,7 +360,8 @@ void grpc_completion_queue_destroy(grpc_completion_queue *cq);
 
 /**
  * @brief Create a secure channel with credentials
- * @param target The server address (e.g., "localhost:50051")
+ * @param target The server address (e.g., "localhost:50051",
+ *               "unix:/run/app.sock" or "unix-abstract:app")
  * @param creds The channel credentials (NULL for insecure)
  * @param args Additional channel arguments
  * @return Pointer to the created channel, or NULL on error
@@ -201,6 +379,97 @@ grpc_channel *grpc_channel_create(const char *target,
 grpc_channel *grpc_insecure_channel_create(const char *target,
                                             const grpc_channel_args *args);
 
+/**
+ * @brief Create a channel to a server in the same process
+ *
+ * Calls skip sockets, HTTP/2 framing and HPACK: messages are handed to
+ * the server by reference and metadata is copied once. The server must
+ * be started and must outlive the channel.
+ * @param server The in-process server
+ * @param args Additional channel arguments
+ * @return Pointer to the created channel, or NULL on error
+ */
+grpc_channel *grpc_inproc_channel_create(grpc_server *server,
+                                          const grpc_channel_args *args);
+
+/**
+ * @brief Connect a channel's backends ahead of its first calls
+ *
+ * Target addresses are resolved when the channel is created; this also
+ * connects the connections opened up front to each backend, sends the
+ * HTTP/2 preface and SETTINGS and waits for the server's SETTINGS, in a
+ * background thread. A backend is skipped by wait-for-ready calls while
+ * it connects. One that fails is marked unavailable until the channel
+ * tries it again. In-process channels are always ready.
+ * @param channel The channel
+ * @param max_backends Backends to connect, in resolution order; 0 for all
+ * @param cq Completion queue for the result
+ * @param tag Posted to cq when done, with success set if every backend
+ *        it connected is ready
+ * @return 0 if started, -1 on error (a warm-up is already running)
+ */
+int grpc_channel_prewarm(grpc_channel *channel, size_t max_backends, grpc_completion_queue *cq, void *tag);
+
+/**
+ * @brief Hedge calls to an idempotent method
+ *
+ * A call to the method is sent once; if no response has arrived after the
+ * hedging delay, the same request is sent again, up to max_attempts in
+ * all. The first attempt to answer (initial metadata, a message or a
+ * status other than a non-fatal one) is the call's response, and the
+ * other attempts are cancelled. Attempts beyond the first draw on the
+ * channel's budget (GRPC_ARG_RETRY_BUDGET_PERCENT); once it is empty, calls
+ * make a single attempt. Applies to calls created afterwards on channels
+ * whose calls have a call transport (in-process channels).
+ * @param channel The channel
+ * @param method Full method name, e.g. "/pkg.Service/Method"
+ * @param policy Policy to use, or NULL to stop hedging the method
+ * @return 0 on success, -1 on error (invalid policy, unsupported channel)
+ */
+int grpc_channel_set_method_hedging_policy(grpc_channel *channel, const char *method,
+                                           const grpc_hedging_policy *policy);
+
+/**
+ * @brief Retry failed calls to a method
+ *
+ * A call that ends with a retryable status before any response arrived is
+ * sent again after a random delay of up to the current backoff, which
+ * grows by backoff_multiplier up to max_backoff_ms, for up to max_attempts
+ * in all. Retries draw on the channel's budget like hedges do. Calls the
+ * server turned away before processing them are retried without counting
+ * against the policy or the budget. Send buffers are released as soon as
+ * a response starts to arrive. Replaces a hedging policy of the method;
+ * channel support is as for grpc_channel_set_method_hedging_policy().
+ * @param channel The channel
+ * @param method Full method name, e.g. "/pkg.Service/Method"
+ * @param policy Policy to use, or NULL to stop retrying the method
+ * @return 0 on success, -1 on error (invalid policy, unsupported channel)
+ */
+int grpc_channel_set_method_retry_policy(grpc_channel *channel, const char *method,
+                                         const grpc_retry_policy *policy);
+
+/**
+ * @brief Gather unary calls to a method into batch calls
+ *
+ * Requests of calls to method are held for up to window_ms, or until
+ * max_calls of them or max_bytes have gathered, and then sent as one call
+ * to batch_method carrying each request as a message, in order. The
+ * server answers with one message per request, in the same order, and a
+ * status; each reply completes its own call with GRPC_STATUS_OK. Calls
+ * left without a reply get the batch's status, or GRPC_STATUS_INTERNAL if
+ * it was OK. Initial metadata of the batched calls is not sent, and
+ * cancelling one only stops it from waiting: the server still sees its
+ * request once the batch has gone. Replaces a hedging or retry policy of
+ * the method; channel support is as for grpc_channel_set_method_hedging_policy().
+ * @param channel The channel
+ * @param method Full method name of the unary calls
+ * @param batch_method Full method name of the batch calls
+ * @param policy Policy to use, or NULL to stop batching the method
+ * @return 0 on success, -1 on error (invalid policy, unsupported channel)
+ */
+int grpc_channel_set_method_batching_policy(grpc_channel *channel, const char *method,
+                                            const char *batch_method, const grpc_batching_policy *policy);
+
 /**
  * @brief Destroy a channel and free resources
  * @param channel The channel to destroy
@@ -211,15 +480,25 @@ void grpc_channel_destroy(grpc_channel *channel);
  * Call API
  * ======================================================================== */
 
+/* What a call created with a parent_call takes from it (propagation_mask) */
+/** The call's deadline is no later than the parent's */
+#define GRPC_PROPAGATE_DEADLINE ((uint32_t)0x0001)
+/** The call is cancelled when the parent is cancelled or its deadline passes */
+#define GRPC_PROPAGATE_CANCELLATION ((uint32_t)0x0008)
+/** Everything above */
+#define GRPC_PROPAGATE_DEFAULTS ((uint32_t)0xffff)
+
 /**
  * @brief Create a call on a channel
  * @param channel The channel to create the call on
- * @param parent_call Parent call for server-side streaming (can be NULL)
- * @param propagation_mask Propagation options
+ * @param parent_call Call this one is made on behalf of, usually a server
+ *        call being handled (can be NULL)
+ * @param propagation_mask GRPC_PROPAGATE_* flags applied from parent_call
  * @param cq The completion queue for this call
  * @param method The RPC method name
  * @param host The host name (can be NULL)
- * @param deadline The call deadline
+ * @param deadline The call deadline; {INT64_MAX, 0} for none. The call is
+ *        cancelled with GRPC_STATUS_DEADLINE_EXCEEDED once it passes.
  * @return Pointer to the created call, or NULL on error
  */
 grpc_call *grpc_channel_create_call(grpc_channel *channel,
@@ -232,8 +511,12 @@ grpc_call *grpc_channel_create_call(grpc_channel *channel,
 
 /**
  * @brief Start a batch of operations on a call
+ *
+ * The tag is posted to the call's completion queue once every operation
+ * in the batch has finished. At most one operation of each receive type
+ * may be outstanding on a call.
  * @param call The call to operate on
- * @param ops Array of operations to perform
+ * @param ops Array of grpc_op to perform
  * @param nops Number of operations
  * @param tag Tag to associate with this batch
  * @return GRPC_CALL_OK on success, error code otherwise
@@ -250,6 +533,14 @@ grpc_call_error grpc_call_start_batch(grpc_call *call,
  */
 grpc_call_error grpc_call_cancel(grpc_call *call);
 
+/**
+ * @brief Get the credentials of the local peer of a call
+ * @param call The call
+ * @param cred Filled with the peer's pid/uid/gid
+ * @return 0 on success, -1 if the call is not on a unix: connection
+ */
+int grpc_call_get_peer_cred(grpc_call *call, grpc_peer_cred *cred);
+
 /**
  * @brief Destroy a call and free resources
  * @param call The call to destroy
@@ -270,9 +561,9 @@ grpc_server *grpc_server_create(const grpc_channel_args *args);
 /**
  * @brief Add a listening port to the server
  * @param server The server
- * @param addr The address to bind to (e.g., "0.0.0.0:50051")
- * @param creds Server credentials (NULL for insecure)
- * @return The bound port number, or 0 on error
+ * @param addr The address to bind to (e.g., "0.0.0.0:50051",
+ *             "unix:/run/app.sock" or "unix-abstract:app")
+ * @return The bound port number (1 for unix sockets), or 0 on error
  */
 int grpc_server_add_insecure_http2_port(grpc_server *server, const char *addr);
 
@@ -287,6 +578,64 @@ int grpc_server_add_secure_http2_port(grpc_server *server,
                                        const char *addr,
                                        grpc_server_credentials *creds);
 
+/**
+ * @brief Run the server's threads only on the given CPUs
+ *
+ * Applies to the threads that accept connections and to each connection's
+ * reader, which also allocates the connection's streams. With
+ * GRPC_ARG_SERVER_NUMA_LOCAL_CONNECTIONS a reader is narrowed further to
+ * the node its connection arrived on. Must be called before
+ * grpc_server_start.
+ * @param server The server
+ * @param cpus CPUs to run on (e.g. from grpc_numa_node_cpus())
+ * @param cpu_count Number of CPUs (0 removes the restriction)
+ * @return 0 on success, -1 on error (server started, invalid CPU)
+ */
+int grpc_server_set_cpu_affinity(grpc_server *server, const int *cpus, size_t cpu_count);
+
+/**
+ * @brief Hand a server's listening sockets to another process
+ *
+ * Sends every listening socket over a connected unix: socket with
+ * SCM_RIGHTS, for grpc_server_create_from_listeners() on the other end.
+ * This server keeps serving on its copies, so no connection is refused
+ * while the new process starts; then shut it down with
+ * grpc_server_shutdown_and_notify() to drain its connections with GOAWAY.
+ * On success the socket files of unix: ports belong to the receiver and are
+ * no longer unlinked when this server is destroyed.
+ * @param server The server
+ * @param unix_fd Connected AF_UNIX socket to the new process
+ * @return 0 on success, -1 on error
+ */
+int grpc_server_export_listeners(grpc_server *server, int unix_fd);
+
+/**
+ * @brief Create a server on listening sockets handed over by another process
+ *
+ * Receives what grpc_server_export_listeners() sent and adopts the sockets
+ * as the new server's ports, in the same order, so no port is added or
+ * bound again. Register methods and completion queues, then start it.
+ * @param args Server arguments (may be NULL)
+ * @param unix_fd Connected AF_UNIX socket from the old process
+ * @return The server, or NULL if the handoff failed (received sockets are
+ *         closed)
+ */
+grpc_server *grpc_server_create_from_listeners(const grpc_channel_args *args, int unix_fd);
+
+/**
+ * @brief Filter connections on unix: ports by peer credentials
+ *
+ * Connections whose SO_PEERCRED credentials are rejected by the filter,
+ * or cannot be read, are closed right after accept. TCP ports are not
+ * affected.
+ * @param server The server
+ * @param filter Credential check (NULL removes the filter)
+ * @param user_data Passed to filter
+ */
+void grpc_server_set_peer_cred_filter(grpc_server *server,
+                                      grpc_peer_cred_filter filter,
+                                      void *user_data);
+
 /**
  * @brief Register a completion queue with the server
  * @param server The server
@@ -303,9 +652,13 @@ void grpc_server_start(grpc_server *server);
 
 /**
  * @brief Request a new call on the server
+ *
+ * The tag is posted to cq once a call arrives (success true) or the server
+ * shuts down first (success false). Client initial metadata is read with
+ * GRPC_OP_RECV_INITIAL_METADATA on the new call.
  * @param server The server
  * @param call Output parameter for the call
- * @param details Output parameter for call details
+ * @param details Output grpc_call_details (may be NULL)
  * @param cq The completion queue
  * @param tag Tag for this operation
  * @return GRPC_CALL_OK on success, error code otherwise
@@ -316,8 +669,124 @@ grpc_call_error grpc_server_request_call(grpc_server *server,
                                           grpc_completion_queue *cq,
                                           void *tag);
 
+/**
+ * @brief Register a method so its calls get a queue of their own
+ *
+ * Must be called before grpc_server_start(). Once any method is
+ * registered, calls whose :path matches no registered method are answered
+ * with UNIMPLEMENTED and never reach the application;
+ * grpc_server_request_call() is only served while no method is registered,
+ * or for methods known only from the server's reflection registry.
+ * @param server The server
+ * @param method Full method path, e.g. "/pkg.Service/Method"
+ * @param host Required :authority, or NULL to accept any host
+ * @return Handle for grpc_server_request_registered_call(), or NULL on
+ *         error (server started, duplicate registration)
+ */
+void *grpc_server_register_method(grpc_server *server, const char *method, const char *host);
+
+/**
+ * @brief Request a new call to a registered method
+ *
+ * The tag is posted to cq once a call to the method arrives (success true)
+ * or the server shuts down first (success false).
+ * @param server The server
+ * @param registered_method Handle from grpc_server_register_method()
+ * @param call Output parameter for the call
+ * @param deadline Output call deadline (may be NULL)
+ * @param cq The completion queue
+ * @param tag Tag for this operation
+ * @return GRPC_CALL_OK on success, error code otherwise
+ */
+grpc_call_error grpc_server_request_registered_call(grpc_server *server,
+                                                     void *registered_method,
+                                                     grpc_call **call,
+                                                     grpc_timespec *deadline,
+                                                     grpc_completion_queue *cq,
+                                                     void *tag);
+
+/**
+ * @brief Answer repeated requests to an idempotent unary method from a cache
+ *
+ * A call to the method waits until its request message and half-close have
+ * arrived. If a response to the same request bytes was stored within ttl_ms
+ * it is sent with status OK and the application never sees the call;
+ * otherwise the call is handed out as usual and a response the application
+ * sends with OK status and no metadata is stored. Entries are evicted in
+ * LRU order once max_bytes are held, and a new response only displaces
+ * entries whose requests arrived less often. Responses must depend on the
+ * request message alone. Must be called before grpc_server_start.
+ * @param server The server
+ * @param registered_method Handle from grpc_server_register_method()
+ * @param ttl_ms How long a response stays valid
+ * @param max_bytes Bound on the request and response bytes cached
+ * @return 0 on success, -1 on error (server started, invalid arguments)
+ */
+int grpc_server_set_method_cache(grpc_server *server, void *registered_method, int ttl_ms,
+                                 size_t max_bytes);
+
+/**
+ * @brief Let identical concurrent requests to a method share one handler run
+ *
+ * A call to the method waits until its request message and half-close have
+ * arrived. If a call with the same request bytes is already with the
+ * application, the new call is not handed out: when the first call sends
+ * its status, each waiting call is answered with the same message, status
+ * and details (metadata stays per call). If the first call ends without a
+ * status or sends more than one message, the waiting calls are handed out
+ * on their own. With grpc_server_set_method_cache() only misses coalesce.
+ * Must be called before grpc_server_start.
+ * @param server The server
+ * @param registered_method Handle from grpc_server_register_method()
+ * @param enabled Non-zero to coalesce, 0 to hand out every call
+ * @return 0 on success, -1 on error (server started, unknown method)
+ */
+int grpc_server_set_method_coalescing(grpc_server *server, void *registered_method, int enabled);
+
+/**
+ * @brief Share the server fairly among tenants
+ *
+ * Calls are grouped by the value of a request metadata key (calls without
+ * it form the "" tenant). When calls are waiting, each
+ * grpc_server_request_call() or _request_registered_call() is served by
+ * deficit round-robin across tenants in proportion to their weights, and a
+ * tenant holding max_inflight calls the application has not destroyed gets
+ * no more until one is. Must be called before grpc_server_start.
+ * @param server The server
+ * @param metadata_key Lowercase metadata key naming the tenant
+ * @param max_inflight Calls each tenant may hold at once (0 for no bound)
+ * @return 0 on success, -1 on error (server started)
+ */
+int grpc_server_set_tenant_key(grpc_server *server, const char *metadata_key, int max_inflight);
+
+/**
+ * @brief Set a tenant's share of the server (default 1)
+ *
+ * Must be called before grpc_server_start.
+ * @param server The server
+ * @param tenant Tenant name, the value of the tenant metadata key
+ * @param weight Calls the tenant is served per turn (at least 1)
+ * @return 0 on success, -1 on error
+ */
+int grpc_server_set_tenant_weight(grpc_server *server, const char *tenant, int weight);
+
+/**
+ * @brief Initialize call details for grpc_server_request_call
+ * @param details The details to initialize
+ */
+void grpc_call_details_init(grpc_call_details *details);
+
+/**
+ * @brief Free the strings held by call details
+ * @param details The details to clean up
+ */
+void grpc_call_details_destroy(grpc_call_details *details);
+
 /**
  * @brief Shutdown the server
+ * Stops accepting connections, sends GOAWAY on every open connection and
+ * waits for in-flight streams to finish (bounded by
+ * GRPC_ARG_SERVER_SHUTDOWN_GRACE_MS) before closing them.
  * @param server The server to shutdown
  * @param cq The completion queue
  * @param tag Tag for this operation
@@ -332,6 +801,137 @@ void grpc_server_shutdown_and_notify(grpc_server *server,
  */
 void grpc_server_destroy(grpc_server *server);
 
+/* ========================================================================
+ * Resource Quota API
+ * ======================================================================== */
+
+/**
+ * @brief The process-wide quota
+ *
+ * Every other quota is a child of this one, so its limit bounds the memory
+ * buffered by all channels and servers together. Unlimited by default.
+ * The global quota is not reference counted.
+ * @return The global quota
+ */
+grpc_resource_quota *grpc_resource_quota_global(void);
+
+/**
+ * @brief Create a quota for buffered transport memory
+ *
+ * Counts received header blocks and messages waiting to be read by the
+ * application. Near the limit, receive windows are no longer refilled;
+ * at the limit sockets are not read and new calls fail with
+ * GRPC_STATUS_RESOURCE_EXHAUSTED.
+ * @param name Name for debugging (may be NULL)
+ * @return New quota with no limit, or NULL on error
+ */
+grpc_resource_quota *grpc_resource_quota_create(const char *name);
+
+/**
+ * @brief Take a reference to a quota
+ * @param quota The quota
+ */
+void grpc_resource_quota_ref(grpc_resource_quota *quota);
+
+/**
+ * @brief Drop a reference; the quota is freed with the last one
+ * @param quota The quota
+ */
+void grpc_resource_quota_unref(grpc_resource_quota *quota);
+
+/**
+ * @brief Set the quota's limit
+ * @param quota The quota
+ * @param new_size Limit in bytes (0 removes the limit)
+ */
+void grpc_resource_quota_resize(grpc_resource_quota *quota, size_t new_size);
+
+/**
+ * @brief Bytes currently charged to a quota
+ * @param quota The quota
+ * @return Usage in bytes
+ */
+size_t grpc_resource_quota_get_usage(grpc_resource_quota *quota);
+
+/**
+ * @brief Charge a server's connections and calls to a quota
+ *
+ * Must be called before grpc_server_start. The server holds a reference.
+ * @param server The server
+ * @param quota The quota (NULL uses the global quota)
+ */
+void grpc_server_set_resource_quota(grpc_server *server, grpc_resource_quota *quota);
+
+/* ========================================================================
+ * Executor API
+ * ======================================================================== */
+
+/**
+ * @brief Create a work-stealing thread pool
+ *
+ * Each thread keeps its own deque of tasks and idle threads steal from the
+ * others, so submitting and running tasks takes no lock shared by the pool.
+ * @param num_threads Number of threads (0 uses one per online CPU)
+ * @return New executor, or NULL on error
+ */
+grpc_executor *grpc_executor_create(size_t num_threads);
+
+/**
+ * @brief Run fn(arg) on one of the executor's threads
+ *
+ * Safe from any thread. Tasks submitted from a task of the same executor
+ * stay on that thread's deque unless another thread steals them.
+ * @param executor The executor
+ * @param fn Task
+ * @param arg Argument for fn
+ * @return 0 on success, -1 on error or once the executor is being destroyed
+ */
+int grpc_executor_run(grpc_executor *executor, grpc_executor_fn fn, void *arg);
+
+/**
+ * @brief Create a work-stealing thread pool pinned to CPUs
+ *
+ * Thread i runs only on cpus[i % cpu_count]. Every thread allocates its own
+ * deque after it is pinned, so with the kernel's first-touch policy the
+ * memory it works on sits on its NUMA node (see grpc_numa_node_cpus()).
+ * @param num_threads Number of threads (0 uses one per listed CPU)
+ * @param cpus CPUs to pin the threads to
+ * @param cpu_count Number of CPUs in cpus (at least 1)
+ * @return New executor, or NULL on error (including an invalid CPU)
+ */
+grpc_executor *grpc_executor_create_pinned(size_t num_threads, const int *cpus, size_t cpu_count);
+
+/**
+ * @brief Number of threads in the executor
+ * @param executor The executor
+ * @return Thread count
+ */
+size_t grpc_executor_thread_count(grpc_executor *executor);
+
+/**
+ * @brief Run every submitted task, then stop the threads and free the executor
+ *
+ * Must not be called from one of the executor's own threads.
+ * @param executor The executor
+ */
+void grpc_executor_destroy(grpc_executor *executor);
+
+/**
+ * @brief Number of NUMA nodes
+ * @return Node count (1 on machines without NUMA information)
+ */
+int grpc_numa_node_count(void);
+
+/**
+ * @brief CPUs of a NUMA node
+ * @param node Node number, from 0 to grpc_numa_node_count() - 1
+ * @param cpus Filled with up to max_cpus CPU numbers
+ * @param max_cpus Capacity of cpus
+ * @return Number of CPUs on the node (may exceed max_cpus), or -1 if the
+ *         node does not exist
+ */
+int grpc_numa_node_cpus(int node, int *cpus, size_t max_cpus);
+
 /* ========================================================================
  * Credentials API
  * ======================================================================== */
@@ -396,7 +996,17 @@ grpc_timespec grpc_timeout_milliseconds_to_deadline(int64_t timeout_ms);
 grpc_byte_buffer *grpc_byte_buffer_create(const uint8_t *data, size_t length);
 
 /**
- * @brief Destroy a byte buffer and free resources
+ * @brief Take an additional reference on a byte buffer
+ * The transport uses this to keep a buffer alive while the kernel still
+ * reads from it (e.g. MSG_ZEROCOPY sends).
+ * @param buffer The buffer to reference
+ * @return The same buffer
+ */
+grpc_byte_buffer *grpc_byte_buffer_ref(grpc_byte_buffer *buffer);
+
+/**
+ * @brief Release a reference to a byte buffer
+ * The data is freed when the last reference is dropped.
  * @param buffer The buffer to destroy
  */
 void grpc_byte_buffer_destroy(grpc_byte_buffer *buffer);
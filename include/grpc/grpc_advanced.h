@@ -22,7 +22,8 @@ extern "C" {
 typedef enum {
     GRPC_LB_POLICY_ROUND_ROBIN = 0,
     GRPC_LB_POLICY_PICK_FIRST = 1,
-    GRPC_LB_POLICY_WEIGHTED = 2
+    GRPC_LB_POLICY_WEIGHTED = 2,
+    GRPC_LB_POLICY_LOWEST_RTT = 3  /* Smallest RTT from grpc_lb_policy_report_rtt() */
 } grpc_lb_policy_type;
 
 typedef struct grpc_lb_policy grpc_lb_policy;
@@ -32,6 +33,7 @@ int grpc_lb_policy_add_address(grpc_lb_policy *policy, const char *address, int
 const char *grpc_lb_policy_pick(grpc_lb_policy *policy);
 int grpc_lb_policy_mark_unavailable(grpc_lb_policy *policy, const char *address);
 int grpc_lb_policy_mark_available(grpc_lb_policy *policy, const char *address);
+int grpc_lb_policy_report_rtt(grpc_lb_policy *policy, const char *address, int64_t smoothed_rtt_us);
 void grpc_lb_policy_destroy(grpc_lb_policy *policy);
 
 /* ========================================================================
@@ -51,6 +53,8 @@ grpc_name_resolver *grpc_name_resolver_create(grpc_resolver_type type, const cha
 int grpc_name_resolver_resolve(grpc_name_resolver *resolver);
 grpc_resolved_address *grpc_name_resolver_get_addresses(grpc_name_resolver *resolver);
 size_t grpc_name_resolver_get_address_count(grpc_name_resolver *resolver);
+grpc_resolved_address *grpc_resolved_address_next(const grpc_resolved_address *address);
+int grpc_resolved_address_to_target(const grpc_resolved_address *address, char *target, size_t size);
 int grpc_name_resolver_set_custom_resolver(grpc_name_resolver *resolver,
                                            grpc_resolved_address *(*custom_resolve)(const char *, void *),
                                            void *user_data);
@@ -71,6 +75,11 @@ int grpc_connection_pool_set_keepalive(grpc_connection_pool *pool,
 http2_connection *grpc_connection_pool_get(grpc_connection_pool *pool, const char *target);
 int grpc_connection_pool_return(grpc_connection_pool *pool, const char *target, http2_connection *connection);
 void grpc_connection_pool_cleanup_idle(grpc_connection_pool *pool);
+/* Round-trip time from keepalive PINGs; -1 until the first ACK arrives */
+int grpc_connection_pool_get_rtt(grpc_connection_pool *pool, http2_connection *connection,
+                                 int64_t *smoothed_rtt_us, int64_t *min_rtt_us);
+/* Reports RTTs and keepalive failures to a load balancer */
+int grpc_connection_pool_set_lb_policy(grpc_connection_pool *pool, grpc_lb_policy *policy);
 void grpc_connection_pool_destroy(grpc_connection_pool *pool);
 
 /* ========================================================================
@@ -144,6 +153,13 @@ void grpc_reflection_registry_destroy(grpc_reflection_registry *registry);
 char *grpc_reflection_get_full_service_name(grpc_service_descriptor *service);
 char *grpc_reflection_get_full_method_name(grpc_service_descriptor *service,
                                           grpc_method_descriptor *method);
+const char *grpc_method_descriptor_get_path(const grpc_method_descriptor *method);
+
+/* Serve every method in the registry; the server compiles them into its
+ * :path router at start. The registry must outlive the server, and methods
+ * added after start are not routed. */
+int grpc_server_set_reflection_registry(grpc_server *server, grpc_reflection_registry *registry);
+grpc_method_descriptor *grpc_call_get_method_descriptor(grpc_call *call);
 
 /* ========================================================================
  * Observability - Tracing
@@ -198,6 +214,16 @@ int grpc_metrics_set(grpc_metrics_registry *registry, const char *name, double v
 grpc_metric *grpc_metrics_get(grpc_metrics_registry *registry, const char *name);
 void grpc_metrics_registry_destroy(grpc_metrics_registry *registry);
 
+/* Export server metrics; call before grpc_server_start. With admission
+ * control on, the server registers the gauges
+ * "grpc.server.concurrency_limit" (calls to unregistered methods) and
+ * "grpc.server.concurrency_limit:<path>[@<host>]" per method, and the counter
+ * "grpc.server.calls_shed". With a method cache set, it counts lookups in
+ * "grpc.server.cache_hits" and "grpc.server.cache_misses", and with
+ * coalescing, calls that shared another's reply in
+ * "grpc.server.calls_coalesced". The registry must outlive the server. */
+int grpc_server_set_metrics_registry(grpc_server *server, grpc_metrics_registry *registry);
+
 /* ========================================================================
  * Observability - Logging
  * ======================================================================== */
@@ -0,0 +1,657 @@
+/**
+ * @file call_attempts.c
+ * @brief Hedged and retried calls: several attempts behind one application call
+ *
+ * The application's call gets this file's transport. Its send operations
+ * are buffered and replayed on each attempt, an internal client call with
+ * a transport of its own. Deliveries from the attempts land here instead
+ * of in the attempt calls: the first attempt to answer is committed, its
+ * deliveries are passed on to the application's call and the others are
+ * cancelled. Once an attempt is committed no other can start, so each
+ * buffered operation is dropped as soon as that attempt has sent it.
+ *
+ * A hedged call starts the next attempt when the hedging delay passes
+ * without an answer; a retried call starts it after a failure, once a
+ * random backoff has passed. An attempt the server refused before
+ * processing it is retried without counting against the policy or the
+ * channel's budget.
+ *
+ * Deliveries arrive with the attempt's transport locked, so anything they
+ * trigger on other attempts (cancelling, starting the next one) runs on
+ * the channel's timer thread instead. Lock order: attempts->mutex, then
+ * channel->mutex.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Refused attempts retried per call on top of the policy's attempts */
+#define ATTEMPTS_MAX_TRANSPARENT 2
+
+typedef enum {
+    ATTEMPT_OP_INITIAL_METADATA,
+    ATTEMPT_OP_MESSAGE,
+    ATTEMPT_OP_CLOSE
+} attempt_op_type;
+
+/* Send operation of the application's call, replayed on every attempt */
+typedef struct {
+    attempt_op_type type;
+    grpc_metadata_array metadata;   /* ATTEMPT_OP_INITIAL_METADATA */
+    grpc_byte_buffer *message;      /* ATTEMPT_OP_MESSAGE, one reference */
+    int users;                      /* Attempts sending it right now */
+} attempt_op;
+
+typedef struct {
+    grpc_call *call;
+    size_t sent;            /* Buffered operations handed to the call's transport */
+    bool busy;              /* A thread is sending on or cancelling the call */
+    bool cancelled;
+    bool failed;            /* Ended with a status that lets another attempt start */
+} call_attempt;
+
+typedef struct call_attempts {
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;            /* Signalled when an attempt stops being busy */
+    grpc_call *parent;
+    channel_method_policy *policy;  /* Receives the call's latency */
+    bool hedged;                    /* Hedging policy, else retry policy */
+    int max_attempts;
+    uint32_t retryable_codes;       /* Statuses that start the next attempt instead of ending the call */
+    int64_t delay_ms;               /* Hedging delay */
+    int64_t backoff_ms;             /* Bound of the next retry's random delay */
+    int64_t max_backoff_ms;
+    double backoff_multiplier;
+    int64_t start_ms;
+    attempt_op **ops;               /* Entries below released are freed */
+    size_t op_count;
+    size_t op_capacity;
+    size_t released;
+    call_attempt *attempts;         /* max_attempts + ATTEMPTS_MAX_TRANSPARENT entries */
+    size_t started;
+    size_t counted;                 /* Started attempts that count against max_attempts */
+    int committed;                  /* Attempt the parent hears from, -1 before the first answer */
+    int64_t next_attempt_ms;        /* When the next attempt is due */
+    bool transparent_due;           /* The next attempt replaces a refused one */
+    bool stopped;                   /* The budget refused an attempt */
+    grpc_status_code last_status;   /* Of the last attempt that failed */
+    char *last_details;
+    int last_failed;
+    bool abandoned;                 /* The parent was cancelled */
+    bool closing;                   /* The parent is being destroyed */
+    uint64_t *timers;               /* Scheduled timers, each holding a reference */
+    size_t timer_count;
+    size_t timer_capacity;
+    int refs;
+} call_attempts;
+
+static const grpc_call_transport call_attempts_transport;
+
+/* ========================================================================
+ * Helpers
+ * ======================================================================== */
+
+static void attempt_op_destroy(attempt_op *op) {
+    grpc_metadata_array_destroy(&op->metadata);
+    if (op->message) {
+        grpc_byte_buffer_destroy(op->message);
+    }
+    free(op);
+}
+
+static void attempts_unref(call_attempts *attempts) {
+    pthread_mutex_lock(&attempts->mutex);
+    int refs = --attempts->refs;
+    pthread_mutex_unlock(&attempts->mutex);
+    if (refs > 0) {
+        return;
+    }
+    
+    for (size_t i = attempts->released; i < attempts->op_count; i++) {
+        attempt_op_destroy(attempts->ops[i]);
+    }
+    free(attempts->ops);
+    free(attempts->attempts);
+    free(attempts->timers);
+    free(attempts->last_details);
+    pthread_cond_destroy(&attempts->idle);
+    pthread_mutex_destroy(&attempts->mutex);
+    free(attempts);
+}
+
+/* Drop the operations the committed attempt has sent; no other attempt
+ * will need them. Caller holds attempts->mutex. */
+static void attempts_release_sent(call_attempts *attempts) {
+    if (attempts->committed < 0) {
+        return;
+    }
+    size_t sent = attempts->attempts[attempts->committed].sent;
+    while (attempts->released < sent && attempts->ops[attempts->released]->users == 0) {
+        attempt_op_destroy(attempts->ops[attempts->released]);
+        attempts->ops[attempts->released++] = NULL;
+    }
+}
+
+static void attempts_on_timer(void *arg);
+
+/* Run attempts_on_timer after delay_ms; caller holds attempts->mutex */
+static void attempts_schedule(call_attempts *attempts, int64_t delay_ms) {
+    if (attempts->closing) {
+        return;
+    }
+    if (attempts->timer_count == attempts->timer_capacity) {
+        size_t capacity = attempts->timer_capacity ? attempts->timer_capacity * 2 : 4;
+        uint64_t *timers = (uint64_t *)realloc(attempts->timers, capacity * sizeof(uint64_t));
+        if (!timers) {
+            return;
+        }
+        attempts->timers = timers;
+        attempts->timer_capacity = capacity;
+    }
+    
+    grpc_channel *channel = attempts->parent->channel;
+    uint64_t id;
+    if (grpc_timer_queue_schedule(channel->timers, delay_ms, attempts_on_timer, attempts, &id) == 0) {
+        attempts->timers[attempts->timer_count++] = id;
+        attempts->refs++;
+    }
+}
+
+/* Start the next attempt once delay_ms have passed; caller holds attempts->mutex */
+static void attempts_start_after(call_attempts *attempts, int64_t delay_ms) {
+    attempts->next_attempt_ms = grpc_monotonic_ms() + delay_ms;
+    attempts_schedule(attempts, delay_ms);
+}
+
+/* Random delay before a retry, up to the current backoff, which then grows */
+static int64_t attempts_next_backoff(call_attempts *attempts) {
+    int64_t delay_ms = attempts->backoff_ms > 0 ? rand() % attempts->backoff_ms : 0;
+    double next = (double)attempts->backoff_ms * attempts->backoff_multiplier;
+    attempts->backoff_ms = next < (double)attempts->max_backoff_ms ? (int64_t)next : attempts->max_backoff_ms;
+    return delay_ms;
+}
+
+/* Whether another counted attempt may start; caller holds attempts->mutex */
+static bool attempts_may_retry(call_attempts *attempts) {
+    return !attempts->stopped && attempts->counted < (size_t)attempts->max_attempts;
+}
+
+/* Start the next attempt; caller holds attempts->mutex
+ * @return Index of the attempt, -1 if none was started */
+static int attempts_start(call_attempts *attempts) {
+    bool transparent = attempts->transparent_due;
+    if (attempts->closing || attempts->abandoned || attempts->committed >= 0 ||
+        (!transparent && !attempts_may_retry(attempts))) {
+        return -1;
+    }
+    
+    grpc_call *parent = attempts->parent;
+    grpc_channel *channel = parent->channel;
+    if (!transparent && attempts->counted > 0 && !channel_take_retry_token(channel)) {
+        attempts->stopped = true;
+        return -1;
+    }
+    
+    grpc_call *call = call_create(channel, NULL, NULL, parent->method, parent->host, parent->deadline);
+    if (!call) {
+        return -1;
+    }
+    if (inproc_client_call_init(call, channel->inproc_server) != 0) {
+        grpc_call_destroy(call);
+        return -1;
+    }
+    call->attempt_of = attempts;
+    
+    int index = (int)attempts->started++;
+    call_attempt *attempt = &attempts->attempts[index];
+    memset(attempt, 0, sizeof(*attempt));
+    attempt->call = call;
+    attempts->transparent_due = false;
+    if (!transparent) {
+        attempts->counted++;
+    }
+    
+    if (attempts->hedged && attempts_may_retry(attempts)) {
+        attempts_start_after(attempts, attempts->delay_ms);
+    }
+    return index;
+}
+
+/* Bring an attempt up to date: replay buffered operations, or cancel it
+ * once another attempt was committed. Only one thread drives an attempt
+ * at a time; others leave the new work to it. */
+static void attempts_drive(call_attempts *attempts, size_t index) {
+    pthread_mutex_lock(&attempts->mutex);
+    call_attempt *attempt = &attempts->attempts[index];
+    if (attempt->busy || attempts->closing) {
+        pthread_mutex_unlock(&attempts->mutex);
+        return;
+    }
+    attempt->busy = true;
+    
+    while (!attempts->closing && !attempt->cancelled) {
+        grpc_call *call = attempt->call;
+        if (attempts->abandoned || (attempts->committed >= 0 && attempts->committed != (int)index)) {
+            attempt->cancelled = true;
+            pthread_mutex_unlock(&attempts->mutex);
+            call_cancel_local(call);
+            pthread_mutex_lock(&attempts->mutex);
+            continue;
+        }
+        if (attempt->sent == attempts->op_count) {
+            break;
+        }
+        
+        /* Sent without the lock: the transport may deliver back into this file */
+        attempt_op *op = attempts->ops[attempt->sent];
+        op->users++;
+        pthread_mutex_unlock(&attempts->mutex);
+        switch (op->type) {
+            case ATTEMPT_OP_INITIAL_METADATA:
+                if (call->transport->send_initial_metadata(call, op->metadata.metadata, op->metadata.count) != 0) {
+                    call_deliver_refused(call, GRPC_STATUS_UNAVAILABLE, "Call could not be sent");
+                }
+                break;
+            case ATTEMPT_OP_MESSAGE:
+                call->transport->send_message(call, op->message);
+                break;
+            case ATTEMPT_OP_CLOSE:
+                call->transport->send_close(call);
+                break;
+        }
+        pthread_mutex_lock(&attempts->mutex);
+        op->users--;
+        attempt->sent++;
+        attempts_release_sent(attempts);
+    }
+    
+    attempt->busy = false;
+    pthread_cond_broadcast(&attempts->idle);
+    pthread_mutex_unlock(&attempts->mutex);
+}
+
+/* Whether an attempt may still answer; caller holds attempts->mutex */
+static bool attempts_running(call_attempts *attempts) {
+    for (size_t i = 0; i < attempts->started; i++) {
+        call_attempt *attempt = &attempts->attempts[i];
+        if (!attempt->failed && !attempt->cancelled) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool attempts_commit(call_attempts *attempts, int index, int64_t *latency_ms);
+static void attempts_unlock(call_attempts *attempts, int64_t latency_ms);
+
+static void attempts_drive_all(call_attempts *attempts) {
+    pthread_mutex_lock(&attempts->mutex);
+    size_t started = attempts->started;
+    pthread_mutex_unlock(&attempts->mutex);
+    
+    for (size_t i = 0; i < started; i++) {
+        attempts_drive(attempts, i);
+    }
+}
+
+/* Starts a due attempt and cancels attempts that lost */
+static void attempts_on_timer(void *arg) {
+    call_attempts *attempts = (call_attempts *)arg;
+    int64_t latency_ms = -1;
+    bool give_up = false;
+    
+    pthread_mutex_lock(&attempts->mutex);
+    if (grpc_monotonic_ms() >= attempts->next_attempt_ms && attempts_start(attempts) < 0 &&
+        attempts->committed < 0 && attempts->started > 0 && !attempts_running(attempts)) {
+        /* Every attempt failed and no more may start: the last failure is the answer */
+        give_up = attempts_commit(attempts, attempts->last_failed, &latency_ms);
+    }
+    attempts_unlock(attempts, latency_ms);
+    
+    if (give_up) {
+        call_deliver_status(attempts->parent, attempts->last_status, attempts->last_details, NULL, 0);
+    }
+    attempts_drive_all(attempts);
+    attempts_unref(attempts);
+}
+
+/* Buffer a send operation of the parent and replay it on every attempt */
+static int attempts_send(grpc_call *parent, attempt_op *op) {
+    call_attempts *attempts = (call_attempts *)parent->transport_data;
+    
+    pthread_mutex_lock(&attempts->mutex);
+    if (attempts->op_count == attempts->op_capacity) {
+        size_t capacity = attempts->op_capacity ? attempts->op_capacity * 2 : 4;
+        attempt_op **ops = (attempt_op **)realloc(attempts->ops, capacity * sizeof(attempt_op *));
+        if (!ops) {
+            pthread_mutex_unlock(&attempts->mutex);
+            attempt_op_destroy(op);
+            return -1;
+        }
+        attempts->ops = ops;
+        attempts->op_capacity = capacity;
+    }
+    attempts->ops[attempts->op_count++] = op;
+    
+    int rc = 0;
+    if (op->type == ATTEMPT_OP_INITIAL_METADATA) {
+        attempts->start_ms = grpc_monotonic_ms();
+        rc = attempts_start(attempts) == 0 ? 0 : -1;
+    }
+    pthread_mutex_unlock(&attempts->mutex);
+    
+    attempts_drive_all(attempts);
+    return rc;
+}
+
+/* ========================================================================
+ * Transport Operations (on the parent call)
+ * ======================================================================== */
+
+static int attempts_send_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count) {
+    attempt_op *op = (attempt_op *)calloc(1, sizeof(attempt_op));
+    if (!op) {
+        return -1;
+    }
+    op->type = ATTEMPT_OP_INITIAL_METADATA;
+    if (grpc_metadata_array_init(&op->metadata, count) != 0) {
+        attempt_op_destroy(op);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char *value = metadata[i].value ? metadata[i].value : "";
+        if (grpc_metadata_array_add(&op->metadata, metadata[i].key, value, metadata[i].value_length) != 0) {
+            attempt_op_destroy(op);
+            return -1;
+        }
+    }
+    return attempts_send(call, op);
+}
+
+static int attempts_send_message(grpc_call *call, grpc_byte_buffer *message) {
+    attempt_op *op = (attempt_op *)calloc(1, sizeof(attempt_op));
+    if (!op) {
+        return -1;
+    }
+    op->type = ATTEMPT_OP_MESSAGE;
+    op->message = grpc_byte_buffer_ref(message);
+    return attempts_send(call, op);
+}
+
+static int attempts_send_close(grpc_call *call) {
+    attempt_op *op = (attempt_op *)calloc(1, sizeof(attempt_op));
+    if (!op) {
+        return -1;
+    }
+    op->type = ATTEMPT_OP_CLOSE;
+    return attempts_send(call, op);
+}
+
+static int attempts_send_status(grpc_call *call, grpc_status_code status, const char *details,
+                                const grpc_metadata *trailing_metadata, size_t trailing_count) {
+    (void)call;
+    (void)status;
+    (void)details;
+    (void)trailing_metadata;
+    (void)trailing_count;
+    return -1;
+}
+
+static void attempts_cancel(grpc_call *call) {
+    call_attempts *attempts = (call_attempts *)call->transport_data;
+    
+    pthread_mutex_lock(&attempts->mutex);
+    attempts->abandoned = true;
+    pthread_mutex_unlock(&attempts->mutex);
+    
+    attempts_drive_all(attempts);
+}
+
+static void attempts_destroy(grpc_call *call) {
+    call_attempts *attempts = (call_attempts *)call->transport_data;
+    grpc_timer_queue *timers = call->channel->timers;
+    
+    /* Timer callbacks and drivers see closing and leave the attempts alone */
+    pthread_mutex_lock(&attempts->mutex);
+    attempts->closing = true;
+    for (size_t i = 0; i < attempts->started; i++) {
+        while (attempts->attempts[i].busy) {
+            pthread_cond_wait(&attempts->idle, &attempts->mutex);
+        }
+    }
+    size_t timer_count = attempts->timer_count;
+    attempts->timer_count = 0;
+    pthread_mutex_unlock(&attempts->mutex);
+    
+    for (size_t i = 0; i < timer_count; i++) {
+        if (grpc_timer_queue_cancel(timers, attempts->timers[i])) {
+            attempts_unref(attempts);
+        }
+    }
+    for (size_t i = 0; i < attempts->started; i++) {
+        grpc_call_destroy(attempts->attempts[i].call);
+    }
+    
+    call->transport_data = NULL;
+    attempts_unref(attempts);
+}
+
+static const grpc_call_transport call_attempts_transport = {
+    attempts_send_initial_metadata,
+    attempts_send_message,
+    attempts_send_close,
+    attempts_send_status,
+    attempts_cancel,
+    attempts_destroy
+};
+
+/* ========================================================================
+ * Delivery From the Attempts
+ * ======================================================================== */
+
+static int attempts_index(call_attempts *attempts, grpc_call *call) {
+    for (size_t i = 0; i < attempts->started; i++) {
+        if (attempts->attempts[i].call == call) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* Whether a delivery from attempt index goes on to the parent; the first
+ * answer commits its attempt. Caller holds attempts->mutex.
+ * @param latency_ms Set to the call's latency when this commits, else -1 */
+static bool attempts_commit(call_attempts *attempts, int index, int64_t *latency_ms) {
+    *latency_ms = -1;
+    if (index < 0 || attempts->closing || attempts->abandoned) {
+        return false;
+    }
+    if (attempts->committed < 0) {
+        attempts->committed = index;
+        *latency_ms = grpc_monotonic_ms() - attempts->start_ms;
+        attempts_release_sent(attempts);
+        if (attempts->started > 1) {
+            attempts_schedule(attempts, 0);
+        }
+    }
+    return attempts->committed == index;
+}
+
+/* Unlock and record the latency of a committing delivery */
+static void attempts_unlock(call_attempts *attempts, int64_t latency_ms) {
+    grpc_call *parent = attempts->parent;
+    channel_method_policy *policy = attempts->policy;
+    pthread_mutex_unlock(&attempts->mutex);
+    if (latency_ms >= 0) {
+        channel_record_latency(parent->channel, policy, latency_ms);
+    }
+}
+
+/* Note a failed attempt that lets another one start; caller holds attempts->mutex
+ * @return true if the parent should not hear of the failure */
+static bool attempts_fail(call_attempts *attempts, int index, grpc_status_code status, const char *details,
+                          bool refused) {
+    if (index < 0 || attempts->committed >= 0 || attempts->closing || attempts->abandoned) {
+        return false;
+    }
+    
+    bool retryable = status != GRPC_STATUS_OK && (int)status < 32 &&
+                     (attempts->retryable_codes & (1u << status)) != 0;
+    bool transparent = refused && attempts->started - attempts->counted < ATTEMPTS_MAX_TRANSPARENT;
+    if (!retryable && !transparent) {
+        return false;
+    }
+    
+    attempts->attempts[index].failed = true;
+    attempts->last_failed = index;
+    attempts->last_status = status;
+    free(attempts->last_details);
+    attempts->last_details = details ? strdup(details) : NULL;
+    
+    if (transparent) {
+        /* Paced like a first retry so a refusing server is not spun on */
+        attempts->transparent_due = true;
+        attempts_start_after(attempts, attempts->hedged ? 0 : attempts->backoff_ms);
+        return true;
+    }
+    
+    /* Hedges start at once; otherwise wait for the attempts still running */
+    bool more = attempts_may_retry(attempts);
+    if (more) {
+        attempts_start_after(attempts, attempts->hedged ? 0 : attempts_next_backoff(attempts));
+    }
+    return more || attempts_running(attempts);
+}
+
+void call_attempts_deliver_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count) {
+    call_attempts *attempts = call->attempt_of;
+    int64_t latency_ms;
+    
+    pthread_mutex_lock(&attempts->mutex);
+    bool forward = attempts_commit(attempts, attempts_index(attempts, call), &latency_ms);
+    attempts_unlock(attempts, latency_ms);
+    
+    if (forward) {
+        call_deliver_initial_metadata(attempts->parent, metadata, count);
+    }
+}
+
+void call_attempts_deliver_message(grpc_call *call, grpc_byte_buffer *message) {
+    call_attempts *attempts = call->attempt_of;
+    int64_t latency_ms;
+    
+    pthread_mutex_lock(&attempts->mutex);
+    bool forward = attempts_commit(attempts, attempts_index(attempts, call), &latency_ms);
+    attempts_unlock(attempts, latency_ms);
+    
+    if (forward) {
+        call_deliver_message(attempts->parent, message);
+    } else {
+        grpc_byte_buffer_destroy(message);
+    }
+}
+
+void call_attempts_deliver_half_close(grpc_call *call) {
+    call_attempts *attempts = call->attempt_of;
+    
+    pthread_mutex_lock(&attempts->mutex);
+    int index = attempts_index(attempts, call);
+    bool forward = index >= 0 && attempts->committed == index && !attempts->closing;
+    pthread_mutex_unlock(&attempts->mutex);
+    
+    if (forward) {
+        call_deliver_half_close(attempts->parent);
+    }
+}
+
+void call_attempts_deliver_status(grpc_call *call, grpc_status_code status, const char *details,
+                                  const grpc_metadata *trailing_metadata, size_t trailing_count, bool refused) {
+    call_attempts *attempts = call->attempt_of;
+    int64_t latency_ms;
+    
+    pthread_mutex_lock(&attempts->mutex);
+    int index = attempts_index(attempts, call);
+    if (attempts_fail(attempts, index, status, details, refused)) {
+        pthread_mutex_unlock(&attempts->mutex);
+        return;
+    }
+    bool forward = attempts_commit(attempts, index, &latency_ms);
+    attempts_unlock(attempts, latency_ms);
+    
+    if (forward) {
+        call_deliver_status(attempts->parent, status, details, trailing_metadata, trailing_count);
+    }
+}
+
+void call_attempts_deliver_cancel(grpc_call *call) {
+    call_attempts *attempts = call->attempt_of;
+    int64_t latency_ms;
+    
+    pthread_mutex_lock(&attempts->mutex);
+    bool forward = attempts_commit(attempts, attempts_index(attempts, call), &latency_ms);
+    attempts_unlock(attempts, latency_ms);
+    
+    if (forward) {
+        call_deliver_cancel(attempts->parent);
+    }
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+/**
+ * Attach a new client call to the attempt transport
+ * @param call The client call, on a channel with timers and a call transport
+ * @param policy Method policy that receives the call's latency
+ * @param hedging Hedging settings, copied (NULL for a retried call)
+ * @param retry Retry settings, copied (used when hedging is NULL)
+ * @param delay_ms Delay before each hedge
+ * @return 0 on success, -1 on error
+ */
+int call_attempts_init(grpc_call *call, channel_method_policy *policy, const grpc_hedging_policy *hedging,
+                       const grpc_retry_policy *retry, int64_t delay_ms) {
+    if (!call || !call->channel || !call->channel->timers || (!hedging && !retry)) {
+        return -1;
+    }
+    int max_attempts = hedging ? hedging->max_attempts : retry->max_attempts;
+    if (max_attempts < 1) {
+        return -1;
+    }
+    
+    call_attempts *attempts = (call_attempts *)calloc(1, sizeof(call_attempts));
+    if (!attempts) {
+        return -1;
+    }
+    attempts->attempts = (call_attempt *)calloc((size_t)max_attempts + ATTEMPTS_MAX_TRANSPARENT,
+                                                sizeof(call_attempt));
+    if (!attempts->attempts) {
+        free(attempts);
+        return -1;
+    }
+    
+    pthread_mutex_init(&attempts->mutex, NULL);
+    pthread_cond_init(&attempts->idle, NULL);
+    attempts->parent = call;
+    attempts->policy = policy;
+    attempts->hedged = hedging != NULL;
+    attempts->max_attempts = max_attempts;
+    if (hedging) {
+        attempts->retryable_codes = hedging->non_fatal_status_codes;
+        attempts->delay_ms = delay_ms;
+    } else {
+        attempts->retryable_codes = retry->retryable_status_codes;
+        attempts->backoff_ms = retry->initial_backoff_ms;
+        attempts->max_backoff_ms = retry->max_backoff_ms;
+        attempts->backoff_multiplier = retry->backoff_multiplier;
+    }
+    attempts->committed = -1;
+    attempts->refs = 1;
+    
+    call->transport = &call_attempts_transport;
+    call->transport_data = attempts;
+    return 0;
+}
@@ -0,0 +1,544 @@
+/**
+ * @file call_batch.c
+ * @brief Batch operation engine for calls with a call transport
+ *
+ * Send operations are handed to the call's transport; receive operations
+ * wait in the call until the transport delivers the matching data from
+ * the peer. A batch's tag is posted once all of its operations finished.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================================
+ * Helpers (all expect call->mutex held)
+ * ======================================================================== */
+
+static int call_copy_metadata(grpc_metadata_array *dst, const grpc_metadata *metadata, size_t count) {
+    if (dst->capacity == 0 && grpc_metadata_array_init(dst, count) != 0) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        const char *value = metadata[i].value ? metadata[i].value : "";
+        if (grpc_metadata_array_add(dst, metadata[i].key, value, metadata[i].value_length) != 0) {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+static void call_batch_op_done(call_batch *batch, bool success) {
+    if (!success) {
+        batch->success = false;
+    }
+    
+    if (--batch->pending == 0) {
+        grpc_event event;
+        event.type = 1; /* GRPC_OP_COMPLETE */
+        event.success = batch->success;
+        event.tag = batch->tag;
+        completion_queue_push_event(batch->cq, event);
+        free(batch);
+    }
+}
+
+/* The response can no longer be cached */
+static void call_cache_drop(grpc_call *call) {
+    if (call->cache_request) {
+        grpc_byte_buffer_destroy(call->cache_request);
+        call->cache_request = NULL;
+    }
+}
+
+/* Keep a sent message for the cache and waiting calls; only a
+ * single-message reply can be replayed */
+static void call_keep_reply(grpc_call *call, grpc_byte_buffer *message) {
+    if (!call->cache_request && !call->coalesced) {
+        return;
+    }
+    if (!call->reply && !call->reply_repeated) {
+        call->reply = grpc_byte_buffer_ref(message);
+        return;
+    }
+    if (call->reply) {
+        grpc_byte_buffer_destroy(call->reply);
+        call->reply = NULL;
+    }
+    call->reply_repeated = true;
+    call_cache_drop(call);
+}
+
+static bool call_is_finished(grpc_call *call) {
+    return call->cancelled || (call->server ? call->status_sent : call->status_received);
+}
+
+/* Complete every pending receive whose data is now available */
+static void call_complete_pending(grpc_call *call) {
+    if (call->recv_initial_metadata_batch &&
+        (call->initial_metadata_received || call->status_received || call->cancelled)) {
+        call_batch *batch = call->recv_initial_metadata_batch;
+        call->recv_initial_metadata_batch = NULL;
+        int rc = call_copy_metadata(call->recv_initial_metadata_dest, call->initial_metadata.metadata,
+                                    call->initial_metadata.count);
+        call_batch_op_done(batch, rc == 0);
+    }
+    
+    if (call->recv_message_batch) {
+        call_batch *batch = call->recv_message_batch;
+        if (call->recv_head) {
+            call_message *msg = call->recv_head;
+            call->recv_head = msg->next;
+            if (!call->recv_head) {
+                call->recv_tail = NULL;
+            }
+            *call->recv_message_dest = msg->buffer;
+            grpc_resource_quota_release(call->quota, msg->charged);
+            free(msg);
+            call->recv_message_batch = NULL;
+            call_batch_op_done(batch, true);
+        } else if (call->half_close_received || call->status_received || call->cancelled) {
+            /* End of stream is reported as a NULL message */
+            *call->recv_message_dest = NULL;
+            call->recv_message_batch = NULL;
+            call_batch_op_done(batch, true);
+        }
+    }
+    
+    if (call->recv_status_batch && call_is_finished(call)) {
+        call_batch *batch = call->recv_status_batch;
+        call->recv_status_batch = NULL;
+        int rc = 0;
+        if (call->server) {
+            *call->recv_cancelled_dest = call->cancelled ? 1 : 0;
+        } else {
+            *call->recv_status_dest = call->status;
+            if (call->recv_status_details_dest) {
+                *call->recv_status_details_dest = strdup(call->status_details ? call->status_details : "");
+            }
+            if (call->recv_trailing_metadata_dest) {
+                rc = call_copy_metadata(call->recv_trailing_metadata_dest, call->trailing_metadata.metadata,
+                                        call->trailing_metadata.count);
+            }
+        }
+        call_batch_op_done(batch, rc == 0);
+    }
+}
+
+/* ========================================================================
+ * Batch Execution
+ * ======================================================================== */
+
+/* Reject ops used on the wrong side or invoked twice; caller holds call->mutex */
+static grpc_call_error call_validate_batch(grpc_call *call, const grpc_op *ops, size_t nops) {
+    bool seen[GRPC_OP_RECV_CLOSE_ON_SERVER + 1] = {false};
+    bool is_server = call->server != NULL;
+    
+    for (size_t i = 0; i < nops; i++) {
+        grpc_op_type type = ops[i].op;
+        if ((int)type < 0 || type > GRPC_OP_RECV_CLOSE_ON_SERVER) {
+            return GRPC_CALL_ERROR;
+        }
+        if (seen[type]) {
+            return GRPC_CALL_ERROR_TOO_MANY_OPERATIONS;
+        }
+        seen[type] = true;
+        
+        switch (type) {
+            case GRPC_OP_SEND_INITIAL_METADATA:
+                if (call->initial_metadata_sent) return GRPC_CALL_ERROR_TOO_MANY_OPERATIONS;
+                break;
+            case GRPC_OP_SEND_MESSAGE:
+                if (!ops[i].data.send_message.send_message) return GRPC_CALL_ERROR;
+                if (call->close_sent || call->status_sent) return GRPC_CALL_ERROR_ALREADY_FINISHED;
+                break;
+            case GRPC_OP_SEND_CLOSE_FROM_CLIENT:
+                if (is_server) return GRPC_CALL_ERROR_NOT_ON_SERVER;
+                if (call->close_sent) return GRPC_CALL_ERROR_TOO_MANY_OPERATIONS;
+                break;
+            case GRPC_OP_SEND_STATUS_FROM_SERVER:
+                if (!is_server) return GRPC_CALL_ERROR_NOT_ON_CLIENT;
+                if (call->status_sent) return GRPC_CALL_ERROR_TOO_MANY_OPERATIONS;
+                break;
+            case GRPC_OP_RECV_INITIAL_METADATA:
+                if (!ops[i].data.recv_initial_metadata.recv_initial_metadata) return GRPC_CALL_ERROR;
+                if (call->recv_initial_metadata_batch) return GRPC_CALL_ERROR_TOO_MANY_OPERATIONS;
+                break;
+            case GRPC_OP_RECV_MESSAGE:
+                if (!ops[i].data.recv_message.recv_message) return GRPC_CALL_ERROR;
+                if (call->recv_message_batch) return GRPC_CALL_ERROR_TOO_MANY_OPERATIONS;
+                break;
+            case GRPC_OP_RECV_STATUS_ON_CLIENT:
+                if (is_server) return GRPC_CALL_ERROR_NOT_ON_SERVER;
+                if (!ops[i].data.recv_status_on_client.status) return GRPC_CALL_ERROR;
+                if (call->recv_status_batch) return GRPC_CALL_ERROR_TOO_MANY_OPERATIONS;
+                break;
+            case GRPC_OP_RECV_CLOSE_ON_SERVER:
+                if (!is_server) return GRPC_CALL_ERROR_NOT_ON_CLIENT;
+                if (!ops[i].data.recv_close_on_server.cancelled) return GRPC_CALL_ERROR;
+                if (call->recv_status_batch) return GRPC_CALL_ERROR_TOO_MANY_OPERATIONS;
+                break;
+        }
+    }
+    
+    return GRPC_CALL_OK;
+}
+
+/**
+ * Run a batch on a call that has a transport
+ * @param call The call
+ * @param ops Operations
+ * @param nops Number of operations
+ * @param tag Posted to the call's completion queue when the batch is done
+ * @return GRPC_CALL_OK if the batch was started
+ */
+grpc_call_error call_run_batch(grpc_call *call, const grpc_op *ops, size_t nops, void *tag) {
+    if (!call || !call->transport || (nops > 0 && !ops)) {
+        return GRPC_CALL_ERROR;
+    }
+    
+    pthread_mutex_lock(&call->mutex);
+    
+    grpc_call_error err = call_validate_batch(call, ops, nops);
+    if (err != GRPC_CALL_OK) {
+        pthread_mutex_unlock(&call->mutex);
+        return err;
+    }
+    
+    call_batch *batch = (call_batch *)calloc(1, sizeof(call_batch));
+    if (!batch) {
+        pthread_mutex_unlock(&call->mutex);
+        return GRPC_CALL_ERROR;
+    }
+    batch->cq = call->cq;
+    batch->tag = tag;
+    batch->pending = 1; /* Held until the send operations below are done */
+    batch->success = true;
+    
+    const grpc_op *send_initial = NULL, *send_message = NULL, *send_close = NULL, *send_status = NULL;
+    grpc_byte_buffer *cache_request = NULL, *reply = NULL;
+    bool reply_shared = false;
+    
+    for (size_t i = 0; i < nops; i++) {
+        const grpc_op *op = &ops[i];
+        switch (op->op) {
+            case GRPC_OP_SEND_INITIAL_METADATA:
+                call->initial_metadata_sent = true;
+                send_initial = op;
+                if (op->data.send_initial_metadata.count > 0) {
+                    call_cache_drop(call);
+                }
+                break;
+            case GRPC_OP_SEND_MESSAGE:
+                send_message = op;
+                call_keep_reply(call, op->data.send_message.send_message);
+                break;
+            case GRPC_OP_SEND_CLOSE_FROM_CLIENT:
+                call->close_sent = true;
+                send_close = op;
+                break;
+            case GRPC_OP_SEND_STATUS_FROM_SERVER:
+                call->status_sent = true;
+                send_status = op;
+                reply = call->reply;
+                reply_shared = !call->reply_repeated;
+                call->reply = NULL;
+                if (reply && op->data.send_status_from_server.status == GRPC_STATUS_OK &&
+                    op->data.send_status_from_server.trailing_metadata_count == 0) {
+                    cache_request = call->cache_request;
+                    call->cache_request = NULL;
+                }
+                call_cache_drop(call);
+                break;
+            case GRPC_OP_RECV_INITIAL_METADATA:
+                call->recv_initial_metadata_batch = batch;
+                call->recv_initial_metadata_dest = op->data.recv_initial_metadata.recv_initial_metadata;
+                batch->pending++;
+                break;
+            case GRPC_OP_RECV_MESSAGE:
+                call->recv_message_batch = batch;
+                call->recv_message_dest = op->data.recv_message.recv_message;
+                batch->pending++;
+                break;
+            case GRPC_OP_RECV_STATUS_ON_CLIENT:
+                call->recv_status_batch = batch;
+                call->recv_trailing_metadata_dest = op->data.recv_status_on_client.trailing_metadata;
+                call->recv_status_dest = op->data.recv_status_on_client.status;
+                call->recv_status_details_dest = op->data.recv_status_on_client.status_details;
+                batch->pending++;
+                break;
+            case GRPC_OP_RECV_CLOSE_ON_SERVER:
+                call->recv_status_batch = batch;
+                call->recv_cancelled_dest = op->data.recv_close_on_server.cancelled;
+                batch->pending++;
+                break;
+        }
+    }
+    
+    bool cancelled = call->cancelled;
+    pthread_mutex_unlock(&call->mutex);
+    
+    /* Sends run without call->mutex: the transport locks the peer call */
+    bool success = !cancelled || !(send_initial || send_message || send_close || send_status);
+    const grpc_call_transport *transport = call->transport;
+    
+    if (!cancelled) {
+        if (send_initial && success) {
+            success = transport->send_initial_metadata(call, send_initial->data.send_initial_metadata.metadata,
+                                                       send_initial->data.send_initial_metadata.count) == 0;
+        }
+        if (send_message && success) {
+            success = transport->send_message(call, send_message->data.send_message.send_message) == 0;
+        }
+        if (send_close && success) {
+            success = transport->send_close(call) == 0;
+        }
+        if (send_status && success) {
+            success = transport->send_status(call, send_status->data.send_status_from_server.status,
+                                             send_status->data.send_status_from_server.status_details,
+                                             send_status->data.send_status_from_server.trailing_metadata,
+                                             send_status->data.send_status_from_server.trailing_metadata_count) == 0;
+        }
+    }
+    
+    /* Stored before the batch completes, so the next identical call hits */
+    if (cache_request) {
+        if (success) {
+            grpc_response_cache_insert(call->cache, cache_request, reply);
+        }
+        grpc_byte_buffer_destroy(cache_request);
+    }
+    if (send_status && call->coalesced) {
+        grpc_server_finish_flight(call, success && reply_shared, reply,
+                                  send_status->data.send_status_from_server.status,
+                                  send_status->data.send_status_from_server.status_details);
+    }
+    if (reply) {
+        grpc_byte_buffer_destroy(reply);
+    }
+    
+    pthread_mutex_lock(&call->mutex);
+    call_complete_pending(call);
+    call_batch_op_done(batch, success);
+    pthread_mutex_unlock(&call->mutex);
+    
+    return GRPC_CALL_OK;
+}
+
+/* ========================================================================
+ * Delivery From the Transport
+ * ======================================================================== */
+
+void call_deliver_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count) {
+    if (call->attempt_of) {
+        call_attempts_deliver_initial_metadata(call, metadata, count);
+        return;
+    }
+    if (call->batch_of) {
+        micro_batch_deliver_initial_metadata(call, metadata, count);
+        return;
+    }
+    
+    pthread_mutex_lock(&call->mutex);
+    if (!call->initial_metadata_received) {
+        call_copy_metadata(&call->initial_metadata, metadata, count);
+        call->initial_metadata_received = true;
+        call_complete_pending(call);
+    }
+    pthread_mutex_unlock(&call->mutex);
+}
+
+/* Takes ownership of one reference to message */
+void call_deliver_message(grpc_call *call, grpc_byte_buffer *message) {
+    if (call->attempt_of) {
+        call_attempts_deliver_message(call, message);
+        return;
+    }
+    if (call->batch_of) {
+        micro_batch_deliver_message(call, message);
+        return;
+    }
+    
+    call_message *msg = (call_message *)malloc(sizeof(call_message));
+    
+    pthread_mutex_lock(&call->mutex);
+    if (!msg || call->cancelled || call->half_close_received) {
+        pthread_mutex_unlock(&call->mutex);
+        free(msg);
+        grpc_byte_buffer_destroy(message);
+        return;
+    }
+    
+    /* Held until the application reads it; a slow reader shows up as quota usage */
+    msg->buffer = message;
+    msg->charged = message->length;
+    msg->next = NULL;
+    grpc_resource_quota_charge(call->quota, msg->charged);
+    if (call->recv_tail) {
+        call->recv_tail->next = msg;
+    } else {
+        call->recv_head = msg;
+    }
+    call->recv_tail = msg;
+    
+    call_complete_pending(call);
+    pthread_mutex_unlock(&call->mutex);
+}
+
+void call_deliver_half_close(grpc_call *call) {
+    if (call->attempt_of) {
+        call_attempts_deliver_half_close(call);
+        return;
+    }
+    
+    pthread_mutex_lock(&call->mutex);
+    call->half_close_received = true;
+    call_complete_pending(call);
+    pthread_mutex_unlock(&call->mutex);
+}
+
+void call_deliver_status(grpc_call *call, grpc_status_code status, const char *details,
+                         const grpc_metadata *trailing_metadata, size_t trailing_count) {
+    if (call->attempt_of) {
+        call_attempts_deliver_status(call, status, details, trailing_metadata, trailing_count, false);
+        return;
+    }
+    if (call->batch_of) {
+        micro_batch_deliver_status(call, status, details);
+        return;
+    }
+    
+    pthread_mutex_lock(&call->mutex);
+    if (!call->status_received) {
+        call->status = status;
+        free(call->status_details);
+        call->status_details = details ? strdup(details) : NULL;
+        call_copy_metadata(&call->trailing_metadata, trailing_metadata, trailing_count);
+        call->status_received = true;
+        call->half_close_received = true;
+        call_complete_pending(call);
+    }
+    pthread_mutex_unlock(&call->mutex);
+}
+
+/* The peer turned the call away before processing it (not serving,
+ * GOAWAY); an attempt of a retried call may be sent again */
+void call_deliver_refused(grpc_call *call, grpc_status_code status, const char *details) {
+    if (call->attempt_of) {
+        call_attempts_deliver_status(call, status, details, NULL, 0, true);
+        return;
+    }
+    
+    call_deliver_status(call, status, details, NULL, 0);
+}
+
+/* The peer cancelled the call */
+void call_deliver_cancel(grpc_call *call) {
+    if (call->attempt_of) {
+        call_attempts_deliver_cancel(call);
+        return;
+    }
+    if (call->batch_of) {
+        micro_batch_deliver_cancel(call);
+        return;
+    }
+    
+    /* A peer cancelling once the deadline has passed gave up waiting */
+    grpc_status_code status = call_deadline_remaining_ms(call->deadline) <= 0 ?
+                              GRPC_STATUS_DEADLINE_EXCEEDED : GRPC_STATUS_CANCELLED;
+    
+    pthread_mutex_lock(&call->mutex);
+    bool cancelled = !call_is_finished(call);
+    if (cancelled) {
+        call->cancelled = true;
+        if (!call->server) {
+            call->status = status;
+            call->status_received = true;
+        }
+        call_complete_pending(call);
+    }
+    pthread_mutex_unlock(&call->mutex);
+    
+    if (cancelled) {
+        call_propagate_cancel(call, status);
+    }
+}
+
+/* ========================================================================
+ * Cancellation and Teardown
+ * ======================================================================== */
+
+/**
+ * Cancel a call locally and tell the peer
+ * @param call The call
+ */
+void call_cancel_local(grpc_call *call) {
+    call_cancel_with_status(call, GRPC_STATUS_CANCELLED, NULL);
+}
+
+/**
+ * Cancel a call locally with a status of our choosing and tell the peer;
+ * calls propagated from it are cancelled as well
+ * @param call The call
+ * @param status Status a client call finishes with
+ * @param details Status details (may be NULL)
+ */
+void call_cancel_with_status(grpc_call *call, grpc_status_code status, const char *details) {
+    pthread_mutex_lock(&call->mutex);
+    if (call_is_finished(call)) {
+        pthread_mutex_unlock(&call->mutex);
+        return;
+    }
+    
+    call->cancelled = true;
+    call->status = status;
+    if (details) {
+        free(call->status_details);
+        call->status_details = strdup(details);
+    }
+    if (!call->server) {
+        call->status_received = true;
+    }
+    call_complete_pending(call);
+    pthread_mutex_unlock(&call->mutex);
+    
+    if (call->transport) {
+        call->transport->cancel(call);
+    } else {
+        channel_fail_waiting_call(call);
+    }
+    call_propagate_cancel(call, status);
+}
+
+/**
+ * Detach a call from its transport before it is freed. An unfinished call
+ * is cancelled and every pending receive is completed.
+ * @param call The call
+ */
+void call_release_transport(grpc_call *call) {
+    if (!call->transport) {
+        return;
+    }
+    
+    call_cancel_local(call);
+    call->transport->destroy(call);
+    
+    pthread_mutex_lock(&call->mutex);
+    call->transport = NULL;
+    call->cancelled = true;
+    call_complete_pending(call);
+    
+    while (call->recv_head) {
+        call_message *msg = call->recv_head;
+        call->recv_head = msg->next;
+        grpc_resource_quota_release(call->quota, msg->charged);
+        grpc_byte_buffer_destroy(msg->buffer);
+        free(msg);
+    }
+    call->recv_tail = NULL;
+    pthread_mutex_unlock(&call->mutex);
+}
@@ -0,0 +1,294 @@
+/**
+ * @file call_propagation.c
+ * @brief Call deadlines, and cancellation from a parent call to its children
+ *
+ * A call with a deadline has a timer on a library-wide timer queue that
+ * cancels it with GRPC_STATUS_DEADLINE_EXCEEDED. A call created with a
+ * parent and GRPC_PROPAGATE_CANCELLATION is linked under it; cancelling the
+ * parent, by the application, the peer or its deadline, cancels every child
+ * with the same status, and each child does the same for its own children.
+ *
+ * The parent/child links are guarded by one lock. A cascade pins the child
+ * it is cancelling and drops the lock while it does, so a child being
+ * destroyed waits for the pin to go before unlinking itself.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CALL_DEADLINE_DETAILS "Deadline Exceeded"
+#define CALL_PARENT_CANCELLED_DETAILS "Parent call cancelled"
+
+/* Deadline timer of one call; the timer holds a reference until it has run */
+typedef struct call_deadline {
+    pthread_mutex_t mutex;  /* Held while the call is expired */
+    grpc_call *call;        /* NULL once the call is being destroyed */
+    uint64_t timer_id;
+    int refs;
+} call_deadline;
+
+static pthread_mutex_t g_propagation_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_propagation_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_mutex_t g_deadline_mutex = PTHREAD_MUTEX_INITIALIZER;
+static grpc_timer_queue *g_deadline_timers;  /* Started with the first deadline */
+
+/* ========================================================================
+ * Parent and Child Calls
+ * ======================================================================== */
+
+static bool timespec_before(grpc_timespec a, grpc_timespec b) {
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+/**
+ * Deadline of a call created with a parent
+ * @param parent Parent call (may be NULL)
+ * @param propagation_mask GRPC_PROPAGATE_* flags
+ * @param deadline Deadline the application asked for
+ * @return The earlier of deadline and the parent's when it is propagated
+ */
+grpc_timespec call_propagated_deadline(grpc_call *parent, uint32_t propagation_mask, grpc_timespec deadline) {
+    if (parent && (propagation_mask & GRPC_PROPAGATE_DEADLINE) && timespec_before(parent->deadline, deadline)) {
+        return parent->deadline;
+    }
+    return deadline;
+}
+
+/**
+ * Cancel a call whenever its parent is cancelled, including when the
+ * parent already was
+ * @param call Call with a transport, not yet shared with another thread
+ * @param parent Parent call
+ */
+void call_link_parent(grpc_call *call, grpc_call *parent) {
+    pthread_mutex_lock(&g_propagation_mutex);
+    call->next_sibling = parent->first_child;
+    if (call->next_sibling) {
+        call->next_sibling->prev_sibling = call;
+    }
+    __atomic_store_n(&call->parent, parent, __ATOMIC_RELEASE);
+    __atomic_store_n(&parent->first_child, call, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_propagation_mutex);
+    
+    /* A cascade that started before the link did not see this call */
+    pthread_mutex_lock(&parent->mutex);
+    bool cancelled = parent->cancelled;
+    grpc_status_code status = parent->status;
+    pthread_mutex_unlock(&parent->mutex);
+    if (status != GRPC_STATUS_DEADLINE_EXCEEDED) {
+        status = call_deadline_remaining_ms(parent->deadline) <= 0 ?
+                 GRPC_STATUS_DEADLINE_EXCEEDED : GRPC_STATUS_CANCELLED;
+    }
+    
+    if (cancelled) {
+        call_cancel_with_status(call, status, status == GRPC_STATUS_DEADLINE_EXCEEDED ?
+                                CALL_DEADLINE_DETAILS : CALL_PARENT_CANCELLED_DETAILS);
+    }
+}
+
+/**
+ * Take a call being destroyed out of its parent's children, once no
+ * cascade is cancelling it
+ * @param call The call
+ */
+void call_unlink_parent(grpc_call *call) {
+    if (!__atomic_load_n(&call->parent, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    
+    pthread_mutex_lock(&g_propagation_mutex);
+    while (call->propagation_pins > 0) {
+        pthread_cond_wait(&g_propagation_cond, &g_propagation_mutex);
+    }
+    grpc_call *parent = call->parent;
+    if (parent) {
+        if (call->prev_sibling) {
+            call->prev_sibling->next_sibling = call->next_sibling;
+        } else {
+            __atomic_store_n(&parent->first_child, call->next_sibling, __ATOMIC_RELEASE);
+        }
+        if (call->next_sibling) {
+            call->next_sibling->prev_sibling = call->prev_sibling;
+        }
+        call->prev_sibling = NULL;
+        call->next_sibling = NULL;
+        __atomic_store_n(&call->parent, NULL, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g_propagation_mutex);
+}
+
+/**
+ * Let the children of a call being destroyed outlive it
+ * @param call The call
+ */
+void call_detach_children(grpc_call *call) {
+    if (!__atomic_load_n(&call->first_child, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    
+    pthread_mutex_lock(&g_propagation_mutex);
+    grpc_call *child = call->first_child;
+    while (child) {
+        grpc_call *next = child->next_sibling;
+        child->prev_sibling = NULL;
+        child->next_sibling = NULL;
+        __atomic_store_n(&child->parent, NULL, __ATOMIC_RELEASE);
+        child = next;
+    }
+    __atomic_store_n(&call->first_child, NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_propagation_mutex);
+}
+
+/**
+ * Cancel the children of a call that was just cancelled
+ * @param call The cancelled call (no locks held)
+ * @param status GRPC_STATUS_DEADLINE_EXCEEDED if its deadline passed,
+ *        anything else for a cancellation
+ */
+void call_propagate_cancel(grpc_call *call, grpc_status_code status) {
+    if (!__atomic_load_n(&call->first_child, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    
+    if (status != GRPC_STATUS_DEADLINE_EXCEEDED) {
+        status = GRPC_STATUS_CANCELLED;
+    }
+    const char *details = status == GRPC_STATUS_DEADLINE_EXCEEDED ?
+                          CALL_DEADLINE_DETAILS : CALL_PARENT_CANCELLED_DETAILS;
+    
+    pthread_mutex_lock(&g_propagation_mutex);
+    grpc_call *child = call->first_child;
+    while (child) {
+        /* The pin keeps the child, and its place in the list, until it is cancelled */
+        child->propagation_pins++;
+        pthread_mutex_unlock(&g_propagation_mutex);
+        
+        call_cancel_with_status(child, status, details);
+        
+        pthread_mutex_lock(&g_propagation_mutex);
+        grpc_call *next = child->next_sibling;
+        if (--child->propagation_pins == 0) {
+            pthread_cond_broadcast(&g_propagation_cond);
+        }
+        child = next;
+    }
+    pthread_mutex_unlock(&g_propagation_mutex);
+}
+
+/* ========================================================================
+ * Deadlines
+ * ======================================================================== */
+
+/**
+ * Time left before a deadline
+ * @param deadline Absolute deadline
+ * @return Milliseconds, rounded up (0 or less once it has passed), or
+ *         INT64_MAX for a deadline too far away to matter
+ */
+int64_t call_deadline_remaining_ms(grpc_timespec deadline) {
+    grpc_timespec now = grpc_now();
+    if (deadline.tv_sec > now.tv_sec && deadline.tv_sec - now.tv_sec >= INT64_MAX / 1000 - 1) {
+        return INT64_MAX;
+    }
+    
+    int64_t nanos = (int64_t)deadline.tv_nsec - now.tv_nsec;
+    int64_t ms = (deadline.tv_sec - now.tv_sec) * 1000;
+    return ms + (nanos > 0 ? (nanos + 999999) / 1000000 : nanos / 1000000);
+}
+
+static void call_deadline_unref(call_deadline *deadline) {
+    if (__atomic_sub_fetch(&deadline->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_destroy(&deadline->mutex);
+        free(deadline);
+    }
+}
+
+static void call_deadline_expired(void *arg) {
+    call_deadline *deadline = (call_deadline *)arg;
+    
+    pthread_mutex_lock(&deadline->mutex);
+    if (deadline->call) {
+        call_cancel_with_status(deadline->call, GRPC_STATUS_DEADLINE_EXCEEDED, CALL_DEADLINE_DETAILS);
+    }
+    pthread_mutex_unlock(&deadline->mutex);
+    call_deadline_unref(deadline);
+}
+
+/**
+ * Arm the timer that expires a call at its deadline; a deadline that has
+ * passed expires it right away
+ * @param call Call with a transport, owned by the application
+ */
+void call_start_deadline(grpc_call *call) {
+    int64_t remaining_ms = call_deadline_remaining_ms(call->deadline);
+    if (remaining_ms == INT64_MAX || call->deadline_timer) {
+        return;
+    }
+    
+    call_deadline *deadline = (call_deadline *)calloc(1, sizeof(call_deadline));
+    if (!deadline) {
+        return;
+    }
+    pthread_mutex_init(&deadline->mutex, NULL);
+    deadline->call = call;
+    deadline->refs = 2;
+    call->deadline_timer = deadline;
+    
+    pthread_mutex_lock(&g_deadline_mutex);
+    if (!g_deadline_timers) {
+        g_deadline_timers = grpc_timer_queue_create();
+    }
+    /* The queue's clock is truncated to whole milliseconds: one more keeps
+     * the timer from firing before the deadline */
+    int rc = grpc_timer_queue_schedule(g_deadline_timers, remaining_ms + 1, call_deadline_expired, deadline,
+                                       &deadline->timer_id);
+    pthread_mutex_unlock(&g_deadline_mutex);
+    
+    if (rc != 0) {
+        call->deadline_timer = NULL;
+        pthread_mutex_destroy(&deadline->mutex);
+        free(deadline);
+    }
+}
+
+/**
+ * Disarm a call's deadline before it is freed, waiting for an expiry that
+ * is already running
+ * @param call The call
+ */
+void call_stop_deadline(grpc_call *call) {
+    call_deadline *deadline = call->deadline_timer;
+    if (!deadline) {
+        return;
+    }
+    call->deadline_timer = NULL;
+    
+    pthread_mutex_lock(&g_deadline_mutex);
+    bool cancelled = grpc_timer_queue_cancel(g_deadline_timers, deadline->timer_id);
+    pthread_mutex_unlock(&g_deadline_mutex);
+    if (cancelled) {
+        call_deadline_unref(deadline);
+    }
+    
+    pthread_mutex_lock(&deadline->mutex);
+    deadline->call = NULL;
+    pthread_mutex_unlock(&deadline->mutex);
+    call_deadline_unref(deadline);
+}
+
+/**
+ * Stop the deadline timer thread (grpc_shutdown); calls are expected to be
+ * destroyed by then
+ */
+void call_deadline_shutdown(void) {
+    pthread_mutex_lock(&g_deadline_mutex);
+    grpc_timer_queue *timers = g_deadline_timers;
+    g_deadline_timers = NULL;
+    pthread_mutex_unlock(&g_deadline_mutex);
+    
+    grpc_timer_queue_destroy(timers);
+}
@@ -6,6 +6,7 @@
 #define _DEFAULT_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #include "grpc/grpc.h"
+#include "grpc/grpc_advanced.h"
 #include "grpc_internal.h"
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,9 @@
  * Connection Pool Types
  * ======================================================================== */
 
+/* Longest wait for the server's SETTINGS when a pooled connection is opened */
+#define GRPC_POOL_CONNECT_TIMEOUT_MS 5000
+
 /* Keep-alive configuration */
 typedef struct {
     int interval_ms;        /* Interval between keep-alive pings */
@@ -28,7 +32,7 @@ typedef struct grpc_pooled_connection {
     char *target;
     http2_connection *connection;
     time_t last_used;
-    time_t last_keepalive;
+    int64_t last_keepalive_ms;
     int active_calls;
     bool is_healthy;
     struct grpc_pooled_connection *next;
@@ -43,7 +47,8 @@ typedef struct grpc_connection_pool {
     grpc_keepalive_config keepalive;
     pthread_mutex_t mutex;
     pthread_t keepalive_thread;
-    bool keepalive_running;
+    bool keepalive_running;     /* Atomic */
+    grpc_lb_policy *lb_policy;  /* Told each connection's RTT and health, if set */
 } grpc_connection_pool;
 
 /* ========================================================================
@@ -65,7 +70,7 @@ static grpc_pooled_connection *grpc_pooled_connection_create(const char *target,
     
     conn->connection = connection;
     conn->last_used = time(NULL);
-    conn->last_keepalive = time(NULL);
+    conn->last_keepalive_ms = grpc_monotonic_ms();
     conn->active_calls = 0;
     conn->is_healthy = true;
     conn->next = NULL;
@@ -88,26 +93,49 @@ static void grpc_pooled_connection_destroy(grpc_pooled_connection *conn) {
  * Keep-Alive Thread
  * ======================================================================== */
 
+/* Report a connection's RTT, or its loss, to the pool's load balancer.
+ * Caller holds pool->mutex. */
+static void grpc_pooled_connection_report(grpc_connection_pool *pool, grpc_pooled_connection *conn) {
+    if (!pool->lb_policy) {
+        return;
+    }
+    
+    int64_t smoothed_rtt_us;
+    if (!conn->is_healthy) {
+        grpc_lb_policy_mark_unavailable(pool->lb_policy, conn->target);
+    } else if (http2_connection_get_rtt(conn->connection, &smoothed_rtt_us, NULL) == 0) {
+        grpc_lb_policy_report_rtt(pool->lb_policy, conn->target, smoothed_rtt_us);
+    }
+}
+
 static void *grpc_keepalive_thread_func(void *arg) {
     grpc_connection_pool *pool = (grpc_connection_pool *)arg;
     
-    while (pool->keepalive_running) {
+    while (__atomic_load_n(&pool->keepalive_running, __ATOMIC_ACQUIRE)) {
         pthread_mutex_lock(&pool->mutex);
         
         time_t now = time(NULL);
+        int64_t now_ms = grpc_monotonic_ms();
         grpc_pooled_connection *conn = pool->connections;
         
         while (conn) {
             /* Check if keep-alive is needed */
-            time_t elapsed = now - conn->last_keepalive;
-            bool should_keepalive = (elapsed * 1000 >= pool->keepalive.interval_ms);
+            bool should_keepalive = now_ms - conn->last_keepalive_ms >= pool->keepalive.interval_ms;
             
-            if (should_keepalive && conn->is_healthy) {
-                if (pool->keepalive.permit_without_calls || conn->active_calls > 0) {
-                    /* Send HTTP/2 PING frame for keep-alive */
-                    /* This would call http2_send_ping_frame(conn->connection) */
-                    conn->last_keepalive = now;
+            if (conn->is_healthy) {
+                /* The connection's reader marks it closed when the server goes away */
+                if (__atomic_load_n(&conn->connection->closed, __ATOMIC_ACQUIRE) ||
+                    http2_connection_ping_expired(conn->connection, pool->keepalive.timeout_ms)) {
+                    /* Peer did not ACK the last PING in time */
+                    conn->is_healthy = false;
+                } else if (should_keepalive &&
+                           (pool->keepalive.permit_without_calls || conn->active_calls > 0)) {
+                    if (http2_connection_send_ping(conn->connection) != 0) {
+                        conn->is_healthy = false;
+                    }
+                    conn->last_keepalive_ms = now_ms;
                 }
+                grpc_pooled_connection_report(pool, conn);
             }
             
             /* Check for idle timeout */
@@ -153,9 +181,9 @@ grpc_connection_pool *grpc_connection_pool_create(size_t max_connections, int id
     pthread_mutex_init(&pool->mutex, NULL);
     
     /* Start keep-alive thread */
-    pool->keepalive_running = true;
+    __atomic_store_n(&pool->keepalive_running, true, __ATOMIC_RELEASE);
     if (pthread_create(&pool->keepalive_thread, NULL, grpc_keepalive_thread_func, pool) != 0) {
-        pool->keepalive_running = false;
+        __atomic_store_n(&pool->keepalive_running, false, __ATOMIC_RELEASE);
     }
     
     return pool;
@@ -180,6 +208,34 @@ int grpc_connection_pool_set_keepalive(grpc_connection_pool *pool,
     return 0;
 }
 
+/**
+ * Report the RTT and health of the pool's connections to a load balancer:
+ * smoothed RTTs through grpc_lb_policy_report_rtt(), and addresses whose
+ * connection failed its keepalive through grpc_lb_policy_mark_unavailable()
+ * @param pool Connection pool
+ * @param policy Load balancer outliving the pool, or NULL to stop reporting
+ * @return 0 on success, -1 on error
+ */
+int grpc_connection_pool_set_lb_policy(grpc_connection_pool *pool, grpc_lb_policy *policy) {
+    if (!pool) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&pool->mutex);
+    pool->lb_policy = policy;
+    pthread_mutex_unlock(&pool->mutex);
+    
+    return 0;
+}
+
+/**
+ * Get a connection to a target, reusing a healthy one or opening a new one.
+ * New connections are connected and have exchanged SETTINGS; their reader
+ * thread answers and matches PINGs for the keepalive.
+ * @param pool Connection pool
+ * @param target Address to connect to
+ * @return Connection, or NULL if the pool is full or the target is unreachable
+ */
 http2_connection *grpc_connection_pool_get(grpc_connection_pool *pool, const char *target) {
     if (!pool || !target) {
         return NULL;
@@ -228,25 +284,31 @@ http2_connection *grpc_connection_pool_get(grpc_connection_pool *pool, const cha
         }
     }
     
-    /* Create new connection */
+    /* Reserve the slot and connect without the lock */
+    pool->current_connections++;
+    pthread_mutex_unlock(&pool->mutex);
+    
     http2_connection *new_conn = http2_connection_create(target, true, NULL);
-    if (!new_conn) {
-        pthread_mutex_unlock(&pool->mutex);
-        return NULL;
+    grpc_pooled_connection *pooled = NULL;
+    if (new_conn && http2_connection_handshake(new_conn, target, GRPC_POOL_CONNECT_TIMEOUT_MS) == 0) {
+        pooled = grpc_pooled_connection_create(target, new_conn);
     }
     
-    grpc_pooled_connection *pooled = grpc_pooled_connection_create(target, new_conn);
+    pthread_mutex_lock(&pool->mutex);
     if (!pooled) {
-        http2_connection_destroy(new_conn);
+        pool->current_connections--;
         pthread_mutex_unlock(&pool->mutex);
+        http2_connection_destroy(new_conn);
         return NULL;
     }
     
     /* Add to pool */
     pooled->next = pool->connections;
     pool->connections = pooled;
-    pool->current_connections++;
     pooled->active_calls++;
+    if (pool->lb_policy) {
+        grpc_lb_policy_mark_available(pool->lb_policy, target);
+    }
     
     pthread_mutex_unlock(&pool->mutex);
     return new_conn;
@@ -277,6 +339,27 @@ int grpc_connection_pool_return(grpc_connection_pool *pool, const char *target,
     return -1;
 }
 
+int grpc_connection_pool_get_rtt(grpc_connection_pool *pool, http2_connection *connection,
+                                 int64_t *smoothed_rtt_us, int64_t *min_rtt_us) {
+    if (!pool || !connection) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&pool->mutex);
+    
+    /* Only report connections owned by this pool */
+    int result = -1;
+    for (grpc_pooled_connection *conn = pool->connections; conn; conn = conn->next) {
+        if (conn->connection == connection) {
+            result = http2_connection_get_rtt(connection, smoothed_rtt_us, min_rtt_us);
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&pool->mutex);
+    return result;
+}
+
 void grpc_connection_pool_cleanup_idle(grpc_connection_pool *pool) {
     if (!pool) return;
     
@@ -314,8 +397,9 @@ void grpc_connection_pool_destroy(grpc_connection_pool *pool) {
     if (!pool) return;
     
     /* Stop keep-alive thread */
-    pool->keepalive_running = false;
-    pthread_join(pool->keepalive_thread, NULL);
+    if (__atomic_exchange_n(&pool->keepalive_running, false, __ATOMIC_ACQ_REL)) {
+        pthread_join(pool->keepalive_thread, NULL);
+    }
     
     pthread_mutex_lock(&pool->mutex);
     
@@ -0,0 +1,257 @@
+/**
+ * @file cpu_affinity.c
+ * @brief CPU and NUMA node placement of library threads
+ *
+ * The topology comes from sysfs: /sys/devices/system/node/node<N>/cpulist
+ * lists the CPUs of each node. Machines without that directory are
+ * treated as a single node holding every configured CPU. Threads are
+ * pinned through their creation attributes, so they never run, and never
+ * touch memory, outside their CPU set.
+ */
+
+#define _GNU_SOURCE
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+
+#define GRPC_NODE_SYSFS "/sys/devices/system/node"
+#define GRPC_CPULIST_MAX 4096
+
+struct grpc_cpu_topology {
+    int cpu_count;          /* Entries in cpu_node */
+    int *cpu_node;          /* Node of each CPU, -1 if unknown */
+    int node_count;
+    int **node_cpus;        /* CPUs of each node */
+    size_t *node_cpu_counts;
+};
+
+/* Parse a sysfs CPU list such as "0-3,8-11"; returns the number of CPUs
+ * listed, of which the first max_cpus are stored */
+static int cpu_list_parse(const char *list, int *cpus, size_t max_cpus) {
+    int count = 0;
+    const char *p = list;
+    while (*p && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return -1;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if ((size_t)count < max_cpus) {
+                cpus[count] = (int)cpu;
+            }
+            count++;
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return count;
+}
+
+static bool numa_sysfs_present(void) {
+    return access(GRPC_NODE_SYSFS "/node0", F_OK) == 0;
+}
+
+/**
+ * Number of NUMA nodes
+ * @return Node count (1 on machines without NUMA information)
+ */
+int grpc_numa_node_count(void) {
+    if (!numa_sysfs_present()) {
+        return 1;
+    }
+    
+    DIR *dir = opendir(GRPC_NODE_SYSFS);
+    if (!dir) {
+        return 1;
+    }
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int node;
+        char tail;
+        if (sscanf(entry->d_name, "node%d%c", &node, &tail) == 1 && node + 1 > count) {
+            count = node + 1;
+        }
+    }
+    closedir(dir);
+    return count > 0 ? count : 1;
+}
+
+/**
+ * CPUs of a NUMA node
+ * @param node Node number
+ * @param cpus Filled with up to max_cpus CPU numbers (may be NULL if max_cpus is 0)
+ * @param max_cpus Capacity of cpus
+ * @return Number of CPUs on the node (more than max_cpus if cpus was too
+ *         small), or -1 if the node does not exist
+ */
+int grpc_numa_node_cpus(int node, int *cpus, size_t max_cpus) {
+    if (node < 0) {
+        return -1;
+    }
+    
+    if (!numa_sysfs_present()) {
+        if (node != 0) {
+            return -1;
+        }
+        long configured = sysconf(_SC_NPROCESSORS_CONF);
+        int count = configured > 0 ? (int)configured : 1;
+        for (int i = 0; i < count && (size_t)i < max_cpus; i++) {
+            cpus[i] = i;
+        }
+        return count;
+    }
+    
+    char path[64];
+    snprintf(path, sizeof(path), GRPC_NODE_SYSFS "/node%d/cpulist", node);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    char list[GRPC_CPULIST_MAX];
+    int count = -1;
+    if (fgets(list, sizeof(list), file)) {
+        count = cpu_list_parse(list, cpus, max_cpus);
+    }
+    fclose(file);
+    return count;
+}
+
+/**
+ * Read the machine's CPU to node layout
+ * @return Topology, or NULL on allocation failure
+ */
+grpc_cpu_topology *grpc_cpu_topology_create(void) {
+    grpc_cpu_topology *topology = (grpc_cpu_topology *)calloc(1, sizeof(grpc_cpu_topology));
+    if (!topology) {
+        return NULL;
+    }
+    
+    long configured = sysconf(_SC_NPROCESSORS_CONF);
+    topology->cpu_count = configured > 0 ? (int)configured : 1;
+    topology->node_count = grpc_numa_node_count();
+    topology->cpu_node = (int *)malloc((size_t)topology->cpu_count * sizeof(int));
+    topology->node_cpus = (int **)calloc((size_t)topology->node_count, sizeof(int *));
+    topology->node_cpu_counts = (size_t *)calloc((size_t)topology->node_count, sizeof(size_t));
+    if (!topology->cpu_node || !topology->node_cpus || !topology->node_cpu_counts) {
+        grpc_cpu_topology_destroy(topology);
+        return NULL;
+    }
+    for (int cpu = 0; cpu < topology->cpu_count; cpu++) {
+        topology->cpu_node[cpu] = -1;
+    }
+    
+    /* Nodes may be numbered with gaps; missing ones stay empty */
+    for (int node = 0; node < topology->node_count; node++) {
+        int count = grpc_numa_node_cpus(node, NULL, 0);
+        if (count <= 0) {
+            continue;
+        }
+        int *cpus = (int *)malloc((size_t)count * sizeof(int));
+        if (!cpus) {
+            grpc_cpu_topology_destroy(topology);
+            return NULL;
+        }
+        grpc_numa_node_cpus(node, cpus, (size_t)count);
+        topology->node_cpus[node] = cpus;
+        topology->node_cpu_counts[node] = (size_t)count;
+        for (int i = 0; i < count; i++) {
+            if (cpus[i] < topology->cpu_count) {
+                topology->cpu_node[cpus[i]] = node;
+            }
+        }
+    }
+    return topology;
+}
+
+/**
+ * CPUs sharing a NUMA node with cpu
+ * @param topology Topology
+ * @param cpu CPU number
+ * @param cpus Set to the node's CPUs
+ * @return Number of CPUs, 0 if cpu is unknown
+ */
+size_t grpc_cpu_topology_node_cpus(const grpc_cpu_topology *topology, int cpu, const int **cpus) {
+    if (!topology || cpu < 0 || cpu >= topology->cpu_count || topology->cpu_node[cpu] < 0) {
+        return 0;
+    }
+    int node = topology->cpu_node[cpu];
+    *cpus = topology->node_cpus[node];
+    return topology->node_cpu_counts[node];
+}
+
+void grpc_cpu_topology_destroy(grpc_cpu_topology *topology) {
+    if (!topology) {
+        return;
+    }
+    for (int node = 0; node < topology->node_count && topology->node_cpus; node++) {
+        free(topology->node_cpus[node]);
+    }
+    free(topology->node_cpus);
+    free(topology->node_cpu_counts);
+    free(topology->cpu_node);
+    free(topology);
+}
+
+/**
+ * Check a CPU list can be used for pinning
+ * @return true if every CPU number is valid
+ */
+bool grpc_cpu_list_valid(const int *cpus, size_t cpu_count) {
+    if (cpu_count > 0 && !cpus) {
+        return false;
+    }
+    for (size_t i = 0; i < cpu_count; i++) {
+        if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Initialize thread attributes that confine the thread to a CPU list
+ * @param attr Attributes to initialize; destroy with pthread_attr_destroy
+ * @param cpus CPUs the thread may run on
+ * @param cpu_count Number of CPUs (0 leaves the thread unpinned)
+ * @return 0 on success, -1 on error
+ */
+int grpc_thread_attr_init_pinned(pthread_attr_t *attr, const int *cpus, size_t cpu_count) {
+    if (pthread_attr_init(attr) != 0) {
+        return -1;
+    }
+    if (cpu_count == 0) {
+        return 0;
+    }
+    if (!grpc_cpu_list_valid(cpus, cpu_count)) {
+        pthread_attr_destroy(attr);
+        return -1;
+    }
+    
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpu_count; i++) {
+        CPU_SET(cpus[i], &set);
+    }
+    if (pthread_attr_setaffinity_np(attr, sizeof(set), &set) != 0) {
+        pthread_attr_destroy(attr);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,456 @@
+/**
+ * @file executor.c
+ * @brief Work-stealing thread pool for application callbacks
+ *
+ * Every worker owns a Chase-Lev deque: it pushes and pops at the bottom
+ * without locks, and idle workers steal from the top of the others. Tasks
+ * submitted from outside the pool go onto a per-worker inbox, a lock-free
+ * stack the owner drains into its deque, so no queue is shared by all
+ * threads. The mutex and condition variable are only used to park workers
+ * that found nothing to do, and to hold them at the start until all exist.
+ * Each worker allocates its own state and deque on its own thread, so when
+ * workers are pinned the memory they work on is on their NUMA node.
+ */
+
+#define _GNU_SOURCE
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define EXECUTOR_INITIAL_DEQUE_SIZE 64
+/* Steal rounds an idle worker tries before it parks */
+#define EXECUTOR_STEAL_ROUNDS 4
+
+typedef struct executor_task {
+    grpc_executor_fn fn;
+    void *arg;
+    struct executor_task *next;  /* Inbox link */
+} executor_task;
+
+typedef struct executor_deque_array {
+    int64_t size;                /* Power of two */
+    struct executor_deque_array *retired;  /* Older, smaller arrays */
+    executor_task *slots[];
+} executor_deque_array;
+
+typedef struct {
+    grpc_executor *executor;
+    size_t index;
+    pthread_t thread;
+    /* Chase-Lev deque: the owner works at bottom, thieves take from top */
+    int64_t top;
+    int64_t bottom;
+    executor_deque_array *array;
+    /* Tasks submitted from other threads */
+    executor_task *inbox;
+} executor_worker;
+
+/* Startup record of one worker thread */
+typedef struct {
+    grpc_executor *executor;
+    size_t index;
+    pthread_t thread;
+} executor_thread;
+
+struct grpc_executor {
+    executor_worker **workers;   /* Each allocated by its own thread */
+    executor_thread *threads;
+    size_t worker_count;
+    size_t next_inbox;           /* Round-robin target for outside submissions */
+    int sleepers;
+    size_t ready;                /* Workers that finished allocating */
+    bool failed;                 /* A worker could not allocate */
+    bool running;                /* Every worker exists; stealing may start */
+    bool shutdown;
+    pthread_mutex_t mutex;       /* Parking only */
+    pthread_cond_t cond;
+};
+
+/* Worker running on this thread, NULL outside any pool */
+static __thread executor_worker *current_worker = NULL;
+
+/* ========================================================================
+ * Chase-Lev Deque
+ * ======================================================================== */
+
+static executor_deque_array *executor_deque_array_create(int64_t size) {
+    executor_deque_array *array = (executor_deque_array *)calloc(
+        1, sizeof(executor_deque_array) + (size_t)size * sizeof(executor_task *));
+    if (array) {
+        array->size = size;
+    }
+    return array;
+}
+
+/* Owner only */
+static int executor_deque_push(executor_worker *w, executor_task *task) {
+    int64_t b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    executor_deque_array *a = __atomic_load_n(&w->array, __ATOMIC_RELAXED);
+    
+    if (b - t > a->size - 1) {
+        /* Thieves may still read the old array, so it is kept until destroy */
+        executor_deque_array *grown = executor_deque_array_create(a->size * 2);
+        if (!grown) {
+            return -1;
+        }
+        for (int64_t i = t; i < b; i++) {
+            grown->slots[i & (grown->size - 1)] =
+                __atomic_load_n(&a->slots[i & (a->size - 1)], __ATOMIC_RELAXED);
+        }
+        grown->retired = a;
+        __atomic_store_n(&w->array, grown, __ATOMIC_RELEASE);
+        a = grown;
+    }
+    
+    /* Release on the slot too, so a thief that reads it sees the task */
+    __atomic_store_n(&a->slots[b & (a->size - 1)], task, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Owner only */
+static executor_task *executor_deque_pop(executor_worker *w) {
+    int64_t b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+    executor_deque_array *a = __atomic_load_n(&w->array, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+    
+    if (t > b) {
+        __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    
+    executor_task *task = __atomic_load_n(&a->slots[b & (a->size - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        /* Last task: race the thieves for it */
+        if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, false, __ATOMIC_SEQ_CST,
+                                         __ATOMIC_RELAXED)) {
+            task = NULL;
+        }
+        __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+/* Any thread; NULL if empty or another thief won */
+static executor_task *executor_deque_steal(executor_worker *w) {
+    int64_t t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+    
+    if (t >= b) {
+        return NULL;
+    }
+    
+    executor_deque_array *a = __atomic_load_n(&w->array, __ATOMIC_ACQUIRE);
+    executor_task *task = __atomic_load_n(&a->slots[t & (a->size - 1)], __ATOMIC_ACQUIRE);
+    if (!__atomic_compare_exchange_n(&w->top, &t, t + 1, false, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return task;
+}
+
+static bool executor_worker_has_work(executor_worker *w) {
+    return __atomic_load_n(&w->inbox, __ATOMIC_ACQUIRE) != NULL ||
+           __atomic_load_n(&w->top, __ATOMIC_ACQUIRE) < __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+}
+
+/* ========================================================================
+ * Workers
+ * ======================================================================== */
+
+/* Move a worker's inbox (our own, or a busy victim's) into our deque,
+ * oldest first; returns one task to run */
+static executor_task *executor_drain_inbox(executor_worker *w, executor_worker *victim) {
+    executor_task *stack = __atomic_exchange_n(&victim->inbox, NULL, __ATOMIC_ACQUIRE);
+    if (!stack) {
+        return NULL;
+    }
+    
+    executor_task *fifo = NULL;
+    while (stack) {
+        executor_task *next = stack->next;
+        stack->next = fifo;
+        fifo = stack;
+        stack = next;
+    }
+    
+    /* Run the oldest now; the rest may be stolen meanwhile */
+    executor_task *first = fifo;
+    for (executor_task *task = fifo->next; task;) {
+        executor_task *next = task->next;
+        if (executor_deque_push(w, task) != 0) {
+            task->fn(task->arg);
+            free(task);
+        }
+        task = next;
+    }
+    return first;
+}
+
+static executor_task *executor_find_task(executor_worker *w) {
+    executor_task *task = executor_deque_pop(w);
+    if (!task) {
+        task = executor_drain_inbox(w, w);
+    }
+    
+    grpc_executor *executor = w->executor;
+    for (int round = 0; !task && round < EXECUTOR_STEAL_ROUNDS; round++) {
+        for (size_t i = 1; i < executor->worker_count && !task; i++) {
+            executor_worker *victim = executor->workers[(w->index + i) % executor->worker_count];
+            task = executor_deque_steal(victim);
+            if (!task) {
+                task = executor_drain_inbox(w, victim);
+            }
+        }
+    }
+    return task;
+}
+
+static bool executor_has_work(grpc_executor *executor) {
+    for (size_t i = 0; i < executor->worker_count; i++) {
+        if (executor_worker_has_work(executor->workers[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *executor_worker_thread(void *arg) {
+    executor_thread *thread = (executor_thread *)arg;
+    grpc_executor *executor = thread->executor;
+    
+    /* Allocated here, where the thread already runs on its CPUs */
+    executor_worker *w = (executor_worker *)calloc(1, sizeof(executor_worker));
+    if (w) {
+        w->executor = executor;
+        w->index = thread->index;
+        w->array = executor_deque_array_create(EXECUTOR_INITIAL_DEQUE_SIZE);
+        if (!w->array) {
+            free(w);
+            w = NULL;
+        }
+    }
+    
+    /* Every deque exists before any worker starts stealing */
+    pthread_mutex_lock(&executor->mutex);
+    executor->workers[thread->index] = w;
+    executor->failed |= w == NULL;
+    executor->ready++;
+    pthread_cond_broadcast(&executor->cond);
+    while (!executor->running && !executor->shutdown) {
+        pthread_cond_wait(&executor->cond, &executor->mutex);
+    }
+    bool running = executor->running;
+    pthread_mutex_unlock(&executor->mutex);
+    if (!running) {
+        return NULL;
+    }
+    current_worker = w;
+    
+    for (;;) {
+        executor_task *task = executor_find_task(w);
+        if (task) {
+            task->fn(task->arg);
+            free(task);
+            continue;
+        }
+        
+        /* Park; submitters check sleepers after publishing their task, and
+         * we look for work again after announcing ourselves */
+        pthread_mutex_lock(&executor->mutex);
+        __atomic_fetch_add(&executor->sleepers, 1, __ATOMIC_SEQ_CST);
+        bool exit_now = false;
+        while (!executor_has_work(executor)) {
+            if (__atomic_load_n(&executor->shutdown, __ATOMIC_ACQUIRE)) {
+                exit_now = true;
+                break;
+            }
+            pthread_cond_wait(&executor->cond, &executor->mutex);
+        }
+        __atomic_fetch_sub(&executor->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&executor->mutex);
+        
+        if (exit_now) {
+            break;
+        }
+    }
+    
+    current_worker = NULL;
+    return NULL;
+}
+
+static void executor_wake_one(grpc_executor *executor) {
+    if (__atomic_load_n(&executor->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&executor->mutex);
+        pthread_cond_signal(&executor->cond);
+        pthread_mutex_unlock(&executor->mutex);
+    }
+}
+
+/* Stop and join the first started workers, then free everything. Workers
+ * finish all submitted work before they exit; anything a racing outside
+ * submitter left behind runs here. */
+static void executor_free(grpc_executor *executor, size_t started) {
+    pthread_mutex_lock(&executor->mutex);
+    __atomic_store_n(&executor->shutdown, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&executor->cond);
+    pthread_mutex_unlock(&executor->mutex);
+    
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(executor->threads[i].thread, NULL);
+    }
+    
+    for (size_t i = 0; i < executor->worker_count; i++) {
+        executor_worker *w = executor->workers[i];
+        if (!w) {
+            continue;
+        }
+        executor_task *task = __atomic_exchange_n(&w->inbox, NULL, __ATOMIC_ACQUIRE);
+        while (task) {
+            executor_task *next = task->next;
+            task->fn(task->arg);
+            free(task);
+            task = next;
+        }
+        
+        executor_deque_array *a = w->array;
+        while (a) {
+            executor_deque_array *retired = a->retired;
+            free(a);
+            a = retired;
+        }
+        free(w);
+    }
+    
+    pthread_mutex_destroy(&executor->mutex);
+    pthread_cond_destroy(&executor->cond);
+    free(executor->workers);
+    free(executor->threads);
+    free(executor);
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+/* Start the workers, worker i pinned to cpus[i % cpu_count] if cpus is
+ * given, and return once all of them are ready */
+static grpc_executor *executor_create(size_t num_threads, const int *cpus, size_t cpu_count) {
+    grpc_executor *executor = (grpc_executor *)calloc(1, sizeof(grpc_executor));
+    if (!executor) {
+        return NULL;
+    }
+    executor->workers = (executor_worker **)calloc(num_threads, sizeof(executor_worker *));
+    executor->threads = (executor_thread *)calloc(num_threads, sizeof(executor_thread));
+    if (!executor->workers || !executor->threads) {
+        free(executor->workers);
+        free(executor->threads);
+        free(executor);
+        return NULL;
+    }
+    pthread_mutex_init(&executor->mutex, NULL);
+    pthread_cond_init(&executor->cond, NULL);
+    executor->worker_count = num_threads;
+    
+    for (size_t i = 0; i < num_threads; i++) {
+        executor_thread *thread = &executor->threads[i];
+        thread->executor = executor;
+        thread->index = i;
+        
+        pthread_attr_t attr;
+        if (grpc_thread_attr_init_pinned(&attr, cpus ? &cpus[i % cpu_count] : NULL, cpus ? 1 : 0) != 0) {
+            executor_free(executor, i);
+            return NULL;
+        }
+        int rc = pthread_create(&thread->thread, &attr, executor_worker_thread, thread);
+        pthread_attr_destroy(&attr);
+        if (rc != 0) {
+            executor_free(executor, i);
+            return NULL;
+        }
+    }
+    
+    pthread_mutex_lock(&executor->mutex);
+    while (executor->ready < num_threads) {
+        pthread_cond_wait(&executor->cond, &executor->mutex);
+    }
+    bool failed = executor->failed;
+    executor->running = !failed;
+    pthread_cond_broadcast(&executor->cond);
+    pthread_mutex_unlock(&executor->mutex);
+    
+    if (failed) {
+        executor_free(executor, num_threads);
+        return NULL;
+    }
+    return executor;
+}
+
+grpc_executor *grpc_executor_create(size_t num_threads) {
+    if (num_threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    return executor_create(num_threads, NULL, 0);
+}
+
+grpc_executor *grpc_executor_create_pinned(size_t num_threads, const int *cpus, size_t cpu_count) {
+    if (cpu_count == 0 || !grpc_cpu_list_valid(cpus, cpu_count)) {
+        return NULL;
+    }
+    return executor_create(num_threads ? num_threads : cpu_count, cpus, cpu_count);
+}
+
+int grpc_executor_run(grpc_executor *executor, grpc_executor_fn fn, void *arg) {
+    if (!executor || !fn) {
+        return -1;
+    }
+    
+    /* Tasks may still spawn tasks while the pool drains for destroy */
+    executor_worker *w = current_worker;
+    bool inside = w && w->executor == executor;
+    if (!inside && __atomic_load_n(&executor->shutdown, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    
+    executor_task *task = (executor_task *)malloc(sizeof(executor_task));
+    if (!task) {
+        return -1;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+    
+    if (!inside || executor_deque_push(w, task) != 0) {
+        /* From outside the pool: leave it in one worker's inbox */
+        size_t i = __atomic_fetch_add(&executor->next_inbox, 1, __ATOMIC_RELAXED);
+        w = executor->workers[i % executor->worker_count];
+        task->next = __atomic_load_n(&w->inbox, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&w->inbox, &task->next, task, true, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+        }
+    }
+    
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    executor_wake_one(executor);
+    return 0;
+}
+
+size_t grpc_executor_thread_count(grpc_executor *executor) {
+    return executor ? executor->worker_count : 0;
+}
+
+void grpc_executor_destroy(grpc_executor *executor) {
+    if (!executor) {
+        return;
+    }
+    executor_free(executor, executor->worker_count);
+}
@@ -14,6 +14,7 @@
 #define HTTP2_WINDOW_UPDATE_THRESHOLD_PERCENT 50  /* Send update when window drops below 50% */
 #define HTTP2_DEFAULT_MAX_FRAME_SIZE 16384
 #define HTTP2_DEFAULT_MAX_CONCURRENT_STREAMS 100
+#define HTTP2_MAX_BDP_WINDOW_SIZE (16 * 1024 * 1024)  /* Upper bound for the BDP-sized window */
 
 /**
  * Send a WINDOW_UPDATE frame
@@ -67,6 +68,7 @@ int http2_flow_control_receive_window_update(http2_connection *conn, uint32_t st
             pthread_mutex_unlock(&conn->write_mutex);
             return -1;
         }
+        pthread_cond_broadcast(&conn->send_window_cond);
         pthread_mutex_unlock(&conn->write_mutex);
     } else {
         /* Stream-level window update */
@@ -81,13 +83,18 @@ int http2_flow_control_receive_window_update(http2_connection *conn, uint32_t st
         }
         
         if (stream) {
+            /* Senders wait for the stream window under write_mutex */
+            pthread_mutex_lock(&conn->write_mutex);
             stream->remote_window_size += increment;
             
             /* Check for overflow */
             if (stream->remote_window_size > 0x7FFFFFFF) {
+                pthread_mutex_unlock(&conn->write_mutex);
                 pthread_mutex_unlock(&conn->streams_mutex);
                 return -1;
             }
+            pthread_cond_broadcast(&conn->send_window_cond);
+            pthread_mutex_unlock(&conn->write_mutex);
         }
         
         pthread_mutex_unlock(&conn->streams_mutex);
@@ -143,6 +150,41 @@ int http2_flow_control_consume_send_window(http2_connection *conn, http2_stream
     return 0;
 }
 
+/**
+ * Wait until both send windows are open and take up to max_len bytes of
+ * them for one DATA frame
+ * @param conn HTTP/2 connection
+ * @param stream Stream that will send
+ * @param max_len Bytes the caller wants to send (at most one frame)
+ * @return Bytes that may be sent now (> 0), or -1 once the connection is
+ *         shut down
+ */
+int32_t http2_flow_control_wait_send_window(http2_connection *conn, http2_stream *stream, size_t max_len) {
+    if (!conn || !stream || max_len == 0) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&conn->write_mutex);
+    for (;;) {
+        if (__atomic_load_n(&conn->closed, __ATOMIC_ACQUIRE)) {
+            pthread_mutex_unlock(&conn->write_mutex);
+            return -1;
+        }
+        
+        int32_t window = conn->remote_window_size < stream->remote_window_size ? conn->remote_window_size
+                                                                               : stream->remote_window_size;
+        if (window > 0) {
+            int32_t len = (size_t)window < max_len ? window : (int32_t)max_len;
+            conn->remote_window_size -= len;
+            stream->remote_window_size -= len;
+            pthread_mutex_unlock(&conn->write_mutex);
+            return len;
+        }
+        
+        pthread_cond_wait(&conn->send_window_cond, &conn->write_mutex);
+    }
+}
+
 /**
  * Consume window size when receiving data
  * @param conn HTTP/2 connection
@@ -169,18 +211,27 @@ int http2_flow_control_consume_recv_window(http2_connection *conn, http2_stream
     }
     
     conn->local_window_size -= data_len;
+    conn->bdp_bytes += (uint32_t)data_len;
     
-    /* Send WINDOW_UPDATE if window is getting low (less than threshold) */
-    int32_t threshold = HTTP2_DEFAULT_WINDOW_SIZE * HTTP2_WINDOW_UPDATE_THRESHOLD_PERCENT / 100;
-    if (conn->local_window_size < threshold) {
-        uint32_t increment = HTTP2_DEFAULT_WINDOW_SIZE - conn->local_window_size;
-        if (increment > 0) {
-            http2_flow_control_send_window_update(conn, 0, increment);
-            conn->local_window_size = HTTP2_DEFAULT_WINDOW_SIZE;
-        }
+    /* Refill the connection window up to the BDP target once it is half used.
+     * Under memory pressure the window is left to drain instead, which stops
+     * the peer until http2_flow_control_resume() */
+    uint32_t conn_increment = 0;
+    int32_t threshold = (int32_t)((int64_t)conn->local_window_target * HTTP2_WINDOW_UPDATE_THRESHOLD_PERCENT / 100);
+    if (grpc_resource_quota_under_pressure(conn->quota)) {
+        conn->local_window_target = HTTP2_DEFAULT_WINDOW_SIZE;
+        conn->window_update_withheld = true;
+    } else if (conn->local_window_size < threshold) {
+        conn_increment = (uint32_t)(conn->local_window_target - conn->local_window_size);
+        conn->local_window_size = conn->local_window_target;
     }
     pthread_mutex_unlock(&conn->write_mutex);
     
+    /* Sent outside write_mutex: send_frame takes it itself */
+    if (conn_increment > 0) {
+        http2_flow_control_send_window_update(conn, 0, conn_increment);
+    }
+    
     /* Check stream window for underflow */
     if (stream->local_window_size < (int32_t)data_len) {
         return -1;
@@ -210,6 +261,8 @@ void http2_flow_control_init_connection(http2_connection *conn) {
     
     conn->local_window_size = HTTP2_DEFAULT_WINDOW_SIZE;
     conn->remote_window_size = HTTP2_DEFAULT_WINDOW_SIZE;
+    conn->local_window_target = HTTP2_DEFAULT_WINDOW_SIZE;
+    conn->bdp_bytes = 0;
     conn->max_frame_size = HTTP2_DEFAULT_MAX_FRAME_SIZE;
     conn->max_concurrent_streams = HTTP2_DEFAULT_MAX_CONCURRENT_STREAMS;
 }
@@ -224,3 +277,72 @@ void http2_flow_control_init_stream(http2_stream *stream) {
     stream->local_window_size = HTTP2_DEFAULT_WINDOW_SIZE;
     stream->remote_window_size = HTTP2_DEFAULT_WINDOW_SIZE;
 }
+
+/**
+ * Start a bandwidth-delay product sample; called when a PING is sent
+ * @param conn HTTP/2 connection
+ */
+void http2_flow_control_begin_bdp_sample(http2_connection *conn) {
+    if (!conn) return;
+    
+    pthread_mutex_lock(&conn->write_mutex);
+    conn->bdp_bytes = 0;
+    pthread_mutex_unlock(&conn->write_mutex);
+}
+
+/**
+ * Finish a BDP sample when the PING ACK arrives
+ *
+ * The bytes received during one round trip approximate the link's
+ * bandwidth-delay product. When a sample fills more than two thirds of
+ * the current target, the connection window is grown to twice the sample
+ * so the sender is never stalled waiting for WINDOW_UPDATE.
+ * @param conn HTTP/2 connection
+ */
+void http2_flow_control_end_bdp_sample(http2_connection *conn) {
+    if (!conn) return;
+    
+    pthread_mutex_lock(&conn->write_mutex);
+    
+    uint64_t sample = conn->bdp_bytes;
+    conn->bdp_bytes = 0;
+    
+    /* The window is not grown while memory is short */
+    if (sample * 3 > (uint64_t)conn->local_window_target * 2 && !grpc_resource_quota_under_pressure(conn->quota)) {
+        uint64_t target = sample * 2;
+        if (target > HTTP2_MAX_BDP_WINDOW_SIZE) {
+            target = HTTP2_MAX_BDP_WINDOW_SIZE;
+        }
+        if (target > (uint64_t)conn->local_window_target) {
+            conn->local_window_target = (int32_t)target;
+        }
+    }
+    
+    pthread_mutex_unlock(&conn->write_mutex);
+}
+
+/**
+ * Send the connection WINDOW_UPDATE held back under memory pressure once
+ * the quota has room again. Called periodically by the connection owner.
+ * @param conn HTTP/2 connection
+ * @return 0 on success or nothing to do, -1 on send error
+ */
+int http2_flow_control_resume(http2_connection *conn) {
+    if (!conn) return -1;
+    
+    pthread_mutex_lock(&conn->write_mutex);
+    if (!conn->window_update_withheld || grpc_resource_quota_under_pressure(conn->quota)) {
+        pthread_mutex_unlock(&conn->write_mutex);
+        return 0;
+    }
+    
+    conn->window_update_withheld = false;
+    uint32_t increment = 0;
+    if (conn->local_window_size < conn->local_window_target) {
+        increment = (uint32_t)(conn->local_window_target - conn->local_window_size);
+        conn->local_window_size = conn->local_window_target;
+    }
+    pthread_mutex_unlock(&conn->write_mutex);
+    
+    return increment > 0 ? http2_flow_control_send_window_update(conn, 0, increment) : 0;
+}
@@ -5,10 +5,896 @@
 
 #define _POSIX_C_SOURCE 200809L
 #include "grpc/grpc.h"
+#include "grpc/grpc_advanced.h"
 #include "grpc_internal.h"
 #include <stdlib.h>
 #include <string.h>
 
+/* ========================================================================
+ * Connection Migration (GOAWAY)
+ * ======================================================================== */
+
+/* Destroy draining connections whose last call has finished, unless a
+ * warm-up may still be reading one; caller holds channel->mutex */
+static void channel_reap_draining(grpc_channel *channel) {
+    if (channel->prewarming) {
+        return;
+    }
+    
+    size_t i = 0;
+    while (i < channel->draining_count) {
+        if (http2_connection_active_streams(channel->draining[i]) == 0) {
+            http2_connection_destroy(channel->draining[i]);
+            channel->draining[i] = channel->draining[--channel->draining_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+/* Open a connection to a subchannel's address, configured from the channel's arguments */
+static http2_connection *channel_open_connection(grpc_channel *channel, channel_subchannel *sub) {
+    http2_connection *conn = http2_connection_create(sub->address, true, NULL);
+    if (!conn) {
+        return NULL;
+    }
+    http2_connection_set_zerocopy_threshold(conn, channel->zerocopy_threshold);
+    conn->shm_ring_bytes = channel->shm_ring_bytes;
+    if (channel->max_header_list_size > 0) {
+        conn->max_header_list_size = channel->max_header_list_size;
+    }
+    return conn;
+}
+
+/**
+ * Move new calls off a connection that received GOAWAY or was closed. The
+ * old connection keeps serving its in-flight streams until they complete.
+ * Caller holds channel->mutex.
+ */
+static int channel_migrate_connection(grpc_channel *channel, channel_subchannel *sub,
+                                      channel_connection *slot) {
+    if (channel->draining_count >= channel->draining_capacity) {
+        size_t new_capacity = channel->draining_capacity ? channel->draining_capacity * 2 : 2;
+        http2_connection **new_draining = (http2_connection **)realloc(
+            channel->draining, new_capacity * sizeof(http2_connection *));
+        if (!new_draining) {
+            return -1;
+        }
+        channel->draining = new_draining;
+        channel->draining_capacity = new_capacity;
+    }
+    
+    http2_connection *fresh = channel_open_connection(channel, sub);
+    if (!fresh) {
+        return -1;
+    }
+    channel->draining[channel->draining_count++] = slot->conn;
+    slot->conn = fresh;
+    slot->write_locks_mark = 0;
+    slot->write_contended_mark = 0;
+    
+    return 0;
+}
+
+/* ========================================================================
+ * Connection Selection
+ * ======================================================================== */
+
+/* Writes between contention samples of a connection */
+#define CHANNEL_CONTENTION_WINDOW 256
+/* A connection is saturated when one write in this many waited for the lock */
+#define CHANNEL_CONTENTION_RATIO 4
+
+/* Whether writers on a connection keep waiting for each other; samples
+ * the counters once per window. Caller holds channel->mutex. */
+static bool channel_connection_contended(channel_connection *slot) {
+    uint64_t locks;
+    uint64_t contended;
+    http2_connection_write_contention(slot->conn, &locks, &contended);
+    if (locks - slot->write_locks_mark < CHANNEL_CONTENTION_WINDOW) {
+        return false;
+    }
+    
+    bool saturated = (contended - slot->write_contended_mark) * CHANNEL_CONTENTION_RATIO >=
+                     locks - slot->write_locks_mark;
+    slot->write_locks_mark = locks;
+    slot->write_contended_mark = contended;
+    return saturated;
+}
+
+static bool channel_connection_closed(const channel_connection *slot) {
+    return __atomic_load_n(&slot->conn->closed, __ATOMIC_ACQUIRE);
+}
+
+/* Open one more connection on a subchannel; caller holds channel->mutex */
+static channel_connection *channel_add_connection(grpc_channel *channel, channel_subchannel *sub) {
+    if (sub->connection_count >= channel->max_connections) {
+        return NULL;
+    }
+    http2_connection *conn = channel_open_connection(channel, sub);
+    if (!conn) {
+        return NULL;
+    }
+    
+    channel_connection *slot = &sub->connections[sub->connection_count++];
+    slot->conn = conn;
+    slot->write_locks_mark = 0;
+    slot->write_contended_mark = 0;
+    return slot;
+}
+
+/**
+ * Choose a subchannel's connection for a new call: the open one with the
+ * fewest active streams. Another connection is opened, up to
+ * max_connections, when that one is at the peer's MAX_CONCURRENT_STREAMS
+ * or its writers contend. Caller holds channel->mutex.
+ * @param failed Set to true if no connection of the subchannel is open
+ * @return Connection, or NULL if none can take a stream
+ */
+static http2_connection *channel_pick_connection(grpc_channel *channel, channel_subchannel *sub,
+                                                 bool *failed) {
+    channel_connection *best = NULL;
+    size_t best_streams = 0;
+    
+    for (size_t i = 0; i < sub->connection_count; i++) {
+        channel_connection *slot = &sub->connections[i];
+        if (channel_connection_closed(slot)) {
+            continue;
+        }
+        if (http2_connection_is_draining(slot->conn) && channel_migrate_connection(channel, sub, slot) != 0) {
+            continue;
+        }
+        size_t streams = http2_connection_active_streams(slot->conn);
+        if (!best || streams < best_streams) {
+            best = slot;
+            best_streams = streams;
+        }
+    }
+    *failed = best == NULL;
+    if (!best) {
+        return NULL;
+    }
+    
+    uint32_t limit = __atomic_load_n(&best->conn->max_concurrent_streams, __ATOMIC_RELAXED);
+    bool full = best_streams >= limit;
+    if (full || channel_connection_contended(best)) {
+        channel_connection *added = channel_add_connection(channel, sub);
+        if (added) {
+            return added->conn;
+        }
+    }
+    return full ? NULL : best->conn;
+}
+
+/* ========================================================================
+ * Subchannels and Load Balancing
+ * ======================================================================== */
+
+/* Time an unavailable subchannel rests before it is tried again */
+#define CHANNEL_SUBCHANNEL_RETRY_MS 1000
+/* Longest dialable target formatted from a resolved address */
+#define CHANNEL_ADDRESS_MAX 320
+
+/* Report a subchannel's connectivity to the LB policy; caller holds channel->mutex */
+static void channel_set_available(grpc_channel *channel, channel_subchannel *sub, bool available) {
+    if (!available) {
+        sub->retry_at_ms = grpc_monotonic_ms() + CHANNEL_SUBCHANNEL_RETRY_MS;
+    }
+    if (sub->available == available) {
+        return;
+    }
+    sub->available = available;
+    if (available) {
+        channel->unavailable_count--;
+        grpc_lb_policy_mark_available(channel->lb_policy, sub->address);
+    } else {
+        channel->unavailable_count++;
+        grpc_lb_policy_mark_unavailable(channel->lb_policy, sub->address);
+    }
+}
+
+/* Reconnect unavailable subchannels whose rest is over; caller holds channel->mutex */
+static void channel_retry_subchannels(grpc_channel *channel) {
+    if (channel->unavailable_count == 0) {
+        return;
+    }
+    
+    int64_t now = grpc_monotonic_ms();
+    for (size_t i = 0; i < channel->subchannel_count; i++) {
+        channel_subchannel *sub = &channel->subchannels[i];
+        if (sub->available || now < sub->retry_at_ms) {
+            continue;
+        }
+        bool open = false;
+        for (size_t j = 0; j < sub->connection_count; j++) {
+            channel_connection *slot = &sub->connections[j];
+            if (!channel_connection_closed(slot) || channel_migrate_connection(channel, sub, slot) == 0) {
+                open = true;
+            }
+        }
+        channel_set_available(channel, sub, open);
+    }
+}
+
+static channel_subchannel *channel_find_subchannel(grpc_channel *channel, const char *address) {
+    for (size_t i = 0; i < channel->subchannel_count; i++) {
+        if (strcmp(channel->subchannels[i].address, address) == 0) {
+            return &channel->subchannels[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Choose the connection for a new call: the LB policy picks a subchannel,
+ * which picks one of its connections. A subchannel without an open
+ * connection is marked unavailable and the policy picks again.
+ * Caller holds channel->mutex.
+ * @param ready_only Skip subchannels that are still connecting
+ * @return Connection, or NULL if no subchannel can take a stream
+ */
+static http2_connection *channel_pick(grpc_channel *channel, bool ready_only) {
+    channel_retry_subchannels(channel);
+    
+    for (size_t attempt = 0; attempt < channel->subchannel_count; attempt++) {
+        const char *address = grpc_lb_policy_pick(channel->lb_policy);
+        channel_subchannel *sub = address ? channel_find_subchannel(channel, address) : NULL;
+        if (!sub) {
+            break;
+        }
+        if (ready_only && sub->connecting) {
+            continue;
+        }
+        bool failed;
+        http2_connection *conn = channel_pick_connection(channel, sub, &failed);
+        if (conn) {
+            return conn;
+        }
+        if (failed) {
+            channel_set_available(channel, sub, false);
+        }
+    }
+    return NULL;
+}
+
+/* Add a subchannel for one address with its first connections; caller
+ * sized channel->subchannels. Duplicate addresses are ignored. */
+static int channel_add_subchannel(grpc_channel *channel, const char *address, size_t connections) {
+    if (channel_find_subchannel(channel, address)) {
+        return 0;
+    }
+    
+    channel_subchannel *sub = &channel->subchannels[channel->subchannel_count];
+    sub->address = strdup(address);
+    sub->connections = (channel_connection *)calloc(channel->max_connections, sizeof(channel_connection));
+    sub->available = true;
+    if (!sub->address || !sub->connections) {
+        free(sub->address);
+        free(sub->connections);
+        return -1;
+    }
+    channel->subchannel_count++;
+    
+    for (size_t i = 0; i < connections; i++) {
+        if (!channel_add_connection(channel, sub)) {
+            return -1;
+        }
+    }
+    return grpc_lb_policy_add_address(channel->lb_policy, sub->address, 1);
+}
+
+/* Resolver for a target: "ipv4:" lists addresses, "dns:" or no scheme
+ * looks the host up (unix: targets resolve to themselves) */
+static grpc_name_resolver *channel_resolver_create(const char *target) {
+    if (strncmp(target, "ipv4:", 5) == 0) {
+        return grpc_name_resolver_create(GRPC_RESOLVER_STATIC, target + 5);
+    }
+    if (strncmp(target, "dns:", 4) == 0) {
+        target += 4;
+        if (strncmp(target, "//", 2) == 0) {
+            /* dns:///host:port; the DNS server authority is not supported */
+            const char *slash = strchr(target + 2, '/');
+            target = slash ? slash + 1 : "";
+        }
+    }
+    return grpc_name_resolver_create(GRPC_RESOLVER_DNS, target);
+}
+
+/**
+ * Resolve the channel's target and open a subchannel per address the
+ * transport can dial. A target that does not resolve gets one subchannel
+ * for the target itself, as connections are only established on use.
+ * @return 0 on success, -1 on allocation failure
+ */
+static int channel_resolve(grpc_channel *channel, size_t connections) {
+    grpc_name_resolver *resolver = channel_resolver_create(channel->target);
+    if (!resolver) {
+        return -1;
+    }
+    
+    size_t count = 0;
+    if (grpc_name_resolver_resolve(resolver) == 0) {
+        count = grpc_name_resolver_get_address_count(resolver);
+    }
+    channel->subchannels = (channel_subchannel *)calloc(count + 1, sizeof(channel_subchannel));
+    if (!channel->subchannels) {
+        grpc_name_resolver_destroy(resolver);
+        return -1;
+    }
+    
+    int rc = 0;
+    for (grpc_resolved_address *addr = count ? grpc_name_resolver_get_addresses(resolver) : NULL;
+         addr && rc == 0; addr = grpc_resolved_address_next(addr)) {
+        char address[CHANNEL_ADDRESS_MAX];
+        struct sockaddr_storage storage;
+        socklen_t storage_len;
+        if (grpc_resolved_address_to_target(addr, address, sizeof(address)) != 0 ||
+            grpc_address_parse(address, &storage, &storage_len) != 0) {
+            continue;
+        }
+        rc = channel_add_subchannel(channel, address, connections);
+    }
+    grpc_name_resolver_destroy(resolver);
+    
+    if (rc == 0 && channel->subchannel_count == 0) {
+        rc = channel_add_subchannel(channel, channel->target, connections);
+    }
+    return rc;
+}
+
+/* ========================================================================
+ * Wait-for-Ready Calls and Pre-warming
+ * ======================================================================== */
+
+/* Longest wait for each frame of the server while a backend is warmed up */
+#define CHANNEL_PREWARM_TIMEOUT_MS 5000
+
+/* A warm-up of the channel's first subchannels */
+typedef struct {
+    grpc_channel *channel;
+    size_t count;
+    grpc_completion_queue *cq;
+    void *tag;
+} channel_prewarm;
+
+/* Give a call a stream on the connection the channel picks; caller holds channel->mutex */
+static bool channel_attach_stream(grpc_channel *channel, grpc_call *call, bool ready_only) {
+    http2_connection *conn = channel_pick(channel, ready_only);
+    if (!conn) {
+        return false;
+    }
+    
+    uint32_t stream_id = conn->next_stream_id;
+    conn->next_stream_id += 2;
+    http2_stream *stream = http2_stream_create(conn, stream_id);
+    if (!stream) {
+        return false;
+    }
+    stream->call = call;
+    pthread_mutex_lock(&call->mutex);
+    call->stream = stream;
+    pthread_mutex_unlock(&call->mutex);
+    return true;
+}
+
+/* Take a call off the waiting queue and complete the batches it held;
+ * caller holds channel->mutex */
+static void channel_release_waiting(grpc_channel *channel, grpc_call *call, grpc_call *prev, bool success) {
+    if (prev) {
+        prev->next_waiting = call->next_waiting;
+    } else {
+        channel->waiting_head = call->next_waiting;
+    }
+    if (channel->waiting_tail == call) {
+        channel->waiting_tail = prev;
+    }
+    call->next_waiting = NULL;
+    __atomic_store_n(&call->waiting, false, __ATOMIC_RELEASE);
+    
+    for (size_t i = 0; i < call->waiting_tag_count; i++) {
+        grpc_event event;
+        event.type = 1; /* GRPC_OP_COMPLETE */
+        event.success = success;
+        event.tag = call->waiting_tags[i];
+        completion_queue_push_event(call->cq, event);
+    }
+    free(call->waiting_tags);
+    call->waiting_tags = NULL;
+    call->waiting_tag_count = 0;
+}
+
+static void channel_serve_waiting(grpc_channel *channel);
+
+static void channel_on_waiting_retry(void *arg) {
+    grpc_channel *channel = (grpc_channel *)arg;
+    
+    pthread_mutex_lock(&channel->mutex);
+    channel->waiting_retry = false;
+    channel_serve_waiting(channel);
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+/* Pick again for the waiting calls once unavailable subchannels may be
+ * retried; caller holds channel->mutex */
+static void channel_schedule_waiting_retry(grpc_channel *channel) {
+    if (channel->waiting_retry || !channel->waiting_head) {
+        return;
+    }
+    if (!channel->timers) {
+        channel->timers = grpc_timer_queue_create();
+        if (!channel->timers) {
+            return;
+        }
+    }
+    channel->waiting_retry = grpc_timer_queue_schedule(channel->timers, CHANNEL_SUBCHANNEL_RETRY_MS,
+                                                       channel_on_waiting_retry, channel, NULL) == 0;
+}
+
+/* Give waiting calls their streams, oldest first, for as long as the
+ * channel has streams to give; caller holds channel->mutex */
+static void channel_serve_waiting(grpc_channel *channel) {
+    grpc_call *prev = NULL;
+    grpc_call *call = channel->waiting_head;
+    while (call) {
+        grpc_call *next = call->next_waiting;
+        pthread_mutex_lock(&call->mutex);
+        bool cancelled = call->cancelled;
+        pthread_mutex_unlock(&call->mutex);
+        
+        /* channel_fail_waiting_call() takes a cancelled call off the queue */
+        if (cancelled) {
+            prev = call;
+        } else if (channel_attach_stream(channel, call, true)) {
+            channel_release_waiting(channel, call, prev, true);
+        } else {
+            break;
+        }
+        call = next;
+    }
+    channel_schedule_waiting_retry(channel);
+}
+
+/* Queue a wait-for-ready call that could not be given a stream; caller holds channel->mutex */
+static void channel_queue_call(grpc_channel *channel, grpc_call *call) {
+    call->next_waiting = NULL;
+    __atomic_store_n(&call->waiting, true, __ATOMIC_RELEASE);
+    if (channel->waiting_tail) {
+        channel->waiting_tail->next_waiting = call;
+    } else {
+        channel->waiting_head = call;
+    }
+    channel->waiting_tail = call;
+    channel_schedule_waiting_retry(channel);
+}
+
+/* Whether conn is open on a subchannel that is done connecting; caller
+ * holds channel->mutex */
+static bool channel_connection_ready(grpc_channel *channel, http2_connection *conn) {
+    for (size_t i = 0; i < channel->subchannel_count; i++) {
+        channel_subchannel *sub = &channel->subchannels[i];
+        for (size_t j = 0; j < sub->connection_count; j++) {
+            if (sub->connections[j].conn == conn) {
+                return !sub->connecting && !channel_connection_closed(&sub->connections[j]);
+            }
+        }
+    }
+    return false;
+}
+
+/* Apply GRPC_INITIAL_METADATA_WAIT_FOR_READY as a call sends its initial
+ * metadata: a call without a stream, with one on a backend that is still
+ * connecting or has failed, or with calls waiting ahead of it waits for a
+ * ready backend */
+static void channel_wait_for_ready(grpc_call *call) {
+    grpc_channel *channel = call->channel;
+    
+    pthread_mutex_lock(&channel->mutex);
+    pthread_mutex_lock(&call->mutex);
+    http2_stream *stream = call->stream;
+    bool ready = call->cancelled || call->waiting ||
+                 (stream && !channel->waiting_head && channel_connection_ready(channel, stream->conn));
+    if (!ready) {
+        call->stream = NULL;
+    }
+    pthread_mutex_unlock(&call->mutex);
+    pthread_mutex_unlock(&channel->mutex);
+    if (ready) {
+        return;
+    }
+    
+    /* Destroy the unused stream outside of the channel mutex, as grpc_call_destroy does */
+    if (stream) {
+        http2_stream_destroy(stream);
+    }
+    pthread_mutex_lock(&channel->mutex);
+    if (channel->waiting_head || !channel_attach_stream(channel, call, true)) {
+        channel_queue_call(channel, call);
+    }
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+/* Hold a batch of a waiting call until the call has a stream */
+static bool channel_hold_batch(grpc_call *call, void *tag) {
+    grpc_channel *channel = call->channel;
+    if (!channel || !__atomic_load_n(&call->waiting, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    
+    bool held = false;
+    pthread_mutex_lock(&channel->mutex);
+    if (call->waiting) {
+        void **tags = (void **)realloc(call->waiting_tags, (call->waiting_tag_count + 1) * sizeof(void *));
+        if (tags) {
+            tags[call->waiting_tag_count++] = tag;
+            call->waiting_tags = tags;
+            held = true;
+        }
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return held;
+}
+
+/**
+ * Fail a wait-for-ready call that is cancelled before it gets a stream,
+ * along with the batches it held
+ * @param call The call (no locks held)
+ */
+void channel_fail_waiting_call(grpc_call *call) {
+    grpc_channel *channel = call->channel;
+    if (!channel || !__atomic_load_n(&call->waiting, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    
+    pthread_mutex_lock(&channel->mutex);
+    grpc_call *prev = NULL;
+    for (grpc_call *it = channel->waiting_head; it; prev = it, it = it->next_waiting) {
+        if (it == call) {
+            channel_release_waiting(channel, call, prev, false);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+/* Connect the first connections of the warm-up's subchannels, one backend
+ * at a time, so waiting calls can start on the first one that is ready */
+static void *channel_prewarm_thread(void *arg) {
+    channel_prewarm *warm = (channel_prewarm *)arg;
+    grpc_channel *channel = warm->channel;
+    bool all_ready = true;
+    
+    for (size_t i = 0; i < warm->count; i++) {
+        channel_subchannel *sub = &channel->subchannels[i];
+        bool ready = true;
+        
+        /* Only this thread connects the connections; new ones may be added meanwhile */
+        for (size_t j = 0;; j++) {
+            pthread_mutex_lock(&channel->mutex);
+            http2_connection *conn = j < sub->connection_count ? sub->connections[j].conn : NULL;
+            bool idle = conn && conn->socket_fd < 0 && !channel_connection_closed(&sub->connections[j]);
+            pthread_mutex_unlock(&channel->mutex);
+            if (!conn) {
+                break;
+            }
+            if (idle && http2_connection_handshake(conn, sub->address, CHANNEL_PREWARM_TIMEOUT_MS) != 0) {
+                /* Closed, so the subchannel replaces it when it is retried */
+                http2_connection_shutdown(conn);
+                ready = false;
+            }
+        }
+        
+        pthread_mutex_lock(&channel->mutex);
+        sub->connecting = false;
+        channel_set_available(channel, sub, ready);
+        channel_serve_waiting(channel);
+        pthread_mutex_unlock(&channel->mutex);
+        all_ready = all_ready && ready;
+    }
+    
+    pthread_mutex_lock(&channel->mutex);
+    channel->prewarming = false;
+    pthread_mutex_unlock(&channel->mutex);
+    
+    grpc_event event;
+    event.type = 1; /* GRPC_OP_COMPLETE */
+    event.success = all_ready;
+    event.tag = warm->tag;
+    completion_queue_push_event(warm->cq, event);
+    free(warm);
+    return NULL;
+}
+
+int grpc_channel_prewarm(grpc_channel *channel, size_t max_backends, grpc_completion_queue *cq, void *tag) {
+    if (!channel || !cq) {
+        return -1;
+    }
+    
+    if (channel->inproc_server) {
+        grpc_event event;
+        event.type = 1; /* GRPC_OP_COMPLETE */
+        event.success = true;
+        event.tag = tag;
+        completion_queue_push_event(cq, event);
+        return 0;
+    }
+    
+    channel_prewarm *warm = (channel_prewarm *)calloc(1, sizeof(channel_prewarm));
+    if (!warm) {
+        return -1;
+    }
+    warm->channel = channel;
+    warm->cq = cq;
+    warm->tag = tag;
+    
+    pthread_mutex_lock(&channel->mutex);
+    if (channel->prewarming) {
+        pthread_mutex_unlock(&channel->mutex);
+        free(warm);
+        return -1;
+    }
+    /* The last warm-up is past its last use of the lock */
+    if (channel->prewarm_started) {
+        pthread_join(channel->prewarm_thread, NULL);
+        channel->prewarm_started = false;
+    }
+    
+    warm->count = max_backends > 0 && max_backends < channel->subchannel_count ? max_backends
+                                                                              : channel->subchannel_count;
+    for (size_t i = 0; i < warm->count; i++) {
+        channel->subchannels[i].connecting = true;
+    }
+    channel->prewarming = true;
+    if (pthread_create(&channel->prewarm_thread, NULL, channel_prewarm_thread, warm) != 0) {
+        for (size_t i = 0; i < warm->count; i++) {
+            channel->subchannels[i].connecting = false;
+        }
+        channel->prewarming = false;
+        pthread_mutex_unlock(&channel->mutex);
+        free(warm);
+        return -1;
+    }
+    channel->prewarm_started = true;
+    pthread_mutex_unlock(&channel->mutex);
+    return 0;
+}
+
+/* ========================================================================
+ * Method Policies and Retry Budget
+ * ======================================================================== */
+
+#define CHANNEL_MAX_ATTEMPTS 5
+#define CHANNEL_P95_MIN_SAMPLES 20      /* Adaptive delays start once this many calls were timed */
+#define CHANNEL_P95_INTERVAL 32         /* Samples between recomputations of the p95 */
+
+/**
+ * Set up the channel's budget for extra attempts from its arguments; the
+ * bucket starts full
+ */
+void channel_init_retry_budget(grpc_channel *channel, const grpc_channel_args *args) {
+    int percent = grpc_channel_args_get_int(args, GRPC_ARG_RETRY_BUDGET_PERCENT, 10);
+    int max_tokens = grpc_channel_args_get_int(args, GRPC_ARG_RETRY_BUDGET_MAX_TOKENS, 10);
+    channel->retry_token_ratio = percent > 0 ? (int64_t)percent * 10 : 0;
+    channel->retry_max_tokens = max_tokens > 0 ? (int64_t)max_tokens * 1000 : 0;
+    channel->retry_tokens = channel->retry_max_tokens;
+}
+
+/**
+ * Withdraw one token for an extra attempt
+ * @return true if the budget allowed the attempt
+ */
+bool channel_take_retry_token(grpc_channel *channel) {
+    pthread_mutex_lock(&channel->mutex);
+    bool taken = channel->retry_tokens >= 1000;
+    if (taken) {
+        channel->retry_tokens -= 1000;
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return taken;
+}
+
+static int channel_compare_latency(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Record the time a call of the method took to its first response
+ */
+void channel_record_latency(grpc_channel *channel, channel_method_policy *policy, int64_t latency_ms) {
+    if (!policy) {
+        return;
+    }
+    
+    pthread_mutex_lock(&channel->mutex);
+    policy->latency_ms[policy->latency_count % CHANNEL_LATENCY_SAMPLES] = latency_ms;
+    policy->latency_count++;
+    if (policy->latency_count >= CHANNEL_P95_MIN_SAMPLES &&
+        (policy->latency_count == CHANNEL_P95_MIN_SAMPLES || policy->latency_count % CHANNEL_P95_INTERVAL == 0)) {
+        size_t count = policy->latency_count < CHANNEL_LATENCY_SAMPLES ? policy->latency_count
+                                                                       : CHANNEL_LATENCY_SAMPLES;
+        int64_t sorted[CHANNEL_LATENCY_SAMPLES];
+        memcpy(sorted, policy->latency_ms, count * sizeof(int64_t));
+        qsort(sorted, count, sizeof(int64_t), channel_compare_latency);
+        policy->p95_ms = sorted[(count - 1) * 95 / 100];
+    }
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+/* Caller holds channel->mutex */
+static channel_method_policy *channel_find_policy(grpc_channel *channel, const char *method) {
+    for (channel_method_policy *policy = channel->method_policies; policy; policy = policy->next) {
+        if (strcmp(policy->method, method) == 0) {
+            return policy;
+        }
+    }
+    return NULL;
+}
+
+/* Every call pays into the budget; a call to a hedged or retried method
+ * gets the attempt transport, and a call to a batched method the batching
+ * transport. Returns 1 if it did, 0 if the method has no policy. */
+static int channel_attach_policy(grpc_channel *channel, grpc_call *call) {
+    if (!__atomic_load_n(&channel->method_policies, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&channel->mutex);
+    channel->retry_tokens += channel->retry_token_ratio;
+    if (channel->retry_tokens > channel->retry_max_tokens) {
+        channel->retry_tokens = channel->retry_max_tokens;
+    }
+    channel_method_policy *policy = channel_find_policy(channel, call->method);
+    bool hedged = policy && policy->hedged;
+    bool retried = policy && policy->retried;
+    grpc_hedging_policy hedging;
+    grpc_retry_policy retry;
+    int64_t delay_ms = 0;
+    if (hedged) {
+        hedging = policy->hedging;
+        delay_ms = hedging.hedging_delay_ms;
+        if (hedging.adaptive_delay && policy->p95_ms >= 0) {
+            delay_ms = policy->p95_ms;
+        }
+    }
+    if (retried) {
+        retry = policy->retry;
+    }
+    bool batched = policy && policy->batched;
+    pthread_mutex_unlock(&channel->mutex);
+    
+    if (batched) {
+        return micro_batch_call_init(call, policy) == 0 ? 1 : -1;
+    }
+    if (!hedged && !retried) {
+        return 0;
+    }
+    int rc = call_attempts_init(call, policy, hedged ? &hedging : NULL, retried ? &retry : NULL, delay_ms);
+    return rc == 0 ? 1 : -1;
+}
+
+/* Find or add the policy entry of a method and start the channel's timers;
+ * caller holds channel->mutex */
+static channel_method_policy *channel_add_policy(grpc_channel *channel, const char *method) {
+    if (!channel->timers) {
+        channel->timers = grpc_timer_queue_create();
+        if (!channel->timers) {
+            return NULL;
+        }
+    }
+    
+    channel_method_policy *entry = channel_find_policy(channel, method);
+    if (entry) {
+        return entry;
+    }
+    entry = (channel_method_policy *)calloc(1, sizeof(channel_method_policy));
+    if (!entry || !(entry->method = strdup(method))) {
+        free(entry);
+        return NULL;
+    }
+    entry->p95_ms = -1;
+    entry->next = channel->method_policies;
+    __atomic_store_n(&channel->method_policies, entry, __ATOMIC_RELEASE);
+    return entry;
+}
+
+int grpc_channel_set_method_hedging_policy(grpc_channel *channel, const char *method,
+                                           const grpc_hedging_policy *policy) {
+    if (!channel || !method || !channel->inproc_server) {
+        return -1;
+    }
+    if (policy && (policy->max_attempts < 1 || policy->max_attempts > CHANNEL_MAX_ATTEMPTS ||
+                   policy->hedging_delay_ms < 0)) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&channel->mutex);
+    channel_method_policy *entry = policy ? channel_add_policy(channel, method)
+                                          : channel_find_policy(channel, method);
+    if (policy && !entry) {
+        pthread_mutex_unlock(&channel->mutex);
+        return -1;
+    }
+    if (entry) {
+        entry->hedged = policy != NULL;
+        if (policy) {
+            entry->hedging = *policy;
+            entry->retried = false;
+            entry->batched = false;
+        }
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return 0;
+}
+
+int grpc_channel_set_method_retry_policy(grpc_channel *channel, const char *method,
+                                         const grpc_retry_policy *policy) {
+    if (!channel || !method || !channel->inproc_server) {
+        return -1;
+    }
+    if (policy && (policy->max_attempts < 1 || policy->max_attempts > CHANNEL_MAX_ATTEMPTS ||
+                   policy->initial_backoff_ms < 0 || policy->max_backoff_ms < policy->initial_backoff_ms ||
+                   policy->backoff_multiplier < 1.0)) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&channel->mutex);
+    channel_method_policy *entry = policy ? channel_add_policy(channel, method)
+                                          : channel_find_policy(channel, method);
+    if (policy && !entry) {
+        pthread_mutex_unlock(&channel->mutex);
+        return -1;
+    }
+    if (entry) {
+        entry->retried = policy != NULL;
+        if (policy) {
+            entry->retry = *policy;
+            entry->hedged = false;
+            entry->batched = false;
+        }
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return 0;
+}
+
+int grpc_channel_set_method_batching_policy(grpc_channel *channel, const char *method,
+                                            const char *batch_method, const grpc_batching_policy *policy) {
+    if (!channel || !method || !channel->inproc_server) {
+        return -1;
+    }
+    if (policy && (!batch_method || policy->max_calls < 1 || policy->window_ms < 0)) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&channel->mutex);
+    channel_method_policy *entry = policy ? channel_add_policy(channel, method)
+                                          : channel_find_policy(channel, method);
+    if (policy && !entry) {
+        pthread_mutex_unlock(&channel->mutex);
+        return -1;
+    }
+    if (policy && (!entry->batch_method || strcmp(entry->batch_method, batch_method) != 0)) {
+        /* Calls read the batch method under the lock when they join a batch */
+        char *copy = strdup(batch_method);
+        if (!copy) {
+            pthread_mutex_unlock(&channel->mutex);
+            return -1;
+        }
+        free(entry->batch_method);
+        entry->batch_method = copy;
+    }
+    if (entry) {
+        entry->batched = policy != NULL;
+        if (policy) {
+            entry->batching = *policy;
+            entry->hedged = false;
+            entry->retried = false;
+        }
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return 0;
+}
+
 /* ========================================================================
  * Channel Implementation
  * ======================================================================== */
@@ -20,6 +906,16 @@ grpc_channel *grpc_channel_create(const char *target,
         return NULL;
     }
     
+    const char *policy_name = grpc_channel_args_get_string(args, GRPC_ARG_LB_POLICY_NAME, "pick_first");
+    grpc_lb_policy_type policy_type;
+    if (strcmp(policy_name, "pick_first") == 0) {
+        policy_type = GRPC_LB_POLICY_PICK_FIRST;
+    } else if (strcmp(policy_name, "round_robin") == 0) {
+        policy_type = GRPC_LB_POLICY_ROUND_ROBIN;
+    } else {
+        return NULL;
+    }
+    
     grpc_channel *channel = (grpc_channel *)calloc(1, sizeof(grpc_channel));
     if (!channel) {
         return NULL;
@@ -34,12 +930,36 @@ grpc_channel *grpc_channel_create(const char *target,
     channel->creds = creds;
     channel->args = (grpc_channel_args *)args; /* Cast away const for storage */
     pthread_mutex_init(&channel->mutex, NULL);
+    channel_init_retry_budget(channel, args);
     
-    /* Create HTTP/2 connection */
-    channel->connection = http2_connection_create(target, true, NULL);
-    if (!channel->connection) {
-        free(channel->target);
-        free(channel);
+    if (grpc_channel_args_get_int(args, GRPC_ARG_TCP_TX_ZEROCOPY_ENABLED, 0)) {
+        int threshold = grpc_channel_args_get_int(args, GRPC_ARG_TCP_TX_ZEROCOPY_SEND_BYTES_THRESHOLD,
+                                                  GRPC_DEFAULT_ZEROCOPY_THRESHOLD);
+        channel->zerocopy_threshold = threshold > 0 ? (size_t)threshold : 1;
+    }
+    
+    int max_metadata_size = grpc_channel_args_get_int(args, GRPC_ARG_MAX_METADATA_SIZE, 0);
+    if (max_metadata_size > 0) {
+        channel->max_header_list_size = (uint32_t)max_metadata_size;
+    }
+    
+    int shm_ring_bytes = grpc_channel_args_get_int(args, GRPC_ARG_SHM_TRANSPORT_RING_BYTES, 0);
+    if (shm_ring_bytes > 0) {
+        channel->shm_ring_bytes = (size_t)shm_ring_bytes;
+    }
+    
+    int connections = grpc_channel_args_get_int(args, GRPC_ARG_CHANNEL_CONNECTIONS, 1);
+    if (connections < 1) {
+        connections = 1;
+    }
+    int max_connections = grpc_channel_args_get_int(args, GRPC_ARG_CHANNEL_MAX_CONNECTIONS, connections);
+    channel->max_connections = max_connections > connections ? (size_t)max_connections
+                                                             : (size_t)connections;
+    
+    /* Create the subchannels and the HTTP/2 connections opened up front */
+    channel->lb_policy = grpc_lb_policy_create(policy_type);
+    if (!channel->lb_policy || channel_resolve(channel, (size_t)connections) != 0) {
+        grpc_channel_destroy(channel);
         return NULL;
     }
     
@@ -54,10 +974,36 @@ grpc_channel *grpc_insecure_channel_create(const char *target,
 void grpc_channel_destroy(grpc_channel *channel) {
     if (!channel) return;
     
+    /* The warm-up and timer callbacks take channel->mutex */
+    if (channel->prewarm_started) {
+        pthread_join(channel->prewarm_thread, NULL);
+    }
+    grpc_timer_queue_destroy(channel->timers);
+    
     pthread_mutex_lock(&channel->mutex);
     
-    if (channel->connection) {
-        http2_connection_destroy(channel->connection);
+    for (size_t i = 0; i < channel->subchannel_count; i++) {
+        channel_subchannel *sub = &channel->subchannels[i];
+        for (size_t j = 0; j < sub->connection_count; j++) {
+            http2_connection_destroy(sub->connections[j].conn);
+        }
+        free(sub->connections);
+        free(sub->address);
+    }
+    free(channel->subchannels);
+    grpc_lb_policy_destroy(channel->lb_policy);
+    
+    for (size_t i = 0; i < channel->draining_count; i++) {
+        http2_connection_destroy(channel->draining[i]);
+    }
+    free(channel->draining);
+    
+    while (channel->method_policies) {
+        channel_method_policy *policy = channel->method_policies;
+        channel->method_policies = policy->next;
+        free(policy->method);
+        free(policy->batch_method);
+        free(policy);
     }
     
     free(channel->target);
@@ -71,55 +1017,89 @@ void grpc_channel_destroy(grpc_channel *channel) {
  * Call Implementation
  * ======================================================================== */
 
-grpc_call *grpc_channel_create_call(grpc_channel *channel,
-                                     grpc_call *parent_call,
-                                     uint32_t propagation_mask,
-                                     grpc_completion_queue *cq,
-                                     const char *method,
-                                     const char *host,
-                                     grpc_timespec deadline) {
-    if (!channel || !cq || !method) {
-        return NULL;
-    }
-    
-    /* Suppress unused parameter warnings - these are for future implementation */
-    (void)parent_call;
-    (void)propagation_mask;
-    
+/**
+ * Allocate a call shared by the client and server paths
+ * @param channel Owning channel (client calls) or NULL
+ * @param server Owning server (server calls) or NULL
+ * @param cq Completion queue for batches (may be set later for server calls)
+ * @param method Method name
+ * @param host Host name (may be NULL)
+ * @param deadline Call deadline
+ * @return The call, or NULL on allocation failure
+ */
+grpc_call *call_create(grpc_channel *channel, grpc_server *server, grpc_completion_queue *cq,
+                       const char *method, const char *host, grpc_timespec deadline) {
     grpc_call *call = (grpc_call *)calloc(1, sizeof(grpc_call));
     if (!call) {
         return NULL;
     }
     
     call->channel = channel;
+    call->server = server;
     call->cq = cq;
     call->method = strdup(method);
     call->host = host ? strdup(host) : NULL;
+    if (!call->method || (host && !call->host)) {
+        free(call->method);
+        free(call->host);
+        free(call);
+        return NULL;
+    }
     call->deadline = deadline;
     call->status = GRPC_STATUS_OK;
     call->cancelled = false;
+    call->quota = server ? server->resource_quota : NULL;
+    grpc_resource_quota_ref(call->quota);
     pthread_mutex_init(&call->mutex, NULL);
     
-    /* Create HTTP/2 stream */
-    pthread_mutex_lock(&channel->mutex);
-    if (channel->connection) {
-        uint32_t stream_id = channel->connection->next_stream_id;
-        channel->connection->next_stream_id += 2;
-        call->stream = http2_stream_create(channel->connection, stream_id);
-        if (call->stream) {
-            call->stream->call = call;
-        }
+    return call;
+}
+
+/* Arm the deadline of a new client call and link it under its parent */
+static void channel_start_call(grpc_call *call, grpc_call *parent_call, uint32_t propagation_mask) {
+    if (parent_call && (propagation_mask & GRPC_PROPAGATE_CANCELLATION)) {
+        call_link_parent(call, parent_call);
+    }
+    call_start_deadline(call);
+}
+
+grpc_call *grpc_channel_create_call(grpc_channel *channel,
+                                     grpc_call *parent_call,
+                                     uint32_t propagation_mask,
+                                     grpc_completion_queue *cq,
+                                     const char *method,
+                                     const char *host,
+                                     grpc_timespec deadline) {
+    if (!channel || !cq || !method) {
+        return NULL;
     }
-    pthread_mutex_unlock(&channel->mutex);
     
-    if (!call->stream) {
-        free(call->method);
-        free(call->host);
-        pthread_mutex_destroy(&call->mutex);
-        free(call);
+    deadline = call_propagated_deadline(parent_call, propagation_mask, deadline);
+    grpc_call *call = call_create(channel, NULL, cq, method, host, deadline);
+    if (!call) {
         return NULL;
     }
     
+    /* In-process calls bypass the HTTP/2 connection entirely */
+    if (channel->inproc_server) {
+        int attached = channel_attach_policy(channel, call);
+        if (attached < 0 || (attached == 0 && inproc_client_call_init(call, channel->inproc_server) != 0)) {
+            grpc_call_destroy(call);
+            return NULL;
+        }
+        channel_start_call(call, parent_call, propagation_mask);
+        return call;
+    }
+    
+    /* Create HTTP/2 stream; a call no backend can take yet waits for one if
+     * it sends its initial metadata with GRPC_INITIAL_METADATA_WAIT_FOR_READY,
+     * and fails with GRPC_STATUS_UNAVAILABLE otherwise */
+    pthread_mutex_lock(&channel->mutex);
+    channel_reap_draining(channel);
+    channel_attach_stream(channel, call, false);
+    pthread_mutex_unlock(&channel->mutex);
+    
+    channel_start_call(call, parent_call, propagation_mask);
     return call;
 }
 
@@ -131,17 +1111,34 @@ grpc_call_error grpc_call_start_batch(grpc_call *call,
         return GRPC_CALL_ERROR;
     }
     
-    /* Suppress unused parameter warnings - these are for future implementation */
-    (void)ops;
-    (void)nops;
+    if (call->transport) {
+        return call_run_batch(call, (const grpc_op *)ops, nops, tag);
+    }
+    
+    const grpc_op *batch = (const grpc_op *)ops;
+    for (size_t i = 0; call->channel && i < nops; i++) {
+        if (batch[i].op == GRPC_OP_SEND_INITIAL_METADATA &&
+            (batch[i].flags & GRPC_INITIAL_METADATA_WAIT_FOR_READY)) {
+            channel_wait_for_ready(call);
+        }
+    }
+    if (channel_hold_batch(call, tag)) {
+        return GRPC_CALL_OK;
+    }
     
     /* This is a simplified implementation */
     /* In a real implementation, we would process each operation in the batch */
     
-    /* Push completion event */
+    /* Push completion event; a call that never got a stream was not sent */
+    pthread_mutex_lock(&call->mutex);
+    bool sent = !call->channel || call->stream;
+    if (!sent && !call->cancelled) {
+        call->status = GRPC_STATUS_UNAVAILABLE;
+    }
+    pthread_mutex_unlock(&call->mutex);
     grpc_event event;
     event.type = 1; /* GRPC_OP_COMPLETE */
-    event.success = true;
+    event.success = sent;
     event.tag = tag;
     
     completion_queue_push_event(call->cq, event);
@@ -154,17 +1151,65 @@ grpc_call_error grpc_call_cancel(grpc_call *call) {
         return GRPC_CALL_ERROR;
     }
     
+    call_cancel_local(call);
+    return GRPC_CALL_OK;
+}
+
+int grpc_call_get_peer_cred(grpc_call *call, grpc_peer_cred *cred) {
+    if (!call || !cred) {
+        return -1;
+    }
+    
+    /* Peer credentials are fixed once the connection is established */
+    int result = -1;
     pthread_mutex_lock(&call->mutex);
-    call->cancelled = true;
-    call->status = GRPC_STATUS_CANCELLED;
+    http2_connection *conn = call->stream ? call->stream->conn : NULL;
+    if (conn && conn->has_peer_cred) {
+        *cred = conn->peer_cred;
+        result = 0;
+    }
+    grpc_channel *channel = conn ? NULL : call->channel;
     pthread_mutex_unlock(&call->mutex);
     
-    return GRPC_CALL_OK;
+    if (channel) {
+        pthread_mutex_lock(&channel->mutex);
+        for (size_t i = 0; i < channel->subchannel_count && result != 0; i++) {
+            channel_subchannel *sub = &channel->subchannels[i];
+            for (size_t j = 0; j < sub->connection_count && result != 0; j++) {
+                if (sub->connections[j].conn->has_peer_cred) {
+                    *cred = sub->connections[j].conn->peer_cred;
+                    result = 0;
+                }
+            }
+        }
+        pthread_mutex_unlock(&channel->mutex);
+    }
+    
+    return result;
 }
 
 void grpc_call_destroy(grpc_call *call) {
     if (!call) return;
     
+    /* Neither the deadline nor a cancelled parent can reach the call after this */
+    call_stop_deadline(call);
+    call_unlink_parent(call);
+    channel_fail_waiting_call(call);
+    
+    /* Cancels the peer, and the calls propagated from it, if the call has not finished */
+    call_release_transport(call);
+    call_detach_children(call);
+    
+    /* Frees the server's concurrency slot and tenant share */
+    if (call->admission || call->tenant) {
+        grpc_server_release_call(call);
+    }
+    
+    /* Calls waiting for this one's reply are handed out on their own */
+    if (call->coalesced) {
+        grpc_server_finish_flight(call, false, NULL, GRPC_STATUS_OK, NULL);
+    }
+    
     pthread_mutex_lock(&call->mutex);
     
     /* Destroy stream if it exists */
@@ -176,6 +1221,13 @@ void grpc_call_destroy(grpc_call *call) {
         /* Destroy stream outside of call mutex to avoid deadlock */
         http2_stream_destroy(stream);
         
+        /* The stream slot may be what a waiting call needs */
+        if (call->channel && !call->server) {
+            pthread_mutex_lock(&call->channel->mutex);
+            channel_serve_waiting(call->channel);
+            pthread_mutex_unlock(&call->channel->mutex);
+        }
+        
         pthread_mutex_lock(&call->mutex);
     }
     
@@ -191,15 +1243,19 @@ void grpc_call_destroy(grpc_call *call) {
         grpc_byte_buffer_destroy(call->recv_buffer);
     }
     
-    if (call->initial_metadata.metadata) {
-        free(call->initial_metadata.metadata);
+    if (call->cache_request) {
+        grpc_byte_buffer_destroy(call->cache_request);
     }
     
-    if (call->trailing_metadata.metadata) {
-        free(call->trailing_metadata.metadata);
+    if (call->reply) {
+        grpc_byte_buffer_destroy(call->reply);
     }
     
+    grpc_metadata_array_destroy(&call->initial_metadata);
+    grpc_metadata_array_destroy(&call->trailing_metadata);
+    
     pthread_mutex_unlock(&call->mutex);
     pthread_mutex_destroy(&call->mutex);
+    grpc_resource_quota_unref(call->quota);
     free(call);
 }
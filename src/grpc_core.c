@@ -3,6 +3,7 @@
  * @brief Core gRPC library implementation
  */
 
+#define _POSIX_C_SOURCE 200809L
 #include "grpc/grpc.h"
 #include "grpc_internal.h"
 #include <stdio.h>
@@ -36,6 +37,8 @@ void grpc_shutdown(void) {
         g_grpc_initialized = false;
     }
     pthread_mutex_unlock(&g_init_mutex);
+    
+    call_deadline_shutdown();
 }
 
 /* ========================================================================
@@ -58,6 +61,46 @@ grpc_completion_queue *grpc_completion_queue_create(grpc_completion_type type) {
     return cq;
 }
 
+grpc_completion_queue *grpc_completion_queue_create_for_callback(grpc_executor *executor) {
+    if (!executor) {
+        return NULL;
+    }
+    
+    grpc_completion_queue *cq = grpc_completion_queue_create(GRPC_CQ_CALLBACK);
+    if (cq) {
+        cq->executor = executor;
+    }
+    return cq;
+}
+
+static void completion_queue_run_callback(void *arg) {
+    completion_queue_event *ev = (completion_queue_event *)arg;
+    grpc_completion_queue_functor *functor = (grpc_completion_queue_functor *)ev->event.tag;
+    int ok = ev->event.success;
+    free(ev);
+    functor->functor_run(functor, ok);
+}
+
+/* Take the completions a callback queue's executor refused; they run with
+ * ok=0, by the caller and outside of cq->mutex */
+static completion_queue_event *completion_queue_take_refused(grpc_completion_queue *cq) {
+    pthread_mutex_lock(&cq->mutex);
+    completion_queue_event *refused = cq->head;
+    cq->head = NULL;
+    cq->tail = NULL;
+    pthread_mutex_unlock(&cq->mutex);
+    return refused;
+}
+
+static void completion_queue_run_refused(completion_queue_event *ev) {
+    while (ev) {
+        completion_queue_event *next = ev->next;
+        ev->event.success = false;
+        completion_queue_run_callback(ev);
+        ev = next;
+    }
+}
+
 void completion_queue_push_event(grpc_completion_queue *cq, grpc_event event) {
     if (!cq) return;
     
@@ -71,6 +114,13 @@ void completion_queue_push_event(grpc_completion_queue *cq, grpc_event event) {
     ev->event = event;
     ev->next = NULL;
     
+    /* Callback queues hand the tag to the pool instead of queueing it. One
+     * the pool refuses while it shuts down is kept on the queue, never run
+     * inline under the caller's locks, and runs with ok=0 at queue shutdown. */
+    if (cq->executor && grpc_executor_run(cq->executor, completion_queue_run_callback, ev) == 0) {
+        return;
+    }
+    
     pthread_mutex_lock(&cq->mutex);
     if (cq->tail) {
         cq->tail->next = ev;
@@ -134,11 +184,20 @@ void grpc_completion_queue_shutdown(grpc_completion_queue *cq) {
     cq->shutdown = true;
     pthread_cond_broadcast(&cq->cond);
     pthread_mutex_unlock(&cq->mutex);
+    
+    if (cq->executor) {
+        completion_queue_run_refused(completion_queue_take_refused(cq));
+    }
 }
 
 void grpc_completion_queue_destroy(grpc_completion_queue *cq) {
     if (!cq) return;
     
+    /* Completions refused after shutdown still reach their functors */
+    if (cq->executor) {
+        completion_queue_run_refused(completion_queue_take_refused(cq));
+    }
+    
     pthread_mutex_lock(&cq->mutex);
     completion_queue_event *ev = cq->head;
     while (ev) {
@@ -167,6 +226,40 @@ grpc_timespec grpc_now(void) {
     return ts;
 }
 
+int64_t grpc_monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int64_t grpc_monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * FNV-1a with a 64-bit finalizer, so both halves of the result are usable
+ * @param data Bytes to hash
+ * @param len Length of data
+ * @param seed Mixed into the offset basis; 0 for plain FNV-1a
+ * @return 64-bit hash
+ */
+uint64_t grpc_hash_bytes(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = 14695981039346656037ull ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
 grpc_timespec grpc_timeout_milliseconds_to_deadline(int64_t timeout_ms) {
     grpc_timespec now = grpc_now();
     now.tv_sec += timeout_ms / 1000;
@@ -195,16 +288,62 @@ grpc_byte_buffer *grpc_byte_buffer_create(const uint8_t *data, size_t length) {
     memcpy(buffer->data, data, length);
     buffer->length = length;
     buffer->capacity = length;
+    buffer->refcount = 1;
     
     return buffer;
 }
 
+grpc_byte_buffer *grpc_byte_buffer_ref(grpc_byte_buffer *buffer) {
+    if (buffer) {
+        __atomic_fetch_add(&buffer->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return buffer;
+}
+
 void grpc_byte_buffer_destroy(grpc_byte_buffer *buffer) {
     if (!buffer) return;
+    if (__atomic_sub_fetch(&buffer->refcount, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
     free(buffer->data);
     free(buffer);
 }
 
+/* ========================================================================
+ * Channel Arguments
+ * ======================================================================== */
+
+int grpc_channel_args_get_int(const grpc_channel_args *args, const char *key, int default_value) {
+    if (!args || !key) {
+        return default_value;
+    }
+    
+    for (size_t i = 0; i < args->num_args; i++) {
+        if (!args->args[i].is_string && args->args[i].key &&
+            strcmp(args->args[i].key, key) == 0) {
+            return args->args[i].value.integer;
+        }
+    }
+    
+    return default_value;
+}
+
+const char *grpc_channel_args_get_string(const grpc_channel_args *args, const char *key,
+                                         const char *default_value) {
+    if (!args || !key) {
+        return default_value;
+    }
+    
+    for (size_t i = 0; i < args->num_args; i++) {
+        if (args->args[i].is_string && args->args[i].key &&
+            strcmp(args->args[i].key, key) == 0) {
+            return args->args[i].value.string;
+        }
+    }
+    
+    return default_value;
+}
+
 const char *grpc_version_string(void) {
     static char version[32];
     snprintf(version, sizeof(version), "%d.%d.%d",
@@ -11,6 +11,12 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+/* Default payload size at which DATA frames switch to MSG_ZEROCOPY */
+#define GRPC_DEFAULT_ZEROCOPY_THRESHOLD 16384
+
+/* How long either side waits for the other during the shared-memory handshake */
+#define GRPC_SHM_HANDSHAKE_TIMEOUT_MS 1000
+
 /* HTTP/2 frame types */
 typedef enum {
     HTTP2_FRAME_DATA = 0x00,
@@ -35,6 +41,22 @@ typedef enum {
     HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE = 0x06
 } http2_settings_id;
 
+/* HTTP/2 error codes (RFC 7540 Section 7) */
+typedef enum {
+    HTTP2_NO_ERROR = 0x00,
+    HTTP2_PROTOCOL_ERROR = 0x01,
+    HTTP2_INTERNAL_ERROR = 0x02,
+    HTTP2_FLOW_CONTROL_ERROR = 0x03,
+    HTTP2_SETTINGS_TIMEOUT = 0x04,
+    HTTP2_STREAM_CLOSED = 0x05,
+    HTTP2_FRAME_SIZE_ERROR = 0x06,
+    HTTP2_REFUSED_STREAM = 0x07,
+    HTTP2_CANCEL = 0x08,
+    HTTP2_COMPRESSION_ERROR = 0x09,
+    HTTP2_CONNECT_ERROR = 0x0a,
+    HTTP2_ENHANCE_YOUR_CALM = 0x0b
+} http2_error_code;
+
 /* HTTP/2 frame header */
 typedef struct {
     uint32_t length;
@@ -43,14 +65,39 @@ typedef struct {
     uint32_t stream_id;
 } http2_frame_header;
 
+/* Buffer pinned by an in-flight MSG_ZEROCOPY send */
+typedef struct http2_zerocopy_pending {
+    grpc_byte_buffer *buffer;
+    uint32_t seq_lo;
+    uint32_t seq_hi;
+    uint32_t outstanding;
+    struct http2_zerocopy_pending *next;
+} http2_zerocopy_pending;
+
 /* HTTP/2 connection */
-typedef struct {
+/* Shared-memory ring pair replacing socket I/O for a co-located peer */
+typedef struct shm_transport shm_transport;
+
+/* Joins a server grpc_call to the HTTP/2 stream carrying it */
+typedef struct http2_call_link http2_call_link;
+
+struct http2_connection;
+struct http2_stream;
+
+/* Called on the reading thread for each stream the peer opens */
+typedef void (*http2_accept_stream_cb)(struct http2_connection *conn, struct http2_stream *stream,
+                                       void *user_data);
+
+typedef struct http2_connection {
     int socket_fd;
+    bool closed;                     /* http2_connection_shutdown() was called */
     void *ssl_ctx;
     void *ssl;
     bool is_client;
     uint32_t next_stream_id;
     pthread_mutex_t write_mutex;
+    uint64_t write_locks;            /* Frame writes (atomic) */
+    uint64_t write_contended;        /* Frame writes that waited for write_mutex (atomic) */
     pthread_mutex_t streams_mutex;
     struct http2_stream **streams;
     size_t streams_count;
@@ -58,9 +105,62 @@ typedef struct {
     /* Flow control */
     int32_t local_window_size;
     int32_t remote_window_size;
+    pthread_cond_t send_window_cond; /* Signalled when the peer opens a window */
     /* Settings */
     uint32_t max_frame_size;
-    uint32_t max_concurrent_streams;
+    uint32_t max_concurrent_streams; /* Peer's limit on our streams (atomic) */
+    /* Zero-copy send (guarded by write_mutex) */
+    size_t zerocopy_threshold;      /* 0 disables MSG_ZEROCOPY */
+    int zerocopy_state;             /* 0 unprobed, 1 enabled, -1 unsupported */
+    uint32_t zerocopy_next_seq;
+    http2_zerocopy_pending *zerocopy_pending;
+    http2_zerocopy_pending *zerocopy_pending_tail;
+    uint32_t zerocopy_inflight;     /* Pinned buffers (atomic); the reader reaps while nonzero */
+    /* GOAWAY state */
+    bool goaway_sent;
+    bool goaway_received;
+    uint32_t goaway_last_stream_id;  /* Last stream the peer will process */
+    uint32_t goaway_sent_last_id;    /* Last stream we announced; newer peer streams are refused */
+    uint32_t last_peer_stream_id;    /* Highest stream opened by the peer */
+    bool drain_ping_outstanding;     /* First drain GOAWAY sent, waiting for its PING ACK */
+    bool drain_finished;             /* Final GOAWAY sent */
+    /* Client side: frames after the handshake are read by this thread */
+    pthread_t reader;
+    bool reader_started;
+    /* Keepalive PING and RTT estimate (guarded by streams_mutex) */
+    bool ping_outstanding;
+    uint8_t ping_payload[8];
+    uint64_t ping_counter;
+    int64_t ping_sent_us;
+    int64_t rtt_smoothed_us;
+    int64_t rtt_min_us;
+    uint32_t rtt_samples;
+    /* BDP-sized connection receive window (guarded by write_mutex) */
+    int32_t local_window_target;
+    uint32_t bdp_bytes;              /* DATA bytes received since the last PING */
+    /* SO_PEERCRED of a unix: peer, set once when the socket is connected */
+    bool has_peer_cred;
+    grpc_peer_cred peer_cred;
+    /* Header list limits (peer limit guarded by write_mutex) */
+    uint32_t max_header_list_size;       /* Our SETTINGS_MAX_HEADER_LIST_SIZE */
+    uint32_t peer_max_header_list_size;
+    /* HEADERS + CONTINUATION reassembly (reading thread only) */
+    uint32_t header_block_stream_id;     /* 0 when no block is open */
+    uint8_t header_block_flags;          /* Flags of the opening HEADERS frame */
+    bool header_block_oversized;         /* Over the limit, fragments are dropped */
+    uint8_t *header_block;
+    size_t header_block_len;
+    size_t header_block_capacity;
+    size_t header_block_received;        /* Including dropped fragments */
+    /* Quota charged for buffered receive data; NULL charges the global quota */
+    grpc_resource_quota *quota;
+    bool window_update_withheld;         /* Refill skipped under memory pressure */
+    /* Shared-memory rings; frames bypass the socket once set */
+    size_t shm_ring_bytes;           /* Requested ring size, 0 keeps frames on the socket */
+    shm_transport *shm;
+    /* Server side: new peer streams are handed to accept_stream */
+    http2_accept_stream_cb accept_stream;
+    void *accept_stream_data;
 } http2_connection;
 
 /* HTTP/2 stream */
@@ -68,9 +168,12 @@ typedef struct http2_stream {
     uint32_t id;
     http2_connection *conn;
     grpc_call *call;
+    http2_call_link *link;  /* Server call attached to the stream, if any */
     bool headers_sent;
+    bool headers_received;  /* Next header block carries trailers */
     bool end_stream_sent;
     bool end_stream_received;
+    bool refused;  /* Never processed by the peer (GOAWAY), safe to retry */
     grpc_metadata_array initial_metadata;
     grpc_metadata_array trailing_metadata;
     grpc_byte_buffer *recv_buffer;
@@ -91,20 +194,117 @@ struct grpc_completion_queue {
     grpc_completion_type type;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
-    completion_queue_event *head;
+    completion_queue_event *head;  /* GRPC_CQ_CALLBACK: completions the executor refused */
     completion_queue_event *tail;
     bool shutdown;
+    grpc_executor *executor;   /* GRPC_CQ_CALLBACK: runs functor tags */
 };
 
+/* One of a subchannel's connections to its address */
+typedef struct channel_connection {
+    http2_connection *conn;
+    uint64_t write_locks_mark;      /* Write lock counters when contention was last sampled */
+    uint64_t write_contended_mark;
+} channel_connection;
+
+/* Connections to one resolved address of a channel's target */
+typedef struct channel_subchannel {
+    char *address;                  /* Target the connections dial, as known to the LB policy */
+    /* Calls go to the open connection with the fewest active streams */
+    channel_connection *connections;
+    size_t connection_count;
+    bool available;                 /* Connectivity last reported to the LB policy */
+    bool connecting;                /* Being connected by grpc_channel_prewarm */
+    int64_t retry_at_ms;            /* When an unavailable subchannel is tried again */
+} channel_subchannel;
+
+/* Recent latencies kept per method for its p95 */
+#define CHANNEL_LATENCY_SAMPLES 128
+
+/* Per-method call policy of a channel (guarded by channel->mutex) */
+typedef struct channel_method_policy {
+    char *method;
+    bool hedged;
+    grpc_hedging_policy hedging;
+    bool retried;
+    grpc_retry_policy retry;
+    bool batched;
+    grpc_batching_policy batching;
+    char *batch_method;             /* Kept when batching stops, for calls still joining */
+    struct micro_batch *open_batch; /* Batch still taking calls, NULL if none */
+    /* Time to first response of recent calls, for adaptive hedging delays */
+    int64_t latency_ms[CHANNEL_LATENCY_SAMPLES];
+    size_t latency_count;           /* Samples recorded so far */
+    int64_t p95_ms;                 /* -1 until enough samples were recorded */
+    struct channel_method_policy *next;
+} channel_method_policy;
+
+typedef struct grpc_timer_queue grpc_timer_queue;
+typedef void (*grpc_timer_fn)(void *arg);
+
 /* Channel implementation */
 struct grpc_channel {
     char *target;
-    http2_connection *connection;
+    /* Resolved addresses, one subchannel each, picked per call by lb_policy */
+    struct grpc_lb_policy *lb_policy;
+    channel_subchannel *subchannels;
+    size_t subchannel_count;
+    size_t unavailable_count;
+    size_t max_connections;         /* Per subchannel; growth stops here */
+    /* Template for connections opened after creation */
+    size_t zerocopy_threshold;
+    size_t shm_ring_bytes;
+    uint32_t max_header_list_size;  /* 0 keeps the HTTP/2 default */
+    /* Connections that received GOAWAY and still carry in-flight calls */
+    http2_connection **draining;
+    size_t draining_count;
+    size_t draining_capacity;
     grpc_channel_credentials *creds;
     grpc_channel_args *args;
+    grpc_server *inproc_server;  /* Set for in-process channels (no connection) */
+    channel_method_policy *method_policies;
+    grpc_timer_queue *timers;       /* Started with the first method policy or waiting call */
+    /* Token bucket for extra attempts, in thousandths of a token */
+    int64_t retry_tokens;
+    int64_t retry_token_ratio;      /* Deposited by each call */
+    int64_t retry_max_tokens;
+    /* Wait-for-ready calls without a stream yet, oldest first */
+    grpc_call *waiting_head;
+    grpc_call *waiting_tail;
+    bool waiting_retry;             /* A timer will pick again for the waiting calls */
+    /* Connection warm-up; draining connections are kept while it runs */
+    pthread_t prewarm_thread;
+    bool prewarm_started;           /* prewarm_thread is to be joined */
+    bool prewarming;
     pthread_mutex_t mutex;
 };
 
+/* Moves batch operations of a call to its peer (e.g. the in-process transport) */
+typedef struct grpc_call_transport {
+    int (*send_initial_metadata)(grpc_call *call, const grpc_metadata *metadata, size_t count);
+    int (*send_message)(grpc_call *call, grpc_byte_buffer *message);
+    int (*send_close)(grpc_call *call);
+    int (*send_status)(grpc_call *call, grpc_status_code status, const char *details,
+                       const grpc_metadata *trailing_metadata, size_t trailing_count);
+    void (*cancel)(grpc_call *call);
+    void (*destroy)(grpc_call *call);
+} grpc_call_transport;
+
+/* Received message waiting for GRPC_OP_RECV_MESSAGE */
+typedef struct call_message {
+    grpc_byte_buffer *buffer;
+    size_t charged;  /* Bytes charged to the call's quota */
+    struct call_message *next;
+} call_message;
+
+/* Batch in progress; completes when pending drops to zero */
+typedef struct call_batch {
+    grpc_completion_queue *cq;
+    void *tag;
+    int pending;
+    bool success;
+} call_batch;
+
 /* Call implementation */
 struct grpc_call {
     grpc_channel *channel;
@@ -121,16 +321,167 @@ struct grpc_call {
     grpc_status_code status;
     char *status_details;
     bool cancelled;
+    /* Batch engine, used when the call has a transport (guarded by mutex) */
+    const grpc_call_transport *transport;
+    void *transport_data;
+    bool initial_metadata_sent;
+    bool close_sent;
+    bool status_sent;
+    bool initial_metadata_received;   /* Stored in initial_metadata */
+    bool half_close_received;
+    bool status_received;             /* Client: status/trailing_metadata are final */
+    call_message *recv_head;
+    call_message *recv_tail;
+    grpc_resource_quota *quota;       /* Charged for queued messages; NULL is global */
+    call_batch *recv_initial_metadata_batch;
+    grpc_metadata_array *recv_initial_metadata_dest;
+    call_batch *recv_message_batch;
+    grpc_byte_buffer **recv_message_dest;
+    call_batch *recv_status_batch;
+    grpc_metadata_array *recv_trailing_metadata_dest;
+    grpc_status_code *recv_status_dest;
+    char **recv_status_details_dest;
+    int *recv_cancelled_dest;
+    struct grpc_method_descriptor *method_descriptor;  /* Server: resolved from :path */
+    struct server_admission *admission;  /* Server: concurrency slot held, NULL if none */
+    int64_t admitted_us;
+    bool admission_queued;            /* Admitted but not yet picked up by the application */
+    struct server_tenant *tenant;     /* Server: tenant charged for the call, NULL if none */
+    struct server_registered_method *registered_method;  /* Server: set for held calls */
+    struct grpc_response_cache *cache;  /* Server: cache of the call's method, NULL if none */
+    bool cache_checked;               /* The complete request was served or published */
+    bool coalesced;                   /* Server: identical calls may wait for this one's reply */
+    struct server_flight *flight;     /* Calls waiting for this one (guarded by server->mutex) */
+    grpc_byte_buffer *cache_request;  /* Missed request, kept to store the response under */
+    grpc_byte_buffer *reply;          /* Message sent, kept for the cache and waiting calls */
+    bool reply_repeated;              /* More than one message was sent */
+    struct call_attempts *attempt_of; /* Client: set on each attempt of a hedged or retried call */
+    struct micro_batch *batch_of;     /* Client: set on the call carrying a micro-batch */
+    struct call_deadline *deadline_timer;  /* Expires the call, NULL if not armed */
+    grpc_call *parent;                /* Cancels this call along with itself (propagation lock) */
+    grpc_call *first_child;           /* Calls created with this one as parent (propagation lock) */
+    grpc_call *prev_sibling;
+    grpc_call *next_sibling;
+    int propagation_pins;             /* Cascades cancelling this call right now (propagation lock) */
+    /* Client: queued by its channel until a subchannel is ready (channel->mutex) */
+    bool waiting;
+    grpc_call *next_waiting;
+    void **waiting_tags;              /* Batches started while waiting */
+    size_t waiting_tag_count;
     pthread_mutex_t mutex;
 };
 
 /* Server implementation */
 typedef struct {
     int socket_fd;
-    struct sockaddr_in addr;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    char *unix_path;  /* Filesystem socket to unlink on destroy, NULL otherwise */
     grpc_server_credentials *creds;
 } server_port;
 
+/* Call that arrived before a matching request */
+typedef struct server_pending_call {
+    grpc_call *call;
+    struct server_pending_call *next;
+} server_pending_call;
+
+/* Calls waiting for the reply to an identical request (guarded by server->mutex) */
+typedef struct server_flight {
+    grpc_byte_buffer *request;
+    uint64_t hash;                /* grpc_hash_bytes() of the request */
+    grpc_call *leader;            /* The call the application answers */
+    server_pending_call *waiters;
+    struct server_flight *next;   /* Same bucket */
+} server_flight;
+
+/* Outstanding grpc_server_request_call or _request_registered_call */
+typedef struct server_call_request {
+    grpc_call **call;
+    grpc_call_details *details;   /* Unregistered requests */
+    grpc_timespec *deadline;      /* Registered requests */
+    grpc_completion_queue *cq;
+    void *tag;
+    struct server_call_request *next;
+} server_call_request;
+
+/* Tenant sharing the server (guarded by server->mutex) */
+typedef struct server_tenant {
+    char *name;                   /* Value of the server's tenant metadata key */
+    int weight;                   /* Calls served per round-robin turn */
+    size_t inflight;              /* Calls taken by the application, not yet destroyed */
+    struct server_tenant *next;
+} server_tenant;
+
+/* One tenant's waiting calls in a queue */
+typedef struct server_tenant_lane {
+    server_tenant *tenant;
+    server_pending_call *pending;
+    server_pending_call *pending_tail;
+    int deficit;                  /* Calls the lane may still take this turn */
+    struct server_tenant_lane *next;
+} server_tenant_lane;
+
+/* Incoming calls and requests awaiting a match. Without tenants at most one
+ * list is non-empty; with tenants, waiting calls sit in per-tenant lanes
+ * and requests may wait while every tenant with calls is at its bound. */
+typedef struct server_call_queue {
+    server_pending_call *pending_calls;
+    server_pending_call *pending_calls_tail;
+    server_call_request *call_requests;
+    server_call_request *call_requests_tail;
+    server_tenant_lane *lanes;
+    size_t lane_count;
+    server_tenant_lane *cursor;   /* Lane whose turn it is */
+} server_call_queue;
+
+/* Adaptive concurrency limit of one method (guarded by server->mutex).
+ * The limit shrinks when even the least-delayed call of an interval sat in
+ * the queue longer than the target, and grows while calls are flowing. */
+typedef struct server_admission {
+    double limit;
+    size_t inflight;              /* Admitted calls not yet destroyed */
+    size_t queued;                /* Admitted calls the application has not picked up */
+    size_t peak_inflight;         /* Highest inflight in this interval */
+    int64_t interval_start_us;
+    int64_t min_delay_us;         /* Lowest queueing delay in this interval, -1 if none */
+    char *metric;                 /* Gauge exporting the limit, NULL if none */
+} server_admission;
+
+/* Minimal perfect hash from :path to method (method_router.c) */
+typedef struct grpc_method_router grpc_method_router;
+
+/* Method registered with grpc_server_register_method, or known only from
+ * the server's reflection registry (implicit) */
+typedef struct server_registered_method {
+    char *method;
+    char *host;                   /* NULL matches any :authority */
+    server_call_queue queue;
+    server_admission admission;
+    struct grpc_method_descriptor *descriptor;     /* From the reflection registry, or NULL */
+    bool implicit;                /* Calls go to grpc_server_request_call() */
+    struct grpc_response_cache *cache;  /* NULL unless responses are cached */
+    bool coalesce;                /* Identical concurrent requests share one reply */
+    server_flight **flights;      /* Requests with the application, by request hash */
+    size_t flight_mask;           /* Buckets - 1, once flights is allocated */
+    size_t flight_count;
+    struct server_registered_method *next_host;    /* Same :path, other host; wildcard last */
+    struct server_registered_method *next;
+} server_registered_method;
+
+/* Accepted connection tracked for GOAWAY drain and age/idle policies */
+typedef struct server_connection {
+    http2_connection *conn;
+    int64_t created_ms;
+    int64_t last_active_ms;
+    int64_t age_deadline_ms;    /* GOAWAY is sent at this point (jittered) */
+    int64_t close_deadline_ms;  /* Hard close once GOAWAY was sent */
+    int64_t drain_ping_deadline_ms; /* Final GOAWAY without the drain PING ACK */
+    pthread_t reader;           /* Reads and dispatches frames */
+    bool reader_done;           /* The peer closed or broke the connection */
+    struct server_connection *next;
+} server_connection;
+
 struct grpc_server {
     grpc_channel_args *args;
     server_port *ports;
@@ -143,6 +494,48 @@ struct grpc_server {
     bool shutdown_called;
     pthread_t *worker_threads;
     size_t worker_count;
+    /* Live connections and connection management policy */
+    server_connection *connections;
+    size_t connection_count;
+    int max_connection_age_ms;
+    int max_connection_age_grace_ms;
+    int max_connection_idle_ms;
+    int shutdown_grace_ms;
+    int listen_backlog;
+    /* Thread placement: CPUs for server threads (none if cpu_count is 0),
+     * and the topology used to keep connections on their NIC's node */
+    int *cpus;
+    size_t cpu_count;
+    struct grpc_cpu_topology *topology;
+    /* Calls for unregistered methods (only used while none are registered)
+     * and for reflection registry methods nobody registered */
+    server_call_queue unregistered;
+    server_admission unregistered_admission;
+    /* Admission control (concurrency_limit 0 disables it) */
+    int concurrency_limit;
+    int max_concurrency_limit;
+    int queue_delay_target_ms;
+    int queue_delay_interval_ms;
+    struct grpc_metrics_registry *metrics;
+    /* Fair scheduling across tenants (tenant_key NULL disables it) */
+    char *tenant_key;
+    int tenant_max_inflight;      /* 0 leaves tenants unbounded */
+    server_tenant *tenants;
+    size_t tenant_count;
+    /* Response caching and coalescing: calls to such methods wait in
+     * cache_held until their request is complete, then are served on
+     * cache_executor */
+    size_t hold_count;            /* Methods with a cache or coalescing (atomic) */
+    server_pending_call *cache_held;
+    grpc_executor *cache_executor;
+    /* Registered methods and the :path router built from them at start */
+    server_registered_method *registered_methods;
+    struct grpc_reflection_registry *reflection_registry;
+    grpc_method_router *method_router;
+    /* Local peer authentication for unix: ports */
+    grpc_peer_cred_filter peer_cred_filter;
+    void *peer_cred_filter_data;
+    grpc_resource_quota *resource_quota;  /* NULL charges the global quota */
     pthread_mutex_t mutex;
 };
 
@@ -160,15 +553,133 @@ struct grpc_server_credentials {
 
 /* Internal functions */
 http2_connection *http2_connection_create(const char *target, bool is_client, void *ssl_ctx);
+int http2_connection_connect(http2_connection *conn, const char *target);
 void http2_connection_destroy(http2_connection *conn);
 int http2_connection_send_frame(http2_connection *conn, const http2_frame_header *header, const uint8_t *payload);
 int http2_connection_recv_frame(http2_connection *conn, http2_frame_header *header, uint8_t **payload);
+void http2_connection_set_zerocopy_threshold(http2_connection *conn, size_t threshold);
+int http2_connection_send_data(http2_connection *conn, const http2_frame_header *header, const uint8_t *prefix,
+                               size_t prefix_len, grpc_byte_buffer *buffer, size_t offset);
+int http2_connection_reap_zerocopy(http2_connection *conn);
+int http2_connection_process_frame(http2_connection *conn, const http2_frame_header *header,
+                                   const uint8_t *payload);
+int http2_connection_send_goaway(http2_connection *conn, uint32_t last_stream_id, uint32_t error_code);
+int http2_connection_start_drain(http2_connection *conn);
+int http2_connection_finish_drain(http2_connection *conn);
+bool http2_connection_drain_finished(http2_connection *conn);
+int http2_connection_start_reader(http2_connection *conn);
+bool http2_connection_is_draining(http2_connection *conn);
+size_t http2_connection_active_streams(http2_connection *conn);
+void http2_connection_write_contention(http2_connection *conn, uint64_t *locks, uint64_t *contended);
+int http2_connection_send_ping(http2_connection *conn);
+bool http2_connection_ping_expired(http2_connection *conn, int timeout_ms);
+int http2_connection_get_rtt(http2_connection *conn, int64_t *smoothed_rtt_us, int64_t *min_rtt_us);
+bool http2_connection_read_allowed(http2_connection *conn);
+int http2_connection_send_settings(http2_connection *conn);
+int http2_connection_send_rst_stream(http2_connection *conn, uint32_t stream_id, uint32_t error_code);
+int http2_connection_send_headers(http2_connection *conn, uint32_t stream_id,
+                                  const grpc_metadata_array *metadata, bool end_stream);
+int http2_connection_send_preface(http2_connection *conn);
+int http2_connection_handshake(http2_connection *conn, const char *target, int timeout_ms);
+int http2_connection_recv_preface(http2_connection *conn);
+void http2_connection_shutdown(http2_connection *conn);
 
 http2_stream *http2_stream_create(http2_connection *conn, uint32_t stream_id);
 void http2_stream_destroy(http2_stream *stream);
 
 void completion_queue_push_event(grpc_completion_queue *cq, grpc_event event);
 
+/* Calls and the batch engine */
+grpc_call *call_create(grpc_channel *channel, grpc_server *server, grpc_completion_queue *cq,
+                       const char *method, const char *host, grpc_timespec deadline);
+grpc_call_error call_run_batch(grpc_call *call, const grpc_op *ops, size_t nops, void *tag);
+void call_deliver_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count);
+void call_deliver_message(grpc_call *call, grpc_byte_buffer *message);
+void call_deliver_half_close(grpc_call *call);
+void call_deliver_status(grpc_call *call, grpc_status_code status, const char *details,
+                         const grpc_metadata *trailing_metadata, size_t trailing_count);
+void call_deliver_cancel(grpc_call *call);
+void call_deliver_refused(grpc_call *call, grpc_status_code status, const char *details);
+void call_cancel_local(grpc_call *call);
+void call_cancel_with_status(grpc_call *call, grpc_status_code status, const char *details);
+void call_release_transport(grpc_call *call);
+void channel_fail_waiting_call(grpc_call *call);
+grpc_status_code grpc_server_publish_call(grpc_server *server, grpc_call *call);
+void grpc_server_continue_call(grpc_server *server, grpc_call *call);
+void grpc_server_finish_flight(grpc_call *call, bool shared, grpc_byte_buffer *message,
+                               grpc_status_code status, const char *details);
+void grpc_server_release_call(grpc_call *call);
+
+/* Server calls over HTTP/2 */
+void http2_call_accept_stream(http2_connection *conn, http2_stream *stream, void *server);
+void http2_call_deliver_data(http2_call_link *link, const uint8_t *data, size_t len, bool end_stream);
+void http2_call_deliver_reset(http2_call_link *link);
+void http2_call_link_ref(http2_call_link *link);
+void http2_call_link_unref(http2_call_link *link);
+void http2_call_close_connection(http2_connection *conn);
+int http2_call_format_timeout(int64_t timeout_ms, char *buf, size_t size);
+
+/* In-process transport */
+int inproc_client_call_init(grpc_call *call, grpc_server *server);
+
+/* Hedged and retried calls (call_attempts.c) */
+int call_attempts_init(grpc_call *call, channel_method_policy *policy, const grpc_hedging_policy *hedging,
+                       const grpc_retry_policy *retry, int64_t delay_ms);
+void call_attempts_deliver_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count);
+void call_attempts_deliver_message(grpc_call *call, grpc_byte_buffer *message);
+void call_attempts_deliver_half_close(grpc_call *call);
+void call_attempts_deliver_status(grpc_call *call, grpc_status_code status, const char *details,
+                                  const grpc_metadata *trailing_metadata, size_t trailing_count, bool refused);
+void call_attempts_deliver_cancel(grpc_call *call);
+
+/* Deadlines and cancellation between calls (call_propagation.c) */
+grpc_timespec call_propagated_deadline(grpc_call *parent, uint32_t propagation_mask, grpc_timespec deadline);
+void call_link_parent(grpc_call *call, grpc_call *parent);
+void call_unlink_parent(grpc_call *call);
+void call_detach_children(grpc_call *call);
+void call_propagate_cancel(grpc_call *call, grpc_status_code status);
+int64_t call_deadline_remaining_ms(grpc_timespec deadline);
+void call_start_deadline(grpc_call *call);
+void call_stop_deadline(grpc_call *call);
+void call_deadline_shutdown(void);
+
+/* Micro-batched unary calls (micro_batch.c) */
+int micro_batch_call_init(grpc_call *call, channel_method_policy *policy);
+void micro_batch_deliver_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count);
+void micro_batch_deliver_message(grpc_call *call, grpc_byte_buffer *message);
+void micro_batch_deliver_status(grpc_call *call, grpc_status_code status, const char *details);
+void micro_batch_deliver_cancel(grpc_call *call);
+
+/* Channel method policies and retry budget */
+void channel_init_retry_budget(grpc_channel *channel, const grpc_channel_args *args);
+bool channel_take_retry_token(grpc_channel *channel);
+void channel_record_latency(grpc_channel *channel, channel_method_policy *policy, int64_t latency_ms);
+
+/* Timers (timer_queue.c) */
+grpc_timer_queue *grpc_timer_queue_create(void);
+int grpc_timer_queue_schedule(grpc_timer_queue *queue, int64_t delay_ms, grpc_timer_fn fn, void *arg,
+                              uint64_t *id);
+bool grpc_timer_queue_cancel(grpc_timer_queue *queue, uint64_t id);
+void grpc_timer_queue_destroy(grpc_timer_queue *queue);
+int grpc_channel_args_get_int(const grpc_channel_args *args, const char *key, int default_value);
+const char *grpc_channel_args_get_string(const grpc_channel_args *args, const char *key,
+                                         const char *default_value);
+int64_t grpc_monotonic_ms(void);
+int64_t grpc_monotonic_us(void);
+uint64_t grpc_hash_bytes(const void *data, size_t len, uint64_t seed);
+
+/* Socket addresses */
+bool grpc_address_is_unix(const char *target);
+int grpc_address_parse(const char *target, struct sockaddr_storage *addr, socklen_t *addr_len);
+int grpc_socket_get_peer_cred(int fd, grpc_peer_cred *cred);
+
+/* Shared-memory ring transport */
+shm_transport *shm_transport_connect(int socket_fd, size_t ring_bytes);
+int shm_transport_accept(int socket_fd, int timeout_ms, shm_transport **out);
+int shm_transport_write(shm_transport *shm, const uint8_t *data, size_t len);
+int shm_transport_read(shm_transport *shm, uint8_t *data, size_t len);
+void shm_transport_destroy(shm_transport *shm);
+
 /* HPACK header compression */
 int hpack_encode_integer(uint32_t value, uint8_t prefix_bits, uint8_t *output, size_t output_len);
 int hpack_decode_integer(const uint8_t *input, size_t input_len, uint8_t prefix_bits, uint32_t *value);
@@ -176,6 +687,9 @@ int hpack_encode_literal_header(const char *name, const char *value, uint8_t *ou
 int hpack_decode_literal_header(const uint8_t *input, size_t input_len, char **key, char **value);
 int hpack_encode_metadata(const grpc_metadata_array *metadata, uint8_t *output, size_t output_len);
 int hpack_decode_metadata(const uint8_t *input, size_t input_len, grpc_metadata_array *metadata);
+int hpack_encode_metadata_alloc(const grpc_metadata_array *metadata, uint8_t **output, size_t *output_len);
+size_t hpack_metadata_encoded_size(const grpc_metadata_array *metadata);
+size_t hpack_metadata_list_size(const grpc_metadata_array *metadata);
 
 /* HTTP/2 flow control */
 int http2_flow_control_send_window_update(http2_connection *conn, uint32_t stream_id, uint32_t increment);
@@ -185,6 +699,45 @@ int http2_flow_control_consume_send_window(http2_connection *conn, http2_stream
 int http2_flow_control_consume_recv_window(http2_connection *conn, http2_stream *stream, size_t data_len);
 void http2_flow_control_init_connection(http2_connection *conn);
 void http2_flow_control_init_stream(http2_stream *stream);
+void http2_flow_control_begin_bdp_sample(http2_connection *conn);
+void http2_flow_control_end_bdp_sample(http2_connection *conn);
+int http2_flow_control_resume(http2_connection *conn);
+int32_t http2_flow_control_wait_send_window(http2_connection *conn, http2_stream *stream, size_t max_len);
+
+/* Resource quota accounting */
+int grpc_resource_quota_reserve(grpc_resource_quota *quota, size_t size);
+void grpc_resource_quota_charge(grpc_resource_quota *quota, size_t size);
+void grpc_resource_quota_release(grpc_resource_quota *quota, size_t size);
+bool grpc_resource_quota_under_pressure(grpc_resource_quota *quota);
+bool grpc_resource_quota_exhausted(grpc_resource_quota *quota);
+
+/* Method routing */
+grpc_method_router *grpc_method_router_create(const char *const *paths, void *const *values,
+                                              size_t count);
+void *grpc_method_router_lookup(const grpc_method_router *router, const char *path);
+size_t grpc_method_router_size(const grpc_method_router *router);
+void grpc_method_router_destroy(grpc_method_router *router);
+int grpc_reflection_registry_visit_methods(struct grpc_reflection_registry *registry,
+                                           int (*visit)(struct grpc_method_descriptor *method,
+                                                        const char *path, void *arg),
+                                           void *arg);
+
+/* CPU placement (cpu_affinity.c) */
+typedef struct grpc_cpu_topology grpc_cpu_topology;
+grpc_cpu_topology *grpc_cpu_topology_create(void);
+size_t grpc_cpu_topology_node_cpus(const grpc_cpu_topology *topology, int cpu, const int **cpus);
+void grpc_cpu_topology_destroy(grpc_cpu_topology *topology);
+bool grpc_cpu_list_valid(const int *cpus, size_t cpu_count);
+int grpc_thread_attr_init_pinned(pthread_attr_t *attr, const int *cpus, size_t cpu_count);
+
+/* Server response cache (response_cache.c) */
+typedef struct grpc_response_cache grpc_response_cache;
+grpc_response_cache *grpc_response_cache_create(size_t max_bytes, int ttl_ms);
+grpc_byte_buffer *grpc_response_cache_lookup(grpc_response_cache *cache, const grpc_byte_buffer *request);
+int grpc_response_cache_insert(grpc_response_cache *cache, const grpc_byte_buffer *request,
+                               const grpc_byte_buffer *response);
+size_t grpc_response_cache_size(grpc_response_cache *cache);
+void grpc_response_cache_destroy(grpc_response_cache *cache);
 
 /* Compression support */
 int grpc_compress_data(const uint8_t *input, size_t input_len, uint8_t **output, size_t *output_len, const char *algorithm);
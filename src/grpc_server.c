@@ -3,20 +3,46 @@
  * @brief Server implementation for gRPC
  */
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include "grpc/grpc.h"
+#include "grpc/grpc_advanced.h"
 #include "grpc_internal.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 /* Server configuration constants */
 #define GRPC_DEFAULT_WORKER_THREADS 4
-#define GRPC_DEFAULT_LISTEN_BACKLOG 128
+#define GRPC_DEFAULT_LISTEN_BACKLOG SOMAXCONN
+#define GRPC_ACCEPT_BATCH 64  /* Connections taken per listener wakeup */
 #define GRPC_SELECT_TIMEOUT_USEC 100000  /* 100ms */
+#define GRPC_DEFAULT_SHUTDOWN_GRACE_MS 30000
+#define GRPC_CONNECTION_AGE_JITTER_PERCENT 10
+#define GRPC_DRAIN_POLL_USEC 10000  /* 10ms */
+#define GRPC_DRAIN_PING_TIMEOUT_MS 1000  /* Final GOAWAY without the drain PING ACK */
+#define GRPC_DEFAULT_MAX_CONCURRENCY_LIMIT 1000
+#define GRPC_DEFAULT_QUEUE_DELAY_TARGET_MS 5
+#define GRPC_DEFAULT_QUEUE_DELAY_INTERVAL_MS 100
+#define GRPC_ADMISSION_BACKOFF 0.9
+#define GRPC_ADMISSION_GROWTH_DIVISOR 16
+#define GRPC_ADMISSION_LIMIT_METRIC "grpc.server.concurrency_limit"
+#define GRPC_ADMISSION_SHED_METRIC "grpc.server.calls_shed"
+#define GRPC_MAX_TENANTS 256
+#define GRPC_CACHE_HIT_METRIC "grpc.server.cache_hits"
+#define GRPC_CACHE_MISS_METRIC "grpc.server.cache_misses"
+#define GRPC_COALESCED_METRIC "grpc.server.calls_coalesced"
+#define GRPC_FLIGHT_INITIAL_BUCKETS 16
+#define GRPC_CACHE_THREADS 2  /* Serve complete requests off the connection readers */
+#define GRPC_MAX_HANDOFF_LISTENERS 64
+#define GRPC_HANDOFF_MAGIC 0x67724c31u  /* "grL1" */
 
 /* ========================================================================
  * Server Implementation
@@ -47,192 +73,2015 @@ grpc_server *grpc_server_create(const grpc_channel_args *args) {
     
     server->started = false;
     server->shutdown_called = false;
+    
+    /* Connection management policy (0 disables a limit) */
+    server->max_connection_age_ms = grpc_channel_args_get_int(args, GRPC_ARG_MAX_CONNECTION_AGE_MS, 0);
+    server->max_connection_age_grace_ms = grpc_channel_args_get_int(args, GRPC_ARG_MAX_CONNECTION_AGE_GRACE_MS, 0);
+    server->max_connection_idle_ms = grpc_channel_args_get_int(args, GRPC_ARG_MAX_CONNECTION_IDLE_MS, 0);
+    server->shutdown_grace_ms = grpc_channel_args_get_int(args, GRPC_ARG_SERVER_SHUTDOWN_GRACE_MS,
+                                                          GRPC_DEFAULT_SHUTDOWN_GRACE_MS);
+    
+    server->listen_backlog = grpc_channel_args_get_int(args, GRPC_ARG_SERVER_LISTEN_BACKLOG,
+                                                       GRPC_DEFAULT_LISTEN_BACKLOG);
+    if (server->listen_backlog <= 0) {
+        server->listen_backlog = GRPC_DEFAULT_LISTEN_BACKLOG;
+    }
+    
+    /* Admission control */
+    server->concurrency_limit = grpc_channel_args_get_int(args, GRPC_ARG_SERVER_CONCURRENCY_LIMIT, 0);
+    server->max_concurrency_limit = grpc_channel_args_get_int(args, GRPC_ARG_SERVER_MAX_CONCURRENCY_LIMIT,
+                                                              GRPC_DEFAULT_MAX_CONCURRENCY_LIMIT);
+    if (server->max_concurrency_limit < server->concurrency_limit) {
+        server->max_concurrency_limit = server->concurrency_limit;
+    }
+    server->queue_delay_target_ms = grpc_channel_args_get_int(args, GRPC_ARG_SERVER_QUEUE_DELAY_TARGET_MS,
+                                                              GRPC_DEFAULT_QUEUE_DELAY_TARGET_MS);
+    server->queue_delay_interval_ms = grpc_channel_args_get_int(args, GRPC_ARG_SERVER_QUEUE_DELAY_INTERVAL_MS,
+                                                                GRPC_DEFAULT_QUEUE_DELAY_INTERVAL_MS);
     pthread_mutex_init(&server->mutex, NULL);
     
-    return server;
+    return server;
+}
+
+/* Append a listening socket; the port takes ownership of unix_path on
+ * success. Caller holds server->mutex. */
+static int server_add_port(grpc_server *server, int socket_fd, const struct sockaddr_storage *addr,
+                           socklen_t addr_len, char *unix_path) {
+    /* Workers race for new connections; the losers must not block in accept */
+    int flags = fcntl(socket_fd, F_GETFL);
+    if (flags < 0 || fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+    
+    if (server->ports_count >= server->ports_capacity) {
+        size_t new_capacity = server->ports_capacity * 2;
+        server_port *new_ports = (server_port *)realloc(server->ports,
+                                                         new_capacity * sizeof(server_port));
+        if (!new_ports) {
+            return -1;
+        }
+        server->ports = new_ports;
+        server->ports_capacity = new_capacity;
+    }
+    
+    server->ports[server->ports_count].socket_fd = socket_fd;
+    server->ports[server->ports_count].addr = *addr;
+    server->ports[server->ports_count].addr_len = addr_len;
+    server->ports[server->ports_count].unix_path = unix_path;
+    server->ports[server->ports_count].creds = NULL;
+    server->ports_count++;
+    return 0;
+}
+
+int grpc_server_add_insecure_http2_port(grpc_server *server, const char *addr) {
+    if (!server || !addr) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        return 0;
+    }
+    
+    /* Parse address: host:port, unix:path or unix-abstract:name */
+    struct sockaddr_storage serv_addr;
+    socklen_t serv_addr_len;
+    if (grpc_address_parse(addr, &serv_addr, &serv_addr_len) != 0) {
+        pthread_mutex_unlock(&server->mutex);
+        return 0;
+    }
+    
+    bool is_unix = serv_addr.ss_family == AF_UNIX;
+    struct sockaddr_un *un = (struct sockaddr_un *)&serv_addr;
+    char *unix_path = NULL;
+    if (is_unix && un->sun_path[0] != '\0') {
+        unix_path = strdup(un->sun_path);
+        if (!unix_path) {
+            pthread_mutex_unlock(&server->mutex);
+            return 0;
+        }
+        /* A socket file left behind by a previous run would make bind fail */
+        struct stat st;
+        if (lstat(unix_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(unix_path);
+        }
+    }
+    
+    /* Create socket */
+    int socket_fd = socket(serv_addr.ss_family, SOCK_STREAM, 0);
+    if (socket_fd < 0) {
+        free(unix_path);
+        pthread_mutex_unlock(&server->mutex);
+        return 0;
+    }
+    
+    /* Set socket options */
+    if (!is_unix) {
+        int opt = 1;
+        setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    }
+    
+    /* Bind socket */
+    if (bind(socket_fd, (struct sockaddr *)&serv_addr, serv_addr_len) < 0) {
+        close(socket_fd);
+        free(unix_path);
+        pthread_mutex_unlock(&server->mutex);
+        return 0;
+    }
+    
+    /* Listen */
+    if (listen(socket_fd, server->listen_backlog) < 0) {
+        close(socket_fd);
+        if (unix_path) {
+            unlink(unix_path);
+        }
+        free(unix_path);
+        pthread_mutex_unlock(&server->mutex);
+        return 0;
+    }
+    
+    /* Add to server ports */
+    if (server_add_port(server, socket_fd, &serv_addr, serv_addr_len, unix_path) != 0) {
+        close(socket_fd);
+        if (unix_path) {
+            unlink(unix_path);
+        }
+        free(unix_path);
+        pthread_mutex_unlock(&server->mutex);
+        return 0;
+    }
+    
+    pthread_mutex_unlock(&server->mutex);
+    
+    /* Unix sockets have no port; report success the same way as gRPC */
+    if (is_unix) {
+        return 1;
+    }
+    
+    /* Report the kernel-chosen port when binding to port 0 */
+    struct sockaddr_in bound;
+    socklen_t bound_len = sizeof(bound);
+    if (getsockname(socket_fd, (struct sockaddr *)&bound, &bound_len) == 0) {
+        return ntohs(bound.sin_port);
+    }
+    return ntohs(((struct sockaddr_in *)&serv_addr)->sin_port);
+}
+
+int grpc_server_add_secure_http2_port(grpc_server *server,
+                                       const char *addr,
+                                       grpc_server_credentials *creds) {
+    /* Suppress unused parameter warning - for future implementation */
+    (void)creds;
+    
+    /* For now, just call insecure version */
+    /* In production, would set up TLS context */
+    return grpc_server_add_insecure_http2_port(server, addr);
+}
+
+/* ========================================================================
+ * Listener Handoff
+ * ======================================================================== */
+
+/* Handoff message: a header, one path length per listener, then the socket
+ * file paths back to back. The listening fds ride on the header as
+ * SCM_RIGHTS. */
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+} server_handoff_header;
+
+static int server_handoff_send(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+static int server_handoff_recv(int fd, void *data, size_t len) {
+    uint8_t *p = (uint8_t *)data;
+    while (len > 0) {
+        ssize_t got = recv(fd, p, len, MSG_WAITALL);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        p += got;
+        len -= (size_t)got;
+    }
+    return 0;
+}
+
+int grpc_server_export_listeners(grpc_server *server, int unix_fd) {
+    if (!server || unix_fd < 0) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    
+    size_t count = server->ports_count;
+    if (count == 0 || count > GRPC_MAX_HANDOFF_LISTENERS || server->shutdown_called) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    
+    size_t paths_len = 0;
+    for (size_t i = 0; i < count; i++) {
+        paths_len += server->ports[i].unix_path ? strlen(server->ports[i].unix_path) : 0;
+    }
+    size_t body_len = count * sizeof(uint32_t) + paths_len;
+    uint8_t *body = (uint8_t *)malloc(body_len);
+    if (!body) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    uint8_t *p = body + count * sizeof(uint32_t);
+    for (size_t i = 0; i < count; i++) {
+        const char *path = server->ports[i].unix_path;
+        uint32_t len = path ? (uint32_t)strlen(path) : 0;
+        memcpy(body + i * sizeof(uint32_t), &len, sizeof(len));
+        if (len > 0) {
+            memcpy(p, path, len);
+            p += len;
+        }
+    }
+    
+    server_handoff_header header = {GRPC_HANDOFF_MAGIC, (uint32_t)count};
+    struct iovec iov = {&header, sizeof(header)};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * GRPC_MAX_HANDOFF_LISTENERS)];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(CMSG_DATA(cmsg) + i * sizeof(int), &server->ports[i].socket_fd, sizeof(int));
+    }
+    
+    /* The fds travel with the first byte; the rest may follow in pieces */
+    ssize_t sent;
+    do {
+        sent = sendmsg(unix_fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    int rc = sent < 0 ? -1 : 0;
+    if (rc == 0) {
+        rc = server_handoff_send(unix_fd, (const uint8_t *)&header + sent, sizeof(header) - (size_t)sent);
+    }
+    if (rc == 0) {
+        rc = server_handoff_send(unix_fd, body, body_len);
+    }
+    free(body);
+    
+    /* The socket files now belong to the new owner: never unlink them here */
+    if (rc == 0) {
+        for (size_t i = 0; i < count; i++) {
+            free(server->ports[i].unix_path);
+            server->ports[i].unix_path = NULL;
+        }
+    }
+    
+    pthread_mutex_unlock(&server->mutex);
+    return rc;
+}
+
+grpc_server *grpc_server_create_from_listeners(const grpc_channel_args *args, int unix_fd) {
+    if (unix_fd < 0) {
+        return NULL;
+    }
+    
+    server_handoff_header header;
+    struct iovec iov = {&header, sizeof(header)};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * GRPC_MAX_HANDOFF_LISTENERS)];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    
+    ssize_t got;
+    do {
+        /* Close-on-exec from the start, as accept4() does for connections */
+        got = recvmsg(unix_fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) {
+        return NULL;
+    }
+    
+    int fds[GRPC_MAX_HANDOFF_LISTENERS];
+    size_t fd_count = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds + fd_count, CMSG_DATA(cmsg), n * sizeof(int));
+            fd_count += n;
+        }
+    }
+    
+    grpc_server *server = NULL;
+    uint32_t *lens = NULL;
+    char *paths = NULL;
+    size_t adopted = 0;
+    bool ok = !(msg.msg_flags & MSG_CTRUNC) &&
+              server_handoff_recv(unix_fd, (uint8_t *)&header + got, sizeof(header) - (size_t)got) == 0 &&
+              header.magic == GRPC_HANDOFF_MAGIC && header.count == fd_count && fd_count > 0;
+    
+    size_t paths_len = 0;
+    if (ok) {
+        lens = (uint32_t *)malloc(fd_count * sizeof(uint32_t));
+        ok = lens && server_handoff_recv(unix_fd, lens, fd_count * sizeof(uint32_t)) == 0;
+    }
+    for (size_t i = 0; ok && i < fd_count; i++) {
+        ok = lens[i] < sizeof(((struct sockaddr_un *)0)->sun_path);
+        paths_len += lens[i];
+    }
+    if (ok) {
+        paths = (char *)malloc(paths_len + 1);
+        ok = paths && server_handoff_recv(unix_fd, paths, paths_len) == 0;
+    }
+    if (ok) {
+        server = grpc_server_create(args);
+        ok = server != NULL;
+    }
+    
+    /* Adopt only sockets that really are listening */
+    const char *path = paths;
+    for (; ok && adopted < fd_count; adopted++) {
+        int listening = 0;
+        socklen_t optlen = sizeof(listening);
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        char *unix_path = lens[adopted] > 0 ? strndup(path, lens[adopted]) : NULL;
+        path += lens[adopted];
+        ok = (lens[adopted] == 0 || unix_path) &&
+             getsockopt(fds[adopted], SOL_SOCKET, SO_ACCEPTCONN, &listening, &optlen) == 0 &&
+             listening && getsockname(fds[adopted], (struct sockaddr *)&addr, &addr_len) == 0 &&
+             server_add_port(server, fds[adopted], &addr, addr_len, unix_path) == 0;
+        if (!ok) {
+            free(unix_path);
+            break;
+        }
+    }
+    
+    free(lens);
+    free(paths);
+    if (!ok) {
+        /* Adopted fds are closed by the server, the rest here */
+        for (size_t i = adopted; i < fd_count; i++) {
+            close(fds[i]);
+        }
+        grpc_server_destroy(server);
+        return NULL;
+    }
+    return server;
+}
+
+void grpc_server_set_peer_cred_filter(grpc_server *server,
+                                      grpc_peer_cred_filter filter,
+                                      void *user_data) {
+    if (!server) {
+        return;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    server->peer_cred_filter = filter;
+    server->peer_cred_filter_data = user_data;
+    pthread_mutex_unlock(&server->mutex);
+}
+
+int grpc_server_set_cpu_affinity(grpc_server *server, const int *cpus, size_t cpu_count) {
+    if (!server || !grpc_cpu_list_valid(cpus, cpu_count)) {
+        return -1;
+    }
+    
+    int *copy = NULL;
+    if (cpu_count > 0) {
+        copy = (int *)malloc(cpu_count * sizeof(int));
+        if (!copy) {
+            return -1;
+        }
+        memcpy(copy, cpus, cpu_count * sizeof(int));
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        free(copy);
+        return -1;
+    }
+    free(server->cpus);
+    server->cpus = copy;
+    server->cpu_count = cpu_count;
+    pthread_mutex_unlock(&server->mutex);
+    return 0;
+}
+
+void grpc_server_set_resource_quota(grpc_server *server, grpc_resource_quota *quota) {
+    if (!server) {
+        return;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        return;
+    }
+    grpc_resource_quota_ref(quota);
+    grpc_resource_quota_unref(server->resource_quota);
+    server->resource_quota = quota;
+    pthread_mutex_unlock(&server->mutex);
+}
+
+void grpc_server_register_completion_queue(grpc_server *server,
+                                            grpc_completion_queue *cq) {
+    if (!server || !cq) {
+        return;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    
+    if (server->cqs_count >= server->cqs_capacity) {
+        size_t new_capacity = server->cqs_capacity * 2;
+        grpc_completion_queue **new_cqs = (grpc_completion_queue **)realloc(
+            server->cqs, new_capacity * sizeof(grpc_completion_queue *));
+        if (!new_cqs) {
+            pthread_mutex_unlock(&server->mutex);
+            return;
+        }
+        server->cqs = new_cqs;
+        server->cqs_capacity = new_capacity;
+    }
+    
+    server->cqs[server->cqs_count++] = cq;
+    
+    pthread_mutex_unlock(&server->mutex);
+}
+
+/* ========================================================================
+ * Method Registration
+ * ======================================================================== */
+
+void *grpc_server_register_method(grpc_server *server, const char *method, const char *host) {
+    if (!server || !method) {
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        return NULL;
+    }
+    
+    for (server_registered_method *rm = server->registered_methods; rm; rm = rm->next) {
+        bool same_host = rm->host ? host && strcmp(rm->host, host) == 0 : host == NULL;
+        if (same_host && strcmp(rm->method, method) == 0) {
+            pthread_mutex_unlock(&server->mutex);
+            return NULL;
+        }
+    }
+    
+    server_registered_method *rm = (server_registered_method *)calloc(1, sizeof(server_registered_method));
+    if (!rm) {
+        pthread_mutex_unlock(&server->mutex);
+        return NULL;
+    }
+    rm->method = strdup(method);
+    rm->host = host ? strdup(host) : NULL;
+    if (!rm->method || (host && !rm->host)) {
+        free(rm->method);
+        free(rm->host);
+        free(rm);
+        pthread_mutex_unlock(&server->mutex);
+        return NULL;
+    }
+    
+    rm->next = server->registered_methods;
+    server->registered_methods = rm;
+    
+    pthread_mutex_unlock(&server->mutex);
+    return rm;
+}
+
+int grpc_server_set_reflection_registry(grpc_server *server, grpc_reflection_registry *registry) {
+    if (!server) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    server->reflection_registry = registry;
+    pthread_mutex_unlock(&server->mutex);
+    return 0;
+}
+
+grpc_method_descriptor *grpc_call_get_method_descriptor(grpc_call *call) {
+    return call ? call->method_descriptor : NULL;
+}
+
+/* A registration or a registry method, sorted together by :path */
+typedef struct {
+    const char *path;
+    server_registered_method *rm;
+    grpc_method_descriptor *descriptor;
+} server_method_entry;
+
+typedef struct {
+    server_method_entry *entries;
+    size_t count;
+    size_t capacity;
+} server_method_entries;
+
+static int server_method_entries_add(server_method_entries *list, const char *path,
+                                     server_registered_method *rm,
+                                     grpc_method_descriptor *descriptor) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        server_method_entry *entries =
+            (server_method_entry *)realloc(list->entries, capacity * sizeof(server_method_entry));
+        if (!entries) {
+            return -1;
+        }
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+    list->entries[list->count].path = path;
+    list->entries[list->count].rm = rm;
+    list->entries[list->count].descriptor = descriptor;
+    list->count++;
+    return 0;
+}
+
+static int server_add_registry_method(grpc_method_descriptor *method, const char *path, void *arg) {
+    return server_method_entries_add((server_method_entries *)arg, path, NULL, method);
+}
+
+/* By path; within a path host-specific registrations, then the wildcard,
+ * then registry descriptors */
+static int server_method_entry_rank(const server_method_entry *entry) {
+    return entry->rm ? (entry->rm->host ? 0 : 1) : 2;
+}
+
+static int server_method_entry_cmp(const void *a, const void *b) {
+    const server_method_entry *x = (const server_method_entry *)a;
+    const server_method_entry *y = (const server_method_entry *)b;
+    int c = strcmp(x->path, y->path);
+    return c != 0 ? c : server_method_entry_rank(x) - server_method_entry_rank(y);
+}
+
+/* Compile registrations and registry methods into the :path router at
+ * start; caller holds server->mutex. Each path maps to a chain of its
+ * registrations, host-specific first, and registry methods nobody
+ * registered get an implicit wildcard entry served by request_call. */
+static int server_build_method_router(grpc_server *server) {
+    server_method_entries list = {NULL, 0, 0};
+    int rc = 0;
+    
+    for (server_registered_method *rm = server->registered_methods; rm && rc == 0; rm = rm->next) {
+        /* Left over from a failed earlier start */
+        rm->next_host = NULL;
+        if (!rm->implicit) {
+            rc = server_method_entries_add(&list, rm->method, rm, NULL);
+        }
+    }
+    if (rc == 0 && server->reflection_registry) {
+        rc = grpc_reflection_registry_visit_methods(server->reflection_registry,
+                                                    server_add_registry_method, &list);
+    }
+    if (rc != 0 || list.count == 0) {
+        free(list.entries);
+        return rc;
+    }
+    
+    qsort(list.entries, list.count, sizeof(server_method_entry), server_method_entry_cmp);
+    
+    const char **paths = (const char **)malloc(list.count * sizeof(char *));
+    void **heads = (void **)malloc(list.count * sizeof(void *));
+    size_t unique = 0;
+    rc = paths && heads ? 0 : -1;
+    
+    for (size_t i = 0; i < list.count && rc == 0;) {
+        size_t end = i;
+        while (end < list.count && strcmp(list.entries[end].path, list.entries[i].path) == 0) {
+            end++;
+        }
+        
+        /* The first registry method for a path describes it */
+        grpc_method_descriptor *descriptor = NULL;
+        server_registered_method *head = NULL;
+        server_registered_method *tail = NULL;
+        for (size_t j = i; j < end; j++) {
+            server_method_entry *entry = &list.entries[j];
+            if (!entry->rm) {
+                if (!descriptor) {
+                    descriptor = entry->descriptor;
+                }
+                continue;
+            }
+            if (tail) {
+                tail->next_host = entry->rm;
+            } else {
+                head = entry->rm;
+            }
+            tail = entry->rm;
+        }
+        
+        if (descriptor && (!tail || tail->host)) {
+            server_registered_method *rm =
+                (server_registered_method *)calloc(1, sizeof(server_registered_method));
+            if (!rm || !(rm->method = strdup(list.entries[i].path))) {
+                free(rm);
+                rc = -1;
+                break;
+            }
+            rm->implicit = true;
+            rm->next = server->registered_methods;
+            server->registered_methods = rm;
+            if (tail) {
+                tail->next_host = rm;
+            } else {
+                head = rm;
+            }
+        }
+        
+        for (server_registered_method *rm = head; rm; rm = rm->next_host) {
+            rm->descriptor = descriptor;
+        }
+        paths[unique] = head->method;
+        heads[unique] = head;
+        unique++;
+        i = end;
+    }
+    
+    if (rc == 0) {
+        server->method_router = grpc_method_router_create(paths, heads, unique);
+        rc = server->method_router ? 0 : -1;
+    }
+    
+    free(paths);
+    free(heads);
+    free(list.entries);
+    return rc;
+}
+
+/* Registered method for a call, NULL if none; the router is read-only
+ * once the server has started */
+static server_registered_method *server_find_method(grpc_server *server, const char *method,
+                                                    const char *host) {
+    server_registered_method *rm = (server_registered_method *)grpc_method_router_lookup(
+        server->method_router, method);
+    for (; rm; rm = rm->next_host) {
+        if (!rm->host || (host && strcmp(rm->host, host) == 0)) {
+            return rm;
+        }
+    }
+    return NULL;
+}
+
+/* ========================================================================
+ * Admission Control
+ * ======================================================================== */
+
+int grpc_server_set_metrics_registry(grpc_server *server, grpc_metrics_registry *registry) {
+    if (!server) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    server->metrics = registry;
+    pthread_mutex_unlock(&server->mutex);
+    return 0;
+}
+
+/* Start a method at the configured limit and register its gauge; caller
+ * holds server->mutex */
+static void server_admission_init(grpc_server *server, server_admission *admission,
+                                  const char *method, const char *host) {
+    admission->limit = server->concurrency_limit;
+    admission->interval_start_us = grpc_monotonic_us();
+    admission->min_delay_us = -1;
+    
+    if (!server->metrics || server->concurrency_limit <= 0) {
+        return;
+    }
+    
+    size_t len = strlen(GRPC_ADMISSION_LIMIT_METRIC) + 1;
+    if (method) {
+        len += 1 + strlen(method) + (host ? 1 + strlen(host) : 0);
+    }
+    admission->metric = (char *)malloc(len);
+    if (!admission->metric) {
+        return;
+    }
+    if (!method) {
+        snprintf(admission->metric, len, "%s", GRPC_ADMISSION_LIMIT_METRIC);
+    } else if (host) {
+        snprintf(admission->metric, len, "%s:%s@%s", GRPC_ADMISSION_LIMIT_METRIC, method, host);
+    } else {
+        snprintf(admission->metric, len, "%s:%s", GRPC_ADMISSION_LIMIT_METRIC, method);
+    }
+    grpc_metrics_register(server->metrics, admission->metric,
+                          "Adaptive concurrency limit", GRPC_METRIC_GAUGE);
+    grpc_metrics_set(server->metrics, admission->metric, admission->limit);
+}
+
+/* Adjust the limit once per interval; caller holds server->mutex.
+ * Like CoDel, the signal is the smallest queueing delay of the interval:
+ * if even that call waited longer than the target (or nothing was picked up
+ * while calls sat in the queue) the queue is standing and the limit backs
+ * off multiplicatively. Otherwise it grows while it is being used. */
+static void server_admission_roll(grpc_server *server, server_admission *admission, int64_t now_us) {
+    if (now_us - admission->interval_start_us < (int64_t)server->queue_delay_interval_ms * 1000) {
+        return;
+    }
+    
+    double limit = admission->limit;
+    bool standing = admission->min_delay_us < 0 ? admission->queued > 0
+                                                : admission->min_delay_us >
+                                                  (int64_t)server->queue_delay_target_ms * 1000;
+    if (standing) {
+        limit *= GRPC_ADMISSION_BACKOFF;
+    } else if ((double)admission->peak_inflight * 2 >= limit) {
+        limit += limit / GRPC_ADMISSION_GROWTH_DIVISOR + 1;
+    }
+    if (limit < 1) {
+        limit = 1;
+    }
+    if (limit > server->max_concurrency_limit) {
+        limit = server->max_concurrency_limit;
+    }
+    
+    if (limit != admission->limit && admission->metric) {
+        grpc_metrics_set(server->metrics, admission->metric, limit);
+    }
+    admission->limit = limit;
+    admission->interval_start_us = now_us;
+    admission->min_delay_us = -1;
+    admission->peak_inflight = admission->inflight;
+}
+
+/* Take a concurrency slot for a new call, or refuse it before any of its
+ * body is read; caller holds server->mutex */
+static bool server_admit(grpc_server *server, server_admission *admission, grpc_call *call) {
+    if (server->concurrency_limit <= 0) {
+        return true;
+    }
+    
+    int64_t now_us = grpc_monotonic_us();
+    server_admission_roll(server, admission, now_us);
+    
+    if ((double)admission->inflight >= admission->limit) {
+        if (server->metrics) {
+            grpc_metrics_increment(server->metrics, GRPC_ADMISSION_SHED_METRIC, 1);
+        }
+        return false;
+    }
+    
+    admission->inflight++;
+    admission->queued++;
+    if (admission->inflight > admission->peak_inflight) {
+        admission->peak_inflight = admission->inflight;
+    }
+    call->admission = admission;
+    call->admitted_us = now_us;
+    call->admission_queued = true;
+    return true;
+}
+
+/* The application picked the call up: record how long it queued; caller
+ * holds server->mutex */
+static void server_admission_dequeued(grpc_server *server, grpc_call *call) {
+    server_admission *admission = call->admission;
+    if (!admission || !call->admission_queued) {
+        return;
+    }
+    
+    int64_t now_us = grpc_monotonic_us();
+    int64_t delay_us = now_us - call->admitted_us;
+    call->admission_queued = false;
+    admission->queued--;
+    if (admission->min_delay_us < 0 || delay_us < admission->min_delay_us) {
+        admission->min_delay_us = delay_us;
+    }
+    server_admission_roll(server, admission, now_us);
+}
+
+/* ========================================================================
+ * Connection Management (GOAWAY drain, max age, max idle)
+ * ======================================================================== */
+
+/* Read frames until the peer goes away or the connection is shut down */
+static void *server_connection_reader(void *arg) {
+    server_connection *sc = (server_connection *)arg;
+    http2_connection *conn = sc->conn;
+    
+    if (http2_connection_recv_preface(conn) == 0 && http2_connection_send_settings(conn) == 0) {
+        for (;;) {
+            /* Leave data in the socket while the memory quota is used up */
+            while (!http2_connection_read_allowed(conn) && !__atomic_load_n(&conn->closed, __ATOMIC_ACQUIRE)) {
+                usleep(GRPC_DRAIN_POLL_USEC);
+            }
+            
+            http2_frame_header header;
+            uint8_t *payload = NULL;
+            if (http2_connection_recv_frame(conn, &header, &payload) != 0) {
+                break;
+            }
+            int rc = http2_connection_process_frame(conn, &header, payload);
+            free(payload);
+            if (rc != 0) {
+                http2_connection_send_goaway(conn, conn->last_peer_stream_id, HTTP2_PROTOCOL_ERROR);
+                break;
+            }
+        }
+    }
+    
+    /* Calls on a dead connection can no longer finish */
+    http2_call_close_connection(conn);
+    __atomic_store_n(&sc->reader_done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Stop the reader and free the connection. Called without server->mutex:
+ * the reader may be waiting for it to publish a call. */
+static void server_connection_close(server_connection *sc) {
+    http2_connection_shutdown(sc->conn);
+    pthread_join(sc->reader, NULL);
+    http2_call_close_connection(sc->conn);
+    http2_connection_destroy(sc->conn);
+    free(sc);
+}
+
+/* CPUs for a connection's reader: the server's set, narrowed to the node
+ * whose CPU received the connection when NUMA-local connections are on.
+ * *owned is set to anything allocated for the result. */
+static size_t server_reader_cpus(grpc_server *server, int client_fd, bool is_unix,
+                                 const int **cpus, int **owned) {
+    *cpus = server->cpus;
+    *owned = NULL;
+    
+    int incoming_cpu = -1;
+    socklen_t len = sizeof(incoming_cpu);
+    const int *node_cpus = NULL;
+    size_t node_count = 0;
+    if (server->topology && !is_unix &&
+        getsockopt(client_fd, SOL_SOCKET, SO_INCOMING_CPU, &incoming_cpu, &len) == 0) {
+        node_count = grpc_cpu_topology_node_cpus(server->topology, incoming_cpu, &node_cpus);
+    }
+    if (node_count == 0) {
+        return server->cpu_count;
+    }
+    if (server->cpu_count == 0) {
+        *cpus = node_cpus;
+        return node_count;
+    }
+    
+    /* Stay inside the server's set; if it has no CPU on that node, use it whole */
+    int *both = (int *)malloc(node_count * sizeof(int));
+    if (!both) {
+        return server->cpu_count;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < node_count; i++) {
+        for (size_t j = 0; j < server->cpu_count; j++) {
+            if (node_cpus[i] == server->cpus[j]) {
+                both[count++] = node_cpus[i];
+                break;
+            }
+        }
+    }
+    if (count == 0) {
+        free(both);
+        return server->cpu_count;
+    }
+    *cpus = both;
+    *owned = both;
+    return count;
+}
+
+static void server_add_connection(grpc_server *server, int client_fd, bool is_unix) {
+    grpc_peer_cred cred;
+    bool has_cred = is_unix && grpc_socket_get_peer_cred(client_fd, &cred) == 0;
+    
+    if (is_unix && server->peer_cred_filter &&
+        (!has_cred || !server->peer_cred_filter(&cred, server->peer_cred_filter_data))) {
+        close(client_fd);
+        return;
+    }
+    
+    /* Co-located clients may move the frames onto shared-memory rings */
+    shm_transport *shm = NULL;
+    if (is_unix && grpc_channel_args_get_int(server->args, GRPC_ARG_SHM_TRANSPORT_RING_BYTES, 0) > 0 &&
+        shm_transport_accept(client_fd, GRPC_SHM_HANDSHAKE_TIMEOUT_MS, &shm) != 0) {
+        close(client_fd);
+        return;
+    }
+    
+    http2_connection *conn = http2_connection_create(NULL, false, NULL);
+    server_connection *sc = (server_connection *)calloc(1, sizeof(server_connection));
+    if (!conn || !sc) {
+        http2_connection_destroy(conn);
+        free(sc);
+        shm_transport_destroy(shm);
+        close(client_fd);
+        return;
+    }
+    
+    conn->shm = shm;
+    conn->quota = server->resource_quota;
+    conn->accept_stream = http2_call_accept_stream;
+    conn->accept_stream_data = server;
+    int max_metadata_size = grpc_channel_args_get_int(server->args, GRPC_ARG_MAX_METADATA_SIZE, 0);
+    if (max_metadata_size > 0) {
+        conn->max_header_list_size = (uint32_t)max_metadata_size;
+    }
+    conn->socket_fd = client_fd;
+    conn->has_peer_cred = has_cred;
+    if (has_cred) {
+        conn->peer_cred = cred;
+    }
+    if (!is_unix && grpc_channel_args_get_int(server->args, GRPC_ARG_TCP_TX_ZEROCOPY_ENABLED, 0)) {
+        int threshold = grpc_channel_args_get_int(server->args, GRPC_ARG_TCP_TX_ZEROCOPY_SEND_BYTES_THRESHOLD,
+                                                  GRPC_DEFAULT_ZEROCOPY_THRESHOLD);
+        http2_connection_set_zerocopy_threshold(conn, threshold > 0 ? (size_t)threshold : 1);
+    }
+    
+    sc->conn = conn;
+    sc->created_ms = grpc_monotonic_ms();
+    sc->last_active_ms = sc->created_ms;
+    sc->age_deadline_ms = 0;
+    if (server->max_connection_age_ms > 0) {
+        /* Spread reconnects so connections created together do not all
+         * go away at the same moment */
+        int64_t age = server->max_connection_age_ms;
+        int64_t jitter = age * GRPC_CONNECTION_AGE_JITTER_PERCENT / 100;
+        if (jitter > 0) {
+            age += (rand() % (2 * jitter + 1)) - jitter;
+        }
+        sc->age_deadline_ms = sc->created_ms + age;
+    }
+    
+    int *owned_cpus;
+    const int *cpus;
+    size_t cpu_count = server_reader_cpus(server, client_fd, is_unix, &cpus, &owned_cpus);
+    pthread_attr_t attr;
+    bool pinned = grpc_thread_attr_init_pinned(&attr, cpus, cpu_count) == 0;
+    int rc = pthread_create(&sc->reader, pinned ? &attr : NULL, server_connection_reader, sc);
+    if (pinned) {
+        pthread_attr_destroy(&attr);
+    }
+    free(owned_cpus);
+    if (rc != 0) {
+        http2_connection_destroy(conn);
+        free(sc);
+        return;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    sc->next = server->connections;
+    server->connections = sc;
+    server->connection_count++;
+    pthread_mutex_unlock(&server->mutex);
+}
+
+/* Start the two-phase GOAWAY and the grace period; caller holds server->mutex */
+static void server_connection_goaway(server_connection *sc, int64_t now, int grace_ms) {
+    if (sc->close_deadline_ms != 0) {
+        return;
+    }
+    
+    http2_connection_start_drain(sc->conn);
+    sc->drain_ping_deadline_ms = now + GRPC_DRAIN_PING_TIMEOUT_MS;
+    sc->close_deadline_ms = now + (grace_ms > 0 ? grace_ms : 0);
+}
+
+/**
+ * Apply the age and idle policies and close drained connections.
+ * Connections that were sent the final GOAWAY are closed once their last
+ * stream finishes or the grace period runs out; the final GOAWAY goes out
+ * without the drain PING ACK once that is overdue. Connections the peer
+ * closed are reaped. Receive windows withheld under memory pressure are reopened
+ * here once the quota has room.
+ */
+static void server_maintain_connections(grpc_server *server) {
+    int64_t now = grpc_monotonic_ms();
+    server_connection *closing = NULL;
+    
+    pthread_mutex_lock(&server->mutex);
+    
+    server_connection *prev = NULL;
+    server_connection *sc = server->connections;
+    
+    while (sc) {
+        server_connection *next = sc->next;
+        size_t active = http2_connection_active_streams(sc->conn);
+        
+        if (active > 0) {
+            sc->last_active_ms = now;
+        }
+        
+        if (sc->age_deadline_ms > 0 && now >= sc->age_deadline_ms) {
+            server_connection_goaway(sc, now, server->max_connection_age_grace_ms);
+        } else if (server->max_connection_idle_ms > 0 && active == 0 &&
+                   now - sc->last_active_ms >= server->max_connection_idle_ms) {
+            server_connection_goaway(sc, now, 0);
+        }
+        
+        bool drained = false;
+        if (sc->close_deadline_ms != 0) {
+            if (now >= sc->drain_ping_deadline_ms) {
+                http2_connection_finish_drain(sc->conn);
+            }
+            drained = http2_connection_drain_finished(sc->conn) && (active == 0 || now >= sc->close_deadline_ms);
+        }
+        
+        bool closed = __atomic_load_n(&sc->reader_done, __ATOMIC_ACQUIRE);
+        if (closed || drained) {
+            if (prev) {
+                prev->next = next;
+            } else {
+                server->connections = next;
+            }
+            server->connection_count--;
+            sc->next = closing;
+            closing = sc;
+        } else {
+            /* Reopen windows that were held back while memory was short */
+            http2_flow_control_resume(sc->conn);
+            prev = sc;
+        }
+        
+        sc = next;
+    }
+    
+    pthread_mutex_unlock(&server->mutex);
+    
+    while (closing) {
+        server_connection *next = closing->next;
+        server_connection_close(closing);
+        closing = next;
+    }
+}
+
+/* GOAWAY every connection and wait for in-flight streams to drain */
+static void server_drain_connections(grpc_server *server) {
+    int64_t now = grpc_monotonic_ms();
+    
+    pthread_mutex_lock(&server->mutex);
+    for (server_connection *sc = server->connections; sc; sc = sc->next) {
+        if (sc->close_deadline_ms == 0) {
+            server_connection_goaway(sc, now, server->shutdown_grace_ms);
+        } else if (sc->close_deadline_ms > now + server->shutdown_grace_ms) {
+            sc->close_deadline_ms = now + server->shutdown_grace_ms;
+        }
+    }
+    pthread_mutex_unlock(&server->mutex);
+    
+    for (;;) {
+        server_maintain_connections(server);
+        
+        pthread_mutex_lock(&server->mutex);
+        bool drained = server->connections == NULL;
+        pthread_mutex_unlock(&server->mutex);
+        
+        if (drained) {
+            break;
+        }
+        usleep(GRPC_DRAIN_POLL_USEC);
+    }
+}
+
+/* Drain a listener's backlog, up to GRPC_ACCEPT_BATCH connections, so a
+ * burst of reconnects leaves the queue in one wakeup instead of one per
+ * select(); the listener is non-blocking, so another worker taking the
+ * connection first only ends the batch */
+static void server_accept_batch(grpc_server *server, const server_port *port) {
+    for (int i = 0; i < GRPC_ACCEPT_BATCH; i++) {
+        int client_fd = accept4(port->socket_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            /* Out of descriptors or memory: let the backlog hold them a while */
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                usleep(GRPC_DRAIN_POLL_USEC);
+            }
+            return;
+        }
+        
+        /* The connection's reader thread dispatches its calls */
+        server_add_connection(server, client_fd, port->addr.ss_family == AF_UNIX);
+    }
+}
+
+void *server_worker_thread(void *arg) {
+    grpc_server *server = (grpc_server *)arg;
+    
+    /* This is a simplified server loop */
+    /* In production, would use epoll/kqueue for multiple connections */
+    
+    while (!server->shutdown_called) {
+        server_maintain_connections(server);
+        
+        if (server->ports_count == 0) {
+            usleep(GRPC_SELECT_TIMEOUT_USEC);
+            continue;
+        }
+        
+        /* Wait on every port at once */
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        int max_fd = -1;
+        for (size_t i = 0; i < server->ports_count; i++) {
+            FD_SET(server->ports[i].socket_fd, &read_fds);
+            if (server->ports[i].socket_fd > max_fd) {
+                max_fd = server->ports[i].socket_fd;
+            }
+        }
+        
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = GRPC_SELECT_TIMEOUT_USEC;
+        
+        if (select(max_fd + 1, &read_fds, NULL, NULL, &tv) > 0) {
+            for (size_t i = 0; i < server->ports_count; i++) {
+                if (FD_ISSET(server->ports[i].socket_fd, &read_fds)) {
+                    server_accept_batch(server, &server->ports[i]);
+                }
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+void grpc_server_start(grpc_server *server) {
+    if (!server) {
+        return;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        return;
+    }
+    
+    /* Method lookups never change after this point */
+    if (server_build_method_router(server) != 0) {
+        pthread_mutex_unlock(&server->mutex);
+        return;
+    }
+    
+    server_admission_init(server, &server->unregistered_admission, NULL, NULL);
+    for (server_registered_method *rm = server->registered_methods; rm; rm = rm->next) {
+        server_admission_init(server, &rm->admission, rm->method, rm->host);
+    }
+    if (server->metrics && server->concurrency_limit > 0) {
+        grpc_metrics_register(server->metrics, GRPC_ADMISSION_SHED_METRIC,
+                              "Calls refused by admission control", GRPC_METRIC_COUNTER);
+    }
+    
+    bool caching = false, coalescing = false;
+    size_t hold_count = 0;
+    for (server_registered_method *rm = server->registered_methods; rm; rm = rm->next) {
+        if (rm->cache || rm->coalesce) {
+            hold_count++;
+        }
+        caching = caching || rm->cache;
+        coalescing = coalescing || rm->coalesce;
+    }
+    __atomic_store_n(&server->hold_count, hold_count, __ATOMIC_RELEASE);
+    if (hold_count > 0) {
+        server->cache_executor = server->cpu_count > 0
+            ? grpc_executor_create_pinned(GRPC_CACHE_THREADS, server->cpus, server->cpu_count)
+            : grpc_executor_create(GRPC_CACHE_THREADS);
+    }
+    if (caching && server->metrics) {
+        grpc_metrics_register(server->metrics, GRPC_CACHE_HIT_METRIC,
+                              "Calls answered from a method cache", GRPC_METRIC_COUNTER);
+        grpc_metrics_register(server->metrics, GRPC_CACHE_MISS_METRIC,
+                              "Cacheable calls passed to the application", GRPC_METRIC_COUNTER);
+    }
+    if (coalescing && server->metrics) {
+        grpc_metrics_register(server->metrics, GRPC_COALESCED_METRIC,
+                              "Calls answered with the reply to an identical call", GRPC_METRIC_COUNTER);
+    }
+    
+    if (grpc_channel_args_get_int(server->args, GRPC_ARG_SERVER_NUMA_LOCAL_CONNECTIONS, 0)) {
+        server->topology = grpc_cpu_topology_create();
+    }
+    
+    server->started = true;
+    
+    /* Start worker threads */
+    server->worker_count = GRPC_DEFAULT_WORKER_THREADS;
+    server->worker_threads = (pthread_t *)calloc(server->worker_count, sizeof(pthread_t));
+    
+    pthread_attr_t attr;
+    bool pinned = grpc_thread_attr_init_pinned(&attr, server->cpus, server->cpu_count) == 0;
+    for (size_t i = 0; i < server->worker_count; i++) {
+        pthread_create(&server->worker_threads[i], pinned ? &attr : NULL, server_worker_thread, server);
+    }
+    if (pinned) {
+        pthread_attr_destroy(&attr);
+    }
+    
+    pthread_mutex_unlock(&server->mutex);
+}
+
+/* ========================================================================
+ * Tenant Scheduling
+ * ======================================================================== */
+
+int grpc_server_set_tenant_key(grpc_server *server, const char *metadata_key, int max_inflight) {
+    if (!server || !metadata_key || max_inflight < 0) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    char *key = strdup(metadata_key);
+    if (!key) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    free(server->tenant_key);
+    server->tenant_key = key;
+    server->tenant_max_inflight = max_inflight;
+    pthread_mutex_unlock(&server->mutex);
+    return 0;
+}
+
+/* Tenant by name, created with weight 1 if new; caller holds server->mutex */
+static server_tenant *server_tenant_get(grpc_server *server, const char *name, size_t len) {
+    for (server_tenant *tenant = server->tenants; tenant; tenant = tenant->next) {
+        if (strlen(tenant->name) == len && memcmp(tenant->name, name, len) == 0) {
+            return tenant;
+        }
+    }
+    
+    server_tenant *tenant = (server_tenant *)calloc(1, sizeof(server_tenant));
+    if (!tenant) {
+        return NULL;
+    }
+    tenant->name = strndup(name, len);
+    if (!tenant->name) {
+        free(tenant);
+        return NULL;
+    }
+    tenant->weight = 1;
+    tenant->next = server->tenants;
+    server->tenants = tenant;
+    server->tenant_count++;
+    return tenant;
+}
+
+int grpc_server_set_tenant_weight(grpc_server *server, const char *tenant, int weight) {
+    if (!server || !tenant || weight < 1) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    if (server->started) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    server_tenant *entry = server_tenant_get(server, tenant, strlen(tenant));
+    if (entry) {
+        entry->weight = weight;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return entry ? 0 : -1;
+}
+
+/* Lane in queue for the tenant named by the call's metadata; caller holds
+ * server->mutex. Calls without the key, and new tenants once
+ * GRPC_MAX_TENANTS exist, share the "" tenant. */
+static server_tenant_lane *server_tenant_lane_get(grpc_server *server, server_call_queue *queue,
+                                                  grpc_call *call) {
+    const char *name = "";
+    size_t len = 0;
+    for (size_t i = 0; i < call->initial_metadata.count; i++) {
+        const grpc_metadata *md = &call->initial_metadata.metadata[i];
+        if (strcmp(md->key, server->tenant_key) == 0) {
+            name = md->value;
+            len = md->value_length;
+            break;
+        }
+    }
+    
+    server_tenant *tenant = NULL;
+    for (tenant = server->tenants; tenant; tenant = tenant->next) {
+        if (strlen(tenant->name) == len && memcmp(tenant->name, name, len) == 0) {
+            break;
+        }
+    }
+    if (!tenant) {
+        if (server->tenant_count >= GRPC_MAX_TENANTS) {
+            len = 0;
+        }
+        tenant = server_tenant_get(server, name, len);
+        if (!tenant) {
+            return NULL;
+        }
+    }
+    
+    server_tenant_lane *lane = queue->lanes;
+    for (; lane; lane = lane->next) {
+        if (lane->tenant == tenant) {
+            return lane;
+        }
+    }
+    lane = (server_tenant_lane *)calloc(1, sizeof(server_tenant_lane));
+    if (!lane) {
+        return NULL;
+    }
+    lane->tenant = tenant;
+    lane->next = queue->lanes;
+    queue->lanes = lane;
+    queue->lane_count++;
+    return lane;
+}
+
+static bool server_tenant_has_room(grpc_server *server, server_tenant *tenant) {
+    return server->tenant_max_inflight == 0 || tenant->inflight < (size_t)server->tenant_max_inflight;
+}
+
+/* The application takes a call: charge it to its tenant */
+static void server_tenant_charge(server_tenant *tenant, grpc_call *call) {
+    tenant->inflight++;
+    call->tenant = tenant;
+}
+
+/* Next waiting call by deficit round-robin, NULL if every tenant with
+ * waiting calls is at its in-flight bound; caller holds server->mutex.
+ * A lane earns its weight in calls when its turn comes round with no credit
+ * left, so busy tenants are served in proportion to their weights and idle
+ * ones bank nothing. */
+static server_pending_call *server_tenant_pick(grpc_server *server, server_call_queue *queue) {
+    server_tenant_lane *lane = queue->cursor ? queue->cursor : queue->lanes;
+    if (!lane) {
+        return NULL;
+    }
+    
+    for (size_t turns = 0; turns <= 2 * queue->lane_count; turns++) {
+        if (!lane->pending) {
+            lane->deficit = 0;
+        } else if (lane->deficit >= 1 && server_tenant_has_room(server, lane->tenant)) {
+            server_pending_call *pending = lane->pending;
+            lane->pending = pending->next;
+            if (!lane->pending) {
+                lane->pending_tail = NULL;
+            }
+            lane->deficit--;
+            queue->cursor = lane;
+            server_tenant_charge(lane->tenant, pending->call);
+            return pending;
+        }
+        
+        lane = lane->next ? lane->next : queue->lanes;
+        if (lane->pending && lane->deficit < 1) {
+            lane->deficit += lane->tenant->weight;
+        }
+    }
+    return NULL;
+}
+
+/* ========================================================================
+ * Response Cache
+ * ======================================================================== */
+
+int grpc_server_set_method_cache(grpc_server *server, void *registered_method, int ttl_ms,
+                                 size_t max_bytes) {
+    if (!server || !registered_method || ttl_ms <= 0 || max_bytes == 0) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&server->mutex);
+    server_registered_method *rm = server->registered_methods;
+    while (rm && rm != registered_method) {
+        rm = rm->next;
+    }
+    if (server->started || !rm) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    
+    grpc_response_cache *cache = grpc_response_cache_create(max_bytes, ttl_ms);
+    if (!cache) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    grpc_response_cache_destroy(rm->cache);
+    rm->cache = cache;
+    pthread_mutex_unlock(&server->mutex);
+    return 0;
+}
+
+/* Keep a call to a cached or coalescing method until its request is
+ * complete; caller holds server->mutex */
+static int server_cache_hold(grpc_server *server, server_registered_method *rm, grpc_call *call) {
+    server_pending_call *held = (server_pending_call *)calloc(1, sizeof(server_pending_call));
+    if (!held) {
+        return -1;
+    }
+    call->registered_method = rm;
+    call->cache = rm->cache;
+    call->coalesced = rm->coalesce;
+    held->call = call;
+    held->next = server->cache_held;
+    server->cache_held = held;
+    return 0;
+}
+
+/* Answer a call the application never sees and free it */
+static void server_reject_call(grpc_call *call, grpc_status_code status) {
+    const char *details = "Server could not take the call";
+    if (status == GRPC_STATUS_UNAVAILABLE) {
+        details = "Server is not accepting calls";
+    } else if (status == GRPC_STATUS_RESOURCE_EXHAUSTED) {
+        details = "Server overloaded";
+    }
+    
+    pthread_mutex_lock(&call->mutex);
+    call->status_sent = true;
+    pthread_mutex_unlock(&call->mutex);
+    call->transport->send_status(call, status, details, NULL, 0);
+    grpc_call_destroy(call);
 }
 
-int grpc_server_add_insecure_http2_port(grpc_server *server, const char *addr) {
-    if (!server || !addr) {
-        return 0;
+/* Send a reply produced for another call (message may be NULL) and free
+ * the call */
+static void server_answer_call(grpc_call *call, grpc_byte_buffer *message, grpc_status_code status,
+                               const char *details) {
+    pthread_mutex_lock(&call->mutex);
+    call->initial_metadata_sent = true;
+    call->status_sent = true;
+    pthread_mutex_unlock(&call->mutex);
+    
+    const grpc_call_transport *transport = call->transport;
+    if (transport->send_initial_metadata(call, NULL, 0) == 0 &&
+        (!message || transport->send_message(call, message) == 0)) {
+        transport->send_status(call, status, details, NULL, 0);
     }
+    grpc_call_destroy(call);
+}
+
+static bool server_flight_join(grpc_server *server, grpc_call *call, grpc_byte_buffer *request);
+
+typedef struct {
+    grpc_server *server;
+    grpc_call *call;
+    grpc_byte_buffer *request;    /* NULL if the request cannot be cached */
+} server_cache_task;
+
+/* Serve a complete request: answer a cache hit, join an identical call in
+ * flight, or publish the call */
+static void server_cache_serve(void *arg) {
+    server_cache_task *task = (server_cache_task *)arg;
+    grpc_server *server = task->server;
+    grpc_call *call = task->call;
+    grpc_byte_buffer *request = task->request;
+    free(task);
     
-    pthread_mutex_lock(&server->mutex);
+    if (request && call->cache) {
+        grpc_byte_buffer *response = grpc_response_cache_lookup(call->cache, request);
+        if (server->metrics) {
+            grpc_metrics_increment(server->metrics, response ? GRPC_CACHE_HIT_METRIC : GRPC_CACHE_MISS_METRIC, 1);
+        }
+        if (response) {
+            grpc_byte_buffer_destroy(request);
+            server_answer_call(call, response, GRPC_STATUS_OK, NULL);
+            grpc_byte_buffer_destroy(response);
+            return;
+        }
+    }
     
-    if (server->started) {
-        pthread_mutex_unlock(&server->mutex);
-        return 0;
+    if (request && call->coalesced && server_flight_join(server, call, request)) {
+        grpc_byte_buffer_destroy(request);
+        return;
     }
     
-    /* Parse address: host:port */
-    char *host = strdup(addr);
-    char *colon = strchr(host, ':');
-    int port = 50051;
+    /* The response the application sends is stored under the request */
+    if (request && !call->cache) {
+        grpc_byte_buffer_destroy(request);
+        request = NULL;
+    }
+    pthread_mutex_lock(&call->mutex);
+    call->cache_request = request;
+    call->cache_checked = true;
+    pthread_mutex_unlock(&call->mutex);
     
-    if (colon) {
-        *colon = '\0';
-        port = atoi(colon + 1);
+    grpc_status_code status = grpc_server_publish_call(server, call);
+    if (status != GRPC_STATUS_OK) {
+        server_reject_call(call, status);
+    }
+}
+
+/**
+ * A held call to a cached or coalescing method may have its request by now: once the
+ * client half-closed, the call is looked up in the cache. Transports call
+ * this after delivering a half-close or cancellation, without holding
+ * locks; calls that are not held are ignored.
+ * @param server The call's server
+ * @param call Server call, which may already be freed if it is not held
+ */
+void grpc_server_continue_call(grpc_server *server, grpc_call *call) {
+    /* Transport threads call this for every call; most servers hold none */
+    if (!server || !call || __atomic_load_n(&server->hold_count, __ATOMIC_ACQUIRE) == 0) {
+        return;
     }
     
-    /* Create socket */
-    int socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_fd < 0) {
-        free(host);
+    pthread_mutex_lock(&server->mutex);
+    server_pending_call **slot = &server->cache_held;
+    while (*slot && (*slot)->call != call) {
+        slot = &(*slot)->next;
+    }
+    if (!*slot) {
         pthread_mutex_unlock(&server->mutex);
-        return 0;
+        return;
     }
     
-    /* Set socket options */
-    int opt = 1;
-    setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    /* Bind socket */
-    struct sockaddr_in serv_addr;
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    
-    if (strcmp(host, "0.0.0.0") == 0 || strcmp(host, "[::]") == 0) {
-        serv_addr.sin_addr.s_addr = INADDR_ANY;
-    } else {
-        inet_pton(AF_INET, host, &serv_addr.sin_addr);
+    /* A unary request is a single message followed by the half-close */
+    pthread_mutex_lock(&call->mutex);
+    bool cancelled = call->cancelled;
+    bool complete = call->half_close_received;
+    grpc_byte_buffer *request = NULL;
+    if (!cancelled && complete && call->recv_head && call->recv_head == call->recv_tail) {
+        request = grpc_byte_buffer_ref(call->recv_head->buffer);
     }
-    serv_addr.sin_port = htons(port);
+    pthread_mutex_unlock(&call->mutex);
     
-    if (bind(socket_fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        close(socket_fd);
-        free(host);
+    if (!cancelled && !complete) {
         pthread_mutex_unlock(&server->mutex);
-        return 0;
+        return;
     }
+    server_pending_call *held = *slot;
+    *slot = held->next;
+    free(held);
     
-    /* Listen */
-    if (listen(socket_fd, GRPC_DEFAULT_LISTEN_BACKLOG) < 0) {
-        close(socket_fd);
-        free(host);
+    if (cancelled) {
         pthread_mutex_unlock(&server->mutex);
-        return 0;
+        grpc_call_destroy(call);
+        return;
     }
-    
-    /* Add to server ports */
-    if (server->ports_count >= server->ports_capacity) {
-        size_t new_capacity = server->ports_capacity * 2;
-        server_port *new_ports = (server_port *)realloc(server->ports,
-                                                         new_capacity * sizeof(server_port));
-        if (!new_ports) {
-            close(socket_fd);
-            free(host);
-            pthread_mutex_unlock(&server->mutex);
-            return 0;
+    if (server->shutdown_called) {
+        pthread_mutex_unlock(&server->mutex);
+        if (request) {
+            grpc_byte_buffer_destroy(request);
         }
-        server->ports = new_ports;
-        server->ports_capacity = new_capacity;
+        server_reject_call(call, GRPC_STATUS_UNAVAILABLE);
+        return;
     }
     
-    server->ports[server->ports_count].socket_fd = socket_fd;
-    server->ports[server->ports_count].addr = serv_addr;
-    server->ports[server->ports_count].creds = NULL;
-    server->ports_count++;
+    server_cache_task *task = (server_cache_task *)malloc(sizeof(server_cache_task));
+    if (!task) {
+        pthread_mutex_unlock(&server->mutex);
+        if (request) {
+            grpc_byte_buffer_destroy(request);
+        }
+        server_reject_call(call, GRPC_STATUS_RESOURCE_EXHAUSTED);
+        return;
+    }
+    task->server = server;
+    task->call = call;
+    task->request = request;
     
-    free(host);
+    /* Submitted under the mutex so shutdown runs it before the executor goes */
+    bool queued = server->cache_executor &&
+                  grpc_executor_run(server->cache_executor, server_cache_serve, task) == 0;
     pthread_mutex_unlock(&server->mutex);
-    
-    return port;
+    if (!queued) {
+        server_cache_serve(task);
+    }
 }
 
-int grpc_server_add_secure_http2_port(grpc_server *server,
-                                       const char *addr,
-                                       grpc_server_credentials *creds) {
-    /* Suppress unused parameter warning - for future implementation */
-    (void)creds;
+/* Stop answering from the cache; runs the lookups already submitted */
+static void server_cache_stop(grpc_server *server) {
+    pthread_mutex_lock(&server->mutex);
+    grpc_executor *executor = server->cache_executor;
+    server->cache_executor = NULL;
+    pthread_mutex_unlock(&server->mutex);
+    grpc_executor_destroy(executor);
+}
+
+/* ========================================================================
+ * Request Coalescing
+ * ======================================================================== */
+
+int grpc_server_set_method_coalescing(grpc_server *server, void *registered_method, int enabled) {
+    if (!server || !registered_method) {
+        return -1;
+    }
     
-    /* For now, just call insecure version */
-    /* In production, would set up TLS context */
-    return grpc_server_add_insecure_http2_port(server, addr);
+    pthread_mutex_lock(&server->mutex);
+    server_registered_method *rm = server->registered_methods;
+    while (rm && rm != registered_method) {
+        rm = rm->next;
+    }
+    if (server->started || !rm) {
+        pthread_mutex_unlock(&server->mutex);
+        return -1;
+    }
+    rm->coalesce = enabled != 0;
+    pthread_mutex_unlock(&server->mutex);
+    return 0;
 }
 
-void grpc_server_register_completion_queue(grpc_server *server,
-                                            grpc_completion_queue *cq) {
-    if (!server || !cq) {
+/* Double a method's flight table once it holds as many flights as
+ * buckets; caller holds server->mutex */
+static void server_flights_grow(server_registered_method *rm) {
+    size_t size = (rm->flight_mask + 1) * 2;
+    server_flight **buckets = (server_flight **)calloc(size, sizeof(*buckets));
+    if (!buckets) {
         return;
     }
+    for (size_t i = 0; i <= rm->flight_mask; i++) {
+        server_flight *flight = rm->flights[i];
+        while (flight) {
+            server_flight *next = flight->next;
+            flight->next = buckets[flight->hash & (size - 1)];
+            buckets[flight->hash & (size - 1)] = flight;
+            flight = next;
+        }
+    }
+    free(rm->flights);
+    rm->flights = buckets;
+    rm->flight_mask = size - 1;
+}
+
+/* Wait behind a call with the same request, or lead a new flight; returns
+ * true if the call now waits and belongs to the flight */
+static bool server_flight_join(grpc_server *server, grpc_call *call, grpc_byte_buffer *request) {
+    server_registered_method *rm = call->registered_method;
+    uint64_t hash = grpc_hash_bytes(request->data, request->length, 0);
     
     pthread_mutex_lock(&server->mutex);
-    
-    if (server->cqs_count >= server->cqs_capacity) {
-        size_t new_capacity = server->cqs_capacity * 2;
-        grpc_completion_queue **new_cqs = (grpc_completion_queue **)realloc(
-            server->cqs, new_capacity * sizeof(grpc_completion_queue *));
-        if (!new_cqs) {
+    if (!rm->flights) {
+        rm->flights = (server_flight **)calloc(GRPC_FLIGHT_INITIAL_BUCKETS, sizeof(server_flight *));
+        rm->flight_mask = GRPC_FLIGHT_INITIAL_BUCKETS - 1;
+        if (!rm->flights) {
             pthread_mutex_unlock(&server->mutex);
-            return;
+            return false;
         }
-        server->cqs = new_cqs;
-        server->cqs_capacity = new_capacity;
     }
     
-    server->cqs[server->cqs_count++] = cq;
+    for (server_flight *flight = rm->flights[hash & rm->flight_mask]; flight; flight = flight->next) {
+        if (flight->hash != hash || flight->request->length != request->length ||
+            (request->length > 0 && memcmp(flight->request->data, request->data, request->length) != 0)) {
+            continue;
+        }
+        server_pending_call *waiter = (server_pending_call *)calloc(1, sizeof(server_pending_call));
+        if (!waiter) {
+            break;
+        }
+        waiter->call = call;
+        waiter->next = flight->waiters;
+        flight->waiters = waiter;
+        if (server->metrics) {
+            grpc_metrics_increment(server->metrics, GRPC_COALESCED_METRIC, 1);
+        }
+        pthread_mutex_unlock(&server->mutex);
+        return true;
+    }
     
+    if (!server->shutdown_called) {
+        server_flight *flight = (server_flight *)calloc(1, sizeof(server_flight));
+        if (flight) {
+            if (rm->flight_count > rm->flight_mask) {
+                server_flights_grow(rm);
+            }
+            flight->request = grpc_byte_buffer_ref(request);
+            flight->hash = hash;
+            flight->leader = call;
+            flight->next = rm->flights[hash & rm->flight_mask];
+            rm->flights[hash & rm->flight_mask] = flight;
+            rm->flight_count++;
+            call->flight = flight;
+        }
+    }
     pthread_mutex_unlock(&server->mutex);
+    return false;
 }
 
-void *server_worker_thread(void *arg) {
-    grpc_server *server = (grpc_server *)arg;
+/* Unlink a flight and move its waiters onto a list; caller holds server->mutex */
+static void server_flight_take(server_registered_method *rm, server_flight *flight,
+                               server_pending_call **waiters) {
+    server_flight **slot = &rm->flights[flight->hash & rm->flight_mask];
+    while (*slot != flight) {
+        slot = &(*slot)->next;
+    }
+    *slot = flight->next;
+    rm->flight_count--;
+    flight->leader->flight = NULL;
     
-    /* This is a simplified server loop */
-    /* In production, would use epoll/kqueue for multiple connections */
+    while (flight->waiters) {
+        server_pending_call *waiter = flight->waiters;
+        flight->waiters = waiter->next;
+        waiter->next = *waiters;
+        *waiters = waiter;
+    }
+    grpc_byte_buffer_destroy(flight->request);
+    free(flight);
+}
+
+/**
+ * A call that may lead a flight finished: every call waiting on it gets
+ * its reply, or, if the reply cannot be shared, is handed to the
+ * application on its own
+ * @param call Server call with coalesced set
+ * @param shared The reply was sent whole (at most one message) and can be replayed
+ * @param message The reply's message, or NULL
+ * @param status Status sent
+ * @param details Status details sent (may be NULL)
+ */
+void grpc_server_finish_flight(grpc_call *call, bool shared, grpc_byte_buffer *message,
+                               grpc_status_code status, const char *details) {
+    grpc_server *server = call->server;
+    server_pending_call *waiters = NULL;
     
-    while (!server->shutdown_called) {
-        /* Accept connections on all ports */
-        for (size_t i = 0; i < server->ports_count; i++) {
-            fd_set read_fds;
-            FD_ZERO(&read_fds);
-            FD_SET(server->ports[i].socket_fd, &read_fds);
-            
-            struct timeval tv;
-            tv.tv_sec = 0;
-            tv.tv_usec = GRPC_SELECT_TIMEOUT_USEC;
-            
-            int ret = select(server->ports[i].socket_fd + 1, &read_fds, NULL, NULL, &tv);
-            if (ret > 0 && FD_ISSET(server->ports[i].socket_fd, &read_fds)) {
-                struct sockaddr_in client_addr;
-                socklen_t client_len = sizeof(client_addr);
-                int client_fd = accept(server->ports[i].socket_fd,
-                                      (struct sockaddr *)&client_addr,
-                                      &client_len);
-                if (client_fd >= 0) {
-                    /* Handle client connection */
-                    /* In production, would create HTTP/2 connection and process requests */
-                    close(client_fd);
-                }
-            }
+    pthread_mutex_lock(&server->mutex);
+    if (call->flight) {
+        server_flight_take(call->registered_method, call->flight, &waiters);
+    }
+    pthread_mutex_unlock(&server->mutex);
+    
+    while (waiters) {
+        server_pending_call *next = waiters->next;
+        grpc_call *waiter = waiters->call;
+        free(waiters);
+        waiters = next;
+        
+        if (shared) {
+            server_answer_call(waiter, message, status, details);
+            continue;
+        }
+        pthread_mutex_lock(&waiter->mutex);
+        waiter->cache_checked = true;
+        pthread_mutex_unlock(&waiter->mutex);
+        grpc_status_code publish_status = grpc_server_publish_call(server, waiter);
+        if (publish_status != GRPC_STATUS_OK) {
+            server_reject_call(waiter, publish_status);
         }
     }
+}
+
+/* ========================================================================
+ * Call Matching
+ * ======================================================================== */
+
+void grpc_call_details_init(grpc_call_details *details) {
+    if (!details) return;
     
-    return NULL;
+    memset(details, 0, sizeof(*details));
 }
 
-void grpc_server_start(grpc_server *server) {
-    if (!server) {
-        return;
+void grpc_call_details_destroy(grpc_call_details *details) {
+    if (!details) return;
+    
+    free(details->method);
+    free(details->host);
+    details->method = NULL;
+    details->host = NULL;
+}
+
+/* Hand an incoming call to a request and post its tag */
+static void server_complete_request(grpc_server *server, server_call_request *request,
+                                    grpc_call *call) {
+    server_admission_dequeued(server, call);
+    call->cq = request->cq;
+    *request->call = call;
+    if (request->details) {
+        request->details->method = strdup(call->method);
+        request->details->host = call->host ? strdup(call->host) : NULL;
+        request->details->deadline = call->deadline;
+    }
+    if (request->deadline) {
+        *request->deadline = call->deadline;
+    }
+    call_start_deadline(call);
+    
+    grpc_event event;
+    event.type = 1; /* GRPC_OP_COMPLETE */
+    event.success = true;
+    event.tag = request->tag;
+    completion_queue_push_event(request->cq, event);
+    free(request);
+}
+
+static server_call_request *server_queue_pop_request(server_call_queue *queue) {
+    server_call_request *request = queue->call_requests;
+    queue->call_requests = request->next;
+    if (!queue->call_requests) {
+        queue->call_requests_tail = NULL;
+    }
+    return request;
+}
+
+/**
+ * Offer a new server-side call to the application. The call's :path picks
+ * the registered method whose queue it joins.
+ * @param server The server
+ * @param call Server call created by a transport
+ * @return GRPC_STATUS_OK if the call was matched or queued, otherwise the
+ *         status the transport should answer with (UNAVAILABLE when the
+ *         server is not serving, UNIMPLEMENTED for an unknown method)
+ */
+grpc_status_code grpc_server_publish_call(grpc_server *server, grpc_call *call) {
+    if (!server || !call) {
+        return GRPC_STATUS_INTERNAL;
     }
     
     pthread_mutex_lock(&server->mutex);
     
-    if (server->started) {
+    if (!server->started || server->shutdown_called) {
         pthread_mutex_unlock(&server->mutex);
-        return;
+        return GRPC_STATUS_UNAVAILABLE;
     }
     
-    server->started = true;
+    server_call_queue *queue = &server->unregistered;
+    server_admission *admission = &server->unregistered_admission;
+    if (server->method_router) {
+        server_registered_method *rm = server_find_method(server, call->method, call->host);
+        if (!rm) {
+            pthread_mutex_unlock(&server->mutex);
+            return GRPC_STATUS_UNIMPLEMENTED;
+        }
+        call->method_descriptor = rm->descriptor;
+        admission = &rm->admission;
+        if ((rm->cache || rm->coalesce) && !call->cache_checked) {
+            /* Nothing is decided until the request is complete */
+            int rc = server_cache_hold(server, rm, call);
+            pthread_mutex_unlock(&server->mutex);
+            return rc == 0 ? GRPC_STATUS_OK : GRPC_STATUS_RESOURCE_EXHAUSTED;
+        }
+        if (!rm->implicit) {
+            queue = &rm->queue;
+        }
+    }
     
-    /* Start worker threads */
-    server->worker_count = GRPC_DEFAULT_WORKER_THREADS;
-    server->worker_threads = (pthread_t *)calloc(server->worker_count, sizeof(pthread_t));
+    /* Shed load before the call is queued or its body read */
+    if (!server_admit(server, admission, call)) {
+        pthread_mutex_unlock(&server->mutex);
+        return GRPC_STATUS_RESOURCE_EXHAUSTED;
+    }
     
-    for (size_t i = 0; i < server->worker_count; i++) {
-        pthread_create(&server->worker_threads[i], NULL, server_worker_thread, server);
+    server_tenant_lane *lane = NULL;
+    if (server->tenant_key) {
+        lane = server_tenant_lane_get(server, queue, call);
+        if (!lane) {
+            pthread_mutex_unlock(&server->mutex);
+            return GRPC_STATUS_RESOURCE_EXHAUSTED;
+        }
+    }
+    
+    /* A tenant's calls keep their order and respect its bound */
+    if (queue->call_requests &&
+        (!lane || (!lane->pending && server_tenant_has_room(server, lane->tenant)))) {
+        if (lane) {
+            server_tenant_charge(lane->tenant, call);
+        }
+        server_complete_request(server, server_queue_pop_request(queue), call);
+        pthread_mutex_unlock(&server->mutex);
+        return GRPC_STATUS_OK;
+    }
+    
+    server_pending_call *pending = (server_pending_call *)calloc(1, sizeof(server_pending_call));
+    if (!pending) {
+        pthread_mutex_unlock(&server->mutex);
+        return GRPC_STATUS_RESOURCE_EXHAUSTED;
+    }
+    pending->call = call;
+    server_pending_call **head = lane ? &lane->pending : &queue->pending_calls;
+    server_pending_call **tail = lane ? &lane->pending_tail : &queue->pending_calls_tail;
+    if (*tail) {
+        (*tail)->next = pending;
+    } else {
+        *head = pending;
+    }
+    *tail = pending;
+    
+    pthread_mutex_unlock(&server->mutex);
+    return GRPC_STATUS_OK;
+}
+
+/* Match a request with a waiting call or queue it; takes ownership of request */
+static grpc_call_error server_request(grpc_server *server, server_call_queue *queue,
+                                      server_call_request *request) {
+    pthread_mutex_lock(&server->mutex);
+    
+    if (server->shutdown_called) {
+        pthread_mutex_unlock(&server->mutex);
+        
+        grpc_event event;
+        event.type = 1; /* GRPC_OP_COMPLETE */
+        event.success = false;
+        event.tag = request->tag;
+        completion_queue_push_event(request->cq, event);
+        free(request);
+        return GRPC_CALL_OK;
+    }
+    
+    server_pending_call *pending = NULL;
+    if (server->tenant_key) {
+        pending = server_tenant_pick(server, queue);
+    } else if ((pending = queue->pending_calls) != NULL) {
+        queue->pending_calls = pending->next;
+        if (!queue->pending_calls) {
+            queue->pending_calls_tail = NULL;
+        }
+    }
+    if (pending) {
+        server_complete_request(server, request, pending->call);
+        free(pending);
+    } else if (queue->call_requests_tail) {
+        queue->call_requests_tail->next = request;
+        queue->call_requests_tail = request;
+    } else {
+        queue->call_requests = request;
+        queue->call_requests_tail = request;
+    }
+    
+    pthread_mutex_unlock(&server->mutex);
+    return GRPC_CALL_OK;
+}
+
+/* Serve requests that waited while every tenant with calls was at its bound;
+ * caller holds server->mutex */
+static void server_tenant_dispatch(grpc_server *server, server_call_queue *queue) {
+    while (queue->call_requests) {
+        server_pending_call *pending = server_tenant_pick(server, queue);
+        if (!pending) {
+            return;
+        }
+        server_complete_request(server, server_queue_pop_request(queue), pending->call);
+        free(pending);
+    }
+}
+
+/**
+ * Return a destroyed server call's concurrency slot and its tenant's share
+ * @param call Server call that was admitted or charged to a tenant
+ */
+void grpc_server_release_call(grpc_call *call) {
+    grpc_server *server = call->server;
+    
+    pthread_mutex_lock(&server->mutex);
+    server_admission *admission = call->admission;
+    if (admission) {
+        if (call->admission_queued) {
+            admission->queued--;
+        }
+        admission->inflight--;
+        call->admission = NULL;
     }
     
+    server_tenant *tenant = call->tenant;
+    if (tenant) {
+        call->tenant = NULL;
+        tenant->inflight--;
+        if (!server->shutdown_called && server->tenant_max_inflight > 0 &&
+            tenant->inflight + 1 == (size_t)server->tenant_max_inflight) {
+            server_tenant_dispatch(server, &server->unregistered);
+            for (server_registered_method *rm = server->registered_methods; rm; rm = rm->next) {
+                server_tenant_dispatch(server, &rm->queue);
+            }
+        }
+    }
     pthread_mutex_unlock(&server->mutex);
 }
 
@@ -245,14 +2094,107 @@ grpc_call_error grpc_server_request_call(grpc_server *server,
         return GRPC_CALL_ERROR;
     }
     
-    /* Suppress unused parameter warnings - these are for future implementation */
-    (void)details;
-    (void)tag;
+    server_call_request *request = (server_call_request *)calloc(1, sizeof(server_call_request));
+    if (!request) {
+        return GRPC_CALL_ERROR;
+    }
+    request->call = call;
+    request->details = (grpc_call_details *)details;
+    request->cq = cq;
+    request->tag = tag;
+    
+    return server_request(server, &server->unregistered, request);
+}
+
+grpc_call_error grpc_server_request_registered_call(grpc_server *server,
+                                                     void *registered_method,
+                                                     grpc_call **call,
+                                                     grpc_timespec *deadline,
+                                                     grpc_completion_queue *cq,
+                                                     void *tag) {
+    if (!server || !registered_method || !call || !cq) {
+        return GRPC_CALL_ERROR;
+    }
     
-    /* This is a simplified implementation */
-    /* In production, would wait for incoming calls and create call objects */
+    server_call_request *request = (server_call_request *)calloc(1, sizeof(server_call_request));
+    if (!request) {
+        return GRPC_CALL_ERROR;
+    }
+    request->call = call;
+    request->deadline = deadline;
+    request->cq = cq;
+    request->tag = tag;
     
-    return GRPC_CALL_OK;
+    server_registered_method *rm = (server_registered_method *)registered_method;
+    return server_request(server, &rm->queue, request);
+}
+
+/* Move a queue's entries onto the given lists; caller holds server->mutex */
+static void server_queue_take(server_call_queue *queue, server_call_request **requests,
+                              server_pending_call **pending) {
+    if (queue->call_requests) {
+        queue->call_requests_tail->next = *requests;
+        *requests = queue->call_requests;
+    }
+    if (queue->pending_calls) {
+        queue->pending_calls_tail->next = *pending;
+        *pending = queue->pending_calls;
+    }
+    while (queue->lanes) {
+        server_tenant_lane *lane = queue->lanes;
+        if (lane->pending) {
+            lane->pending_tail->next = *pending;
+            *pending = lane->pending;
+        }
+        queue->lanes = lane->next;
+        free(lane);
+    }
+    memset(queue, 0, sizeof(*queue));
+}
+
+/* Fail outstanding requests (posting their tags if notify) and drop calls
+ * nobody asked for */
+static void server_cancel_pending_calls(grpc_server *server, bool notify) {
+    server_call_request *requests = NULL;
+    server_pending_call *pending = NULL;
+    
+    pthread_mutex_lock(&server->mutex);
+    server_queue_take(&server->unregistered, &requests, &pending);
+    for (server_registered_method *rm = server->registered_methods; rm; rm = rm->next) {
+        server_queue_take(&rm->queue, &requests, &pending);
+        for (size_t i = 0; rm->flights && i <= rm->flight_mask; i++) {
+            while (rm->flights[i]) {
+                server_flight_take(rm, rm->flights[i], &pending);
+            }
+        }
+    }
+    while (server->cache_held) {
+        server_pending_call *held = server->cache_held;
+        server->cache_held = held->next;
+        held->next = pending;
+        pending = held;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    
+    while (requests) {
+        server_call_request *next = requests->next;
+        if (notify) {
+            grpc_event event;
+            event.type = 1; /* GRPC_OP_COMPLETE */
+            event.success = false;
+            event.tag = requests->tag;
+            completion_queue_push_event(requests->cq, event);
+        }
+        free(requests);
+        requests = next;
+    }
+    
+    while (pending) {
+        server_pending_call *next = pending->next;
+        grpc_call_destroy(pending->call);
+        free(pending);
+        pending = next;
+    }
 }
 
 void grpc_server_shutdown_and_notify(grpc_server *server,
@@ -275,6 +2217,12 @@ void grpc_server_shutdown_and_notify(grpc_server *server,
         server->worker_threads = NULL;
     }
     
+    server_cache_stop(server);
+    
+    /* Let in-flight streams finish before closing connections */
+    server_drain_connections(server);
+    server_cancel_pending_calls(server, true);
+    
     /* Notify completion queue */
     if (cq && tag) {
         grpc_event event;
@@ -295,11 +2243,55 @@ void grpc_server_destroy(grpc_server *server) {
         if (server->ports[i].socket_fd >= 0) {
             close(server->ports[i].socket_fd);
         }
+        if (server->ports[i].unix_path) {
+            unlink(server->ports[i].unix_path);
+            free(server->ports[i].unix_path);
+        }
     }
     free(server->ports);
     free(server->cqs);
     
+    server_connection *sc = server->connections;
+    server->connections = NULL;
+    
     pthread_mutex_unlock(&server->mutex);
+    
+    /* Cached answers still in flight use the connections */
+    server_cache_stop(server);
+    
+    while (sc) {
+        server_connection *next = sc->next;
+        server_connection_close(sc);
+        sc = next;
+    }
+    
+    /* Destroyed without shutdown: the request queues may be gone already */
+    server_cancel_pending_calls(server, false);
+    
+    server_registered_method *rm = server->registered_methods;
+    while (rm) {
+        server_registered_method *next = rm->next;
+        free(rm->method);
+        free(rm->host);
+        free(rm->admission.metric);
+        grpc_response_cache_destroy(rm->cache);
+        free(rm->flights);
+        free(rm);
+        rm = next;
+    }
+    grpc_method_router_destroy(server->method_router);
+    while (server->tenants) {
+        server_tenant *next = server->tenants->next;
+        free(server->tenants->name);
+        free(server->tenants);
+        server->tenants = next;
+    }
+    free(server->tenant_key);
+    free(server->unregistered_admission.metric);
+    free(server->cpus);
+    grpc_cpu_topology_destroy(server->topology);
+    
+    grpc_resource_quota_unref(server->resource_quota);
     pthread_mutex_destroy(&server->mutex);
     free(server);
 }
@@ -17,6 +17,7 @@
 #define HPACK_INTEGER_MAX_BYTES 5  /* Maximum bytes for variable-length integer */
 #define HPACK_MAX_SHIFT_BITS 28     /* Prevent overflow in 32-bit integers */
 #define HPACK_DECODE_INITIAL_CAPACITY 16  /* Initial capacity for decoded metadata */
+#define HPACK_HEADER_FIELD_OVERHEAD 32     /* Per-field overhead in header list size */
 
 /* Static table entry */
 typedef struct {
@@ -128,6 +129,26 @@ int hpack_encode_integer(uint32_t value, uint8_t prefix_bits, uint8_t *output, s
     return pos;
 }
 
+/* Bytes hpack_encode_integer needs for value */
+static size_t hpack_integer_size(uint32_t value, uint8_t prefix_bits) {
+    uint32_t max_prefix = (1U << prefix_bits) - 1;
+    if (value < max_prefix) {
+        return 1;
+    }
+    
+    size_t size = 2;
+    for (value -= max_prefix; value >= 128; value >>= 7) {
+        size++;
+    }
+    return size;
+}
+
+/* Bytes hpack_encode_literal_header needs for one field */
+static size_t hpack_literal_header_size(size_t name_len, size_t value_len) {
+    return 1 + hpack_integer_size((uint32_t)name_len, 7) + name_len +
+           hpack_integer_size((uint32_t)value_len, 7) + value_len;
+}
+
 /**
  * Decode integer using HPACK integer encoding
  * @param input Input buffer
@@ -192,10 +213,9 @@ int hpack_encode_literal_header(const char *name, const char *value, uint8_t *ou
     size_t value_len = strlen(value);
     size_t pos = 0;
     
-    /* Check if we have space for the header
-     * Worst case: 1 byte prefix + max integer encoding + name + max integer encoding + value */
-    size_t max_required = 1 + HPACK_INTEGER_MAX_BYTES + name_len + HPACK_INTEGER_MAX_BYTES + value_len;
-    if (output_len < max_required) {
+    /* Check if we have space for the header */
+    if (name_len > UINT32_MAX || value_len > UINT32_MAX ||
+        output_len < hpack_literal_header_size(name_len, value_len)) {
         return -1;
     }
     
@@ -255,6 +275,68 @@ int hpack_encode_metadata(const grpc_metadata_array *metadata, uint8_t *output,
     return pos;
 }
 
+/**
+ * Size of the block hpack_encode_metadata produces for metadata
+ * @param metadata Metadata array
+ * @return Encoded size in bytes
+ */
+size_t hpack_metadata_encoded_size(const grpc_metadata_array *metadata) {
+    size_t size = 0;
+    
+    for (size_t i = 0; metadata && i < metadata->count; i++) {
+        const grpc_metadata *md = &metadata->metadata[i];
+        size += hpack_literal_header_size(strlen(md->key), strlen(md->value));
+    }
+    
+    return size;
+}
+
+/**
+ * Header list size as defined for SETTINGS_MAX_HEADER_LIST_SIZE
+ * (RFC 7540 Section 6.5.2): name + value + 32 per field
+ * @param metadata Metadata array
+ * @return Header list size in bytes
+ */
+size_t hpack_metadata_list_size(const grpc_metadata_array *metadata) {
+    size_t size = 0;
+    
+    for (size_t i = 0; metadata && i < metadata->count; i++) {
+        const grpc_metadata *md = &metadata->metadata[i];
+        size += strlen(md->key) + strlen(md->value) + HPACK_HEADER_FIELD_OVERHEAD;
+    }
+    
+    return size;
+}
+
+/**
+ * Encode metadata into a newly allocated block of exactly the right size
+ * @param metadata Metadata array to encode
+ * @param output Output block, free with free()
+ * @param output_len Output block length
+ * @return 0 on success, -1 on error
+ */
+int hpack_encode_metadata_alloc(const grpc_metadata_array *metadata, uint8_t **output, size_t *output_len) {
+    if (!metadata || !output || !output_len) {
+        return -1;
+    }
+    
+    size_t size = hpack_metadata_encoded_size(metadata);
+    uint8_t *block = (uint8_t *)malloc(size > 0 ? size : 1);
+    if (!block) {
+        return -1;
+    }
+    
+    int written = size > 0 ? hpack_encode_metadata(metadata, block, size) : 0;
+    if (written < 0) {
+        free(block);
+        return -1;
+    }
+    
+    *output = block;
+    *output_len = (size_t)written;
+    return 0;
+}
+
 /**
  * Decode a literal header field
  * @param input Input buffer
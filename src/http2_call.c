@@ -0,0 +1,684 @@
+/**
+ * @file http2_call.c
+ * @brief Server calls carried on HTTP/2 streams
+ *
+ * The connection's reading thread turns each stream the client opens into
+ * a server grpc_call and offers it to grpc_server_publish_call(). A link
+ * joins the call to its stream: batch operations write HEADERS and DATA
+ * frames through it, and DATA, END_STREAM and RST_STREAM from the client
+ * are delivered through it. The call and the connection can go away in
+ * either order; the link is freed with its last reference.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Length-prefixed message header: compressed flag and 4-byte length */
+#define GRPC_MESSAGE_HEADER_SIZE 5
+#define GRPC_TIMEOUT_MAX_DIGITS 8
+
+struct http2_call_link {
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;          /* Signalled when busy drops to zero */
+    http2_connection *conn;       /* NULL once the call or connection is gone */
+    http2_stream *stream;
+    grpc_call *call;              /* NULL once the call is destroyed */
+    int busy;                     /* Send operations using conn */
+    int refs;                     /* The call's plus transient reader references */
+    bool headers_sent;
+    char *encoding;               /* grpc-encoding of compressed request messages */
+    /* Message split across DATA frames (reading thread only) */
+    uint8_t *message;
+    size_t message_len;
+    size_t message_capacity;
+};
+
+static const grpc_call_transport http2_server_call_transport;
+
+/* ========================================================================
+ * Link Helpers
+ * ======================================================================== */
+
+void http2_call_link_ref(http2_call_link *link) {
+    __atomic_fetch_add(&link->refs, 1, __ATOMIC_RELAXED);
+}
+
+void http2_call_link_unref(http2_call_link *link) {
+    if (__atomic_sub_fetch(&link->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    
+    free(link->encoding);
+    free(link->message);
+    pthread_cond_destroy(&link->idle);
+    pthread_mutex_destroy(&link->mutex);
+    free(link);
+}
+
+/* Pin the connection for a send; NULL once it is closed */
+static http2_connection *http2_call_begin(http2_call_link *link) {
+    pthread_mutex_lock(&link->mutex);
+    http2_connection *conn = link->conn;
+    if (conn) {
+        link->busy++;
+    }
+    pthread_mutex_unlock(&link->mutex);
+    return conn;
+}
+
+static void http2_call_end(http2_call_link *link) {
+    pthread_mutex_lock(&link->mutex);
+    if (--link->busy == 0) {
+        pthread_cond_broadcast(&link->idle);
+    }
+    pthread_mutex_unlock(&link->mutex);
+}
+
+/* Detach the connection once no send is using it; caller holds link->mutex */
+static void http2_call_detach(http2_call_link *link) {
+    link->conn = NULL;
+    while (link->busy > 0) {
+        pthread_cond_wait(&link->idle, &link->mutex);
+    }
+}
+
+/* ========================================================================
+ * Header Encoding
+ * ======================================================================== */
+
+/* :status and content-type open every response */
+static int http2_call_add_response_headers(grpc_metadata_array *headers) {
+    if (grpc_metadata_array_add(headers, ":status", "200", 3) != 0) {
+        return -1;
+    }
+    return grpc_metadata_array_add(headers, "content-type", "application/grpc", strlen("application/grpc"));
+}
+
+static int http2_call_add_metadata(grpc_metadata_array *headers, const grpc_metadata *metadata, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const char *value = metadata[i].value ? metadata[i].value : "";
+        if (grpc_metadata_array_add(headers, metadata[i].key, value, metadata[i].value_length) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* grpc-message is percent-encoded: anything outside printable ASCII and '%' */
+static int http2_call_add_status_message(grpc_metadata_array *headers, const char *details) {
+    size_t len = strlen(details);
+    char *encoded = (char *)malloc(len * 3 + 1);
+    if (!encoded) {
+        return -1;
+    }
+    
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)details[i];
+        if (c < 0x20 || c > 0x7E || c == '%') {
+            snprintf(encoded + out, 4, "%%%02X", c);
+            out += 3;
+        } else {
+            encoded[out++] = (char)c;
+        }
+    }
+    encoded[out] = '\0';
+    
+    int rc = grpc_metadata_array_add(headers, "grpc-message", encoded, out);
+    free(encoded);
+    return rc;
+}
+
+/* ========================================================================
+ * Transport Operations
+ * ======================================================================== */
+
+static int http2_server_send_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count) {
+    http2_call_link *link = (http2_call_link *)call->transport_data;
+    http2_connection *conn = http2_call_begin(link);
+    if (!conn) {
+        return -1;
+    }
+    
+    grpc_metadata_array headers;
+    int rc = grpc_metadata_array_init(&headers, count + 2);
+    if (rc == 0) {
+        rc = http2_call_add_response_headers(&headers);
+    }
+    if (rc == 0) {
+        rc = http2_call_add_metadata(&headers, metadata, count);
+    }
+    if (rc == 0) {
+        rc = http2_connection_send_headers(conn, link->stream->id, &headers, false);
+    }
+    grpc_metadata_array_destroy(&headers);
+    
+    if (rc == 0) {
+        pthread_mutex_lock(&link->mutex);
+        link->headers_sent = true;
+        pthread_mutex_unlock(&link->mutex);
+    }
+    http2_call_end(link);
+    return rc;
+}
+
+/* One length-prefixed message, in DATA frames as the peer's windows allow.
+ * The payload is sent straight from the message buffer, zero-copy above
+ * the connection's threshold; only the 5-byte prefix is copied. */
+static int http2_server_send_message(grpc_call *call, grpc_byte_buffer *message) {
+    if (message->length > UINT32_MAX) {
+        return -1;
+    }
+    
+    http2_call_link *link = (http2_call_link *)call->transport_data;
+    http2_connection *conn = http2_call_begin(link);
+    if (!conn) {
+        return -1;
+    }
+    
+    uint8_t prefix[GRPC_MESSAGE_HEADER_SIZE];
+    prefix[0] = 0; /* Not compressed */
+    prefix[1] = (uint8_t)(message->length >> 24);
+    prefix[2] = (uint8_t)(message->length >> 16);
+    prefix[3] = (uint8_t)(message->length >> 8);
+    prefix[4] = (uint8_t)message->length;
+    
+    int rc = 0;
+    size_t total = GRPC_MESSAGE_HEADER_SIZE + message->length;
+    size_t offset = 0;
+    while (rc == 0 && offset < total) {
+        pthread_mutex_lock(&conn->write_mutex);
+        size_t max_frame = conn->max_frame_size;
+        pthread_mutex_unlock(&conn->write_mutex);
+        
+        size_t want = total - offset < max_frame ? total - offset : max_frame;
+        int32_t len = http2_flow_control_wait_send_window(conn, link->stream, want);
+        if (len < 0) {
+            rc = -1;
+            break;
+        }
+        
+        /* Whatever is left of the prefix leads the frame */
+        size_t prefix_len = 0;
+        if (offset < GRPC_MESSAGE_HEADER_SIZE) {
+            prefix_len = GRPC_MESSAGE_HEADER_SIZE - offset;
+            if (prefix_len > (size_t)len) {
+                prefix_len = (size_t)len;
+            }
+        }
+        size_t end = offset + prefix_len;
+        size_t payload_offset = end > GRPC_MESSAGE_HEADER_SIZE ? end - GRPC_MESSAGE_HEADER_SIZE : 0;
+        
+        http2_frame_header header;
+        header.length = (uint32_t)len;
+        header.type = HTTP2_FRAME_DATA;
+        header.flags = 0;
+        header.stream_id = link->stream->id;
+        rc = http2_connection_send_data(conn, &header, prefix + (prefix_len > 0 ? offset : 0), prefix_len,
+                                        message, payload_offset);
+        offset += (size_t)len;
+    }
+    
+    http2_call_end(link);
+    return rc;
+}
+
+static int http2_server_send_close(grpc_call *call) {
+    /* Only clients half-close; the batch engine never gets here */
+    (void)call;
+    return -1;
+}
+
+/* Trailers end the stream; without earlier headers they form a
+ * Trailers-Only response that carries :status as well */
+static int http2_server_send_status(grpc_call *call, grpc_status_code status, const char *details,
+                                    const grpc_metadata *trailing_metadata, size_t trailing_count) {
+    http2_call_link *link = (http2_call_link *)call->transport_data;
+    http2_connection *conn = http2_call_begin(link);
+    if (!conn) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&link->mutex);
+    bool trailers_only = !link->headers_sent;
+    link->headers_sent = true;
+    pthread_mutex_unlock(&link->mutex);
+    
+    char code[16];
+    snprintf(code, sizeof(code), "%d", (int)status);
+    
+    grpc_metadata_array headers;
+    int rc = grpc_metadata_array_init(&headers, trailing_count + 4);
+    if (rc == 0 && trailers_only) {
+        rc = http2_call_add_response_headers(&headers);
+    }
+    if (rc == 0) {
+        rc = grpc_metadata_array_add(&headers, "grpc-status", code, strlen(code));
+    }
+    if (rc == 0 && details && details[0] != '\0') {
+        rc = http2_call_add_status_message(&headers, details);
+    }
+    if (rc == 0) {
+        rc = http2_call_add_metadata(&headers, trailing_metadata, trailing_count);
+    }
+    if (rc == 0) {
+        rc = http2_connection_send_headers(conn, link->stream->id, &headers, true);
+    }
+    grpc_metadata_array_destroy(&headers);
+    
+    http2_call_end(link);
+    return rc;
+}
+
+static void http2_server_cancel(grpc_call *call) {
+    http2_call_link *link = (http2_call_link *)call->transport_data;
+    http2_connection *conn = http2_call_begin(link);
+    if (!conn) {
+        return;
+    }
+    
+    http2_connection_send_rst_stream(conn, link->stream->id, HTTP2_CANCEL);
+    http2_call_end(link);
+}
+
+static void http2_server_destroy(grpc_call *call) {
+    http2_call_link *link = (http2_call_link *)call->transport_data;
+    
+    pthread_mutex_lock(&link->mutex);
+    link->call = NULL;
+    http2_connection *conn = link->conn;
+    http2_stream *stream = link->stream;
+    http2_call_detach(link);
+    link->stream = NULL;
+    
+    /* Under link->mutex: the connection is not freed before it detached us */
+    if (conn) {
+        http2_stream_destroy(stream);
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    call->transport_data = NULL;
+    http2_call_link_unref(link);
+}
+
+static const grpc_call_transport http2_server_call_transport = {
+    http2_server_send_initial_metadata,
+    http2_server_send_message,
+    http2_server_send_close,
+    http2_server_send_status,
+    http2_server_cancel,
+    http2_server_destroy
+};
+
+/* ========================================================================
+ * Delivery From the Reading Thread
+ * ======================================================================== */
+
+static uint32_t http2_call_message_length(const uint8_t *header) {
+    return ((uint32_t)header[1] << 24) | ((uint32_t)header[2] << 16) |
+           ((uint32_t)header[3] << 8) | header[4];
+}
+
+/* Hand one complete message to the call; caller holds link->mutex */
+static int http2_call_deliver_message(http2_call_link *link, uint8_t flags, const uint8_t *data, size_t len) {
+    grpc_byte_buffer *buffer;
+    
+    if (flags & 1) {
+        uint8_t *plain;
+        size_t plain_len;
+        if (!link->encoding || grpc_decompress_data(data, len, &plain, &plain_len, link->encoding) != 0) {
+            return -1;
+        }
+        buffer = grpc_byte_buffer_create(plain, plain_len);
+        free(plain);
+    } else {
+        buffer = grpc_byte_buffer_create(data, len);
+    }
+    
+    if (!buffer) {
+        return -1;
+    }
+    call_deliver_message(link->call, buffer);
+    return 0;
+}
+
+/* Split stream data into messages; caller holds link->mutex */
+static int http2_call_consume(http2_call_link *link, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        /* Whole messages in this frame are delivered without copying them first */
+        if (link->message_len == 0 && len >= GRPC_MESSAGE_HEADER_SIZE) {
+            size_t message_len = http2_call_message_length(data);
+            if (len - GRPC_MESSAGE_HEADER_SIZE >= message_len) {
+                if (http2_call_deliver_message(link, data[0], data + GRPC_MESSAGE_HEADER_SIZE, message_len) != 0) {
+                    return -1;
+                }
+                data += GRPC_MESSAGE_HEADER_SIZE + message_len;
+                len -= GRPC_MESSAGE_HEADER_SIZE + message_len;
+                continue;
+            }
+        }
+        
+        /* Buffer up to the end of the current message header or body */
+        size_t need = GRPC_MESSAGE_HEADER_SIZE - link->message_len;
+        if (link->message_len >= GRPC_MESSAGE_HEADER_SIZE) {
+            need = GRPC_MESSAGE_HEADER_SIZE + http2_call_message_length(link->message) - link->message_len;
+        }
+        size_t take = len < need ? len : need;
+        
+        if (link->message_len + take > link->message_capacity) {
+            size_t new_capacity = link->message_capacity ? link->message_capacity : 256;
+            while (new_capacity < link->message_len + take) {
+                new_capacity *= 2;
+            }
+            uint8_t *grown = (uint8_t *)realloc(link->message, new_capacity);
+            if (!grown) {
+                return -1;
+            }
+            link->message = grown;
+            link->message_capacity = new_capacity;
+        }
+        memcpy(link->message + link->message_len, data, take);
+        link->message_len += take;
+        data += take;
+        len -= take;
+        
+        if (link->message_len >= GRPC_MESSAGE_HEADER_SIZE &&
+            link->message_len == GRPC_MESSAGE_HEADER_SIZE + http2_call_message_length(link->message)) {
+            int rc = http2_call_deliver_message(link, link->message[0], link->message + GRPC_MESSAGE_HEADER_SIZE,
+                                                link->message_len - GRPC_MESSAGE_HEADER_SIZE);
+            link->message_len = 0;
+            if (rc != 0) {
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * Deliver DATA received on a server call's stream
+ * @param link Link of the stream (caller holds a reference)
+ * @param data Frame data without padding (may be NULL when len is 0)
+ * @param len Data length
+ * @param end_stream The client half-closed
+ */
+void http2_call_deliver_data(http2_call_link *link, const uint8_t *data, size_t len, bool end_stream) {
+    pthread_mutex_lock(&link->mutex);
+    grpc_call *call = link->call;
+    if (!call) {
+        pthread_mutex_unlock(&link->mutex);
+        return;
+    }
+    grpc_server *server = call->server;
+    
+    bool done = true;
+    if (http2_call_consume(link, data, len) != 0) {
+        /* Undecodable or unaffordable message: the call cannot continue */
+        if (link->conn) {
+            http2_connection_send_rst_stream(link->conn, link->stream->id, HTTP2_INTERNAL_ERROR);
+        }
+        call_deliver_cancel(call);
+    } else if (end_stream) {
+        call_deliver_half_close(call);
+    } else {
+        done = false;
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    if (done) {
+        grpc_server_continue_call(server, call);
+    }
+}
+
+/**
+ * The client reset a server call's stream
+ * @param link Link of the stream (caller holds a reference)
+ */
+void http2_call_deliver_reset(http2_call_link *link) {
+    pthread_mutex_lock(&link->mutex);
+    grpc_call *call = link->call;
+    grpc_server *server = call ? call->server : NULL;
+    if (call) {
+        call_deliver_cancel(call);
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    grpc_server_continue_call(server, call);
+}
+
+/**
+ * Cancel every call on a connection that is going away. Afterwards the
+ * calls no longer touch the connection, so it may be destroyed.
+ * @param conn Server connection, already shut down
+ */
+void http2_call_close_connection(http2_connection *conn) {
+    for (;;) {
+        http2_call_link *link = NULL;
+        
+        pthread_mutex_lock(&conn->streams_mutex);
+        for (size_t i = 0; i < conn->streams_count && !link; i++) {
+            link = conn->streams[i]->link;
+            conn->streams[i]->link = NULL;
+        }
+        if (link) {
+            http2_call_link_ref(link);
+        }
+        pthread_mutex_unlock(&conn->streams_mutex);
+        
+        if (!link) {
+            break;
+        }
+        
+        pthread_mutex_lock(&link->mutex);
+        http2_call_detach(link);
+        link->stream = NULL;
+        grpc_call *call = link->call;
+        grpc_server *server = call ? call->server : NULL;
+        if (call) {
+            call_deliver_cancel(call);
+        }
+        pthread_mutex_unlock(&link->mutex);
+        http2_call_link_unref(link);
+        
+        /* A call held for its request is not anybody else's to free */
+        grpc_server_continue_call(server, call);
+    }
+}
+
+/* ========================================================================
+ * Accepting Calls
+ * ======================================================================== */
+
+/* grpc-timeout is up to 8 digits and a unit; no header means no deadline */
+static grpc_timespec http2_call_parse_timeout(const char *value) {
+    grpc_timespec never = {INT64_MAX, 0};
+    if (!value) {
+        return never;
+    }
+    
+    size_t digits = strspn(value, "0123456789");
+    if (digits == 0 || digits > GRPC_TIMEOUT_MAX_DIGITS || value[digits] == '\0' || value[digits + 1] != '\0') {
+        return never;
+    }
+    
+    int64_t amount = strtoll(value, NULL, 10);
+    int64_t ms;
+    switch (value[digits]) {
+        case 'H': ms = amount * 3600000; break;
+        case 'M': ms = amount * 60000; break;
+        case 'S': ms = amount * 1000; break;
+        case 'm': ms = amount; break;
+        case 'u': ms = (amount + 999) / 1000; break;
+        case 'n': ms = (amount + 999999) / 1000000; break;
+        default: return never;
+    }
+    return grpc_timeout_milliseconds_to_deadline(ms);
+}
+
+/* Three significant digits: deadlines a few milliseconds apart encode to
+ * the same value, which HPACK indexes once and then sends as one byte */
+static int64_t http2_call_round_timeout(int64_t value) {
+    int64_t scale = 1;
+    while (value / scale >= 1000) {
+        scale *= 10;
+    }
+    return (value + scale - 1) / scale * scale;
+}
+
+/**
+ * Encode the time left before a deadline as a grpc-timeout value, in the
+ * coarsest unit that keeps it exact after rounding up
+ * @param timeout_ms Milliseconds left (0 or less expires on arrival)
+ * @param buf Output, at least GRPC_TIMEOUT_MAX_DIGITS + 2 bytes
+ * @param size Size of buf
+ * @return 0 on success, -1 if buf is too small
+ */
+int http2_call_format_timeout(int64_t timeout_ms, char *buf, size_t size) {
+    int64_t amount = 1;
+    char unit = 'n';
+    if (timeout_ms > 0) {
+        int64_t ms = http2_call_round_timeout(timeout_ms);
+        int64_t seconds = ms / 1000;
+        int64_t minutes = (seconds + 59) / 60;
+        if (ms % 1000 != 0) {
+            amount = ms;
+            unit = 'm';
+        } else if (seconds % 60 != 0 && seconds < 100000000) {
+            amount = seconds;
+            unit = 'S';
+        } else if (minutes % 60 != 0 && minutes < 100000000) {
+            amount = minutes;
+            unit = 'M';
+        } else {
+            amount = (minutes + 59) / 60;
+            if (amount > 99999999) {
+                amount = 99999999;
+            }
+            unit = 'H';
+        }
+    }
+    
+    int len = snprintf(buf, size, "%lld%c", (long long)amount, unit);
+    return len > 0 && (size_t)len < size ? 0 : -1;
+}
+
+/* Headers that belong to HTTP/2 or gRPC framing are not shown to the application */
+static bool http2_call_is_reserved_header(const char *key) {
+    return key[0] == ':' || strcmp(key, "te") == 0 || strcmp(key, "content-type") == 0 ||
+           strcmp(key, "grpc-timeout") == 0 || strcmp(key, "grpc-encoding") == 0 ||
+           strcmp(key, "grpc-accept-encoding") == 0;
+}
+
+/* Answer a call the application never sees and free it */
+static void http2_call_reject(grpc_call *call, grpc_status_code status) {
+    char details[256];
+    if (status == GRPC_STATUS_UNIMPLEMENTED) {
+        snprintf(details, sizeof(details), "Method not found: %s", call->method);
+    } else if (status == GRPC_STATUS_UNAVAILABLE) {
+        snprintf(details, sizeof(details), "Server is not accepting calls");
+    } else if (status == GRPC_STATUS_RESOURCE_EXHAUSTED) {
+        snprintf(details, sizeof(details), "Server overloaded");
+    } else {
+        snprintf(details, sizeof(details), "Server could not take the call");
+    }
+    
+    http2_server_send_status(call, status, details, NULL, 0);
+    
+    /* Finished, so destroying it does not also reset the stream */
+    pthread_mutex_lock(&call->mutex);
+    call->status_sent = true;
+    pthread_mutex_unlock(&call->mutex);
+    grpc_call_destroy(call);
+}
+
+/**
+ * Turn a stream opened by the client into a server call and offer it to
+ * the server. Installed as the accept_stream callback of server
+ * connections; runs on the reading thread.
+ * @param conn Server connection
+ * @param stream New stream holding the request headers
+ * @param server The grpc_server
+ */
+void http2_call_accept_stream(http2_connection *conn, http2_stream *stream, void *server) {
+    const grpc_metadata_array *headers = &stream->initial_metadata;
+    const char *path = NULL, *authority = NULL, *timeout = NULL, *encoding = NULL;
+    size_t app_count = 0;
+    
+    for (size_t i = 0; i < headers->count; i++) {
+        const grpc_metadata *md = &headers->metadata[i];
+        if (strcmp(md->key, ":path") == 0) {
+            path = md->value;
+        } else if (strcmp(md->key, ":authority") == 0) {
+            authority = md->value;
+        } else if (strcmp(md->key, "grpc-timeout") == 0) {
+            timeout = md->value;
+        } else if (strcmp(md->key, "grpc-encoding") == 0) {
+            encoding = md->value;
+        }
+        if (!http2_call_is_reserved_header(md->key)) {
+            app_count++;
+        }
+    }
+    
+    uint32_t stream_id = stream->id;
+    if (!path || path[0] != '/') {
+        http2_stream_destroy(stream);
+        http2_connection_send_rst_stream(conn, stream_id, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+    
+    grpc_call *call = call_create(NULL, (grpc_server *)server, NULL, path, authority,
+                                  http2_call_parse_timeout(timeout));
+    http2_call_link *link = (http2_call_link *)calloc(1, sizeof(http2_call_link));
+    grpc_metadata *app_metadata = (grpc_metadata *)calloc(app_count ? app_count : 1, sizeof(grpc_metadata));
+    char *encoding_copy = encoding ? strdup(encoding) : NULL;
+    if (!call || !link || !app_metadata || (encoding && !encoding_copy)) {
+        grpc_call_destroy(call);
+        free(link);
+        free(app_metadata);
+        free(encoding_copy);
+        http2_stream_destroy(stream);
+        http2_connection_send_rst_stream(conn, stream_id, HTTP2_REFUSED_STREAM);
+        return;
+    }
+    
+    pthread_mutex_init(&link->mutex, NULL);
+    pthread_cond_init(&link->idle, NULL);
+    link->conn = conn;
+    link->stream = stream;
+    link->call = call;
+    link->refs = 1;
+    link->encoding = encoding_copy;
+    call->transport = &http2_server_call_transport;
+    call->transport_data = link;
+    
+    size_t n = 0;
+    for (size_t i = 0; i < headers->count; i++) {
+        if (!http2_call_is_reserved_header(headers->metadata[i].key)) {
+            app_metadata[n++] = headers->metadata[i];
+        }
+    }
+    call_deliver_initial_metadata(call, app_metadata, app_count);
+    free(app_metadata);
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    stream->link = link;
+    bool end_stream = stream->end_stream_received;
+    pthread_mutex_unlock(&conn->streams_mutex);
+    if (end_stream) {
+        call_deliver_half_close(call);
+    }
+    
+    grpc_status_code status = grpc_server_publish_call((grpc_server *)server, call);
+    if (status != GRPC_STATUS_OK) {
+        http2_call_reject(call, status);
+    } else if (end_stream) {
+        grpc_server_continue_call((grpc_server *)server, call);
+    }
+}
@@ -3,6 +3,7 @@
  * @brief HTTP/2 transport layer implementation
  */
 
+#define _DEFAULT_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #include "grpc_internal.h"
 #include <stdio.h>
@@ -12,19 +13,40 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
 
-/* HTTP/2 connection preface (for future use in connection establishment) */
-static const uint8_t HTTP2_CLIENT_PREFACE[] __attribute__((unused)) = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
-static const size_t HTTP2_CLIENT_PREFACE_LEN __attribute__((unused)) = 24;
+/* Connection preface every client sends first (RFC 7540 3.5) */
+static const uint8_t HTTP2_CLIENT_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+#define HTTP2_CLIENT_PREFACE_LEN 24
 
 /* HTTP/2 frame header size */
 #define HTTP2_FRAME_HEADER_SIZE 9
 
+/* HTTP/2 frame flags */
+#define HTTP2_FLAG_ACK 0x01
+#define HTTP2_FLAG_END_STREAM 0x01
+#define HTTP2_FLAG_END_HEADERS 0x04
+#define HTTP2_FLAG_PADDED 0x08
+#define HTTP2_FLAG_PRIORITY 0x20
+
 /* Default HTTP/2 settings */
 #define HTTP2_DEFAULT_WINDOW_SIZE 65535
 #define HTTP2_DEFAULT_MAX_FRAME_SIZE 16384
+#define HTTP2_MAX_ALLOWED_FRAME_SIZE 16777215
+#define HTTP2_DEFAULT_MAX_HEADER_LIST_SIZE 16384
+#define HTTP2_SETTINGS_ENTRY_SIZE 6
+/* Dropped fragments of an oversized header block beyond this many times
+ * the limit are treated as a flood and fail the connection */
+#define HTTP2_HEADER_BLOCK_FLOOD_FACTOR 4
 #define HTTP2_DEFAULT_MAX_CONCURRENT_STREAMS 100
 #define HTTP2_DEFAULT_LISTEN_BACKLOG 128
+/* Largest stream id; the first GOAWAY of a drain announces it */
+#define HTTP2_MAX_STREAM_ID 0x7FFFFFFFu
 
 /* ========================================================================
  * HTTP/2 Connection Implementation
@@ -39,8 +61,11 @@ http2_connection *http2_connection_create(const char *target, bool is_client, vo
     conn->is_client = is_client;
     conn->next_stream_id = is_client ? 1 : 2;
     conn->socket_fd = -1; /* Initialize to invalid */
+    conn->max_header_list_size = HTTP2_DEFAULT_MAX_HEADER_LIST_SIZE;
+    conn->peer_max_header_list_size = UINT32_MAX; /* Unlimited until the peer's SETTINGS */
     pthread_mutex_init(&conn->write_mutex, NULL);
     pthread_mutex_init(&conn->streams_mutex, NULL);
+    pthread_cond_init(&conn->send_window_cond, NULL);
     
     conn->streams_capacity = 16;
     conn->streams = (http2_stream **)calloc(conn->streams_capacity, sizeof(http2_stream *));
@@ -60,37 +85,89 @@ http2_connection *http2_connection_create(const char *target, bool is_client, vo
     return conn;
 }
 
+/**
+ * Connect a client connection's socket to its target
+ * @param conn HTTP/2 connection (not yet connected)
+ * @param target "host:port", "unix:path" or "unix-abstract:name"
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_connect(http2_connection *conn, const char *target) {
+    if (!conn || !target || conn->socket_fd >= 0) {
+        return -1;
+    }
+    
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    if (grpc_address_parse(target, &addr, &addr_len) != 0) {
+        return -1;
+    }
+    
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    if (connect(fd, (struct sockaddr *)&addr, addr_len) != 0) {
+        close(fd);
+        return -1;
+    }
+    
+    /* Local hops can authenticate the server process cheaply */
+    if (addr.ss_family == AF_UNIX) {
+        conn->has_peer_cred = grpc_socket_get_peer_cred(fd, &conn->peer_cred) == 0;
+        
+        if (conn->shm_ring_bytes > 0) {
+            conn->shm = shm_transport_connect(fd, conn->shm_ring_bytes);
+            if (!conn->shm) {
+                close(fd);
+                return -1;
+            }
+        }
+    }
+    
+    conn->socket_fd = fd;
+    return 0;
+}
+
 void http2_connection_destroy(http2_connection *conn) {
     if (!conn) return;
     
+    if (conn->reader_started) {
+        http2_connection_shutdown(conn);
+        pthread_join(conn->reader, NULL);
+    }
+    
     pthread_mutex_lock(&conn->streams_mutex);
     for (size_t i = 0; i < conn->streams_count; i++) {
+        /* Detach first so the stream does not re-take streams_mutex */
+        conn->streams[i]->conn = NULL;
         http2_stream_destroy(conn->streams[i]);
     }
     free(conn->streams);
     pthread_mutex_unlock(&conn->streams_mutex);
     
+    free(conn->header_block);
+    shm_transport_destroy(conn->shm);
     if (conn->socket_fd >= 0) {
         close(conn->socket_fd);
     }
     
+    /* The socket is gone, so no more completions will arrive */
+    http2_zerocopy_pending *pending = conn->zerocopy_pending;
+    while (pending) {
+        http2_zerocopy_pending *next = pending->next;
+        grpc_byte_buffer_destroy(pending->buffer);
+        free(pending);
+        pending = next;
+    }
+    
+    pthread_cond_destroy(&conn->send_window_cond);
     pthread_mutex_destroy(&conn->write_mutex);
     pthread_mutex_destroy(&conn->streams_mutex);
     free(conn);
 }
 
-int http2_connection_send_frame(http2_connection *conn, const http2_frame_header *header, const uint8_t *payload) {
-    if (!conn || !header) {
-        return -1;
-    }
-    
-    /* Check if socket is valid */
-    if (conn->socket_fd < 0) {
-        return -1;
-    }
-    
-    /* Encode frame header */
-    uint8_t frame_header[HTTP2_FRAME_HEADER_SIZE];
+static void http2_encode_frame_header(const http2_frame_header *header, uint8_t *frame_header) {
     frame_header[0] = (header->length >> 16) & 0xFF;
     frame_header[1] = (header->length >> 8) & 0xFF;
     frame_header[2] = header->length & 0xFF;
@@ -100,29 +177,236 @@ int http2_connection_send_frame(http2_connection *conn, const http2_frame_header
     frame_header[6] = (header->stream_id >> 16) & 0xFF;
     frame_header[7] = (header->stream_id >> 8) & 0xFF;
     frame_header[8] = header->stream_id & 0xFF;
+}
+
+/* Write one frame to the socket or ring; caller holds write_mutex */
+static int http2_connection_write_frame(http2_connection *conn, const http2_frame_header *header,
+                                        const uint8_t *payload) {
+    /* Encode frame header */
+    uint8_t frame_header[HTTP2_FRAME_HEADER_SIZE];
+    http2_encode_frame_header(header, frame_header);
     
-    pthread_mutex_lock(&conn->write_mutex);
+    if (conn->shm) {
+        int rc = shm_transport_write(conn->shm, frame_header, HTTP2_FRAME_HEADER_SIZE);
+        if (rc == 0 && header->length > 0 && payload) {
+            rc = shm_transport_write(conn->shm, payload, header->length);
+        }
+        return rc;
+    }
     
     /* Send frame header */
-    ssize_t sent = send(conn->socket_fd, frame_header, HTTP2_FRAME_HEADER_SIZE, 0);
+    ssize_t sent = send(conn->socket_fd, frame_header, HTTP2_FRAME_HEADER_SIZE, MSG_NOSIGNAL);
     if (sent != HTTP2_FRAME_HEADER_SIZE) {
-        pthread_mutex_unlock(&conn->write_mutex);
         return -1;
     }
     
     /* Send payload if present */
     if (header->length > 0 && payload) {
-        sent = send(conn->socket_fd, payload, header->length, 0);
+        sent = send(conn->socket_fd, payload, header->length, MSG_NOSIGNAL);
         if (sent != (ssize_t)header->length) {
-            pthread_mutex_unlock(&conn->write_mutex);
             return -1;
         }
     }
     
+    return 0;
+}
+
+/* Take write_mutex for a frame write, counting writes that had to wait */
+static void http2_connection_lock_writes(http2_connection *conn) {
+    __atomic_fetch_add(&conn->write_locks, 1, __ATOMIC_RELAXED);
+    if (pthread_mutex_trylock(&conn->write_mutex) != 0) {
+        __atomic_fetch_add(&conn->write_contended, 1, __ATOMIC_RELAXED);
+        pthread_mutex_lock(&conn->write_mutex);
+    }
+}
+
+/**
+ * Read the write lock counters of a connection
+ * @param conn HTTP/2 connection
+ * @param locks Set to the number of frame writes
+ * @param contended Set to the number of those that waited for another writer
+ */
+void http2_connection_write_contention(http2_connection *conn, uint64_t *locks, uint64_t *contended) {
+    *locks = __atomic_load_n(&conn->write_locks, __ATOMIC_RELAXED);
+    *contended = __atomic_load_n(&conn->write_contended, __ATOMIC_RELAXED);
+}
+
+int http2_connection_send_frame(http2_connection *conn, const http2_frame_header *header, const uint8_t *payload) {
+    if (!conn || !header) {
+        return -1;
+    }
+    
+    /* Check if socket is valid */
+    if (conn->socket_fd < 0) {
+        return -1;
+    }
+    
+    http2_connection_lock_writes(conn);
+    int rc = http2_connection_write_frame(conn, header, payload);
+    pthread_mutex_unlock(&conn->write_mutex);
+    return rc;
+}
+
+/* Read exactly len bytes from the shared-memory ring or the socket */
+static int http2_connection_recv_exact(http2_connection *conn, uint8_t *buf, size_t len) {
+    if (conn->shm) {
+        return shm_transport_read(conn->shm, buf, len);
+    }
+    
+    ssize_t received = recv(conn->socket_fd, buf, len, MSG_WAITALL);
+    return received == (ssize_t)len ? 0 : -1;
+}
+
+/**
+ * Send the client connection preface; SETTINGS should follow it
+ * @param conn Connected client connection
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_send_preface(http2_connection *conn) {
+    if (!conn || conn->socket_fd < 0) {
+        return -1;
+    }
+    
+    int rc;
+    pthread_mutex_lock(&conn->write_mutex);
+    if (conn->shm) {
+        rc = shm_transport_write(conn->shm, HTTP2_CLIENT_PREFACE, HTTP2_CLIENT_PREFACE_LEN);
+    } else {
+        ssize_t sent = send(conn->socket_fd, HTTP2_CLIENT_PREFACE, HTTP2_CLIENT_PREFACE_LEN, MSG_NOSIGNAL);
+        rc = sent == HTTP2_CLIENT_PREFACE_LEN ? 0 : -1;
+    }
     pthread_mutex_unlock(&conn->write_mutex);
+    return rc;
+}
+
+/**
+ * Read and check the client connection preface on an accepted connection
+ * @param conn Server connection
+ * @return 0 if the preface matched, -1 otherwise
+ */
+int http2_connection_recv_preface(http2_connection *conn) {
+    if (!conn || conn->socket_fd < 0) {
+        return -1;
+    }
+    
+    uint8_t preface[HTTP2_CLIENT_PREFACE_LEN];
+    if (http2_connection_recv_exact(conn, preface, sizeof(preface)) != 0) {
+        return -1;
+    }
+    return memcmp(preface, HTTP2_CLIENT_PREFACE, sizeof(preface)) == 0 ? 0 : -1;
+}
+
+/* Bound how long a read may block on a connection's socket; 0 waits forever */
+static int http2_connection_set_recv_timeout(http2_connection *conn, int timeout_ms) {
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    return setsockopt(conn->socket_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+/**
+ * Connect a client connection and exchange SETTINGS with the server: the
+ * preface and our SETTINGS go out, then frames are processed until the
+ * server's SETTINGS has been applied and acknowledged. A reader thread
+ * (http2_connection_start_reader()) takes over the connection afterwards.
+ * @param conn Client connection, not yet connected
+ * @param target Address to dial
+ * @param timeout_ms Longest wait for each frame from the server
+ * @return 0 once the connection is ready for streams, -1 on error
+ */
+int http2_connection_handshake(http2_connection *conn, const char *target, int timeout_ms) {
+    if (http2_connection_connect(conn, target) != 0 || http2_connection_send_preface(conn) != 0 ||
+        http2_connection_send_settings(conn) != 0 || http2_connection_set_recv_timeout(conn, timeout_ms) != 0) {
+        return -1;
+    }
+    
+    /* The server may send other frames first, e.g. a WINDOW_UPDATE */
+    bool settled = false;
+    while (!settled) {
+        http2_frame_header header;
+        uint8_t *payload = NULL;
+        if (http2_connection_recv_frame(conn, &header, &payload) != 0) {
+            return -1;
+        }
+        settled = header.type == HTTP2_FRAME_SETTINGS && !(header.flags & HTTP2_FLAG_ACK);
+        int rc = http2_connection_process_frame(conn, &header, payload);
+        free(payload);
+        if (rc != 0) {
+            return -1;
+        }
+    }
+    if (http2_connection_set_recv_timeout(conn, 0) != 0) {
+        return -1;
+    }
+    return http2_connection_start_reader(conn);
+}
+
+/* Process frames from the server until the connection fails or is shut down */
+static void *http2_connection_reader(void *arg) {
+    http2_connection *conn = (http2_connection *)arg;
+    
+    for (;;) {
+        http2_frame_header header;
+        uint8_t *payload = NULL;
+        if (http2_connection_recv_frame(conn, &header, &payload) != 0) {
+            break;
+        }
+        int rc = http2_connection_process_frame(conn, &header, payload);
+        free(payload);
+        if (rc != 0) {
+            http2_connection_send_goaway(conn, conn->last_peer_stream_id, HTTP2_PROTOCOL_ERROR);
+            break;
+        }
+    }
+    
+    /* Marks the connection closed, so its owner replaces it */
+    http2_connection_shutdown(conn);
+    return NULL;
+}
+
+/**
+ * Start the thread that reads a connected client connection: GOAWAY,
+ * PING, SETTINGS and WINDOW_UPDATE take effect as they arrive, and the
+ * connection is marked closed when the server goes away. The thread is
+ * joined by http2_connection_destroy().
+ * @param conn Client connection, connected
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_start_reader(http2_connection *conn) {
+    if (!conn || conn->socket_fd < 0 || conn->reader_started) {
+        return -1;
+    }
+    if (pthread_create(&conn->reader, NULL, http2_connection_reader, conn) != 0) {
+        return -1;
+    }
+    conn->reader_started = true;
     return 0;
 }
 
+/**
+ * Stop all I/O on a connection without freeing it: a thread blocked
+ * reading returns, later sends fail and senders waiting for flow control
+ * wake up
+ * @param conn HTTP/2 connection
+ */
+void http2_connection_shutdown(http2_connection *conn) {
+    if (!conn) {
+        return;
+    }
+    
+    /* Before taking write_mutex: a writer may hold it, blocked on the socket */
+    __atomic_store_n(&conn->closed, true, __ATOMIC_RELEASE);
+    if (conn->socket_fd >= 0) {
+        shutdown(conn->socket_fd, SHUT_RDWR);
+    }
+    
+    pthread_mutex_lock(&conn->write_mutex);
+    pthread_cond_broadcast(&conn->send_window_cond);
+    pthread_mutex_unlock(&conn->write_mutex);
+}
+
+static void http2_zerocopy_wait_readable(http2_connection *conn);
+
 int http2_connection_recv_frame(http2_connection *conn, http2_frame_header *header, uint8_t **payload) {
     if (!conn || !header) {
         return -1;
@@ -133,10 +417,13 @@ int http2_connection_recv_frame(http2_connection *conn, http2_frame_header *head
         return -1;
     }
     
+    if (!conn->shm) {
+        http2_zerocopy_wait_readable(conn);
+    }
+    
     /* Receive frame header */
     uint8_t frame_header[HTTP2_FRAME_HEADER_SIZE];
-    ssize_t received = recv(conn->socket_fd, frame_header, HTTP2_FRAME_HEADER_SIZE, MSG_WAITALL);
-    if (received != HTTP2_FRAME_HEADER_SIZE) {
+    if (http2_connection_recv_exact(conn, frame_header, HTTP2_FRAME_HEADER_SIZE) != 0) {
         return -1;
     }
     
@@ -154,8 +441,7 @@ int http2_connection_recv_frame(http2_connection *conn, http2_frame_header *head
             return -1;
         }
         
-        received = recv(conn->socket_fd, *payload, header->length, MSG_WAITALL);
-        if (received != (ssize_t)header->length) {
+        if (http2_connection_recv_exact(conn, *payload, header->length) != 0) {
             free(*payload);
             *payload = NULL;
             return -1;
@@ -168,77 +454,1258 @@ int http2_connection_recv_frame(http2_connection *conn, http2_frame_header *head
 }
 
 /* ========================================================================
- * HTTP/2 Stream Implementation
+ * Frame Processing and GOAWAY
  * ======================================================================== */
 
-http2_stream *http2_stream_create(http2_connection *conn, uint32_t stream_id) {
+bool http2_connection_is_draining(http2_connection *conn) {
     if (!conn) {
-        return NULL;
+        return false;
     }
     
-    http2_stream *stream = (http2_stream *)calloc(1, sizeof(http2_stream));
-    if (!stream) {
-        return NULL;
+    pthread_mutex_lock(&conn->streams_mutex);
+    bool draining = conn->goaway_sent || conn->goaway_received;
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    return draining;
+}
+
+size_t http2_connection_active_streams(http2_connection *conn) {
+    if (!conn) {
+        return 0;
     }
     
-    stream->id = stream_id;
-    stream->conn = conn;
-    stream->headers_sent = false;
-    stream->end_stream_sent = false;
-    stream->end_stream_received = false;
-    stream->status = GRPC_STATUS_OK;
+    pthread_mutex_lock(&conn->streams_mutex);
+    size_t count = conn->streams_count;
+    pthread_mutex_unlock(&conn->streams_mutex);
     
-    /* Initialize flow control */
-    http2_flow_control_init_stream(stream);
+    return count;
+}
+
+/* Write a GOAWAY frame without touching the GOAWAY state */
+static int http2_connection_write_goaway(http2_connection *conn, uint32_t last_stream_id, uint32_t error_code) {
+    uint8_t payload[8];
+    payload[0] = (last_stream_id >> 24) & 0x7F;
+    payload[1] = (last_stream_id >> 16) & 0xFF;
+    payload[2] = (last_stream_id >> 8) & 0xFF;
+    payload[3] = last_stream_id & 0xFF;
+    payload[4] = (error_code >> 24) & 0xFF;
+    payload[5] = (error_code >> 16) & 0xFF;
+    payload[6] = (error_code >> 8) & 0xFF;
+    payload[7] = error_code & 0xFF;
+    
+    http2_frame_header header;
+    header.length = sizeof(payload);
+    header.type = HTTP2_FRAME_GOAWAY;
+    header.flags = 0;
+    header.stream_id = 0;
+    
+    return http2_connection_send_frame(conn, &header, payload);
+}
+
+/* Record an announced last stream id; caller holds streams_mutex */
+static void http2_connection_record_goaway(http2_connection *conn, uint32_t last_stream_id) {
+    if (!conn->goaway_sent || last_stream_id < conn->goaway_sent_last_id) {
+        conn->goaway_sent_last_id = last_stream_id;
+    }
+    conn->goaway_sent = true;
+}
+
+/**
+ * Send a GOAWAY frame
+ * @param conn HTTP/2 connection
+ * @param last_stream_id Highest peer-initiated stream that will be processed
+ * @param error_code HTTP/2 error code (HTTP2_NO_ERROR for graceful drain)
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_send_goaway(http2_connection *conn, uint32_t last_stream_id, uint32_t error_code) {
+    if (!conn) {
+        return -1;
+    }
     
-    /* Add stream to connection */
     pthread_mutex_lock(&conn->streams_mutex);
-    if (conn->streams_count >= conn->streams_capacity) {
-        size_t new_capacity = conn->streams_capacity * 2;
-        http2_stream **new_streams = (http2_stream **)realloc(conn->streams, 
-                                                               new_capacity * sizeof(http2_stream *));
-        if (!new_streams) {
-            pthread_mutex_unlock(&conn->streams_mutex);
-            free(stream);
-            return NULL;
-        }
-        conn->streams = new_streams;
-        conn->streams_capacity = new_capacity;
+    http2_connection_record_goaway(conn, last_stream_id);
+    conn->drain_ping_outstanding = false;
+    conn->drain_finished = true;
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    return http2_connection_write_goaway(conn, last_stream_id, error_code);
+}
+
+/* Opaque of the drain PING; keepalive PINGs count up from 1 and never set the top bit */
+static const uint8_t http2_drain_ping_payload[8] = {0x80, 'd', 'r', 'a', 'i', 'n', 0, 0};
+
+/**
+ * Start a graceful drain: GOAWAY with the largest stream id, so the peer
+ * stops opening streams without losing any already on the wire, and a
+ * PING. The final GOAWAY follows when the PING is acknowledged, which
+ * proves the peer has seen the first one. A drain already started, or a
+ * GOAWAY already sent, is left alone.
+ * @param conn Server connection
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_start_drain(http2_connection *conn) {
+    if (!conn) {
+        return -1;
     }
-    conn->streams[conn->streams_count++] = stream;
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    if (conn->goaway_sent) {
+        pthread_mutex_unlock(&conn->streams_mutex);
+        return 0;
+    }
+    http2_connection_record_goaway(conn, HTTP2_MAX_STREAM_ID);
+    conn->drain_ping_outstanding = true;
     pthread_mutex_unlock(&conn->streams_mutex);
     
-    return stream;
+    http2_frame_header header;
+    header.length = sizeof(http2_drain_ping_payload);
+    header.type = HTTP2_FRAME_PING;
+    header.flags = 0;
+    header.stream_id = 0;
+    
+    if (http2_connection_write_goaway(conn, HTTP2_MAX_STREAM_ID, HTTP2_NO_ERROR) != 0 ||
+        http2_connection_send_frame(conn, &header, http2_drain_ping_payload) != 0) {
+        return -1;
+    }
+    return 0;
 }
 
-void http2_stream_destroy(http2_stream *stream) {
-    if (!stream) return;
+/**
+ * Send the final GOAWAY of a drain, naming the last stream the peer opened.
+ * Called when the drain PING is acknowledged, or by the owner when the ACK
+ * does not come in time; only the first call sends anything.
+ * @param conn Server connection
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_finish_drain(http2_connection *conn) {
+    if (!conn) {
+        return -1;
+    }
     
-    /* Remove stream from connection's streams array */
-    if (stream->conn) {
-        pthread_mutex_lock(&stream->conn->streams_mutex);
-        for (size_t i = 0; i < stream->conn->streams_count; i++) {
-            if (stream->conn->streams[i] == stream) {
-                /* Move last element to this position */
-                stream->conn->streams[i] = stream->conn->streams[stream->conn->streams_count - 1];
-                stream->conn->streams_count--;
-                break;
-            }
-        }
-        pthread_mutex_unlock(&stream->conn->streams_mutex);
+    /* Same critical section as the refusal check, so no stream slips past the id */
+    pthread_mutex_lock(&conn->streams_mutex);
+    if (conn->drain_finished) {
+        pthread_mutex_unlock(&conn->streams_mutex);
+        return 0;
     }
+    uint32_t last_stream_id = conn->last_peer_stream_id;
+    http2_connection_record_goaway(conn, last_stream_id);
+    conn->drain_ping_outstanding = false;
+    conn->drain_finished = true;
+    pthread_mutex_unlock(&conn->streams_mutex);
     
-    if (stream->recv_buffer) {
-        grpc_byte_buffer_destroy(stream->recv_buffer);
+    return http2_connection_write_goaway(conn, last_stream_id, HTTP2_NO_ERROR);
+}
+
+bool http2_connection_drain_finished(http2_connection *conn) {
+    if (!conn) {
+        return false;
+    }
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    bool finished = conn->drain_finished;
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    return finished;
+}
+
+static int http2_connection_handle_goaway(http2_connection *conn, const http2_frame_header *header,
+                                          const uint8_t *payload) {
+    if (header->stream_id != 0 || header->length < 8 || !payload) {
+        return -1;
+    }
+    
+    uint32_t last_stream_id = ((uint32_t)(payload[0] & 0x7F) << 24) | ((uint32_t)payload[1] << 16) |
+                              ((uint32_t)payload[2] << 8) | payload[3];
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    
+    /* A peer may lower last_stream_id in a follow-up GOAWAY, never raise it */
+    if (!conn->goaway_received || last_stream_id < conn->goaway_last_stream_id) {
+        conn->goaway_last_stream_id = last_stream_id;
+    }
+    conn->goaway_received = true;
+    
+    /* Our streams above last_stream_id were never seen by the peer */
+    for (size_t i = 0; i < conn->streams_count; i++) {
+        http2_stream *stream = conn->streams[i];
+        bool locally_initiated = (stream->id & 1) == (conn->is_client ? 1u : 0u);
+        if (locally_initiated && stream->id > conn->goaway_last_stream_id) {
+            stream->refused = true;
+            stream->end_stream_received = true;
+            stream->status = GRPC_STATUS_UNAVAILABLE;
+        }
     }
     
-    if (stream->initial_metadata.metadata) {
-        free(stream->initial_metadata.metadata);
+    pthread_mutex_unlock(&conn->streams_mutex);
+    return 0;
+}
+
+/**
+ * Send a keepalive PING carrying a fresh opaque payload
+ *
+ * Only one PING is outstanding at a time; while one is in flight this is a
+ * no-op so a slow peer is judged by the oldest unanswered PING.
+ * @param conn HTTP/2 connection
+ * @return 0 on success (or PING already outstanding), -1 on error
+ */
+int http2_connection_send_ping(http2_connection *conn) {
+    if (!conn) {
+        return -1;
     }
     
-    if (stream->trailing_metadata.metadata) {
-        free(stream->trailing_metadata.metadata);
+    uint8_t payload[8];
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    if (conn->ping_outstanding) {
+        pthread_mutex_unlock(&conn->streams_mutex);
+        return 0;
+    }
+    uint64_t opaque = ++conn->ping_counter;
+    for (int i = 0; i < 8; i++) {
+        payload[i] = (uint8_t)(opaque >> (56 - 8 * i));
     }
+    memcpy(conn->ping_payload, payload, sizeof(payload));
+    conn->ping_outstanding = true;
+    conn->ping_sent_us = grpc_monotonic_us();
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    http2_flow_control_begin_bdp_sample(conn);
+    
+    http2_frame_header header;
+    header.length = sizeof(payload);
+    header.type = HTTP2_FRAME_PING;
+    header.flags = 0;
+    header.stream_id = 0;
+    
+    if (http2_connection_send_frame(conn, &header, payload) != 0) {
+        pthread_mutex_lock(&conn->streams_mutex);
+        conn->ping_outstanding = false;
+        pthread_mutex_unlock(&conn->streams_mutex);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Check whether the outstanding PING has gone unanswered for too long
+ * @param conn HTTP/2 connection
+ * @param timeout_ms Time allowed for the ACK
+ * @return true if a PING is outstanding and older than timeout_ms
+ */
+bool http2_connection_ping_expired(http2_connection *conn, int timeout_ms) {
+    if (!conn) {
+        return false;
+    }
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    bool expired = conn->ping_outstanding &&
+                   grpc_monotonic_us() - conn->ping_sent_us > (int64_t)timeout_ms * 1000;
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    return expired;
+}
+
+/**
+ * Get the connection's round-trip time measured from PING ACKs
+ * @param conn HTTP/2 connection
+ * @param smoothed_rtt_us Smoothed RTT in microseconds (may be NULL)
+ * @param min_rtt_us Minimum observed RTT in microseconds (may be NULL)
+ * @return 0 on success, -1 if no RTT sample exists yet
+ */
+int http2_connection_get_rtt(http2_connection *conn, int64_t *smoothed_rtt_us, int64_t *min_rtt_us) {
+    if (!conn) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    int result = conn->rtt_samples > 0 ? 0 : -1;
+    if (result == 0) {
+        if (smoothed_rtt_us) *smoothed_rtt_us = conn->rtt_smoothed_us;
+        if (min_rtt_us) *min_rtt_us = conn->rtt_min_us;
+    }
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    return result;
+}
+
+static int http2_connection_handle_ping(http2_connection *conn, const http2_frame_header *header,
+                                        const uint8_t *payload) {
+    if (header->stream_id != 0 || header->length != 8 || !payload) {
+        return -1;
+    }
+    
+    if (!(header->flags & HTTP2_FLAG_ACK)) {
+        /* Echo the peer's PING back with ACK set */
+        http2_frame_header ack;
+        ack.length = 8;
+        ack.type = HTTP2_FRAME_PING;
+        ack.flags = HTTP2_FLAG_ACK;
+        ack.stream_id = 0;
+        return http2_connection_send_frame(conn, &ack, payload);
+    }
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    
+    /* The peer has seen the first drain GOAWAY */
+    if (conn->drain_ping_outstanding && memcmp(payload, http2_drain_ping_payload, 8) == 0) {
+        pthread_mutex_unlock(&conn->streams_mutex);
+        return http2_connection_finish_drain(conn);
+    }
+    
+    /* ACKs that do not match our outstanding PING are ignored */
+    if (!conn->ping_outstanding || memcmp(conn->ping_payload, payload, 8) != 0) {
+        pthread_mutex_unlock(&conn->streams_mutex);
+        return 0;
+    }
+    
+    int64_t rtt = grpc_monotonic_us() - conn->ping_sent_us;
+    if (rtt < 0) {
+        rtt = 0;
+    }
+    conn->ping_outstanding = false;
+    
+    /* Smoothed RTT uses the RFC 6298 gain of 1/8 */
+    if (conn->rtt_samples == 0) {
+        conn->rtt_smoothed_us = rtt;
+        conn->rtt_min_us = rtt;
+    } else {
+        conn->rtt_smoothed_us += (rtt - conn->rtt_smoothed_us) / 8;
+        if (rtt < conn->rtt_min_us) {
+            conn->rtt_min_us = rtt;
+        }
+    }
+    conn->rtt_samples++;
+    
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    http2_flow_control_end_bdp_sample(conn);
+    return 0;
+}
+
+/* ========================================================================
+ * SETTINGS and Header Blocks (HEADERS + CONTINUATION)
+ * ======================================================================== */
+
+/**
+ * Whether the connection's owner should read more frames. False while the
+ * connection's resource quota is exhausted: unread data stays in the
+ * kernel and TCP flow control pushes back on the peer.
+ * @param conn HTTP/2 connection
+ * @return true if reading is allowed
+ */
+bool http2_connection_read_allowed(http2_connection *conn) {
+    return conn && !grpc_resource_quota_exhausted(conn->quota);
+}
+
+/**
+ * Advertise our SETTINGS_MAX_HEADER_LIST_SIZE to the peer
+ * @param conn HTTP/2 connection
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_send_settings(http2_connection *conn) {
+    if (!conn) {
+        return -1;
+    }
+    
+    uint32_t value = conn->max_header_list_size;
+    uint8_t payload[HTTP2_SETTINGS_ENTRY_SIZE];
+    payload[0] = 0;
+    payload[1] = HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE;
+    payload[2] = (value >> 24) & 0xFF;
+    payload[3] = (value >> 16) & 0xFF;
+    payload[4] = (value >> 8) & 0xFF;
+    payload[5] = value & 0xFF;
+    
+    http2_frame_header header;
+    header.length = sizeof(payload);
+    header.type = HTTP2_FRAME_SETTINGS;
+    header.flags = 0;
+    header.stream_id = 0;
+    return http2_connection_send_frame(conn, &header, payload);
+}
+
+static int http2_connection_handle_settings(http2_connection *conn, const http2_frame_header *header,
+                                            const uint8_t *payload) {
+    if (header->stream_id != 0 || header->length % HTTP2_SETTINGS_ENTRY_SIZE != 0 ||
+        (header->length > 0 && !payload)) {
+        return -1;
+    }
+    
+    if (header->flags & HTTP2_FLAG_ACK) {
+        return header->length == 0 ? 0 : -1;
+    }
+    
+    pthread_mutex_lock(&conn->write_mutex);
+    for (uint32_t pos = 0; pos < header->length; pos += HTTP2_SETTINGS_ENTRY_SIZE) {
+        uint16_t id = (uint16_t)((payload[pos] << 8) | payload[pos + 1]);
+        uint32_t value = ((uint32_t)payload[pos + 2] << 24) | ((uint32_t)payload[pos + 3] << 16) |
+                         ((uint32_t)payload[pos + 4] << 8) | payload[pos + 5];
+        
+        switch (id) {
+            case HTTP2_SETTINGS_MAX_FRAME_SIZE:
+                if (value < HTTP2_DEFAULT_MAX_FRAME_SIZE || value > HTTP2_MAX_ALLOWED_FRAME_SIZE) {
+                    pthread_mutex_unlock(&conn->write_mutex);
+                    return -1;
+                }
+                conn->max_frame_size = value;
+                break;
+            case HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE:
+                conn->peer_max_header_list_size = value;
+                break;
+            case HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS:
+                __atomic_store_n(&conn->max_concurrent_streams, value, __ATOMIC_RELAXED);
+                break;
+            default:
+                /* Other settings are not acted on yet */
+                break;
+        }
+    }
+    pthread_mutex_unlock(&conn->write_mutex);
+    
+    http2_frame_header ack;
+    ack.length = 0;
+    ack.type = HTTP2_FRAME_SETTINGS;
+    ack.flags = HTTP2_FLAG_ACK;
+    ack.stream_id = 0;
+    return http2_connection_send_frame(conn, &ack, NULL);
+}
+
+/**
+ * Reset a stream
+ * @param conn HTTP/2 connection
+ * @param stream_id Stream to reset
+ * @param error_code HTTP/2 error code
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_send_rst_stream(http2_connection *conn, uint32_t stream_id, uint32_t error_code) {
+    if (!conn || stream_id == 0) {
+        return -1;
+    }
+    
+    uint8_t payload[4];
+    payload[0] = (error_code >> 24) & 0xFF;
+    payload[1] = (error_code >> 16) & 0xFF;
+    payload[2] = (error_code >> 8) & 0xFF;
+    payload[3] = error_code & 0xFF;
+    
+    http2_frame_header header;
+    header.length = sizeof(payload);
+    header.type = HTTP2_FRAME_RST_STREAM;
+    header.flags = 0;
+    header.stream_id = stream_id;
+    return http2_connection_send_frame(conn, &header, payload);
+}
+
+/**
+ * Send a header block, split into HEADERS and CONTINUATION frames of at
+ * most the peer's SETTINGS_MAX_FRAME_SIZE. The frames are written under
+ * one hold of write_mutex so no other frame can land between them.
+ * @param conn HTTP/2 connection
+ * @param stream_id Stream the headers belong to
+ * @param metadata Header fields
+ * @param end_stream Set END_STREAM (trailers, or a request without body)
+ * @return 0 on success, -1 on error or if the peer's header list limit is exceeded
+ */
+int http2_connection_send_headers(http2_connection *conn, uint32_t stream_id,
+                                  const grpc_metadata_array *metadata, bool end_stream) {
+    if (!conn || stream_id == 0 || !metadata || conn->socket_fd < 0) {
+        return -1;
+    }
+    
+    uint8_t *block;
+    size_t block_len;
+    if (hpack_encode_metadata_alloc(metadata, &block, &block_len) != 0) {
+        return -1;
+    }
+    
+    http2_connection_lock_writes(conn);
+    
+    if (hpack_metadata_list_size(metadata) > conn->peer_max_header_list_size) {
+        pthread_mutex_unlock(&conn->write_mutex);
+        free(block);
+        return -1;
+    }
+    
+    size_t offset = 0;
+    int rc = 0;
+    do {
+        size_t len = block_len - offset;
+        if (len > conn->max_frame_size) {
+            len = conn->max_frame_size;
+        }
+        
+        http2_frame_header header;
+        header.length = (uint32_t)len;
+        header.type = offset == 0 ? HTTP2_FRAME_HEADERS : HTTP2_FRAME_CONTINUATION;
+        header.flags = 0;
+        if (offset == 0 && end_stream) {
+            header.flags |= HTTP2_FLAG_END_STREAM;
+        }
+        if (offset + len == block_len) {
+            header.flags |= HTTP2_FLAG_END_HEADERS;
+        }
+        header.stream_id = stream_id;
+        
+        rc = http2_connection_write_frame(conn, &header, block + offset);
+        offset += len;
+    } while (rc == 0 && offset < block_len);
+    
+    pthread_mutex_unlock(&conn->write_mutex);
+    free(block);
+    return rc;
+}
+
+static void http2_header_block_reset(http2_connection *conn) {
+    grpc_resource_quota_release(conn->quota, conn->header_block_capacity);
+    free(conn->header_block);
+    conn->header_block = NULL;
+    conn->header_block_len = 0;
+    conn->header_block_capacity = 0;
+    conn->header_block_received = 0;
+    conn->header_block_stream_id = 0;
+    conn->header_block_flags = 0;
+    conn->header_block_oversized = false;
+}
+
+/* Buffer one fragment; past the limit the block is dropped but still
+ * consumed so the next frame is parsed in sync */
+static int http2_header_block_append(http2_connection *conn, const uint8_t *fragment, size_t len) {
+    conn->header_block_received += len;
+    if ((uint64_t)conn->header_block_received >
+        (uint64_t)conn->max_header_list_size * HTTP2_HEADER_BLOCK_FLOOD_FACTOR) {
+        return -1;
+    }
+    
+    /* Literal fields encode smaller than their header list size, so an
+     * encoded block over the limit can be refused before decoding */
+    if (conn->header_block_oversized || conn->header_block_received > conn->max_header_list_size) {
+        grpc_resource_quota_release(conn->quota, conn->header_block_capacity);
+        free(conn->header_block);
+        conn->header_block = NULL;
+        conn->header_block_len = 0;
+        conn->header_block_capacity = 0;
+        conn->header_block_oversized = true;
+        return 0;
+    }
+    
+    if (conn->header_block_len + len > conn->header_block_capacity) {
+        size_t new_capacity = conn->header_block_capacity ? conn->header_block_capacity : 1024;
+        while (new_capacity < conn->header_block_len + len) {
+            new_capacity *= 2;
+        }
+        
+        /* No memory for the block: drop it like an oversized one */
+        size_t growth = new_capacity - conn->header_block_capacity;
+        if (grpc_resource_quota_reserve(conn->quota, growth) != 0) {
+            grpc_resource_quota_release(conn->quota, conn->header_block_capacity);
+            free(conn->header_block);
+            conn->header_block = NULL;
+            conn->header_block_len = 0;
+            conn->header_block_capacity = 0;
+            conn->header_block_oversized = true;
+            return 0;
+        }
+        
+        uint8_t *new_block = (uint8_t *)realloc(conn->header_block, new_capacity);
+        if (!new_block) {
+            grpc_resource_quota_release(conn->quota, growth);
+            return -1;
+        }
+        conn->header_block = new_block;
+        conn->header_block_capacity = new_capacity;
+    }
+    
+    if (len > 0) {
+        memcpy(conn->header_block + conn->header_block_len, fragment, len);
+        conn->header_block_len += len;
+    }
+    return 0;
+}
+
+/* END_HEADERS seen: decode the block and hand it to its stream */
+static int http2_header_block_finish(http2_connection *conn) {
+    uint32_t stream_id = conn->header_block_stream_id;
+    bool end_stream = (conn->header_block_flags & HTTP2_FLAG_END_STREAM) != 0;
+    bool oversized = conn->header_block_oversized;
+    
+    grpc_metadata_array metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    if (!oversized) {
+        const uint8_t *block = conn->header_block ? conn->header_block : (const uint8_t *)"";
+        if (hpack_decode_metadata(block, conn->header_block_len, &metadata) != 0) {
+            /* Undecodable blocks leave the compression state unknown */
+            http2_header_block_reset(conn);
+            return -1;
+        }
+        if (hpack_metadata_list_size(&metadata) > conn->max_header_list_size) {
+            grpc_metadata_array_destroy(&metadata);
+            oversized = true;
+        }
+    }
+    http2_header_block_reset(conn);
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    http2_stream *stream = NULL;
+    for (size_t i = 0; i < conn->streams_count; i++) {
+        if (conn->streams[i]->id == stream_id) {
+            stream = conn->streams[i];
+            break;
+        }
+    }
+    
+    /* A new stream from the peer is refused while memory is exhausted */
+    bool peer_initiated = (stream_id & 1) != (conn->is_client ? 1u : 0u);
+    bool new_stream = !stream && peer_initiated && stream_id > conn->last_peer_stream_id;
+    if (new_stream && !oversized && grpc_resource_quota_exhausted(conn->quota)) {
+        oversized = true;
+        grpc_metadata_array_destroy(&metadata);
+    }
+    
+    http2_call_link *link = NULL;
+    if (stream && oversized) {
+        stream->status = GRPC_STATUS_RESOURCE_EXHAUSTED;
+        stream->end_stream_received = true;
+    } else if (stream) {
+        grpc_metadata_array *dst = stream->headers_received ? &stream->trailing_metadata
+                                                            : &stream->initial_metadata;
+        grpc_metadata_array_destroy(dst);
+        *dst = metadata;
+        metadata.metadata = NULL;
+        stream->headers_received = true;
+        if (end_stream) {
+            stream->end_stream_received = true;
+        }
+    }
+    /* Trailers of a server call close its request side; a reset cancels it */
+    if (stream && stream->link && (oversized || end_stream)) {
+        link = stream->link;
+        http2_call_link_ref(link);
+    }
+    bool refused = new_stream && conn->goaway_sent && stream_id > conn->goaway_sent_last_id;
+    if (new_stream && !refused && !oversized) {
+        /* Counted before the lock drops: a final GOAWAY must cover it */
+        conn->last_peer_stream_id = stream_id;
+    }
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    if (link) {
+        if (oversized) {
+            http2_call_deliver_reset(link);
+        } else {
+            http2_call_deliver_data(link, NULL, 0, true);
+        }
+        http2_call_link_unref(link);
+    }
+    
+    if (oversized) {
+        return http2_connection_send_rst_stream(conn, stream_id, HTTP2_ENHANCE_YOUR_CALM);
+    }
+    
+    /* Streams above the last id of our GOAWAY are never processed */
+    if (refused) {
+        grpc_metadata_array_destroy(&metadata);
+        return http2_connection_send_rst_stream(conn, stream_id, HTTP2_REFUSED_STREAM);
+    }
+    
+    if (new_stream && conn->accept_stream) {
+        http2_stream *created = http2_stream_create(conn, stream_id);
+        if (!created) {
+            grpc_metadata_array_destroy(&metadata);
+            return http2_connection_send_rst_stream(conn, stream_id, HTTP2_REFUSED_STREAM);
+        }
+        created->initial_metadata = metadata;
+        memset(&metadata, 0, sizeof(metadata));
+        created->headers_received = true;
+        created->end_stream_received = end_stream;
+        conn->accept_stream(conn, created, conn->accept_stream_data);
+    }
+    
+    grpc_metadata_array_destroy(&metadata);
+    return 0;
+}
+
+static int http2_connection_handle_headers(http2_connection *conn, const http2_frame_header *header,
+                                           const uint8_t *payload) {
+    if (header->stream_id == 0 || (header->length > 0 && !payload)) {
+        return -1;
+    }
+    
+    const uint8_t *fragment = payload;
+    size_t len = header->length;
+    
+    if (header->flags & HTTP2_FLAG_PADDED) {
+        if (len < 1 || fragment[0] >= len) {
+            return -1;
+        }
+        len -= 1 + fragment[0];
+        fragment++;
+    }
+    if (header->flags & HTTP2_FLAG_PRIORITY) {
+        /* Stream dependency and weight are not used */
+        if (len < 5) {
+            return -1;
+        }
+        fragment += 5;
+        len -= 5;
+    }
+    
+    conn->header_block_stream_id = header->stream_id;
+    conn->header_block_flags = header->flags;
+    if (http2_header_block_append(conn, fragment, len) != 0) {
+        http2_header_block_reset(conn);
+        return -1;
+    }
+    
+    if (header->flags & HTTP2_FLAG_END_HEADERS) {
+        return http2_header_block_finish(conn);
+    }
+    return 0;
+}
+
+static int http2_connection_handle_continuation(http2_connection *conn, const http2_frame_header *header,
+                                                const uint8_t *payload) {
+    if (header->stream_id == 0 || header->stream_id != conn->header_block_stream_id ||
+        (header->length > 0 && !payload)) {
+        return -1;
+    }
+    
+    if (http2_header_block_append(conn, payload, header->length) != 0) {
+        http2_header_block_reset(conn);
+        return -1;
+    }
+    
+    if (header->flags & HTTP2_FLAG_END_HEADERS) {
+        return http2_header_block_finish(conn);
+    }
+    return 0;
+}
+
+/* Stream with the given id, NULL if closed; caller holds streams_mutex */
+static http2_stream *http2_connection_find_stream(http2_connection *conn, uint32_t stream_id) {
+    for (size_t i = 0; i < conn->streams_count; i++) {
+        if (conn->streams[i]->id == stream_id) {
+            return conn->streams[i];
+        }
+    }
+    return NULL;
+}
+
+static int http2_connection_handle_data(http2_connection *conn, const http2_frame_header *header,
+                                        const uint8_t *payload) {
+    if (header->stream_id == 0 || (header->length > 0 && !payload)) {
+        return -1;
+    }
+    
+    const uint8_t *data = payload;
+    size_t len = header->length;
+    if (header->flags & HTTP2_FLAG_PADDED) {
+        if (len < 1 || data[0] >= len) {
+            return -1;
+        }
+        len -= 1 + data[0];
+        data++;
+    }
+    bool end_stream = (header->flags & HTTP2_FLAG_END_STREAM) != 0;
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    http2_stream *stream = http2_connection_find_stream(conn, header->stream_id);
+    if (!stream) {
+        /* Already closed on our side; the data is dropped */
+        pthread_mutex_unlock(&conn->streams_mutex);
+        return 0;
+    }
+    
+    /* Padding counts against the windows too */
+    int rc = header->length > 0 ? http2_flow_control_consume_recv_window(conn, stream, header->length) : 0;
+    http2_call_link *link = rc == 0 ? stream->link : NULL;
+    if (link) {
+        http2_call_link_ref(link);
+    }
+    if (end_stream) {
+        stream->end_stream_received = true;
+    }
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    if (link) {
+        http2_call_deliver_data(link, data, len, end_stream);
+        http2_call_link_unref(link);
+    }
+    return rc;
+}
+
+static int http2_connection_handle_rst_stream(http2_connection *conn, const http2_frame_header *header,
+                                              const uint8_t *payload) {
+    if (header->stream_id == 0 || header->length != 4 || !payload) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&conn->streams_mutex);
+    http2_stream *stream = http2_connection_find_stream(conn, header->stream_id);
+    http2_call_link *link = NULL;
+    if (stream) {
+        stream->end_stream_received = true;
+        link = stream->link;
+        if (link) {
+            http2_call_link_ref(link);
+        }
+    }
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    if (link) {
+        http2_call_deliver_reset(link);
+        http2_call_link_unref(link);
+    }
+    return 0;
+}
+
+/**
+ * Process a connection-level or control frame read from the peer
+ * @param conn HTTP/2 connection
+ * @param header Frame header
+ * @param payload Frame payload (may be NULL for empty frames)
+ * @return 0 on success, -1 on protocol error
+ */
+int http2_connection_process_frame(http2_connection *conn, const http2_frame_header *header,
+                                   const uint8_t *payload) {
+    if (!conn || !header) {
+        return -1;
+    }
+    
+    /* Nothing may interleave with an open header block (RFC 7540 6.10) */
+    if (conn->header_block_stream_id != 0 && header->type != HTTP2_FRAME_CONTINUATION) {
+        return -1;
+    }
+    
+    switch (header->type) {
+        case HTTP2_FRAME_SETTINGS:
+            return http2_connection_handle_settings(conn, header, payload);
+        case HTTP2_FRAME_DATA:
+            return http2_connection_handle_data(conn, header, payload);
+        case HTTP2_FRAME_RST_STREAM:
+            return http2_connection_handle_rst_stream(conn, header, payload);
+        case HTTP2_FRAME_HEADERS:
+            return http2_connection_handle_headers(conn, header, payload);
+        case HTTP2_FRAME_CONTINUATION:
+            if (conn->header_block_stream_id == 0) {
+                return -1;
+            }
+            return http2_connection_handle_continuation(conn, header, payload);
+        case HTTP2_FRAME_GOAWAY:
+            return http2_connection_handle_goaway(conn, header, payload);
+        case HTTP2_FRAME_PING:
+            return http2_connection_handle_ping(conn, header, payload);
+        case HTTP2_FRAME_WINDOW_UPDATE: {
+            if (header->length != 4 || !payload) {
+                return -1;
+            }
+            uint32_t increment = ((uint32_t)(payload[0] & 0x7F) << 24) | ((uint32_t)payload[1] << 16) |
+                                 ((uint32_t)payload[2] << 8) | payload[3];
+            return http2_flow_control_receive_window_update(conn, header->stream_id, increment);
+        }
+        default:
+            /* Unknown and not yet handled frame types are ignored (RFC 7540 4.1) */
+            return 0;
+    }
+}
+
+/* ========================================================================
+ * Zero-Copy Send (MSG_ZEROCOPY)
+ * ======================================================================== */
+
+void http2_connection_set_zerocopy_threshold(http2_connection *conn, size_t threshold) {
+    if (!conn) return;
+    
+    pthread_mutex_lock(&conn->write_mutex);
+    conn->zerocopy_threshold = threshold;
+    pthread_mutex_unlock(&conn->write_mutex);
+}
+
+/* Decide whether a payload goes out with MSG_ZEROCOPY; caller holds write_mutex */
+static bool http2_zerocopy_usable(http2_connection *conn, size_t len) {
+    if (conn->shm || conn->zerocopy_threshold == 0 || len < conn->zerocopy_threshold ||
+        conn->zerocopy_state < 0) {
+        return false;
+    }
+    
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    if (conn->zerocopy_state == 0) {
+        /* Fails on sockets that cannot do zero-copy, e.g. AF_UNIX */
+        int one = 1;
+        conn->zerocopy_state = setsockopt(conn->socket_fd, SOL_SOCKET, SO_ZEROCOPY,
+                                          &one, sizeof(one)) == 0 ? 1 : -1;
+    }
+    return conn->zerocopy_state > 0;
+#else
+    conn->zerocopy_state = -1;
+    return false;
+#endif
+}
+
+/* Account completed send sequence numbers [lo, hi]; caller holds write_mutex */
+static int http2_zerocopy_complete(http2_connection *conn, uint32_t lo, uint32_t hi) {
+    int released = 0;
+    http2_zerocopy_pending *prev = NULL;
+    http2_zerocopy_pending *entry = conn->zerocopy_pending;
+    
+    while (entry) {
+        http2_zerocopy_pending *next = entry->next;
+        
+        /* Unsigned arithmetic keeps this correct across sequence wrap-around */
+        uint32_t span = entry->seq_hi - entry->seq_lo;
+        for (uint32_t i = 0; i <= span && entry->outstanding > 0; i++) {
+            if ((uint32_t)(entry->seq_lo + i - lo) <= (uint32_t)(hi - lo)) {
+                entry->outstanding--;
+            }
+        }
+        
+        if (entry->outstanding == 0) {
+            if (prev) {
+                prev->next = next;
+            } else {
+                conn->zerocopy_pending = next;
+            }
+            if (conn->zerocopy_pending_tail == entry) {
+                conn->zerocopy_pending_tail = prev;
+            }
+            grpc_byte_buffer_destroy(entry->buffer);
+            free(entry);
+            __atomic_sub_fetch(&conn->zerocopy_inflight, 1, __ATOMIC_RELEASE);
+            released++;
+        } else {
+            prev = entry;
+        }
+        entry = next;
+    }
+    
+    return released;
+}
+
+/* Read every completion notification queued on the socket; returns the
+ * number read, or -1 if a writer holds write_mutex (it reaps before its
+ * next zero-copy send) */
+static int http2_zerocopy_drain(http2_connection *conn, int *released) {
+    *released = 0;
+#if defined(MSG_ERRQUEUE) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    if (pthread_mutex_trylock(&conn->write_mutex) != 0) {
+        return -1;
+    }
+    
+    int notifications = 0;
+    while (conn->socket_fd >= 0) {
+        uint8_t control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        
+        if (recvmsg(conn->socket_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+        
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            
+            /* The kernel fell back to copying (e.g. loopback); a deferred
+             * copy costs more than a plain send, so stop using zero-copy */
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                conn->zerocopy_state = -1;
+            }
+            
+            *released += http2_zerocopy_complete(conn, serr->ee_info, serr->ee_data);
+            notifications++;
+        }
+    }
+    pthread_mutex_unlock(&conn->write_mutex);
+    return notifications;
+#else
+    (void)conn;
+    return 0;
+#endif
+}
+
+/**
+ * Drain zero-copy completion notifications from the socket error queue
+ * and drop the buffer references of sends the kernel is done with.
+ * @param conn HTTP/2 connection
+ * @return Number of buffers released, or -1 on error
+ */
+int http2_connection_reap_zerocopy(http2_connection *conn) {
+    if (!conn) {
+        return -1;
+    }
+    
+    int released;
+    http2_zerocopy_drain(conn, &released);
+    return released;
+}
+
+/* Wait until a frame can be read while buffers are pinned, releasing them
+ * as their completions arrive rather than when the peer next writes */
+static void http2_zerocopy_wait_readable(http2_connection *conn) {
+    while (__atomic_load_n(&conn->zerocopy_inflight, __ATOMIC_ACQUIRE) > 0) {
+        struct pollfd pfd;
+        pfd.fd = conn->socket_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        
+        /* Data or hang-up: the read reports either */
+        if (pfd.revents & ~POLLERR) {
+            return;
+        }
+        /* Only the error queue; nothing in it means a socket error */
+        int released;
+        if (http2_zerocopy_drain(conn, &released) <= 0) {
+            return;
+        }
+    }
+}
+
+/* Write vectors in full, resuming after partial sends; caller holds write_mutex */
+static int http2_connection_send_iov(http2_connection *conn, struct iovec *iov, int count, int flags) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)count;
+    
+    while (msg.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(conn->socket_fd, &msg, flags | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+            sent -= (ssize_t)msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+/* Send a payload with MSG_ZEROCOPY, pinning buffer until the kernel is
+ * done with it; caller holds write_mutex and sent the bytes before it */
+static int http2_zerocopy_send(http2_connection *conn, grpc_byte_buffer *buffer, const uint8_t *payload,
+                               size_t len) {
+#if defined(MSG_ZEROCOPY)
+    http2_zerocopy_pending *pending = (http2_zerocopy_pending *)calloc(1, sizeof(http2_zerocopy_pending));
+    if (!pending) {
+        return -1;
+    }
+    
+    uint32_t seq_lo = conn->zerocopy_next_seq;
+    size_t remaining = len;
+    int flags = MSG_ZEROCOPY | MSG_NOSIGNAL;
+    
+    while (remaining > 0) {
+        ssize_t sent = send(conn->socket_fd, payload, remaining, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                /* optmem limit reached: copy the rest of this frame */
+                flags = MSG_NOSIGNAL;
+                continue;
+            }
+            break;
+        }
+        
+        /* Every successful MSG_ZEROCOPY send consumes one sequence number */
+        if (flags & MSG_ZEROCOPY) {
+            conn->zerocopy_next_seq++;
+        }
+        payload += sent;
+        remaining -= (size_t)sent;
+    }
+    
+    uint32_t seq_count = conn->zerocopy_next_seq - seq_lo;
+    if (seq_count > 0) {
+        pending->buffer = grpc_byte_buffer_ref(buffer);
+        pending->seq_lo = seq_lo;
+        pending->seq_hi = conn->zerocopy_next_seq - 1;
+        pending->outstanding = seq_count;
+        if (conn->zerocopy_pending_tail) {
+            conn->zerocopy_pending_tail->next = pending;
+        } else {
+            conn->zerocopy_pending = pending;
+        }
+        conn->zerocopy_pending_tail = pending;
+        __atomic_add_fetch(&conn->zerocopy_inflight, 1, __ATOMIC_RELEASE);
+    } else {
+        free(pending);
+    }
+    return remaining == 0 ? 0 : -1;
+#else
+    (void)buffer;
+    struct iovec iov = {(void *)payload, len};
+    return http2_connection_send_iov(conn, &iov, 1, 0);
+#endif
+}
+
+/**
+ * Send a DATA frame: a few copied bytes (e.g. a gRPC message prefix)
+ * followed by a payload read straight from a reference-counted buffer.
+ * Payloads at or above the connection's zero-copy threshold are sent with
+ * MSG_ZEROCOPY and a reference on the buffer is held until the kernel
+ * reports completion, which the connection's reader picks up.
+ * @param conn HTTP/2 connection
+ * @param header Frame header (length covers the prefix and the payload)
+ * @param prefix Bytes sent ahead of the payload (may be NULL)
+ * @param prefix_len Length of prefix
+ * @param buffer Buffer holding the payload (may be NULL without one)
+ * @param offset Offset of the payload within the buffer
+ * @return 0 on success, -1 on error
+ */
+int http2_connection_send_data(http2_connection *conn, const http2_frame_header *header, const uint8_t *prefix,
+                               size_t prefix_len, grpc_byte_buffer *buffer, size_t offset) {
+    if (!conn || !header || prefix_len > header->length || (prefix_len > 0 && !prefix)) {
+        return -1;
+    }
+    
+    size_t len = header->length - prefix_len;
+    if (len > 0 && (!buffer || offset > buffer->length || len > buffer->length - offset)) {
+        return -1;
+    }
+    
+    if (conn->socket_fd < 0) {
+        return -1;
+    }
+    
+    const uint8_t *payload = len > 0 ? buffer->data + offset : NULL;
+    
+    /* Release buffers from earlier sends before pinning another one */
+    if (__atomic_load_n(&conn->zerocopy_inflight, __ATOMIC_ACQUIRE) > 0) {
+        http2_connection_reap_zerocopy(conn);
+    }
+    
+    uint8_t frame_header[HTTP2_FRAME_HEADER_SIZE];
+    http2_encode_frame_header(header, frame_header);
+    
+    int rc;
+    http2_connection_lock_writes(conn);
+    if (conn->shm) {
+        rc = shm_transport_write(conn->shm, frame_header, HTTP2_FRAME_HEADER_SIZE);
+        if (rc == 0 && prefix_len > 0) {
+            rc = shm_transport_write(conn->shm, prefix, prefix_len);
+        }
+        if (rc == 0 && len > 0) {
+            rc = shm_transport_write(conn->shm, payload, len);
+        }
+    } else if (len > 0 && http2_zerocopy_usable(conn, len)) {
+        /* The frame header and prefix are small, so they are always copied */
+        struct iovec head[2] = {{frame_header, HTTP2_FRAME_HEADER_SIZE}, {(void *)prefix, prefix_len}};
+        rc = http2_connection_send_iov(conn, head, prefix_len > 0 ? 2 : 1, MSG_MORE);
+        if (rc == 0) {
+            rc = http2_zerocopy_send(conn, buffer, payload, len);
+        }
+    } else {
+        struct iovec iov[3];
+        int count = 0;
+        iov[count].iov_base = frame_header;
+        iov[count++].iov_len = HTTP2_FRAME_HEADER_SIZE;
+        if (prefix_len > 0) {
+            iov[count].iov_base = (void *)prefix;
+            iov[count++].iov_len = prefix_len;
+        }
+        if (len > 0) {
+            iov[count].iov_base = (void *)payload;
+            iov[count++].iov_len = len;
+        }
+        rc = http2_connection_send_iov(conn, iov, count, 0);
+    }
+    pthread_mutex_unlock(&conn->write_mutex);
+    return rc;
+}
+
+/* ========================================================================
+ * HTTP/2 Stream Implementation
+ * ======================================================================== */
+
+http2_stream *http2_stream_create(http2_connection *conn, uint32_t stream_id) {
+    if (!conn) {
+        return NULL;
+    }
+    
+    http2_stream *stream = (http2_stream *)calloc(1, sizeof(http2_stream));
+    if (!stream) {
+        return NULL;
+    }
+    
+    stream->id = stream_id;
+    stream->conn = conn;
+    stream->headers_sent = false;
+    stream->end_stream_sent = false;
+    stream->end_stream_received = false;
+    stream->refused = false;
+    stream->status = GRPC_STATUS_OK;
+    
+    /* Initialize flow control */
+    http2_flow_control_init_stream(stream);
+    
+    /* Add stream to connection */
+    pthread_mutex_lock(&conn->streams_mutex);
+    bool peer_initiated = (stream_id & 1) != (conn->is_client ? 1u : 0u);
+    if (peer_initiated && stream_id > conn->last_peer_stream_id) {
+        conn->last_peer_stream_id = stream_id;
+    }
+    if (conn->streams_count >= conn->streams_capacity) {
+        size_t new_capacity = conn->streams_capacity * 2;
+        http2_stream **new_streams = (http2_stream **)realloc(conn->streams, 
+                                                               new_capacity * sizeof(http2_stream *));
+        if (!new_streams) {
+            pthread_mutex_unlock(&conn->streams_mutex);
+            free(stream);
+            return NULL;
+        }
+        conn->streams = new_streams;
+        conn->streams_capacity = new_capacity;
+    }
+    conn->streams[conn->streams_count++] = stream;
+    pthread_mutex_unlock(&conn->streams_mutex);
+    
+    return stream;
+}
+
+void http2_stream_destroy(http2_stream *stream) {
+    if (!stream) return;
+    
+    /* Remove stream from connection's streams array */
+    if (stream->conn) {
+        pthread_mutex_lock(&stream->conn->streams_mutex);
+        for (size_t i = 0; i < stream->conn->streams_count; i++) {
+            if (stream->conn->streams[i] == stream) {
+                /* Move last element to this position */
+                stream->conn->streams[i] = stream->conn->streams[stream->conn->streams_count - 1];
+                stream->conn->streams_count--;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&stream->conn->streams_mutex);
+    }
+    
+    if (stream->recv_buffer) {
+        grpc_byte_buffer_destroy(stream->recv_buffer);
+    }
+    
+    grpc_metadata_array_destroy(&stream->initial_metadata);
+    grpc_metadata_array_destroy(&stream->trailing_metadata);
     
     free(stream->status_details);
     free(stream);
@@ -0,0 +1,260 @@
+/**
+ * @file inproc_transport.c
+ * @brief In-process transport between a grpc_channel and a grpc_server
+ *
+ * A client call and its server call are joined by a link. Sending on one
+ * side delivers directly into the other call's receive state: messages
+ * are passed by reference (grpc_byte_buffer_ref), metadata is copied once.
+ * No sockets, HTTP/2 framing or HPACK are involved.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Shared by both calls; each side drops its reference when destroyed */
+typedef struct inproc_link {
+    pthread_mutex_t mutex;
+    grpc_server *server;
+    grpc_call *client;
+    grpc_call *server_call;
+    int refs;
+} inproc_link;
+
+static const grpc_call_transport inproc_client_transport;
+static const grpc_call_transport inproc_server_transport;
+
+/* ========================================================================
+ * Link Helpers
+ * ======================================================================== */
+
+/* Peer of call, NULL once either side is gone; caller holds link->mutex */
+static grpc_call *inproc_peer(inproc_link *link, grpc_call *call) {
+    if (call == link->client) {
+        return link->server_call;
+    }
+    if (call == link->server_call) {
+        return link->client;
+    }
+    return NULL;
+}
+
+static void inproc_link_unref(inproc_link *link) {
+    pthread_mutex_lock(&link->mutex);
+    int refs = --link->refs;
+    pthread_mutex_unlock(&link->mutex);
+    
+    if (refs == 0) {
+        pthread_mutex_destroy(&link->mutex);
+        free(link);
+    }
+}
+
+/* ========================================================================
+ * Transport Operations
+ * ======================================================================== */
+
+/* Client initial metadata creates the server call and hands it to the server */
+static int inproc_client_send_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count) {
+    inproc_link *link = (inproc_link *)call->transport_data;
+    
+    if (grpc_resource_quota_exhausted(link->server->resource_quota)) {
+        call_deliver_status(call, GRPC_STATUS_RESOURCE_EXHAUSTED, "Server memory quota exhausted", NULL, 0);
+        return 0;
+    }
+    
+    grpc_call *server_call = call_create(NULL, link->server, NULL, call->method, call->host, call->deadline);
+    if (!server_call) {
+        return -1;
+    }
+    server_call->transport = &inproc_server_transport;
+    server_call->transport_data = link;
+    call_deliver_initial_metadata(server_call, metadata, count);
+    
+    pthread_mutex_lock(&link->mutex);
+    link->server_call = server_call;
+    link->refs++;
+    pthread_mutex_unlock(&link->mutex);
+    
+    grpc_status_code status = grpc_server_publish_call(link->server, server_call);
+    if (status != GRPC_STATUS_OK) {
+        /* Unlink first so destroying the server call does not cancel us */
+        pthread_mutex_lock(&link->mutex);
+        link->server_call = NULL;
+        pthread_mutex_unlock(&link->mutex);
+        const char *details = "Server is not accepting calls";
+        if (status == GRPC_STATUS_UNIMPLEMENTED) {
+            details = "Method not found";
+        } else if (status == GRPC_STATUS_RESOURCE_EXHAUSTED) {
+            details = "Server overloaded";
+        }
+        if (status == GRPC_STATUS_UNAVAILABLE) {
+            call_deliver_refused(call, status, details);
+        } else {
+            call_deliver_status(call, status, details, NULL, 0);
+        }
+        grpc_call_destroy(server_call);
+    }
+    
+    return 0;
+}
+
+static int inproc_server_send_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count) {
+    inproc_link *link = (inproc_link *)call->transport_data;
+    
+    pthread_mutex_lock(&link->mutex);
+    grpc_call *peer = inproc_peer(link, call);
+    if (peer) {
+        call_deliver_initial_metadata(peer, metadata, count);
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    return peer ? 0 : -1;
+}
+
+static int inproc_send_message(grpc_call *call, grpc_byte_buffer *message) {
+    inproc_link *link = (inproc_link *)call->transport_data;
+    
+    pthread_mutex_lock(&link->mutex);
+    grpc_call *peer = inproc_peer(link, call);
+    if (peer) {
+        call_deliver_message(peer, grpc_byte_buffer_ref(message));
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    return peer ? 0 : -1;
+}
+
+static int inproc_send_close(grpc_call *call) {
+    inproc_link *link = (inproc_link *)call->transport_data;
+    
+    pthread_mutex_lock(&link->mutex);
+    grpc_call *peer = inproc_peer(link, call);
+    if (peer) {
+        call_deliver_half_close(peer);
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    /* The request is complete: a cached method can answer now */
+    grpc_server_continue_call(link->server, peer);
+    return peer ? 0 : -1;
+}
+
+static int inproc_send_status(grpc_call *call, grpc_status_code status, const char *details,
+                              const grpc_metadata *trailing_metadata, size_t trailing_count) {
+    inproc_link *link = (inproc_link *)call->transport_data;
+    
+    pthread_mutex_lock(&link->mutex);
+    grpc_call *peer = inproc_peer(link, call);
+    if (peer) {
+        call_deliver_status(peer, status, details, trailing_metadata, trailing_count);
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    return peer ? 0 : -1;
+}
+
+static void inproc_cancel(grpc_call *call) {
+    inproc_link *link = (inproc_link *)call->transport_data;
+    
+    pthread_mutex_lock(&link->mutex);
+    grpc_call *peer = inproc_peer(link, call);
+    bool to_server = link->client == call;
+    if (peer) {
+        call_deliver_cancel(peer);
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    if (to_server) {
+        grpc_server_continue_call(link->server, peer);
+    }
+}
+
+static void inproc_destroy(grpc_call *call) {
+    inproc_link *link = (inproc_link *)call->transport_data;
+    
+    pthread_mutex_lock(&link->mutex);
+    if (link->client == call) {
+        link->client = NULL;
+    } else if (link->server_call == call) {
+        link->server_call = NULL;
+    }
+    pthread_mutex_unlock(&link->mutex);
+    
+    call->transport_data = NULL;
+    inproc_link_unref(link);
+}
+
+static const grpc_call_transport inproc_client_transport = {
+    inproc_client_send_initial_metadata,
+    inproc_send_message,
+    inproc_send_close,
+    inproc_send_status,
+    inproc_cancel,
+    inproc_destroy
+};
+
+static const grpc_call_transport inproc_server_transport = {
+    inproc_server_send_initial_metadata,
+    inproc_send_message,
+    inproc_send_close,
+    inproc_send_status,
+    inproc_cancel,
+    inproc_destroy
+};
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+/**
+ * Attach a new client call on an in-process channel to the transport
+ * @param call The client call
+ * @param server Server that will receive the call
+ * @return 0 on success, -1 on error
+ */
+int inproc_client_call_init(grpc_call *call, grpc_server *server) {
+    if (!call || !server) {
+        return -1;
+    }
+    
+    inproc_link *link = (inproc_link *)calloc(1, sizeof(inproc_link));
+    if (!link) {
+        return -1;
+    }
+    
+    pthread_mutex_init(&link->mutex, NULL);
+    link->server = server;
+    link->client = call;
+    link->refs = 1;
+    
+    call->transport = &inproc_client_transport;
+    call->transport_data = link;
+    return 0;
+}
+
+grpc_channel *grpc_inproc_channel_create(grpc_server *server, const grpc_channel_args *args) {
+    if (!server) {
+        return NULL;
+    }
+    
+    grpc_channel *channel = (grpc_channel *)calloc(1, sizeof(grpc_channel));
+    if (!channel) {
+        return NULL;
+    }
+    
+    channel->target = strdup("inproc");
+    if (!channel->target) {
+        free(channel);
+        return NULL;
+    }
+    
+    channel->args = (grpc_channel_args *)args; /* Cast away const for storage */
+    channel->inproc_server = server;
+    pthread_mutex_init(&channel->mutex, NULL);
+    channel_init_retry_budget(channel, args);
+    
+    return channel;
+}
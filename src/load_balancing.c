@@ -18,7 +18,8 @@
 typedef enum {
     GRPC_LB_POLICY_ROUND_ROBIN,
     GRPC_LB_POLICY_PICK_FIRST,
-    GRPC_LB_POLICY_WEIGHTED
+    GRPC_LB_POLICY_WEIGHTED,
+    GRPC_LB_POLICY_LOWEST_RTT
 } grpc_lb_policy_type;
 
 /* Backend server address */
@@ -26,6 +27,7 @@ typedef struct grpc_lb_address {
     char *address;
     int weight;  /* For weighted load balancing */
     bool is_available;
+    int64_t rtt_us;  /* Smoothed RTT reported for the address, -1 if unmeasured */
     struct grpc_lb_address *next;
 } grpc_lb_address;
 
@@ -56,6 +58,7 @@ static grpc_lb_address *grpc_lb_address_create(const char *address, int weight)
     
     addr->weight = weight > 0 ? weight : 1;
     addr->is_available = true;
+    addr->rtt_us = -1;
     addr->next = NULL;
     
     return addr;
@@ -180,6 +183,29 @@ static const char *grpc_lb_weighted_pick(grpc_lb_policy *policy) {
     return NULL;
 }
 
+/* ========================================================================
+ * Lowest-RTT Load Balancer
+ * ======================================================================== */
+
+/* Unmeasured addresses are picked first so that they get an RTT */
+static const char *grpc_lb_lowest_rtt_pick(grpc_lb_policy *policy) {
+    if (!policy || !policy->addresses) {
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&policy->mutex);
+    
+    grpc_lb_address *best = NULL;
+    for (grpc_lb_address *addr = policy->addresses; addr; addr = addr->next) {
+        if (addr->is_available && (!best || addr->rtt_us < best->rtt_us)) {
+            best = addr;
+        }
+    }
+    
+    pthread_mutex_unlock(&policy->mutex);
+    return best ? best->address : NULL;
+}
+
 /* ========================================================================
  * Load Balancing Policy API
  * ======================================================================== */
@@ -243,6 +269,8 @@ const char *grpc_lb_policy_pick(grpc_lb_policy *policy) {
             return grpc_lb_pick_first_pick(policy);
         case GRPC_LB_POLICY_WEIGHTED:
             return grpc_lb_weighted_pick(policy);
+        case GRPC_LB_POLICY_LOWEST_RTT:
+            return grpc_lb_lowest_rtt_pick(policy);
         default:
             return NULL;
     }
@@ -290,6 +318,35 @@ int grpc_lb_policy_mark_available(grpc_lb_policy *policy, const char *address) {
     return -1;
 }
 
+/**
+ * Record the smoothed round-trip time measured to an address, e.g. by the
+ * connection pool's keepalive PINGs; the lowest-RTT policy picks by it
+ * @param policy Load balancing policy
+ * @param address Address previously added to the policy
+ * @param smoothed_rtt_us Smoothed RTT in microseconds
+ * @return 0 on success, -1 if the address is unknown
+ */
+int grpc_lb_policy_report_rtt(grpc_lb_policy *policy, const char *address, int64_t smoothed_rtt_us) {
+    if (!policy || !address || smoothed_rtt_us < 0) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&policy->mutex);
+    
+    grpc_lb_address *addr = policy->addresses;
+    while (addr) {
+        if (strcmp(addr->address, address) == 0) {
+            addr->rtt_us = smoothed_rtt_us;
+            pthread_mutex_unlock(&policy->mutex);
+            return 0;
+        }
+        addr = addr->next;
+    }
+    
+    pthread_mutex_unlock(&policy->mutex);
+    return -1;
+}
+
 void grpc_lb_policy_destroy(grpc_lb_policy *policy) {
     if (!policy) return;
     
@@ -0,0 +1,263 @@
+/**
+ * @file method_router.c
+ * @brief Minimal perfect hash from :path to method
+ *
+ * The router is built once from a fixed set of paths using hash-and-displace:
+ * keys are split into small buckets by one half of a 64-bit hash, and each
+ * bucket gets a displacement that sends all of its keys to free slots of a
+ * table exactly as large as the key set. A lookup hashes the path once,
+ * reads one displacement and one slot, and confirms the match with a single
+ * compare; it never allocates.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Average keys per bucket */
+#define METHOD_ROUTER_BUCKET_KEYS 4
+/* Displacements tried per bucket before the build starts over with a new seed */
+#define METHOD_ROUTER_MAX_DISPLACEMENTS 65536
+#define METHOD_ROUTER_MAX_SEEDS 16
+/* A displacement with this bit set names its single key's slot directly */
+#define METHOD_ROUTER_DIRECT 0x80000000u
+
+typedef struct {
+    const char *path;
+    uint64_t hash;
+    void *value;
+} method_route;
+
+struct grpc_method_router {
+    size_t count;
+    size_t bucket_count;
+    uint64_t seed;
+    uint32_t *displacements;  /* One per bucket */
+    method_route *routes;     /* Exactly count slots */
+};
+
+/* Map a 32-bit value onto [0, n) without a division */
+static size_t method_router_reduce(uint32_t value, size_t n) {
+    return (size_t)(((uint64_t)value * n) >> 32);
+}
+
+static size_t method_router_bucket(uint64_t hash, size_t bucket_count) {
+    return method_router_reduce((uint32_t)hash, bucket_count);
+}
+
+static size_t method_router_slot(uint64_t hash, uint32_t displacement, size_t count) {
+    if (displacement & METHOD_ROUTER_DIRECT) {
+        return displacement & ~METHOD_ROUTER_DIRECT;
+    }
+    uint32_t x = (uint32_t)(hash >> 32) ^ (displacement * 0x9e3779b9u);
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return method_router_reduce(x, count);
+}
+
+typedef struct {
+    size_t bucket;
+    size_t size;
+    size_t first;  /* Offset of the bucket's keys in the sorted key order */
+} method_router_bucket_info;
+
+static int method_router_bucket_cmp(const void *a, const void *b) {
+    const method_router_bucket_info *x = (const method_router_bucket_info *)a;
+    const method_router_bucket_info *y = (const method_router_bucket_info *)b;
+    if (x->size != y->size) {
+        return x->size > y->size ? -1 : 1;
+    }
+    return x->bucket < y->bucket ? -1 : (x->bucket > y->bucket);
+}
+
+/* Try to place every key with one seed; 0 on success, 1 to retry with
+ * another seed, -1 if two keys are identical */
+static int method_router_place(grpc_method_router *router, const char *const *paths,
+                               void *const *values, uint64_t *hashes, size_t *order,
+                               method_router_bucket_info *buckets, bool *used, size_t *slots) {
+    size_t count = router->count;
+    size_t bucket_count = router->bucket_count;
+    
+    for (size_t i = 0; i < count; i++) {
+        hashes[i] = grpc_hash_bytes(paths[i], strlen(paths[i]), router->seed);
+    }
+    
+    /* Counting sort of the keys by bucket */
+    for (size_t b = 0; b < bucket_count; b++) {
+        buckets[b].bucket = b;
+        buckets[b].size = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        buckets[method_router_bucket(hashes[i], bucket_count)].size++;
+    }
+    size_t offset = 0;
+    for (size_t b = 0; b < bucket_count; b++) {
+        buckets[b].first = offset;
+        offset += buckets[b].size;
+        buckets[b].size = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        method_router_bucket_info *info = &buckets[method_router_bucket(hashes[i], bucket_count)];
+        order[info->first + info->size++] = i;
+    }
+    
+    /* Largest buckets first, while the table is still mostly empty */
+    qsort(buckets, bucket_count, sizeof(*buckets), method_router_bucket_cmp);
+    memset(used, 0, count * sizeof(*used));
+    size_t next_free = 0;
+    
+    for (size_t b = 0; b < bucket_count && buckets[b].size > 0; b++) {
+        method_router_bucket_info *info = &buckets[b];
+        const size_t *keys = &order[info->first];
+        
+        for (size_t i = 0; i < info->size; i++) {
+            for (size_t j = 0; j < i; j++) {
+                if (hashes[keys[i]] == hashes[keys[j]]) {
+                    if (strcmp(paths[keys[i]], paths[keys[j]]) == 0) {
+                        return -1;
+                    }
+                    return 1;
+                }
+            }
+        }
+        
+        uint32_t displacement;
+        if (info->size == 1) {
+            /* A lone key takes any free slot directly */
+            while (used[next_free]) {
+                next_free++;
+            }
+            displacement = METHOD_ROUTER_DIRECT | (uint32_t)next_free;
+            slots[0] = next_free;
+        } else {
+            bool placed = false;
+            for (displacement = 0; displacement < METHOD_ROUTER_MAX_DISPLACEMENTS; displacement++) {
+                placed = true;
+                for (size_t i = 0; i < info->size && placed; i++) {
+                    slots[i] = method_router_slot(hashes[keys[i]], displacement, count);
+                    placed = !used[slots[i]];
+                    for (size_t j = 0; j < i && placed; j++) {
+                        placed = slots[j] != slots[i];
+                    }
+                }
+                if (placed) {
+                    break;
+                }
+            }
+            if (!placed) {
+                return 1;
+            }
+        }
+        
+        router->displacements[info->bucket] = displacement;
+        for (size_t i = 0; i < info->size; i++) {
+            used[slots[i]] = true;
+            router->routes[slots[i]].path = paths[keys[i]];
+            router->routes[slots[i]].hash = hashes[keys[i]];
+            router->routes[slots[i]].value = values[keys[i]];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Build a router over a fixed set of paths
+ * @param paths Distinct paths; the strings must outlive the router
+ * @param values Value returned for each path
+ * @param count Number of paths (may be 0)
+ * @return Router, or NULL on allocation failure or duplicate paths
+ */
+grpc_method_router *grpc_method_router_create(const char *const *paths, void *const *values,
+                                              size_t count) {
+    if (count > 0 && (!paths || !values)) {
+        return NULL;
+    }
+    if (count >= METHOD_ROUTER_DIRECT) {
+        return NULL;
+    }
+    
+    grpc_method_router *router = (grpc_method_router *)calloc(1, sizeof(grpc_method_router));
+    if (!router) {
+        return NULL;
+    }
+    router->count = count;
+    if (count == 0) {
+        return router;
+    }
+    router->bucket_count = (count + METHOD_ROUTER_BUCKET_KEYS - 1) / METHOD_ROUTER_BUCKET_KEYS;
+    router->displacements = (uint32_t *)calloc(router->bucket_count, sizeof(uint32_t));
+    router->routes = (method_route *)calloc(count, sizeof(method_route));
+    
+    /* Scratch space for the build only */
+    uint64_t *hashes = (uint64_t *)malloc(count * sizeof(uint64_t));
+    size_t *order = (size_t *)malloc(count * sizeof(size_t));
+    size_t *slots = (size_t *)malloc(count * sizeof(size_t));
+    bool *used = (bool *)malloc(count * sizeof(bool));
+    method_router_bucket_info *buckets =
+        (method_router_bucket_info *)malloc(router->bucket_count * sizeof(method_router_bucket_info));
+    
+    int rc = -1;
+    if (router->displacements && router->routes && hashes && order && slots && used && buckets) {
+        for (uint64_t seed = 0; seed < METHOD_ROUTER_MAX_SEEDS; seed++) {
+            router->seed = seed * 0x9e3779b97f4a7c15ull;
+            rc = method_router_place(router, paths, values, hashes, order, buckets, used, slots);
+            if (rc <= 0) {
+                break;
+            }
+        }
+    }
+    
+    free(hashes);
+    free(order);
+    free(slots);
+    free(used);
+    free(buckets);
+    
+    if (rc != 0) {
+        grpc_method_router_destroy(router);
+        return NULL;
+    }
+    return router;
+}
+
+/**
+ * Look up a path with one probe
+ * @param router Router (NULL finds nothing)
+ * @param path Path to resolve
+ * @return Value registered for path, or NULL
+ */
+void *grpc_method_router_lookup(const grpc_method_router *router, const char *path) {
+    if (!router || !path || router->count == 0) {
+        return NULL;
+    }
+    
+    uint64_t hash = grpc_hash_bytes(path, strlen(path), router->seed);
+    uint32_t displacement = router->displacements[method_router_bucket(hash, router->bucket_count)];
+    const method_route *route = &router->routes[method_router_slot(hash, displacement, router->count)];
+    if (route->hash != hash || strcmp(route->path, path) != 0) {
+        return NULL;
+    }
+    return route->value;
+}
+
+/**
+ * Number of paths in the router (equal to its slot count)
+ */
+size_t grpc_method_router_size(const grpc_method_router *router) {
+    return router ? router->count : 0;
+}
+
+void grpc_method_router_destroy(grpc_method_router *router) {
+    if (!router) {
+        return;
+    }
+    free(router->displacements);
+    free(router->routes);
+    free(router);
+}
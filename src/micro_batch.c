@@ -0,0 +1,462 @@
+/**
+ * @file micro_batch.c
+ * @brief Small unary calls to one method gathered into batch calls
+ *
+ * A call to a batched method gets this file's transport. Its request is
+ * held until the call half-closes and then joins the method's open batch.
+ * The batch is sent once it is full, or when the window of its first call
+ * runs out on the channel's timer thread: one client call to the batch
+ * method, carrying each request as a message. Deliveries from that call
+ * land here; the n-th reply completes the n-th call sent, and the final
+ * status completes the calls left without one.
+ *
+ * The batch call is destroyed with the last reference to the batch: one
+ * per member call, one while the window timer is pending and one while
+ * the batch is being sent. Deliveries to a member run without the batch
+ * lock and mark it busy, so destroying the member waits for them. Lock
+ * order: channel->mutex, then batch->mutex.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MICRO_BATCH_NO_REPLY "No reply for the call in its batch"
+
+/* Call waiting in a batch */
+typedef struct {
+    grpc_call *call;            /* NULL once the call is destroyed */
+    grpc_byte_buffer *request;  /* Dropped once sent */
+    bool gone;                  /* Cancelled or destroyed: nothing more is delivered */
+    bool answered;
+    bool busy;                  /* A delivery to the call is running */
+} micro_batch_member;
+
+typedef struct micro_batch {
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;        /* Signalled when a member stops being busy */
+    grpc_channel *channel;
+    channel_method_policy *policy;
+    char *method;               /* Batch method */
+    micro_batch_member *members;
+    size_t count;
+    size_t capacity;
+    size_t bytes;               /* Requests gathered so far */
+    size_t *sent;               /* Members in the order their requests were sent */
+    size_t sent_count;
+    size_t replies;             /* Messages received so far */
+    uint64_t timer_id;          /* Window timer, 0 if none */
+    bool flushed;
+    grpc_call *call;            /* The batch call, once sent */
+    grpc_metadata_array initial_metadata;
+    int refs;
+} micro_batch;
+
+/* Transport data of a batched call */
+typedef struct {
+    channel_method_policy *policy;
+    grpc_byte_buffer *request;
+    micro_batch *batch;         /* Batch joined, NULL before (guarded by channel->mutex) */
+    size_t index;
+} micro_batch_call;
+
+static const grpc_call_transport micro_batch_transport;
+
+/* ========================================================================
+ * Batches
+ * ======================================================================== */
+
+/* Caller holds channel->mutex */
+static micro_batch *micro_batch_create(grpc_channel *channel, channel_method_policy *policy, size_t capacity) {
+    micro_batch *batch = (micro_batch *)calloc(1, sizeof(micro_batch));
+    if (!batch) {
+        return NULL;
+    }
+    batch->members = (micro_batch_member *)calloc(capacity, sizeof(micro_batch_member));
+    batch->sent = (size_t *)calloc(capacity, sizeof(size_t));
+    batch->method = strdup(policy->batch_method);
+    if (!batch->members || !batch->sent || !batch->method ||
+        grpc_metadata_array_init(&batch->initial_metadata, 0) != 0) {
+        free(batch->members);
+        free(batch->sent);
+        free(batch->method);
+        free(batch);
+        return NULL;
+    }
+    
+    pthread_mutex_init(&batch->mutex, NULL);
+    pthread_cond_init(&batch->idle, NULL);
+    batch->channel = channel;
+    batch->policy = policy;
+    batch->capacity = capacity;
+    return batch;
+}
+
+static void micro_batch_unref(micro_batch *batch) {
+    pthread_mutex_lock(&batch->mutex);
+    int refs = --batch->refs;
+    pthread_mutex_unlock(&batch->mutex);
+    if (refs > 0) {
+        return;
+    }
+    
+    /* Waits for deliveries still running on the batch call */
+    grpc_call_destroy(batch->call);
+    
+    for (size_t i = 0; i < batch->count; i++) {
+        if (batch->members[i].request) {
+            grpc_byte_buffer_destroy(batch->members[i].request);
+        }
+    }
+    grpc_metadata_array_destroy(&batch->initial_metadata);
+    pthread_cond_destroy(&batch->idle);
+    pthread_mutex_destroy(&batch->mutex);
+    free(batch->members);
+    free(batch->sent);
+    free(batch->method);
+    free(batch);
+}
+
+/* Complete the calls sent in the batch that are still without a reply */
+static void micro_batch_finish(micro_batch *batch, grpc_status_code status, const char *details, bool cancelled) {
+    if (status == GRPC_STATUS_OK) {
+        status = GRPC_STATUS_INTERNAL;
+        details = MICRO_BATCH_NO_REPLY;
+    }
+    
+    pthread_mutex_lock(&batch->mutex);
+    for (size_t i = 0; i < batch->sent_count; i++) {
+        micro_batch_member *member = &batch->members[batch->sent[i]];
+        if (member->gone || member->answered) {
+            continue;
+        }
+        member->answered = true;
+        member->busy = true;
+        grpc_call *call = member->call;
+        pthread_mutex_unlock(&batch->mutex);
+        
+        if (cancelled) {
+            call_deliver_cancel(call);
+        } else {
+            call_deliver_status(call, status, details, NULL, 0);
+        }
+        
+        pthread_mutex_lock(&batch->mutex);
+        member->busy = false;
+        pthread_cond_broadcast(&batch->idle);
+    }
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+static bool micro_batch_later(grpc_timespec a, grpc_timespec b) {
+    return a.tv_sec > b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec > b.tv_nsec);
+}
+
+/* Send the batch as one call; the caller holds a reference */
+static void micro_batch_flush(micro_batch *batch) {
+    grpc_channel *channel = batch->channel;
+    
+    pthread_mutex_lock(&batch->mutex);
+    if (batch->flushed) {
+        pthread_mutex_unlock(&batch->mutex);
+        return;
+    }
+    batch->flushed = true;
+    if (batch->timer_id != 0 && grpc_timer_queue_cancel(channel->timers, batch->timer_id)) {
+        batch->refs--;
+    }
+    
+    /* Cancelled calls are left out; the batch lives as long as the latest deadline */
+    grpc_timespec deadline = {0, 0};
+    for (size_t i = 0; i < batch->count; i++) {
+        micro_batch_member *member = &batch->members[i];
+        if (member->gone) {
+            grpc_byte_buffer_destroy(member->request);
+            member->request = NULL;
+            continue;
+        }
+        batch->sent[batch->sent_count++] = i;
+        if (micro_batch_later(member->call->deadline, deadline)) {
+            deadline = member->call->deadline;
+        }
+    }
+    size_t sent_count = batch->sent_count;
+    pthread_mutex_unlock(&batch->mutex);
+    
+    if (sent_count == 0) {
+        return;
+    }
+    
+    grpc_call *call = call_create(channel, NULL, NULL, batch->method, NULL, deadline);
+    if (!call || inproc_client_call_init(call, channel->inproc_server) != 0) {
+        grpc_call_destroy(call);
+        micro_batch_finish(batch, GRPC_STATUS_UNAVAILABLE, "Batch call could not be created", false);
+        return;
+    }
+    call->batch_of = batch;
+    pthread_mutex_lock(&batch->mutex);
+    batch->call = call;
+    pthread_mutex_unlock(&batch->mutex);
+    
+    /* Sent without the lock: the transport may deliver back into this file */
+    if (call->transport->send_initial_metadata(call, NULL, 0) != 0) {
+        micro_batch_finish(batch, GRPC_STATUS_UNAVAILABLE, "Batch call could not be sent", false);
+        return;
+    }
+    for (size_t i = 0; i < sent_count; i++) {
+        call->transport->send_message(call, batch->members[batch->sent[i]].request);
+    }
+    call->transport->send_close(call);
+    
+    pthread_mutex_lock(&batch->mutex);
+    for (size_t i = 0; i < sent_count; i++) {
+        micro_batch_member *member = &batch->members[batch->sent[i]];
+        grpc_byte_buffer_destroy(member->request);
+        member->request = NULL;
+    }
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+/* The window of the batch's first call ran out */
+static void micro_batch_on_timer(void *arg) {
+    micro_batch *batch = (micro_batch *)arg;
+    grpc_channel *channel = batch->channel;
+    
+    pthread_mutex_lock(&channel->mutex);
+    if (batch->policy->open_batch == batch) {
+        batch->policy->open_batch = NULL;
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    
+    micro_batch_flush(batch);
+    micro_batch_unref(batch);
+}
+
+/* Add a half-closed call to the method's open batch, sending the batch if
+ * that fills it */
+static int micro_batch_join(grpc_call *call, micro_batch_call *entry) {
+    grpc_channel *channel = call->channel;
+    channel_method_policy *policy = entry->policy;
+    
+    pthread_mutex_lock(&channel->mutex);
+    /* Batching stopped since the call was created: it goes on its own */
+    size_t max_calls = policy->batched ? (size_t)policy->batching.max_calls : 1;
+    size_t max_bytes = policy->batched ? policy->batching.max_bytes : 0;
+    micro_batch *batch = policy->open_batch;
+    bool opened = false;
+    if (!batch) {
+        batch = micro_batch_create(channel, policy, max_calls);
+        if (!batch) {
+            pthread_mutex_unlock(&channel->mutex);
+            return -1;
+        }
+        policy->open_batch = batch;
+        opened = true;
+    }
+    
+    pthread_mutex_lock(&batch->mutex);
+    size_t index = batch->count++;
+    micro_batch_member *member = &batch->members[index];
+    member->call = call;
+    member->request = entry->request;
+    entry->request = NULL;
+    entry->batch = batch;
+    entry->index = index;
+    batch->bytes += member->request->length;
+    batch->refs++;
+    
+    bool flush = batch->count == batch->capacity || (max_bytes > 0 && batch->bytes >= max_bytes);
+    if (opened && !flush) {
+        if (grpc_timer_queue_schedule(channel->timers, policy->batching.window_ms, micro_batch_on_timer, batch,
+                                      &batch->timer_id) == 0) {
+            batch->refs++;
+        } else {
+            flush = true;
+        }
+    }
+    if (flush) {
+        policy->open_batch = NULL;
+        batch->refs++;
+    }
+    pthread_mutex_unlock(&batch->mutex);
+    pthread_mutex_unlock(&channel->mutex);
+    
+    if (flush) {
+        micro_batch_flush(batch);
+        micro_batch_unref(batch);
+    }
+    return 0;
+}
+
+/* ========================================================================
+ * Transport Operations (on the batched call)
+ * ======================================================================== */
+
+static int micro_batch_send_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count) {
+    (void)call;
+    (void)metadata;
+    (void)count;
+    return 0;
+}
+
+static int micro_batch_send_message(grpc_call *call, grpc_byte_buffer *message) {
+    micro_batch_call *entry = (micro_batch_call *)call->transport_data;
+    if (entry->request) {
+        return -1;
+    }
+    entry->request = grpc_byte_buffer_ref(message);
+    return 0;
+}
+
+static int micro_batch_send_close(grpc_call *call) {
+    micro_batch_call *entry = (micro_batch_call *)call->transport_data;
+    if (!entry->request) {
+        return -1;
+    }
+    return micro_batch_join(call, entry);
+}
+
+static int micro_batch_send_status(grpc_call *call, grpc_status_code status, const char *details,
+                                   const grpc_metadata *trailing_metadata, size_t trailing_count) {
+    (void)call;
+    (void)status;
+    (void)details;
+    (void)trailing_metadata;
+    (void)trailing_count;
+    return -1;
+}
+
+static micro_batch *micro_batch_of(grpc_call *call, size_t *index) {
+    micro_batch_call *entry = (micro_batch_call *)call->transport_data;
+    
+    pthread_mutex_lock(&call->channel->mutex);
+    micro_batch *batch = entry->batch;
+    *index = entry->index;
+    pthread_mutex_unlock(&call->channel->mutex);
+    return batch;
+}
+
+static void micro_batch_cancel(grpc_call *call) {
+    size_t index;
+    micro_batch *batch = micro_batch_of(call, &index);
+    if (!batch) {
+        return;
+    }
+    
+    pthread_mutex_lock(&batch->mutex);
+    batch->members[index].gone = true;
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+static void micro_batch_destroy(grpc_call *call) {
+    micro_batch_call *entry = (micro_batch_call *)call->transport_data;
+    size_t index;
+    micro_batch *batch = micro_batch_of(call, &index);
+    
+    if (batch) {
+        pthread_mutex_lock(&batch->mutex);
+        micro_batch_member *member = &batch->members[index];
+        while (member->busy) {
+            pthread_cond_wait(&batch->idle, &batch->mutex);
+        }
+        member->call = NULL;
+        member->gone = true;
+        pthread_mutex_unlock(&batch->mutex);
+        micro_batch_unref(batch);
+    }
+    
+    if (entry->request) {
+        grpc_byte_buffer_destroy(entry->request);
+    }
+    call->transport_data = NULL;
+    free(entry);
+}
+
+static const grpc_call_transport micro_batch_transport = {
+    micro_batch_send_initial_metadata,
+    micro_batch_send_message,
+    micro_batch_send_close,
+    micro_batch_send_status,
+    micro_batch_cancel,
+    micro_batch_destroy
+};
+
+/* ========================================================================
+ * Delivery From the Batch Call
+ * ======================================================================== */
+
+void micro_batch_deliver_initial_metadata(grpc_call *call, const grpc_metadata *metadata, size_t count) {
+    micro_batch *batch = call->batch_of;
+    
+    pthread_mutex_lock(&batch->mutex);
+    if (batch->initial_metadata.count == 0) {
+        for (size_t i = 0; i < count; i++) {
+            const char *value = metadata[i].value ? metadata[i].value : "";
+            grpc_metadata_array_add(&batch->initial_metadata, metadata[i].key, value, metadata[i].value_length);
+        }
+    }
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+void micro_batch_deliver_message(grpc_call *call, grpc_byte_buffer *message) {
+    micro_batch *batch = call->batch_of;
+    
+    pthread_mutex_lock(&batch->mutex);
+    size_t reply = batch->replies++;
+    micro_batch_member *member = reply < batch->sent_count ? &batch->members[batch->sent[reply]] : NULL;
+    if (!member || member->gone || member->answered) {
+        pthread_mutex_unlock(&batch->mutex);
+        grpc_byte_buffer_destroy(message);
+        return;
+    }
+    member->answered = true;
+    member->busy = true;
+    grpc_call *target = member->call;
+    pthread_mutex_unlock(&batch->mutex);
+    
+    /* Initial metadata is only written before the first message */
+    call_deliver_initial_metadata(target, batch->initial_metadata.metadata, batch->initial_metadata.count);
+    call_deliver_message(target, message);
+    call_deliver_status(target, GRPC_STATUS_OK, NULL, NULL, 0);
+    
+    pthread_mutex_lock(&batch->mutex);
+    member->busy = false;
+    pthread_cond_broadcast(&batch->idle);
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+void micro_batch_deliver_status(grpc_call *call, grpc_status_code status, const char *details) {
+    micro_batch_finish(call->batch_of, status, details, false);
+}
+
+void micro_batch_deliver_cancel(grpc_call *call) {
+    micro_batch_finish(call->batch_of, GRPC_STATUS_CANCELLED, NULL, true);
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+/**
+ * Attach a new client call to the batching transport
+ * @param call The client call, on a channel with timers and a call transport
+ * @param policy Method policy of the call's method, with a batch method
+ * @return 0 on success, -1 on error
+ */
+int micro_batch_call_init(grpc_call *call, channel_method_policy *policy) {
+    if (!call || !call->channel || !call->channel->timers || !policy || !policy->batch_method) {
+        return -1;
+    }
+    
+    micro_batch_call *entry = (micro_batch_call *)calloc(1, sizeof(micro_batch_call));
+    if (!entry) {
+        return -1;
+    }
+    entry->policy = policy;
+    
+    call->transport = &micro_batch_transport;
+    call->transport_data = entry;
+    return 0;
+}
@@ -6,6 +6,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include "grpc/grpc.h"
 #include "grpc_internal.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <netdb.h>
@@ -158,30 +159,65 @@ static grpc_resolved_address *grpc_dns_resolve(const char *target) {
  * Static Resolver
  * ======================================================================== */
 
+/* Parse one "address:port" entry of a static target */
+static grpc_resolved_address *grpc_static_resolve_one(const char *entry, size_t entry_len) {
+    char address[256];
+    int port = 50051;
+    
+    const char *colon = memchr(entry, ':', entry_len);
+    size_t addr_len = colon ? (size_t)(colon - entry) : entry_len;
+    if (addr_len >= sizeof(address)) {
+        return NULL;
+    }
+    memcpy(address, entry, addr_len);
+    address[addr_len] = '\0';
+    if (colon) {
+        port = atoi(colon + 1);
+    }
+    
+    return grpc_resolved_address_create(address, port);
+}
+
+/* Target: address:port, or a comma-separated list of them */
 static grpc_resolved_address *grpc_static_resolve(const char *target) {
     if (!target) {
         return NULL;
     }
     
-    /* Parse target: address:port */
-    char address[256];
-    int port = 50051;
-    
-    const char *colon = strchr(target, ':');
-    if (colon) {
-        size_t addr_len = colon - target;
-        if (addr_len >= sizeof(address)) {
+    grpc_resolved_address *head = NULL;
+    grpc_resolved_address *tail = NULL;
+    const char *entry = target;
+    for (;;) {
+        const char *comma = strchr(entry, ',');
+        size_t entry_len = comma ? (size_t)(comma - entry) : strlen(entry);
+        grpc_resolved_address *addr = grpc_static_resolve_one(entry, entry_len);
+        if (!addr) {
+            grpc_resolved_address_list_destroy(head);
             return NULL;
         }
-        strncpy(address, target, addr_len);
-        address[addr_len] = '\0';
-        port = atoi(colon + 1);
-    } else {
-        strncpy(address, target, sizeof(address) - 1);
-        address[sizeof(address) - 1] = '\0';
+        if (!head) {
+            head = addr;
+        } else {
+            tail->next = addr;
+        }
+        tail = addr;
+        if (!comma) {
+            break;
+        }
+        entry = comma + 1;
     }
     
-    return grpc_resolved_address_create(address, port);
+    return head;
+}
+
+/* ========================================================================
+ * Unix Socket Targets
+ * ======================================================================== */
+
+/* unix: and unix-abstract: targets name a local socket directly; the full
+ * target is kept as the address so the transport can parse the scheme */
+static grpc_resolved_address *grpc_unix_resolve(const char *target) {
+    return grpc_resolved_address_create(target, 0);
 }
 
 /* ========================================================================
@@ -231,10 +267,12 @@ int grpc_name_resolver_resolve(grpc_name_resolver *resolver) {
     
     switch (resolver->type) {
         case GRPC_RESOLVER_DNS:
-            resolved = grpc_dns_resolve(resolver->target);
+            resolved = grpc_address_is_unix(resolver->target) ? grpc_unix_resolve(resolver->target)
+                                                               : grpc_dns_resolve(resolver->target);
             break;
         case GRPC_RESOLVER_STATIC:
-            resolved = grpc_static_resolve(resolver->target);
+            resolved = grpc_address_is_unix(resolver->target) ? grpc_unix_resolve(resolver->target)
+                                                               : grpc_static_resolve(resolver->target);
             break;
         case GRPC_RESOLVER_CUSTOM:
             if (resolver->custom_resolve) {
@@ -287,6 +325,39 @@ size_t grpc_name_resolver_get_address_count(grpc_name_resolver *resolver) {
     return count;
 }
 
+/**
+ * Next address in a resolved list
+ * @param address Current address
+ * @return The following address, or NULL at the end of the list
+ */
+grpc_resolved_address *grpc_resolved_address_next(const grpc_resolved_address *address) {
+    return address ? address->next : NULL;
+}
+
+/**
+ * Format a resolved address as a target the transport can dial
+ * @param address Resolved address
+ * @param target Filled with "host:port", "[host]:port" for IPv6, or the
+ *        unix: target itself
+ * @param size Capacity of target
+ * @return 0 on success, -1 if target is too small
+ */
+int grpc_resolved_address_to_target(const grpc_resolved_address *address, char *target, size_t size) {
+    if (!address || !target) {
+        return -1;
+    }
+    
+    int len;
+    if (grpc_address_is_unix(address->address)) {
+        len = snprintf(target, size, "%s", address->address);
+    } else if (strchr(address->address, ':')) {
+        len = snprintf(target, size, "[%s]:%d", address->address, address->port);
+    } else {
+        len = snprintf(target, size, "%s:%d", address->address, address->port);
+    }
+    return len >= 0 && (size_t)len < size ? 0 : -1;
+}
+
 int grpc_name_resolver_set_custom_resolver(grpc_name_resolver *resolver,
                                            grpc_resolved_address *(*custom_resolve)(const char *, void *),
                                            void *user_data) {
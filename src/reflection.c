@@ -6,6 +6,7 @@
 #define _DEFAULT_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #include "grpc/grpc.h"
+#include "grpc/grpc_advanced.h"
 #include "grpc_internal.h"
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +28,7 @@ typedef struct grpc_service_descriptor {
 /* Method descriptor */
 typedef struct grpc_method_descriptor {
     char *method_name;
+    char *path;              /* "/package.Service/Method", built once */
     char *input_type;
     char *output_type;
     bool client_streaming;
@@ -87,6 +89,7 @@ static void grpc_method_descriptor_destroy(grpc_method_descriptor *method) {
     if (!method) return;
     
     free(method->method_name);
+    free(method->path);
     free(method->input_type);
     free(method->output_type);
     free(method);
@@ -230,6 +233,15 @@ int grpc_reflection_registry_add_method(grpc_reflection_registry *registry,
         return -1;
     }
     
+    /* The :path is fixed once the method exists, so build it here rather
+     * than on every lookup */
+    method->path = grpc_reflection_get_full_method_name(service, method);
+    if (!method->path) {
+        grpc_method_descriptor_destroy(method);
+        pthread_mutex_unlock(&registry->mutex);
+        return -1;
+    }
+    
     /* Add to service */
     method->next = service->methods;
     service->methods = method;
@@ -333,12 +345,16 @@ char *grpc_reflection_get_full_method_name(grpc_service_descriptor *service,
         return NULL;
     }
     
+    if (method->path) {
+        return strdup(method->path);
+    }
+    
     char *service_name = grpc_reflection_get_full_service_name(service);
     if (!service_name) {
         return NULL;
     }
     
-    size_t len = strlen(service_name) + strlen(method->method_name) + 2; /* +1 for slash, +1 for null */
+    size_t len = strlen(service_name) + strlen(method->method_name) + 3; /* two slashes and null */
     char *full_name = (char *)malloc(len);
     if (!full_name) {
         free(service_name);
@@ -350,3 +366,40 @@ char *grpc_reflection_get_full_method_name(grpc_service_descriptor *service,
     
     return full_name;
 }
+
+/* Method :path without allocating */
+const char *grpc_method_descriptor_get_path(const grpc_method_descriptor *method) {
+    return method ? method->path : NULL;
+}
+
+/* ========================================================================
+ * Server Routing Support
+ * ======================================================================== */
+
+/**
+ * Call visit for every method in the registry, holding the registry lock
+ * @param registry Registry
+ * @param visit Callback; a non-zero return stops the walk
+ * @param arg Passed to visit
+ * @return 0, or the first non-zero value returned by visit
+ */
+int grpc_reflection_registry_visit_methods(grpc_reflection_registry *registry,
+                                           int (*visit)(grpc_method_descriptor *method,
+                                                        const char *path, void *arg),
+                                           void *arg) {
+    if (!registry || !visit) {
+        return -1;
+    }
+    
+    int rc = 0;
+    pthread_mutex_lock(&registry->mutex);
+    for (grpc_service_descriptor *service = registry->services; service && rc == 0;
+         service = service->next) {
+        for (grpc_method_descriptor *method = service->methods; method && rc == 0;
+             method = method->next) {
+            rc = visit(method, method->path, arg);
+        }
+    }
+    pthread_mutex_unlock(&registry->mutex);
+    return rc;
+}
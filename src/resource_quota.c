@@ -0,0 +1,193 @@
+/**
+ * @file resource_quota.c
+ * @brief Memory quotas for buffered transport data
+ *
+ * Quotas form a two-level tree: every quota created by the application is
+ * a child of the process-wide global quota, and memory charged to a child
+ * also counts against the global one. Usage is tracked with atomics so the
+ * hot receive path never takes a lock.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Usage above this fraction of the limit counts as memory pressure */
+#define GRPC_RESOURCE_QUOTA_PRESSURE_NUM 7
+#define GRPC_RESOURCE_QUOTA_PRESSURE_DEN 8
+
+struct grpc_resource_quota {
+    char *name;
+    size_t limit;                        /* SIZE_MAX means unlimited */
+    size_t usage;
+    int refs;
+    struct grpc_resource_quota *parent;  /* NULL for the global quota */
+};
+
+static grpc_resource_quota global_quota = {NULL, SIZE_MAX, 0, 1, NULL};
+
+static grpc_resource_quota *resource_quota_or_global(grpc_resource_quota *quota) {
+    return quota ? quota : &global_quota;
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+grpc_resource_quota *grpc_resource_quota_global(void) {
+    return &global_quota;
+}
+
+grpc_resource_quota *grpc_resource_quota_create(const char *name) {
+    grpc_resource_quota *quota = (grpc_resource_quota *)calloc(1, sizeof(grpc_resource_quota));
+    if (!quota) {
+        return NULL;
+    }
+    
+    if (name) {
+        quota->name = strdup(name);
+        if (!quota->name) {
+            free(quota);
+            return NULL;
+        }
+    }
+    quota->limit = SIZE_MAX;
+    quota->refs = 1;
+    quota->parent = &global_quota;
+    return quota;
+}
+
+void grpc_resource_quota_ref(grpc_resource_quota *quota) {
+    if (!quota || quota == &global_quota) {
+        return;
+    }
+    __atomic_fetch_add(&quota->refs, 1, __ATOMIC_RELAXED);
+}
+
+void grpc_resource_quota_unref(grpc_resource_quota *quota) {
+    if (!quota || quota == &global_quota) {
+        return;
+    }
+    if (__atomic_sub_fetch(&quota->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    
+    free(quota->name);
+    free(quota);
+}
+
+void grpc_resource_quota_resize(grpc_resource_quota *quota, size_t new_size) {
+    if (!quota) {
+        return;
+    }
+    __atomic_store_n(&quota->limit, new_size > 0 ? new_size : SIZE_MAX, __ATOMIC_RELAXED);
+}
+
+size_t grpc_resource_quota_get_usage(grpc_resource_quota *quota) {
+    if (!quota) {
+        return 0;
+    }
+    return __atomic_load_n(&quota->usage, __ATOMIC_RELAXED);
+}
+
+/* ========================================================================
+ * Accounting
+ * ======================================================================== */
+
+/* Add size to one level if it stays within that level's limit */
+static bool resource_quota_try_add(grpc_resource_quota *quota, size_t size) {
+    size_t limit = __atomic_load_n(&quota->limit, __ATOMIC_RELAXED);
+    size_t usage = __atomic_load_n(&quota->usage, __ATOMIC_RELAXED);
+    
+    do {
+        if (usage > limit || size > limit - usage) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&quota->usage, &usage, usage + size, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+/**
+ * Reserve memory if it fits within the quota and every ancestor
+ * @param quota Quota to charge (NULL charges the global quota)
+ * @param size Bytes
+ * @return 0 if reserved, -1 if over budget (nothing is charged)
+ */
+int grpc_resource_quota_reserve(grpc_resource_quota *quota, size_t size) {
+    quota = resource_quota_or_global(quota);
+    
+    for (grpc_resource_quota *q = quota; q; q = q->parent) {
+        if (!resource_quota_try_add(q, size)) {
+            /* Undo the levels already charged */
+            for (grpc_resource_quota *undo = quota; undo != q; undo = undo->parent) {
+                __atomic_fetch_sub(&undo->usage, size, __ATOMIC_RELAXED);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Charge memory that is already held, even past the limit. Used for bytes
+ * the peer has sent and that must be buffered anyway; the overshoot is what
+ * turns on backpressure.
+ * @param quota Quota to charge (NULL charges the global quota)
+ * @param size Bytes
+ */
+void grpc_resource_quota_charge(grpc_resource_quota *quota, size_t size) {
+    for (grpc_resource_quota *q = resource_quota_or_global(quota); q; q = q->parent) {
+        __atomic_fetch_add(&q->usage, size, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Return memory charged with grpc_resource_quota_reserve() or _charge()
+ * @param quota Quota that was charged
+ * @param size Bytes
+ */
+void grpc_resource_quota_release(grpc_resource_quota *quota, size_t size) {
+    for (grpc_resource_quota *q = resource_quota_or_global(quota); q; q = q->parent) {
+        __atomic_fetch_sub(&q->usage, size, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Whether the quota or an ancestor is nearly full; receive windows stop
+ * being refilled so peers slow down before the limit is hit
+ * @param quota Quota (NULL checks the global quota)
+ * @return true above 7/8 of any limit
+ */
+bool grpc_resource_quota_under_pressure(grpc_resource_quota *quota) {
+    for (grpc_resource_quota *q = resource_quota_or_global(quota); q; q = q->parent) {
+        size_t limit = __atomic_load_n(&q->limit, __ATOMIC_RELAXED);
+        if (limit == SIZE_MAX) {
+            continue;
+        }
+        size_t usage = __atomic_load_n(&q->usage, __ATOMIC_RELAXED);
+        if (usage > limit / GRPC_RESOURCE_QUOTA_PRESSURE_DEN * GRPC_RESOURCE_QUOTA_PRESSURE_NUM) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Whether the quota or an ancestor is at its limit; sockets are not read
+ * and new streams are refused until memory is released
+ * @param quota Quota (NULL checks the global quota)
+ * @return true if any limit is reached
+ */
+bool grpc_resource_quota_exhausted(grpc_resource_quota *quota) {
+    for (grpc_resource_quota *q = resource_quota_or_global(quota); q; q = q->parent) {
+        size_t limit = __atomic_load_n(&q->limit, __ATOMIC_RELAXED);
+        if (limit != SIZE_MAX && __atomic_load_n(&q->usage, __ATOMIC_RELAXED) >= limit) {
+            return true;
+        }
+    }
+    return false;
+}
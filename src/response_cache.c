@@ -0,0 +1,345 @@
+/**
+ * @file response_cache.c
+ * @brief Serialized responses of idempotent unary methods, keyed by request
+ *
+ * Entries hold a copy of the request and response bytes and expire a fixed
+ * time after they were stored. The cache is bounded by the bytes it holds:
+ * entries are kept in LRU order, and a new entry that would push out older
+ * ones is admitted TinyLFU-style, only if its request was seen more often
+ * than the entry it would evict. Request frequencies are estimated by a
+ * count-min sketch that is halved periodically, so popularity fades.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define RESPONSE_CACHE_MIN_BUCKETS 16
+/* Sketch rows; a request's estimate is its smallest counter */
+#define RESPONSE_CACHE_SKETCH_DEPTH 4
+#define RESPONSE_CACHE_SKETCH_MIN_WIDTH 64
+#define RESPONSE_CACHE_SKETCH_MAX_WIDTH 65536
+/* Expected bytes per entry, for sizing the sketch */
+#define RESPONSE_CACHE_SKETCH_BYTES_PER_ENTRY 256
+#define RESPONSE_CACHE_SKETCH_MAX_COUNT 15
+/* Counters are halved after this many increments per column */
+#define RESPONSE_CACHE_SKETCH_SAMPLE_FACTOR 10
+
+typedef struct response_cache_entry {
+    uint64_t hash;
+    uint8_t *request;
+    size_t request_len;
+    uint8_t *response;
+    size_t response_len;
+    size_t charge;                /* Bytes counted against the bound */
+    int64_t expires_ms;
+    struct response_cache_entry *hash_next;
+    struct response_cache_entry *lru_prev;  /* Towards the most recently used */
+    struct response_cache_entry *lru_next;
+} response_cache_entry;
+
+struct grpc_response_cache {
+    pthread_mutex_t mutex;
+    size_t max_bytes;
+    size_t bytes;
+    int ttl_ms;
+    response_cache_entry **buckets;
+    size_t bucket_mask;
+    size_t count;
+    response_cache_entry *lru_head;
+    response_cache_entry *lru_tail;
+    uint8_t *sketch;              /* RESPONSE_CACHE_SKETCH_DEPTH rows */
+    size_t sketch_mask;
+    size_t sketch_additions;
+    size_t sketch_sample_size;
+};
+
+/* ========================================================================
+ * Frequency Sketch
+ * ======================================================================== */
+
+static size_t response_cache_sketch_index(const grpc_response_cache *cache, uint64_t hash, int row) {
+    uint64_t step = (hash >> 32) | 1;
+    return (size_t)row * (cache->sketch_mask + 1) + (size_t)((hash + (uint64_t)row * step) & cache->sketch_mask);
+}
+
+static void response_cache_sketch_add(grpc_response_cache *cache, uint64_t hash) {
+    for (int row = 0; row < RESPONSE_CACHE_SKETCH_DEPTH; row++) {
+        uint8_t *counter = &cache->sketch[response_cache_sketch_index(cache, hash, row)];
+        if (*counter < RESPONSE_CACHE_SKETCH_MAX_COUNT) {
+            (*counter)++;
+        }
+    }
+    
+    /* Age every count so yesterday's popular requests make room */
+    if (++cache->sketch_additions >= cache->sketch_sample_size) {
+        size_t total = RESPONSE_CACHE_SKETCH_DEPTH * (cache->sketch_mask + 1);
+        for (size_t i = 0; i < total; i++) {
+            cache->sketch[i] >>= 1;
+        }
+        cache->sketch_additions /= 2;
+    }
+}
+
+static uint8_t response_cache_sketch_estimate(const grpc_response_cache *cache, uint64_t hash) {
+    uint8_t estimate = RESPONSE_CACHE_SKETCH_MAX_COUNT;
+    for (int row = 0; row < RESPONSE_CACHE_SKETCH_DEPTH; row++) {
+        uint8_t counter = cache->sketch[response_cache_sketch_index(cache, hash, row)];
+        if (counter < estimate) {
+            estimate = counter;
+        }
+    }
+    return estimate;
+}
+
+/* ========================================================================
+ * Entries (all expect cache->mutex held)
+ * ======================================================================== */
+
+static response_cache_entry **response_cache_slot(grpc_response_cache *cache, uint64_t hash,
+                                                  const uint8_t *request, size_t request_len) {
+    response_cache_entry **slot = &cache->buckets[hash & cache->bucket_mask];
+    while (*slot) {
+        response_cache_entry *entry = *slot;
+        if (entry->hash == hash && entry->request_len == request_len &&
+            (request_len == 0 || memcmp(entry->request, request, request_len) == 0)) {
+            break;
+        }
+        slot = &entry->hash_next;
+    }
+    return slot;
+}
+
+static void response_cache_lru_unlink(grpc_response_cache *cache, response_cache_entry *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void response_cache_lru_push(grpc_response_cache *cache, response_cache_entry *entry) {
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) {
+        cache->lru_head->lru_prev = entry;
+    } else {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+static void response_cache_entry_free(response_cache_entry *entry) {
+    free(entry->request);
+    free(entry->response);
+    free(entry);
+}
+
+static void response_cache_remove(grpc_response_cache *cache, response_cache_entry *entry) {
+    response_cache_entry **slot = response_cache_slot(cache, entry->hash, entry->request, entry->request_len);
+    *slot = entry->hash_next;
+    response_cache_lru_unlink(cache, entry);
+    cache->bytes -= entry->charge;
+    cache->count--;
+    response_cache_entry_free(entry);
+}
+
+/* Double the table once it holds as many entries as buckets */
+static void response_cache_grow(grpc_response_cache *cache) {
+    size_t size = (cache->bucket_mask + 1) * 2;
+    response_cache_entry **buckets = (response_cache_entry **)calloc(size, sizeof(*buckets));
+    if (!buckets) {
+        return;
+    }
+    for (size_t i = 0; i <= cache->bucket_mask; i++) {
+        response_cache_entry *entry = cache->buckets[i];
+        while (entry) {
+            response_cache_entry *next = entry->hash_next;
+            entry->hash_next = buckets[entry->hash & (size - 1)];
+            buckets[entry->hash & (size - 1)] = entry;
+            entry = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_mask = size - 1;
+}
+
+/* ========================================================================
+ * Public Interface
+ * ======================================================================== */
+
+/**
+ * Create a response cache
+ * @param max_bytes Bound on the request and response bytes held
+ * @param ttl_ms Lifetime of an entry
+ * @return Cache, or NULL on error
+ */
+grpc_response_cache *grpc_response_cache_create(size_t max_bytes, int ttl_ms) {
+    if (max_bytes == 0 || ttl_ms <= 0) {
+        return NULL;
+    }
+    
+    grpc_response_cache *cache = (grpc_response_cache *)calloc(1, sizeof(grpc_response_cache));
+    if (!cache) {
+        return NULL;
+    }
+    
+    size_t width = RESPONSE_CACHE_SKETCH_MIN_WIDTH;
+    while (width < RESPONSE_CACHE_SKETCH_MAX_WIDTH && width * RESPONSE_CACHE_SKETCH_BYTES_PER_ENTRY < max_bytes) {
+        width *= 2;
+    }
+    cache->max_bytes = max_bytes;
+    cache->ttl_ms = ttl_ms;
+    cache->buckets = (response_cache_entry **)calloc(RESPONSE_CACHE_MIN_BUCKETS, sizeof(response_cache_entry *));
+    cache->bucket_mask = RESPONSE_CACHE_MIN_BUCKETS - 1;
+    cache->sketch = (uint8_t *)calloc(RESPONSE_CACHE_SKETCH_DEPTH * width, 1);
+    cache->sketch_mask = width - 1;
+    cache->sketch_sample_size = width * RESPONSE_CACHE_SKETCH_SAMPLE_FACTOR;
+    if (!cache->buckets || !cache->sketch) {
+        free(cache->buckets);
+        free(cache->sketch);
+        free(cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->mutex, NULL);
+    return cache;
+}
+
+/**
+ * Find the response stored for a request. Every lookup counts towards the
+ * request's frequency, hit or miss.
+ * @param cache The cache
+ * @param request Serialized request
+ * @return New buffer holding a copy of the response, or NULL on a miss
+ */
+grpc_byte_buffer *grpc_response_cache_lookup(grpc_response_cache *cache, const grpc_byte_buffer *request) {
+    if (!cache || !request) {
+        return NULL;
+    }
+    
+    uint64_t hash = grpc_hash_bytes(request->data, request->length, 0);
+    int64_t now_ms = grpc_monotonic_ms();
+    grpc_byte_buffer *response = NULL;
+    
+    pthread_mutex_lock(&cache->mutex);
+    response_cache_sketch_add(cache, hash);
+    response_cache_entry *entry = *response_cache_slot(cache, hash, request->data, request->length);
+    if (entry && entry->expires_ms <= now_ms) {
+        response_cache_remove(cache, entry);
+    } else if (entry) {
+        response_cache_lru_unlink(cache, entry);
+        response_cache_lru_push(cache, entry);
+        response = grpc_byte_buffer_create(entry->response, entry->response_len);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    
+    return response;
+}
+
+/**
+ * Store the response to a request, replacing any earlier one. Making room
+ * evicts expired and least recently used entries, unless the request is
+ * less frequent than an entry it would evict.
+ * @param cache The cache
+ * @param request Serialized request
+ * @param response Serialized response
+ * @return 0 if stored, -1 if refused (too large or not frequent enough) or on error
+ */
+int grpc_response_cache_insert(grpc_response_cache *cache, const grpc_byte_buffer *request,
+                               const grpc_byte_buffer *response) {
+    if (!cache || !request || !response) {
+        return -1;
+    }
+    
+    size_t charge = sizeof(response_cache_entry) + request->length + response->length;
+    if (charge > cache->max_bytes) {
+        return -1;
+    }
+    
+    response_cache_entry *entry = (response_cache_entry *)calloc(1, sizeof(response_cache_entry));
+    if (!entry) {
+        return -1;
+    }
+    entry->hash = grpc_hash_bytes(request->data, request->length, 0);
+    entry->request = (uint8_t *)malloc(request->length ? request->length : 1);
+    entry->response = (uint8_t *)malloc(response->length ? response->length : 1);
+    if (!entry->request || !entry->response) {
+        response_cache_entry_free(entry);
+        return -1;
+    }
+    memcpy(entry->request, request->data, request->length);
+    memcpy(entry->response, response->data, response->length);
+    entry->request_len = request->length;
+    entry->response_len = response->length;
+    entry->charge = charge;
+    entry->expires_ms = grpc_monotonic_ms() + cache->ttl_ms;
+    
+    pthread_mutex_lock(&cache->mutex);
+    response_cache_entry *old = *response_cache_slot(cache, entry->hash, entry->request, entry->request_len);
+    if (old) {
+        response_cache_remove(cache, old);
+    }
+    
+    int64_t now_ms = grpc_monotonic_ms();
+    uint8_t frequency = response_cache_sketch_estimate(cache, entry->hash);
+    while (cache->bytes + charge > cache->max_bytes) {
+        response_cache_entry *victim = cache->lru_tail;
+        if (victim->expires_ms > now_ms && frequency <= response_cache_sketch_estimate(cache, victim->hash)) {
+            pthread_mutex_unlock(&cache->mutex);
+            response_cache_entry_free(entry);
+            return -1;
+        }
+        response_cache_remove(cache, victim);
+    }
+    
+    if (cache->count >= cache->bucket_mask + 1) {
+        response_cache_grow(cache);
+    }
+    response_cache_entry **slot = &cache->buckets[entry->hash & cache->bucket_mask];
+    entry->hash_next = *slot;
+    *slot = entry;
+    response_cache_lru_push(cache, entry);
+    cache->bytes += charge;
+    cache->count++;
+    pthread_mutex_unlock(&cache->mutex);
+    
+    return 0;
+}
+
+/**
+ * Number of entries held, expired ones included until they are found
+ */
+size_t grpc_response_cache_size(grpc_response_cache *cache) {
+    if (!cache) {
+        return 0;
+    }
+    pthread_mutex_lock(&cache->mutex);
+    size_t count = cache->count;
+    pthread_mutex_unlock(&cache->mutex);
+    return count;
+}
+
+void grpc_response_cache_destroy(grpc_response_cache *cache) {
+    if (!cache) {
+        return;
+    }
+    while (cache->lru_head) {
+        response_cache_entry *next = cache->lru_head->lru_next;
+        response_cache_entry_free(cache->lru_head);
+        cache->lru_head = next;
+    }
+    free(cache->buckets);
+    free(cache->sketch);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+}
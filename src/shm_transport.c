@@ -0,0 +1,524 @@
+/**
+ * @file shm_transport.c
+ * @brief Shared-memory ring transport for peers on the same host
+ *
+ * Frames travel through two single-producer/single-consumer byte rings in
+ * one memfd mapping, one ring per direction. A side only sleeps when its
+ * ring is empty (reader) or full (writer) and is woken through an eventfd;
+ * while both sides keep up no system calls are made at all.
+ *
+ * The memfd and the four eventfds are passed over the already connected
+ * Unix socket with SCM_RIGHTS. The socket then stays open only so that a
+ * side blocked on a ring notices when its peer goes away.
+ */
+
+#define _GNU_SOURCE
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#define SHM_HANDSHAKE_MAGIC "GRPCSHM1"
+#define SHM_HANDSHAKE_MAGIC_LEN 8
+#define SHM_MIN_RING_BYTES 4096
+#define SHM_MAX_RING_BYTES (1u << 30)
+#define SHM_SPIN_ITERATIONS 1024
+
+/* Eventfd slots: data/space wakeups for ring 0 (client to server) and ring 1 */
+enum {
+    SHM_EFD_RING0_DATA,
+    SHM_EFD_RING0_SPACE,
+    SHM_EFD_RING1_DATA,
+    SHM_EFD_RING1_SPACE,
+    SHM_EFD_COUNT
+};
+
+/* Ring control block at the start of each ring; head and tail sit on their
+ * own cache lines so the two processes do not false-share */
+typedef struct shm_ring {
+    uint64_t head;              /* Bytes consumed, written by the reader */
+    uint32_t reader_waiting;    /* Reader is asleep on the data eventfd */
+    uint8_t head_pad[52];
+    uint64_t tail;              /* Bytes produced, written by the writer */
+    uint32_t writer_waiting;    /* Writer is asleep on the space eventfd */
+    uint8_t tail_pad[52];
+} shm_ring;
+
+typedef struct shm_hello {
+    char magic[SHM_HANDSHAKE_MAGIC_LEN];
+    uint32_t ring_bytes;
+    uint32_t reserved;
+} shm_hello;
+
+struct shm_transport {
+    int socket_fd;              /* Not owned; watched for peer hang-up */
+    uint8_t *base;
+    size_t map_size;
+    size_t ring_bytes;          /* Power of two */
+    shm_ring *tx;
+    shm_ring *rx;
+    uint8_t *tx_data;
+    uint8_t *rx_data;
+    int efds[SHM_EFD_COUNT];
+    int tx_data_efd;            /* Signalled after producing into tx */
+    int tx_space_efd;           /* Slept on while tx is full */
+    int rx_data_efd;            /* Slept on while rx is empty */
+    int rx_space_efd;           /* Signalled after consuming from rx */
+};
+
+/* ========================================================================
+ * Setup and Teardown
+ * ======================================================================== */
+
+static size_t shm_map_size(size_t ring_bytes) {
+    return 2 * (sizeof(shm_ring) + ring_bytes);
+}
+
+static shm_transport *shm_transport_alloc(int socket_fd) {
+    shm_transport *shm = (shm_transport *)calloc(1, sizeof(shm_transport));
+    if (!shm) {
+        return NULL;
+    }
+    
+    shm->socket_fd = socket_fd;
+    shm->base = MAP_FAILED;
+    for (int i = 0; i < SHM_EFD_COUNT; i++) {
+        shm->efds[i] = -1;
+    }
+    return shm;
+}
+
+/* Point tx/rx at the right ring for this side of the connection */
+static int shm_transport_map(shm_transport *shm, int memfd, size_t ring_bytes, bool is_client) {
+    shm->ring_bytes = ring_bytes;
+    shm->map_size = shm_map_size(ring_bytes);
+    shm->base = (uint8_t *)mmap(NULL, shm->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (shm->base == MAP_FAILED) {
+        return -1;
+    }
+    
+    shm_ring *ring0 = (shm_ring *)shm->base;
+    shm_ring *ring1 = (shm_ring *)(shm->base + sizeof(shm_ring) + ring_bytes);
+    uint8_t *data0 = (uint8_t *)(ring0 + 1);
+    uint8_t *data1 = (uint8_t *)(ring1 + 1);
+    
+    if (is_client) {
+        shm->tx = ring0;
+        shm->tx_data = data0;
+        shm->tx_data_efd = shm->efds[SHM_EFD_RING0_DATA];
+        shm->tx_space_efd = shm->efds[SHM_EFD_RING0_SPACE];
+        shm->rx = ring1;
+        shm->rx_data = data1;
+        shm->rx_data_efd = shm->efds[SHM_EFD_RING1_DATA];
+        shm->rx_space_efd = shm->efds[SHM_EFD_RING1_SPACE];
+    } else {
+        shm->tx = ring1;
+        shm->tx_data = data1;
+        shm->tx_data_efd = shm->efds[SHM_EFD_RING1_DATA];
+        shm->tx_space_efd = shm->efds[SHM_EFD_RING1_SPACE];
+        shm->rx = ring0;
+        shm->rx_data = data0;
+        shm->rx_data_efd = shm->efds[SHM_EFD_RING0_DATA];
+        shm->rx_space_efd = shm->efds[SHM_EFD_RING0_SPACE];
+    }
+    return 0;
+}
+
+/**
+ * Unmap the rings and close the eventfds. The socket is left to the caller.
+ * @param shm Transport, may be NULL
+ */
+void shm_transport_destroy(shm_transport *shm) {
+    if (!shm) {
+        return;
+    }
+    
+    if (shm->base != MAP_FAILED) {
+        munmap(shm->base, shm->map_size);
+    }
+    for (int i = 0; i < SHM_EFD_COUNT; i++) {
+        if (shm->efds[i] >= 0) {
+            close(shm->efds[i]);
+        }
+    }
+    free(shm);
+}
+
+/* Wait until fd is readable; 0 on success, -1 on timeout or error */
+static int shm_poll_readable(int fd, int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    
+    return ret == 1 && (pfd.revents & POLLIN) ? 0 : -1;
+}
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+
+/**
+ * Client side of the handshake: create the rings, pass them to the server
+ * over the connected Unix socket and wait for its acknowledgement.
+ * @param socket_fd Connected AF_UNIX socket
+ * @param ring_bytes Requested ring size per direction, rounded up to a power of two
+ * @return Transport, or NULL if the server did not accept the rings
+ */
+shm_transport *shm_transport_connect(int socket_fd, size_t ring_bytes) {
+    if (socket_fd < 0 || ring_bytes == 0 || ring_bytes > SHM_MAX_RING_BYTES) {
+        return NULL;
+    }
+    
+    size_t rounded = SHM_MIN_RING_BYTES;
+    while (rounded < ring_bytes) {
+        rounded <<= 1;
+    }
+    
+    shm_transport *shm = shm_transport_alloc(socket_fd);
+    if (!shm) {
+        return NULL;
+    }
+    
+    int memfd = memfd_create("grpc-shm-transport", MFD_CLOEXEC);
+    if (memfd < 0 || ftruncate(memfd, (off_t)shm_map_size(rounded)) != 0) {
+        goto fail;
+    }
+    for (int i = 0; i < SHM_EFD_COUNT; i++) {
+        shm->efds[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (shm->efds[i] < 0) {
+            goto fail;
+        }
+    }
+    /* A fresh memfd is zero-filled, so both rings start empty */
+    if (shm_transport_map(shm, memfd, rounded, true) != 0) {
+        goto fail;
+    }
+    
+    shm_hello hello;
+    memset(&hello, 0, sizeof(hello));
+    memcpy(hello.magic, SHM_HANDSHAKE_MAGIC, SHM_HANDSHAKE_MAGIC_LEN);
+    hello.ring_bytes = (uint32_t)rounded;
+    
+    int fds[1 + SHM_EFD_COUNT];
+    fds[0] = memfd;
+    memcpy(fds + 1, shm->efds, sizeof(shm->efds));
+    
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    
+    struct iovec iov;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    
+    if (sendmsg(socket_fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hello)) {
+        goto fail;
+    }
+    
+    uint8_t ack = 0;
+    if (shm_poll_readable(socket_fd, GRPC_SHM_HANDSHAKE_TIMEOUT_MS) != 0 ||
+        recv(socket_fd, &ack, 1, 0) != 1 || ack != 1) {
+        goto fail;
+    }
+    
+    close(memfd);
+    return shm;
+    
+fail:
+    if (memfd >= 0) {
+        close(memfd);
+    }
+    shm_transport_destroy(shm);
+    return NULL;
+}
+
+/**
+ * Server side of the handshake. A client that does not start with the
+ * shared-memory hello is left untouched and keeps using the socket.
+ * @param socket_fd Accepted AF_UNIX socket
+ * @param timeout_ms How long to wait for the client's first bytes
+ * @param out Set to the transport, or NULL if the client did not ask for one
+ * @return 0 on success (including no request), -1 on a failed handshake
+ */
+int shm_transport_accept(int socket_fd, int timeout_ms, shm_transport **out) {
+    if (socket_fd < 0 || !out) {
+        return -1;
+    }
+    *out = NULL;
+    
+    char magic[SHM_HANDSHAKE_MAGIC_LEN];
+    if (shm_poll_readable(socket_fd, timeout_ms) != 0 ||
+        recv(socket_fd, magic, sizeof(magic), MSG_PEEK) != (ssize_t)sizeof(magic) ||
+        memcmp(magic, SHM_HANDSHAKE_MAGIC, SHM_HANDSHAKE_MAGIC_LEN) != 0) {
+        return 0;
+    }
+    
+    shm_hello hello;
+    int fds[1 + SHM_EFD_COUNT];
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    
+    struct iovec iov;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    
+    if (recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(hello)) {
+        return -1;
+    }
+    
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    size_t nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cmsg), (nfds < 1 + SHM_EFD_COUNT ? nfds : 1 + SHM_EFD_COUNT) * sizeof(int));
+    
+    shm_transport *shm = NULL;
+    if (nfds != 1 + SHM_EFD_COUNT || (msg.msg_flags & MSG_CTRUNC)) {
+        for (size_t i = 0; i < nfds && i < 1 + SHM_EFD_COUNT; i++) {
+            close(fds[i]);
+        }
+        return -1;
+    }
+    
+    /* Only trust sizes we can check: the ring size must be sane and match the memfd */
+    size_t ring_bytes = hello.ring_bytes;
+    struct stat st;
+    bool valid = ring_bytes >= SHM_MIN_RING_BYTES && ring_bytes <= SHM_MAX_RING_BYTES &&
+                 (ring_bytes & (ring_bytes - 1)) == 0 &&
+                 fstat(fds[0], &st) == 0 && (size_t)st.st_size == shm_map_size(ring_bytes);
+    
+    if (valid) {
+        shm = shm_transport_alloc(socket_fd);
+    }
+    if (shm) {
+        memcpy(shm->efds, fds + 1, sizeof(shm->efds));
+        if (shm_transport_map(shm, fds[0], ring_bytes, false) != 0) {
+            shm_transport_destroy(shm);
+            shm = NULL;
+        }
+    } else {
+        for (int i = 1; i < 1 + SHM_EFD_COUNT; i++) {
+            close(fds[i]);
+        }
+    }
+    close(fds[0]);
+    
+    uint8_t ack = shm ? 1 : 0;
+    if (send(socket_fd, &ack, 1, MSG_NOSIGNAL) != 1 || !shm) {
+        shm_transport_destroy(shm);
+        return -1;
+    }
+    
+    *out = shm;
+    return 0;
+}
+
+#else
+
+shm_transport *shm_transport_connect(int socket_fd, size_t ring_bytes) {
+    (void)socket_fd;
+    (void)ring_bytes;
+    return NULL;
+}
+
+int shm_transport_accept(int socket_fd, int timeout_ms, shm_transport **out) {
+    (void)socket_fd;
+    (void)timeout_ms;
+    if (!out) {
+        return -1;
+    }
+    *out = NULL;
+    return 0;
+}
+
+#endif
+
+/* ========================================================================
+ * Ring I/O
+ * ======================================================================== */
+
+/* Wake the peer if it announced that it is asleep on efd */
+static void shm_transport_notify(int efd, uint32_t *waiting) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+        uint64_t one = 1;
+        ssize_t written = write(efd, &one, sizeof(one));
+        (void)written; /* EAGAIN means a wakeup is already pending */
+    }
+}
+
+/**
+ * Block until *counter moves away from seen. The waiting flag is raised
+ * before the final check so a peer that advances the counter afterwards
+ * is guaranteed to signal efd.
+ * @return 0 once the counter moved, -1 if the peer hung up
+ */
+static int shm_transport_wait(shm_transport *shm, int efd, uint32_t *waiting,
+                              const uint64_t *counter, uint64_t seen) {
+    for (int i = 0; i < SHM_SPIN_ITERATIONS; i++) {
+        if (__atomic_load_n(counter, __ATOMIC_ACQUIRE) != seen) {
+            return 0;
+        }
+    }
+    
+    int rc = 0;
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    
+    while (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == seen) {
+        struct pollfd fds[2];
+        fds[0].fd = efd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = shm->socket_fd;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        
+        int ret = poll(fds, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = -1;
+            break;
+        }
+        
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            ssize_t got = read(efd, &value, sizeof(value));
+            (void)got;
+        } else if (fds[1].revents) {
+            /* Nothing more is said on the socket after the handshake */
+            rc = __atomic_load_n(counter, __ATOMIC_SEQ_CST) != seen ? 0 : -1;
+            break;
+        }
+    }
+    
+    __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+    return rc;
+}
+
+/**
+ * Copy bytes into the outgoing ring, blocking while it is full
+ * @param shm Transport
+ * @param data Bytes to send
+ * @param len Number of bytes
+ * @return 0 on success, -1 if the peer went away
+ */
+int shm_transport_write(shm_transport *shm, const uint8_t *data, size_t len) {
+    shm_ring *ring = shm->tx;
+    uint64_t mask = shm->ring_bytes - 1;
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    
+    while (len > 0) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t used = tail - head;
+        if (used > shm->ring_bytes) {
+            return -1; /* Peer corrupted the ring */
+        }
+        
+        size_t space = shm->ring_bytes - (size_t)used;
+        if (space == 0) {
+            if (shm_transport_wait(shm, shm->tx_space_efd, &ring->writer_waiting, &ring->head, head) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        
+        size_t n = len < space ? len : space;
+        size_t offset = (size_t)(tail & mask);
+        size_t first = n < shm->ring_bytes - offset ? n : shm->ring_bytes - offset;
+        memcpy(shm->tx_data + offset, data, first);
+        memcpy(shm->tx_data, data + first, n - first);
+        
+        tail += n;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        shm_transport_notify(shm->tx_data_efd, &ring->reader_waiting);
+        
+        data += n;
+        len -= n;
+    }
+    
+    return 0;
+}
+
+/**
+ * Copy exactly len bytes out of the incoming ring, blocking while it is empty
+ * @param shm Transport
+ * @param data Output buffer
+ * @param len Number of bytes
+ * @return 0 on success, -1 if the peer went away
+ */
+int shm_transport_read(shm_transport *shm, uint8_t *data, size_t len) {
+    shm_ring *ring = shm->rx;
+    uint64_t mask = shm->ring_bytes - 1;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    
+    while (len > 0) {
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        uint64_t avail = tail - head;
+        if (avail > shm->ring_bytes) {
+            return -1; /* Peer corrupted the ring */
+        }
+        
+        if (avail == 0) {
+            if (shm_transport_wait(shm, shm->rx_data_efd, &ring->reader_waiting, &ring->tail, tail) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        
+        size_t n = len < avail ? len : (size_t)avail;
+        size_t offset = (size_t)(head & mask);
+        size_t first = n < shm->ring_bytes - offset ? n : shm->ring_bytes - offset;
+        memcpy(data, shm->rx_data + offset, first);
+        memcpy(data + first, shm->rx_data, n - first);
+        
+        head += n;
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+        shm_transport_notify(shm->rx_space_efd, &ring->writer_waiting);
+        
+        data += n;
+        len -= n;
+    }
+    
+    return 0;
+}
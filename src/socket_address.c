@@ -0,0 +1,164 @@
+/**
+ * @file socket_address.c
+ * @brief Target address parsing and local peer credentials
+ *
+ * Targets are either "host:port" (IPv4) or one of the local schemes:
+ *   unix:relative/path, unix:/absolute/path, unix:///absolute/path
+ *   unix-abstract:name  (Linux abstract namespace, no filesystem entry)
+ */
+
+#define _GNU_SOURCE
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+
+#define GRPC_UNIX_PREFIX "unix:"
+#define GRPC_UNIX_ABSTRACT_PREFIX "unix-abstract:"
+#define GRPC_DEFAULT_PORT 50051
+
+bool grpc_address_is_unix(const char *target) {
+    if (!target) {
+        return false;
+    }
+    return strncmp(target, GRPC_UNIX_PREFIX, strlen(GRPC_UNIX_PREFIX)) == 0 ||
+           strncmp(target, GRPC_UNIX_ABSTRACT_PREFIX, strlen(GRPC_UNIX_ABSTRACT_PREFIX)) == 0;
+}
+
+static int grpc_address_parse_unix(const char *target, struct sockaddr_storage *addr, socklen_t *addr_len) {
+    struct sockaddr_un *un = (struct sockaddr_un *)addr;
+    un->sun_family = AF_UNIX;
+    
+    if (strncmp(target, GRPC_UNIX_ABSTRACT_PREFIX, strlen(GRPC_UNIX_ABSTRACT_PREFIX)) == 0) {
+        /* Abstract names start with a NUL byte and are not NUL terminated */
+        const char *name = target + strlen(GRPC_UNIX_ABSTRACT_PREFIX);
+        size_t name_len = strlen(name);
+        if (name_len == 0 || name_len + 1 > sizeof(un->sun_path)) {
+            return -1;
+        }
+        un->sun_path[0] = '\0';
+        memcpy(un->sun_path + 1, name, name_len);
+        *addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + name_len);
+        return 0;
+    }
+    
+    const char *path = target + strlen(GRPC_UNIX_PREFIX);
+    if (strncmp(path, "//", 2) == 0) {
+        /* URI form unix:///abs/path; an authority is not supported */
+        path += 2;
+        if (path[0] != '/') {
+            return -1;
+        }
+    }
+    
+    size_t path_len = strlen(path);
+    if (path_len == 0 || path_len >= sizeof(un->sun_path)) {
+        return -1;
+    }
+    memcpy(un->sun_path, path, path_len + 1);
+    *addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len + 1);
+    return 0;
+}
+
+static int grpc_address_parse_inet(const char *target, struct sockaddr_storage *addr, socklen_t *addr_len) {
+    char host[256];
+    int port = GRPC_DEFAULT_PORT;
+    
+    const char *colon = strrchr(target, ':');
+    size_t host_len = colon ? (size_t)(colon - target) : strlen(target);
+    if (host_len >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, target, host_len);
+    host[host_len] = '\0';
+    if (colon) {
+        port = atoi(colon + 1);
+    }
+    if (port < 0 || port > 65535) {
+        return -1;
+    }
+    
+    struct sockaddr_in *in = (struct sockaddr_in *)addr;
+    in->sin_family = AF_INET;
+    in->sin_port = htons((uint16_t)port);
+    *addr_len = sizeof(struct sockaddr_in);
+    
+    if (host[0] == '\0' || strcmp(host, "0.0.0.0") == 0 || strcmp(host, "[::]") == 0) {
+        in->sin_addr.s_addr = INADDR_ANY;
+        return 0;
+    }
+    if (inet_pton(AF_INET, host, &in->sin_addr) == 1) {
+        return 0;
+    }
+    
+    /* Fall back to the system resolver for names such as "localhost" */
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+        return -1;
+    }
+    in->sin_addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    return 0;
+}
+
+/**
+ * Parse a target into a socket address
+ * @param target "host:port", "unix:path" or "unix-abstract:name"
+ * @param addr Output address
+ * @param addr_len Output address length to pass to bind/connect
+ * @return 0 on success, -1 on malformed or unresolvable target
+ */
+int grpc_address_parse(const char *target, struct sockaddr_storage *addr, socklen_t *addr_len) {
+    if (!target || !addr || !addr_len) {
+        return -1;
+    }
+    
+    memset(addr, 0, sizeof(*addr));
+    
+    if (grpc_address_is_unix(target)) {
+        return grpc_address_parse_unix(target, addr, addr_len);
+    }
+    return grpc_address_parse_inet(target, addr, addr_len);
+}
+
+/**
+ * Read the credentials of the process at the other end of a unix socket
+ * @param fd Connected AF_UNIX socket
+ * @param cred Output credentials
+ * @return 0 on success, -1 if unavailable
+ */
+int grpc_socket_get_peer_cred(int fd, grpc_peer_cred *cred) {
+    if (fd < 0 || !cred) {
+        return -1;
+    }
+    
+#ifdef SO_PEERCRED
+    struct ucred ucred;
+    socklen_t len = sizeof(ucred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) != 0 || len != sizeof(ucred)) {
+        return -1;
+    }
+    cred->pid = (int32_t)ucred.pid;
+    cred->uid = (uint32_t)ucred.uid;
+    cred->gid = (uint32_t)ucred.gid;
+    return 0;
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0) {
+        return -1;
+    }
+    cred->pid = -1;
+    cred->uid = (uint32_t)uid;
+    cred->gid = (uint32_t)gid;
+    return 0;
+#endif
+}
+
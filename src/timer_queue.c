@@ -0,0 +1,252 @@
+/**
+ * @file timer_queue.c
+ * @brief One thread running callbacks at their due time
+ *
+ * Timers sit in a binary min-heap ordered by due time. The thread sleeps
+ * until the earliest one is due, runs it without holding the queue lock,
+ * and goes back to sleep. Callbacks should be short: a slow one delays
+ * every timer behind it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "grpc/grpc.h"
+#include "grpc_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TIMER_QUEUE_INITIAL_CAPACITY 16
+
+typedef struct {
+    int64_t due_ms;
+    uint64_t id;
+    grpc_timer_fn fn;
+    void *arg;
+} timer_entry;
+
+struct grpc_timer_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    timer_entry *heap;
+    size_t count;
+    size_t capacity;
+    uint64_t next_id;
+    bool shutdown;
+};
+
+/* ========================================================================
+ * Heap (caller holds queue->mutex)
+ * ======================================================================== */
+
+static bool timer_before(const timer_entry *a, const timer_entry *b) {
+    return a->due_ms < b->due_ms || (a->due_ms == b->due_ms && a->id < b->id);
+}
+
+static void timer_swap(timer_entry *heap, size_t i, size_t j) {
+    timer_entry tmp = heap[i];
+    heap[i] = heap[j];
+    heap[j] = tmp;
+}
+
+static void timer_sift_up(grpc_timer_queue *queue, size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!timer_before(&queue->heap[i], &queue->heap[parent])) {
+            break;
+        }
+        timer_swap(queue->heap, i, parent);
+        i = parent;
+    }
+}
+
+static void timer_sift_down(grpc_timer_queue *queue, size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < queue->count && timer_before(&queue->heap[left], &queue->heap[smallest])) {
+            smallest = left;
+        }
+        if (right < queue->count && timer_before(&queue->heap[right], &queue->heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        timer_swap(queue->heap, i, smallest);
+        i = smallest;
+    }
+}
+
+static void timer_remove_at(grpc_timer_queue *queue, size_t i) {
+    queue->heap[i] = queue->heap[--queue->count];
+    if (i < queue->count) {
+        timer_sift_down(queue, i);
+        timer_sift_up(queue, i);
+    }
+}
+
+/* ========================================================================
+ * Timer Thread
+ * ======================================================================== */
+
+static void *timer_queue_thread(void *arg) {
+    grpc_timer_queue *queue = (grpc_timer_queue *)arg;
+    
+    pthread_mutex_lock(&queue->mutex);
+    while (!queue->shutdown) {
+        if (queue->count == 0) {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+            continue;
+        }
+        
+        int64_t due = queue->heap[0].due_ms;
+        int64_t now = grpc_monotonic_ms();
+        if (due > now) {
+            /* The condition variable waits on CLOCK_REALTIME */
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            int64_t wait_ms = due - now;
+            ts.tv_sec += wait_ms / 1000;
+            ts.tv_nsec += (long)(wait_ms % 1000) * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&queue->cond, &queue->mutex, &ts);
+            continue;
+        }
+        
+        timer_entry entry = queue->heap[0];
+        timer_remove_at(queue, 0);
+        pthread_mutex_unlock(&queue->mutex);
+        
+        entry.fn(entry.arg);
+        
+        pthread_mutex_lock(&queue->mutex);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return NULL;
+}
+
+/* ========================================================================
+ * Timer Queue API
+ * ======================================================================== */
+
+/**
+ * Create a timer queue and start its thread
+ * @return Queue, or NULL on error
+ */
+grpc_timer_queue *grpc_timer_queue_create(void) {
+    grpc_timer_queue *queue = (grpc_timer_queue *)calloc(1, sizeof(grpc_timer_queue));
+    if (!queue) {
+        return NULL;
+    }
+    
+    queue->capacity = TIMER_QUEUE_INITIAL_CAPACITY;
+    queue->heap = (timer_entry *)malloc(queue->capacity * sizeof(timer_entry));
+    queue->next_id = 1;
+    if (!queue->heap) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    
+    if (pthread_create(&queue->thread, NULL, timer_queue_thread, queue) != 0) {
+        pthread_cond_destroy(&queue->cond);
+        pthread_mutex_destroy(&queue->mutex);
+        free(queue->heap);
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+/**
+ * Run fn(arg) on the queue's thread once delay_ms have passed
+ * @param queue Timer queue
+ * @param delay_ms Delay (0 or less runs it as soon as the thread is free)
+ * @param fn Callback
+ * @param arg Passed to fn
+ * @param id Set to the timer's id for grpc_timer_queue_cancel (may be NULL)
+ * @return 0 on success, -1 on error
+ */
+int grpc_timer_queue_schedule(grpc_timer_queue *queue, int64_t delay_ms, grpc_timer_fn fn, void *arg,
+                              uint64_t *id) {
+    if (!queue || !fn) {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->shutdown) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+    if (queue->count == queue->capacity) {
+        timer_entry *heap = (timer_entry *)realloc(queue->heap, queue->capacity * 2 * sizeof(timer_entry));
+        if (!heap) {
+            pthread_mutex_unlock(&queue->mutex);
+            return -1;
+        }
+        queue->heap = heap;
+        queue->capacity *= 2;
+    }
+    
+    timer_entry *entry = &queue->heap[queue->count];
+    entry->due_ms = grpc_monotonic_ms() + (delay_ms > 0 ? delay_ms : 0);
+    entry->id = queue->next_id++;
+    entry->fn = fn;
+    entry->arg = arg;
+    if (id) {
+        *id = entry->id;
+    }
+    timer_sift_up(queue, queue->count++);
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+/**
+ * Cancel a timer; does not wait for a callback that is already running
+ * @param queue Timer queue
+ * @param id Id from grpc_timer_queue_schedule
+ * @return true if the callback will never run, false if it has started
+ */
+bool grpc_timer_queue_cancel(grpc_timer_queue *queue, uint64_t id) {
+    if (!queue || id == 0) {
+        return false;
+    }
+    
+    pthread_mutex_lock(&queue->mutex);
+    for (size_t i = 0; i < queue->count; i++) {
+        if (queue->heap[i].id == id) {
+            timer_remove_at(queue, i);
+            pthread_mutex_unlock(&queue->mutex);
+            return true;
+        }
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return false;
+}
+
+/**
+ * Stop the thread and free the queue; timers that have not run are dropped
+ */
+void grpc_timer_queue_destroy(grpc_timer_queue *queue) {
+    if (!queue) {
+        return;
+    }
+    
+    pthread_mutex_lock(&queue->mutex);
+    queue->shutdown = true;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    pthread_join(queue->thread, NULL);
+    
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue->heap);
+    free(queue);
+}
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 /* Test counter */
 static int tests_passed = 0;
@@ -146,6 +147,25 @@ void test_name_resolver_dns(void) {
     TEST_PASS();
 }
 
+void test_name_resolver_unix_passthrough(void) {
+    TEST_START("test_name_resolver_unix_passthrough");
+    
+    /* Local socket targets are passed through unresolved */
+    grpc_name_resolver *resolver = grpc_name_resolver_create(GRPC_RESOLVER_DNS, "unix:/run/app.sock");
+    assert(resolver != NULL);
+    assert(grpc_name_resolver_resolve(resolver) == 0);
+    assert(grpc_name_resolver_get_address_count(resolver) == 1);
+    grpc_name_resolver_destroy(resolver);
+    
+    resolver = grpc_name_resolver_create(GRPC_RESOLVER_STATIC, "unix-abstract:app");
+    assert(resolver != NULL);
+    assert(grpc_name_resolver_resolve(resolver) == 0);
+    assert(grpc_name_resolver_get_address_count(resolver) == 1);
+    grpc_name_resolver_destroy(resolver);
+    
+    TEST_PASS();
+}
+
 /* ========================================================================
  * Connection Pool Tests
  * ======================================================================== */
@@ -173,6 +193,91 @@ void test_connection_pool_keepalive_config(void) {
     TEST_PASS();
 }
 
+void test_connection_pool_rtt_unmeasured(void) {
+    TEST_START("test_connection_pool_rtt_unmeasured");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50061") == 50061);
+    grpc_server_start(server);
+    
+    grpc_connection_pool *pool = grpc_connection_pool_create(10, 30000);
+    assert(pool != NULL);
+    
+    /* Pooled connections are connected up front; unreachable targets fail */
+    http2_connection *conn = grpc_connection_pool_get(pool, "127.0.0.1:50061");
+    assert(conn != NULL);
+    assert(grpc_connection_pool_get(pool, "127.0.0.1:50062") == NULL);
+    
+    /* No PING has been answered yet */
+    int64_t srtt = 0, min_rtt = 0;
+    assert(grpc_connection_pool_get_rtt(pool, conn, &srtt, &min_rtt) == -1);
+    assert(grpc_connection_pool_return(pool, "127.0.0.1:50061", conn) == 0);
+    
+    grpc_connection_pool_destroy(pool);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    TEST_PASS();
+}
+
+static bool wait_for_pick(grpc_lb_policy *policy, const char *address) {
+    for (int i = 0; i < 300; i++) {
+        const char *picked = grpc_lb_policy_pick(policy);
+        if (picked && strcmp(picked, address) == 0) {
+            return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+void test_connection_pool_keepalive_rtt(void) {
+    TEST_START("test_connection_pool_keepalive_rtt");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50063") == 50063);
+    grpc_server_start(server);
+    
+    grpc_lb_policy *policy = grpc_lb_policy_create(GRPC_LB_POLICY_LOWEST_RTT);
+    assert(grpc_lb_policy_add_address(policy, "127.0.0.1:50064", 1) == 0);
+    assert(grpc_lb_policy_add_address(policy, "127.0.0.1:50063", 1) == 0);
+    assert(grpc_lb_policy_report_rtt(policy, "127.0.0.1:50064", 0) == 0);
+    
+    grpc_connection_pool *pool = grpc_connection_pool_create(10, 30000);
+    assert(grpc_connection_pool_set_keepalive(pool, 50, 1000, true) == 0);
+    assert(grpc_connection_pool_set_lb_policy(pool, policy) == 0);
+    http2_connection *conn = grpc_connection_pool_get(pool, "127.0.0.1:50063");
+    assert(conn != NULL);
+    
+    /* The connection's reader matches the ACK of a keepalive PING */
+    int64_t srtt = -1, min_rtt = -1;
+    for (int i = 0; i < 200 && grpc_connection_pool_get_rtt(pool, conn, &srtt, &min_rtt) != 0; i++) {
+        usleep(10000);
+    }
+    assert(srtt >= 0 && min_rtt >= 0 && min_rtt <= srtt);
+    
+    /* Once the pool reports it, the measured address no longer goes first */
+    assert(wait_for_pick(policy, "127.0.0.1:50064"));
+    
+    /* Unmeasured addresses are picked first so they get an RTT */
+    assert(grpc_lb_policy_add_address(policy, "127.0.0.1:50065", 1) == 0);
+    assert(strcmp(grpc_lb_policy_pick(policy), "127.0.0.1:50065") == 0);
+    assert(grpc_lb_policy_mark_unavailable(policy, "127.0.0.1:50065") == 0);
+    
+    /* Otherwise the lowest RTT wins */
+    assert(grpc_lb_policy_report_rtt(policy, "127.0.0.1:50064", srtt + 10000000) == 0);
+    assert(strcmp(grpc_lb_policy_pick(policy), "127.0.0.1:50063") == 0);
+    
+    /* A server that goes away takes its address out of the balancer */
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    assert(wait_for_pick(policy, "127.0.0.1:50064"));
+    
+    assert(grpc_connection_pool_return(pool, "127.0.0.1:50063", conn) == 0);
+    grpc_connection_pool_destroy(pool);
+    grpc_lb_policy_destroy(policy);
+    grpc_server_destroy(server);
+    TEST_PASS();
+}
+
 /* ========================================================================
  * Interceptor Tests
  * ======================================================================== */
@@ -323,10 +428,13 @@ int main(void) {
     /* Name Resolution Tests */
     test_name_resolver_static();
     test_name_resolver_dns();
+    test_name_resolver_unix_passthrough();
     
     /* Connection Pool Tests */
     test_connection_pool_create_destroy();
     test_connection_pool_keepalive_config();
+    test_connection_pool_rtt_unmeasured();
+    test_connection_pool_keepalive_rtt();
     
     /* Interceptor Tests */
     test_client_interceptor_chain();
@@ -168,6 +168,42 @@ void test_byte_buffer(void) {
     TEST_PASS();
 }
 
+void test_byte_buffer_ref(void) {
+    TEST(test_byte_buffer_ref);
+    
+    grpc_init();
+    
+    const uint8_t test_data[] = "shared";
+    grpc_byte_buffer *buffer = grpc_byte_buffer_create(test_data, sizeof(test_data));
+    
+    if (!buffer || buffer->refcount != 1) {
+        TEST_FAIL("New byte buffer should hold one reference");
+        grpc_byte_buffer_destroy(buffer);
+        grpc_shutdown();
+        return;
+    }
+    
+    if (grpc_byte_buffer_ref(buffer) != buffer || buffer->refcount != 2) {
+        TEST_FAIL("Reference count not incremented");
+        grpc_byte_buffer_destroy(buffer);
+        grpc_shutdown();
+        return;
+    }
+    
+    /* First destroy only drops a reference; data must stay readable */
+    grpc_byte_buffer_destroy(buffer);
+    if (buffer->refcount != 1 || memcmp(buffer->data, test_data, sizeof(test_data)) != 0) {
+        TEST_FAIL("Buffer released while still referenced");
+        grpc_shutdown();
+        return;
+    }
+    
+    grpc_byte_buffer_destroy(buffer);
+    grpc_shutdown();
+    
+    TEST_PASS();
+}
+
 void test_timespec(void) {
     TEST(test_timespec);
     
@@ -243,6 +279,7 @@ int main(void) {
     test_server_create_destroy();
     test_server_add_port();
     test_byte_buffer();
+    test_byte_buffer_ref();
     test_timespec();
     test_call_lifecycle();
     
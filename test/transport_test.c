@@ -0,0 +1,3615 @@
+/**
+ * @file transport_test.c
+ * @brief Tests for the HTTP/2 transport internals
+ */
+
+#define _GNU_SOURCE
+#include "grpc/grpc.h"
+#include "grpc/grpc_advanced.h"
+#include "grpc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+/* Test counter */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+/* Helper macros */
+#define TEST_START(name) \
+    printf("Running test: %s... ", name); \
+    fflush(stdout);
+
+#define TEST_PASS() \
+    printf("PASS\n"); \
+    tests_passed++;
+
+#define TEST_FAIL(msg) \
+    printf("FAIL: %s\n", msg); \
+    tests_failed++;
+
+/* ========================================================================
+ * Helpers
+ * ======================================================================== */
+
+/* Connect two sockets over TCP loopback */
+static int tcp_loopback_pair(int fds[2]) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        return -1;
+    }
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 1) < 0 ||
+        getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        close(listen_fd);
+        return -1;
+    }
+    
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (fds[0] < 0 || connect(fds[0], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(listen_fd);
+        return -1;
+    }
+    
+    fds[1] = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    return fds[1] < 0 ? -1 : 0;
+}
+
+/* ========================================================================
+ * Zero-Copy Send Tests
+ * ======================================================================== */
+
+/* Read one frame on a connection that has pinned buffers */
+static void *zerocopy_reader_thread(void *arg) {
+    http2_connection *conn = (http2_connection *)arg;
+    http2_frame_header header;
+    uint8_t *payload = NULL;
+    assert(http2_connection_recv_frame(conn, &header, &payload) == 0);
+    assert(header.type == HTTP2_FRAME_PING);
+    free(payload);
+    return NULL;
+}
+
+void test_zerocopy_send_large_frame(void) {
+    TEST_START("test_zerocopy_send_large_frame");
+    
+    int fds[2];
+    assert(tcp_loopback_pair(fds) == 0);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:0", true, NULL);
+    http2_connection *server = http2_connection_create("127.0.0.1:0", false, NULL);
+    assert(client != NULL && server != NULL);
+    client->socket_fd = fds[0];
+    server->socket_fd = fds[1];
+    http2_connection_set_zerocopy_threshold(client, 4096);
+    
+    size_t len = 64 * 1024;
+    uint8_t *data = (uint8_t *)malloc(len);
+    assert(data != NULL);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (uint8_t)(i * 31);
+    }
+    grpc_byte_buffer *buffer = grpc_byte_buffer_create(data, len);
+    assert(buffer != NULL);
+    
+    http2_frame_header header;
+    header.length = (uint32_t)len;
+    header.type = HTTP2_FRAME_DATA;
+    header.flags = 0;
+    header.stream_id = 1;
+    assert(http2_connection_send_data(client, &header, NULL, 0, buffer, 0) == 0);
+    
+    http2_frame_header recv_header;
+    uint8_t *payload = NULL;
+    assert(http2_connection_recv_frame(server, &recv_header, &payload) == 0);
+    assert(recv_header.length == len);
+    assert(recv_header.type == HTTP2_FRAME_DATA);
+    assert(memcmp(payload, data, len) == 0);
+    free(payload);
+    
+    /* A reader waiting on a quiet peer drops the reference once the kernel is done */
+    pthread_t reader;
+    assert(pthread_create(&reader, NULL, zerocopy_reader_thread, client) == 0);
+    for (int i = 0; i < 100 && __atomic_load_n(&buffer->refcount, __ATOMIC_ACQUIRE) > 1; i++) {
+        usleep(10000);
+    }
+    assert(__atomic_load_n(&buffer->refcount, __ATOMIC_ACQUIRE) == 1);
+    uint8_t ping[8] = {0};
+    http2_frame_header ping_header = {sizeof(ping), HTTP2_FRAME_PING, 0, 0};
+    assert(http2_connection_send_frame(server, &ping_header, ping) == 0);
+    pthread_join(reader, NULL);
+    
+    grpc_byte_buffer_destroy(buffer);
+    free(data);
+    http2_connection_destroy(client);
+    http2_connection_destroy(server);
+    TEST_PASS();
+}
+
+void test_zerocopy_below_threshold_copies(void) {
+    TEST_START("test_zerocopy_below_threshold_copies");
+    
+    int fds[2];
+    assert(tcp_loopback_pair(fds) == 0);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:0", true, NULL);
+    http2_connection *server = http2_connection_create("127.0.0.1:0", false, NULL);
+    assert(client != NULL && server != NULL);
+    client->socket_fd = fds[0];
+    server->socket_fd = fds[1];
+    http2_connection_set_zerocopy_threshold(client, 1 << 20);
+    
+    const uint8_t data[] = "small payload";
+    grpc_byte_buffer *buffer = grpc_byte_buffer_create(data, sizeof(data));
+    assert(buffer != NULL);
+    
+    http2_frame_header header;
+    header.length = 2 + sizeof(data) - 6;
+    header.type = HTTP2_FRAME_DATA;
+    header.flags = 0;
+    header.stream_id = 1;
+    assert(http2_connection_send_data(client, &header, (const uint8_t *)"ab", 2, buffer, 6) == 0);
+    
+    /* Copy path never pins the buffer */
+    assert(buffer->refcount == 1);
+    
+    /* The prefix goes out ahead of the payload, in the same frame */
+    http2_frame_header recv_header;
+    uint8_t *payload = NULL;
+    assert(http2_connection_recv_frame(server, &recv_header, &payload) == 0);
+    assert(recv_header.length == 2 + sizeof(data) - 6);
+    assert(memcmp(payload, "ab", 2) == 0 && memcmp(payload + 2, data + 6, sizeof(data) - 6) == 0);
+    free(payload);
+    
+    /* Out-of-range payloads are rejected */
+    header.length = sizeof(data);
+    assert(http2_connection_send_data(client, &header, NULL, 0, buffer, 1) == -1);
+    
+    grpc_byte_buffer_destroy(buffer);
+    http2_connection_destroy(client);
+    http2_connection_destroy(server);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * GOAWAY Tests
+ * ======================================================================== */
+
+void test_goaway_refuses_unprocessed_streams(void) {
+    TEST_START("test_goaway_refuses_unprocessed_streams");
+    
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:0", true, NULL);
+    http2_connection *server = http2_connection_create("127.0.0.1:0", false, NULL);
+    assert(client != NULL && server != NULL);
+    client->socket_fd = fds[0];
+    server->socket_fd = fds[1];
+    
+    http2_stream *s1 = http2_stream_create(client, 1);
+    http2_stream *s3 = http2_stream_create(client, 3);
+    http2_stream *s5 = http2_stream_create(client, 5);
+    assert(s1 && s3 && s5);
+    
+    /* Server saw streams 1 and 3 only */
+    assert(http2_stream_create(server, 1) != NULL);
+    assert(http2_stream_create(server, 3) != NULL);
+    assert(server->last_peer_stream_id == 3);
+    
+    assert(http2_connection_send_goaway(server, server->last_peer_stream_id, HTTP2_NO_ERROR) == 0);
+    assert(http2_connection_is_draining(server));
+    
+    http2_frame_header header;
+    uint8_t *payload = NULL;
+    assert(http2_connection_recv_frame(client, &header, &payload) == 0);
+    assert(header.type == HTTP2_FRAME_GOAWAY);
+    assert(http2_connection_process_frame(client, &header, payload) == 0);
+    free(payload);
+    
+    assert(http2_connection_is_draining(client));
+    assert(client->goaway_last_stream_id == 3);
+    assert(!s1->refused && !s3->refused);
+    assert(s5->refused && s5->status == GRPC_STATUS_UNAVAILABLE);
+    
+    http2_connection_destroy(client);
+    http2_connection_destroy(server);
+    TEST_PASS();
+}
+
+void test_channel_migrates_after_goaway(void) {
+    TEST_START("test_channel_migrates_after_goaway");
+    
+    grpc_channel *channel = grpc_insecure_channel_create("localhost:50051", NULL);
+    grpc_completion_queue *cq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    assert(channel != NULL && cq != NULL);
+    
+    grpc_timespec deadline = grpc_timeout_milliseconds_to_deadline(5000);
+    grpc_call *old_call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(old_call != NULL);
+    http2_connection *old_conn = channel->subchannels[0].connections[0].conn;
+    
+    /* Simulate a GOAWAY from the server */
+    old_conn->goaway_received = true;
+    old_conn->goaway_last_stream_id = 1;
+    
+    grpc_call *new_call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/B", NULL, deadline);
+    assert(new_call != NULL);
+    assert(channel->subchannels[0].connections[0].conn != old_conn);
+    assert(new_call->stream->conn == channel->subchannels[0].connections[0].conn);
+    assert(old_call->stream->conn == old_conn);
+    assert(channel->draining_count == 1);
+    
+    /* The draining connection is released once its last call is gone */
+    grpc_call_destroy(old_call);
+    grpc_call *third_call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/C", NULL, deadline);
+    assert(third_call != NULL);
+    assert(channel->draining_count == 0);
+    
+    grpc_call_destroy(new_call);
+    grpc_call_destroy(third_call);
+    grpc_completion_queue_shutdown(cq);
+    grpc_completion_queue_destroy(cq);
+    grpc_channel_destroy(channel);
+    TEST_PASS();
+}
+
+static int connect_loopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static size_t server_connection_count(grpc_server *server) {
+    pthread_mutex_lock(&server->mutex);
+    size_t count = server->connection_count;
+    pthread_mutex_unlock(&server->mutex);
+    return count;
+}
+
+/* Wait until a worker has accepted the expected number of connections */
+static bool wait_for_connections(grpc_server *server, size_t count) {
+    for (int i = 0; i < 100 && server_connection_count(server) != count; i++) {
+        usleep(10000);
+    }
+    return server_connection_count(server) == count;
+}
+
+/* Read a drain from a raw socket that never acknowledges the drain PING:
+ * GOAWAY announcing every stream, the PING, the final GOAWAY, then close */
+static bool expect_goaway_then_close(int fd) {
+    uint8_t frame[9 + 8];
+    int goaways = 0;
+    uint32_t last_stream_id = 0;
+    while (recv(fd, frame, sizeof(frame), MSG_WAITALL) == (ssize_t)sizeof(frame)) {
+        if (frame[3] == HTTP2_FRAME_GOAWAY) {
+            last_stream_id = ((uint32_t)frame[9] << 24) | ((uint32_t)frame[10] << 16) |
+                             ((uint32_t)frame[11] << 8) | frame[12];
+            if (goaways++ == 0 && last_stream_id != 0x7FFFFFFF) {
+                return false;
+            }
+        } else if (frame[3] != HTTP2_FRAME_PING) {
+            return false;
+        }
+    }
+    return goaways == 2 && last_stream_id == 0;
+}
+
+void test_server_max_connection_age(void) {
+    TEST_START("test_server_max_connection_age");
+    
+    grpc_arg arg_values[1];
+    arg_values[0].key = GRPC_ARG_MAX_CONNECTION_AGE_MS;
+    arg_values[0].value.integer = 200;
+    arg_values[0].is_string = false;
+    grpc_channel_args args = {1, arg_values};
+    
+    grpc_server *server = grpc_server_create(&args);
+    assert(server != NULL);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50071") == 50071);
+    grpc_server_start(server);
+    
+    int fd = connect_loopback(50071);
+    assert(fd >= 0);
+    
+    /* No streams are open, so the connection closes right after GOAWAY */
+    assert(expect_goaway_then_close(fd));
+    close(fd);
+    
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    TEST_PASS();
+}
+
+void test_server_shutdown_sends_goaway(void) {
+    TEST_START("test_server_shutdown_sends_goaway");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(server != NULL);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50072") == 50072);
+    grpc_server_start(server);
+    
+    int fd = connect_loopback(50072);
+    assert(fd >= 0);
+    
+    assert(wait_for_connections(server, 1));
+    
+    grpc_completion_queue *cq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    int tag = 0;
+    grpc_server_shutdown_and_notify(server, cq, &tag);
+    assert(expect_goaway_then_close(fd));
+    close(fd);
+    
+    grpc_event ev = grpc_completion_queue_next(cq, grpc_timeout_milliseconds_to_deadline(1000));
+    assert(ev.success && ev.tag == &tag);
+    
+    grpc_completion_queue_shutdown(cq);
+    grpc_completion_queue_destroy(cq);
+    grpc_server_destroy(server);
+    TEST_PASS();
+}
+
+static bool wait_for_connection_state(http2_connection *conn, bool closed) {
+    for (int i = 0; i < 200; i++) {
+        bool done = closed ? __atomic_load_n(&conn->closed, __ATOMIC_ACQUIRE) : http2_connection_is_draining(conn);
+        if (done) {
+            return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+void test_channel_follows_server_drain(void) {
+    TEST_START("test_channel_follows_server_drain");
+    
+    grpc_arg arg_values[1];
+    arg_values[0].key = GRPC_ARG_MAX_CONNECTION_AGE_MS;
+    arg_values[0].value.integer = 200;
+    arg_values[0].is_string = false;
+    grpc_channel_args args = {1, arg_values};
+    
+    grpc_server *server = grpc_server_create(&args);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50081") == 50081);
+    grpc_server_start(server);
+    grpc_completion_queue *cq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    /* Connected by the warm-up, after which the reader thread owns it */
+    grpc_channel *channel = grpc_insecure_channel_create("127.0.0.1:50081", NULL);
+    http2_connection *old_conn = channel->subchannels[0].connections[0].conn;
+    assert(grpc_channel_prewarm(channel, 0, cq, (void *)1) == 0);
+    grpc_event ev = grpc_completion_queue_next(cq, grpc_timeout_milliseconds_to_deadline(1000));
+    assert(ev.success && ev.tag == (void *)1);
+    
+    /* The first GOAWAY of the age drain moves new calls to a fresh connection */
+    assert(wait_for_connection_state(old_conn, false));
+    grpc_timespec deadline = grpc_timeout_milliseconds_to_deadline(5000);
+    grpc_call *call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(call != NULL);
+    assert(channel->subchannels[0].connections[0].conn != old_conn);
+    assert(channel->draining_count == 1 && channel->draining[0] == old_conn);
+    
+    /* The reader acknowledged the drain PING, so the final GOAWAY names no
+     * stream and the server closes the idle connection */
+    assert(wait_for_connection_state(old_conn, true));
+    pthread_mutex_lock(&old_conn->streams_mutex);
+    assert(old_conn->goaway_received && old_conn->goaway_last_stream_id == 0);
+    pthread_mutex_unlock(&old_conn->streams_mutex);
+    
+    grpc_call_destroy(call);
+    grpc_channel_destroy(channel);
+    grpc_completion_queue_shutdown(cq);
+    grpc_completion_queue_destroy(cq);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * PING Keepalive Tests
+ * ======================================================================== */
+
+/* Read one frame on conn and run it through the frame processor */
+static int recv_and_process(http2_connection *conn, uint8_t type) {
+    http2_frame_header header;
+    uint8_t *payload = NULL;
+    if (http2_connection_recv_frame(conn, &header, &payload) != 0) {
+        return -1;
+    }
+    int result = header.type == type ? http2_connection_process_frame(conn, &header, payload) : -1;
+    free(payload);
+    return result;
+}
+
+void test_ping_ack_records_rtt(void) {
+    TEST_START("test_ping_ack_records_rtt");
+    
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:0", true, NULL);
+    http2_connection *server = http2_connection_create("127.0.0.1:0", false, NULL);
+    assert(client != NULL && server != NULL);
+    client->socket_fd = fds[0];
+    server->socket_fd = fds[1];
+    
+    int64_t srtt = 0, min_rtt = 0;
+    assert(http2_connection_get_rtt(client, &srtt, &min_rtt) == -1);
+    
+    /* Server answers the PING with an ACK, client matches it */
+    assert(http2_connection_send_ping(client) == 0);
+    assert(client->ping_outstanding);
+    assert(recv_and_process(server, HTTP2_FRAME_PING) == 0);
+    assert(recv_and_process(client, HTTP2_FRAME_PING) == 0);
+    assert(!client->ping_outstanding);
+    assert(http2_connection_get_rtt(client, &srtt, &min_rtt) == 0);
+    assert(srtt >= 0 && min_rtt >= 0 && min_rtt <= srtt);
+    
+    /* An ACK with a foreign payload leaves the PING outstanding */
+    assert(http2_connection_send_ping(client) == 0);
+    uint8_t bogus[8] = {0xde, 0xad, 0xbe, 0xef, 0, 0, 0, 0};
+    http2_frame_header ack = {8, HTTP2_FRAME_PING, 0x01, 0};
+    assert(http2_connection_send_frame(server, &ack, bogus) == 0);
+    assert(recv_and_process(client, HTTP2_FRAME_PING) == 0);
+    assert(client->ping_outstanding);
+    assert(client->rtt_samples == 1);
+    
+    http2_connection_destroy(client);
+    http2_connection_destroy(server);
+    TEST_PASS();
+}
+
+void test_ping_timeout_expires(void) {
+    TEST_START("test_ping_timeout_expires");
+    
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:0", true, NULL);
+    assert(client != NULL);
+    client->socket_fd = fds[0];
+    
+    assert(!http2_connection_ping_expired(client, 10));
+    assert(http2_connection_send_ping(client) == 0);
+    assert(!http2_connection_ping_expired(client, 10000));
+    
+    /* Peer never answers */
+    usleep(20000);
+    assert(http2_connection_ping_expired(client, 10));
+    
+    http2_connection_destroy(client);
+    close(fds[1]);
+    TEST_PASS();
+}
+
+void test_bdp_sample_grows_recv_window(void) {
+    TEST_START("test_bdp_sample_grows_recv_window");
+    
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:0", true, NULL);
+    http2_connection *server = http2_connection_create("127.0.0.1:0", false, NULL);
+    assert(client != NULL && server != NULL);
+    client->socket_fd = fds[0];
+    server->socket_fd = fds[1];
+    int32_t initial_target = client->local_window_target;
+    
+    /* Receive three full frames within one PING round trip */
+    http2_stream *stream = http2_stream_create(client, 1);
+    assert(stream != NULL);
+    assert(http2_connection_send_ping(client) == 0);
+    for (int i = 0; i < 3; i++) {
+        assert(http2_flow_control_consume_recv_window(client, stream, 16384) == 0);
+    }
+    
+    assert(recv_and_process(server, HTTP2_FRAME_PING) == 0);
+    assert(recv_and_process(client, HTTP2_FRAME_PING) == 0);
+    assert(client->local_window_target == 3 * 16384 * 2);
+    assert(client->local_window_target > initial_target);
+    
+    http2_connection_destroy(client);
+    http2_connection_destroy(server);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Unix Domain Socket Tests
+ * ======================================================================== */
+
+void test_address_parse_schemes(void) {
+    TEST_START("test_address_parse_schemes");
+    
+    struct sockaddr_storage addr;
+    socklen_t len;
+    struct sockaddr_un *un = (struct sockaddr_un *)&addr;
+    
+    assert(grpc_address_parse("unix:/tmp/app.sock", &addr, &len) == 0);
+    assert(addr.ss_family == AF_UNIX && strcmp(un->sun_path, "/tmp/app.sock") == 0);
+    
+    assert(grpc_address_parse("unix:///tmp/app.sock", &addr, &len) == 0);
+    assert(strcmp(un->sun_path, "/tmp/app.sock") == 0);
+    
+    assert(grpc_address_parse("unix-abstract:app", &addr, &len) == 0);
+    assert(un->sun_path[0] == '\0' && memcmp(un->sun_path + 1, "app", 3) == 0);
+    assert(len == offsetof(struct sockaddr_un, sun_path) + 4);
+    
+    assert(grpc_address_parse("127.0.0.1:8080", &addr, &len) == 0);
+    assert(addr.ss_family == AF_INET);
+    assert(ntohs(((struct sockaddr_in *)&addr)->sin_port) == 8080);
+    
+    char long_target[200] = "unix:/";
+    memset(long_target + 6, 'a', sizeof(long_target) - 7);
+    long_target[sizeof(long_target) - 1] = '\0';
+    assert(grpc_address_parse("unix:", &addr, &len) == -1);
+    assert(grpc_address_parse("unix-abstract:", &addr, &len) == -1);
+    assert(grpc_address_parse(long_target, &addr, &len) == -1);
+    
+    TEST_PASS();
+}
+
+void test_unix_socket_peer_cred(void) {
+    TEST_START("test_unix_socket_peer_cred");
+    
+    char target[64];
+    snprintf(target, sizeof(target), "unix:/tmp/grpc_c_test_%d.sock", (int)getpid());
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(server != NULL);
+    assert(grpc_server_add_insecure_http2_port(server, target) == 1);
+    grpc_server_start(server);
+    
+    http2_connection *client = http2_connection_create(target, true, NULL);
+    assert(client != NULL);
+    assert(http2_connection_connect(client, target) == 0);
+    assert(client->has_peer_cred);
+    assert(client->peer_cred.pid == (int32_t)getpid());
+    assert(client->peer_cred.uid == (uint32_t)getuid());
+    
+    assert(wait_for_connections(server, 1));
+    pthread_mutex_lock(&server->mutex);
+    assert(server->connections->conn->has_peer_cred);
+    assert(server->connections->conn->peer_cred.pid == (int32_t)getpid());
+    pthread_mutex_unlock(&server->mutex);
+    
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    http2_connection_destroy(client);
+    
+    /* The socket file is removed with the server */
+    assert(access(target + strlen("unix:"), F_OK) != 0);
+    TEST_PASS();
+}
+
+/* Called on a server worker thread (atomic) */
+static int peer_filter_calls = 0;
+
+static bool reject_all_peers(const grpc_peer_cred *cred, void *user_data) {
+    (void)cred;
+    (void)user_data;
+    __atomic_add_fetch(&peer_filter_calls, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+void test_unix_abstract_peer_cred_filter(void) {
+    TEST_START("test_unix_abstract_peer_cred_filter");
+    
+    char target[64];
+    snprintf(target, sizeof(target), "unix-abstract:grpc_c_test_%d", (int)getpid());
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(server != NULL);
+    assert(grpc_server_add_insecure_http2_port(server, target) == 1);
+    grpc_server_set_peer_cred_filter(server, reject_all_peers, NULL);
+    grpc_server_start(server);
+    
+    http2_connection *client = http2_connection_create(target, true, NULL);
+    assert(client != NULL);
+    assert(http2_connection_connect(client, target) == 0);
+    
+    /* Rejected right after accept: the client sees EOF */
+    uint8_t byte;
+    assert(recv(client->socket_fd, &byte, 1, 0) == 0);
+    assert(__atomic_load_n(&peer_filter_calls, __ATOMIC_RELAXED) == 1);
+    assert(server_connection_count(server) == 0);
+    
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    http2_connection_destroy(client);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Shared-Memory Transport Tests
+ * ======================================================================== */
+
+typedef struct {
+    int fd;
+    shm_transport *shm;
+    int rc;
+} shm_accept_args;
+
+static void *shm_accept_thread(void *arg) {
+    shm_accept_args *args = (shm_accept_args *)arg;
+    args->rc = shm_transport_accept(args->fd, 1000, &args->shm);
+    return NULL;
+}
+
+typedef struct {
+    http2_connection *conn;
+    const uint8_t *payload;
+    uint32_t length;
+    int rc;
+} shm_send_args;
+
+static void *shm_send_thread(void *arg) {
+    shm_send_args *args = (shm_send_args *)arg;
+    http2_frame_header header = {args->length, HTTP2_FRAME_DATA, 0, 1};
+    args->rc = http2_connection_send_frame(args->conn, &header, args->payload);
+    return NULL;
+}
+
+void test_shm_ring_frames(void) {
+    TEST_START("test_shm_ring_frames");
+    
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    
+    shm_accept_args accept_args = {fds[1], NULL, -1};
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, shm_accept_thread, &accept_args) == 0);
+    shm_transport *client_shm = shm_transport_connect(fds[0], 4096);
+    pthread_join(thread, NULL);
+    assert(client_shm != NULL);
+    assert(accept_args.rc == 0 && accept_args.shm != NULL);
+    
+    http2_connection *client = http2_connection_create(NULL, true, NULL);
+    http2_connection *server = http2_connection_create(NULL, false, NULL);
+    client->socket_fd = fds[0];
+    client->shm = client_shm;
+    server->socket_fd = fds[1];
+    server->shm = accept_args.shm;
+    
+    /* Much larger than the ring: the writer blocks until the reader drains it */
+    uint32_t length = 100000;
+    uint8_t *data = (uint8_t *)malloc(length);
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = (uint8_t)(i * 7);
+    }
+    
+    shm_send_args send_args = {client, data, length, -1};
+    assert(pthread_create(&thread, NULL, shm_send_thread, &send_args) == 0);
+    
+    http2_frame_header header;
+    uint8_t *payload = NULL;
+    assert(http2_connection_recv_frame(server, &header, &payload) == 0);
+    pthread_join(thread, NULL);
+    assert(send_args.rc == 0);
+    assert(header.type == HTTP2_FRAME_DATA && header.stream_id == 1 && header.length == length);
+    assert(memcmp(payload, data, length) == 0);
+    free(payload);
+    
+    /* Nothing went over the socket itself */
+    uint8_t byte;
+    assert(recv(fds[1], &byte, 1, MSG_DONTWAIT) == -1);
+    
+    /* The other direction, through the PING handler */
+    assert(http2_connection_send_ping(server) == 0);
+    assert(recv_and_process(client, HTTP2_FRAME_PING) == 0);
+    assert(recv_and_process(server, HTTP2_FRAME_PING) == 0);
+    
+    /* A reader waiting on an empty ring sees the peer go away */
+    http2_connection_destroy(server);
+    assert(http2_connection_recv_frame(client, &header, &payload) == -1);
+    
+    http2_connection_destroy(client);
+    free(data);
+    TEST_PASS();
+}
+
+void test_shm_unix_server(void) {
+    TEST_START("test_shm_unix_server");
+    
+    char target[64];
+    snprintf(target, sizeof(target), "unix-abstract:grpc_c_shm_%d", (int)getpid());
+    
+    grpc_arg arg_values[1];
+    arg_values[0].key = GRPC_ARG_SHM_TRANSPORT_RING_BYTES;
+    arg_values[0].value.integer = 65536;
+    arg_values[0].is_string = false;
+    grpc_channel_args args = {1, arg_values};
+    
+    grpc_server *server = grpc_server_create(&args);
+    assert(server != NULL);
+    assert(grpc_server_add_insecure_http2_port(server, target) == 1);
+    grpc_server_start(server);
+    
+    http2_connection *client = http2_connection_create(target, true, NULL);
+    client->shm_ring_bytes = 65536;
+    assert(http2_connection_connect(client, target) == 0);
+    assert(client->shm != NULL);
+    
+    assert(wait_for_connections(server, 1));
+    pthread_mutex_lock(&server->mutex);
+    assert(server->connections->conn->shm != NULL);
+    pthread_mutex_unlock(&server->mutex);
+    
+    /* The shutdown GOAWAY arrives through the ring */
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    http2_frame_header header;
+    uint8_t *payload = NULL;
+    assert(http2_connection_recv_frame(client, &header, &payload) == 0);
+    assert(header.type == HTTP2_FRAME_GOAWAY);
+    free(payload);
+    
+    grpc_server_destroy(server);
+    http2_connection_destroy(client);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Header Block Tests
+ * ======================================================================== */
+
+void test_headers_split_into_continuation(void) {
+    TEST_START("test_headers_split_into_continuation");
+    
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    
+    http2_connection *client = http2_connection_create(NULL, true, NULL);
+    http2_connection *server = http2_connection_create(NULL, false, NULL);
+    client->socket_fd = fds[0];
+    server->socket_fd = fds[1];
+    server->max_header_list_size = 65536;
+    http2_stream *stream = http2_stream_create(server, 1);
+    assert(stream != NULL);
+    
+    /* An auth token larger than two default frames */
+    size_t token_len = 40000;
+    char *token = (char *)malloc(token_len + 1);
+    memset(token, 't', token_len);
+    token[token_len] = '\0';
+    
+    grpc_metadata_array metadata;
+    grpc_metadata_array_init(&metadata, 2);
+    grpc_metadata_array_add(&metadata, ":path", "/svc/Method", strlen("/svc/Method"));
+    grpc_metadata_array_add(&metadata, "authorization", token, token_len);
+    assert(http2_connection_send_headers(client, 1, &metadata, false) == 0);
+    
+    int frames = 0;
+    bool end_headers = false;
+    while (!end_headers) {
+        http2_frame_header header;
+        uint8_t *payload = NULL;
+        assert(http2_connection_recv_frame(server, &header, &payload) == 0);
+        assert(header.length <= 16384);
+        assert(header.type == (frames == 0 ? HTTP2_FRAME_HEADERS : HTTP2_FRAME_CONTINUATION));
+        assert(http2_connection_process_frame(server, &header, payload) == 0);
+        free(payload);
+        end_headers = (header.flags & 0x04) != 0; /* END_HEADERS */
+        frames++;
+    }
+    assert(frames == 3);
+    
+    assert(stream->headers_received);
+    assert(stream->initial_metadata.count == 2);
+    assert(strcmp(stream->initial_metadata.metadata[0].key, ":path") == 0);
+    assert(strcmp(stream->initial_metadata.metadata[1].value, token) == 0);
+    assert(!stream->end_stream_received);
+    
+    /* The next block on the stream is the trailers */
+    grpc_metadata_array trailers;
+    grpc_metadata_array_init(&trailers, 1);
+    grpc_metadata_array_add(&trailers, "grpc-status", "0", 1);
+    assert(http2_connection_send_headers(client, 1, &trailers, true) == 0);
+    assert(recv_and_process(server, HTTP2_FRAME_HEADERS) == 0);
+    assert(stream->trailing_metadata.count == 1);
+    assert(stream->end_stream_received);
+    
+    grpc_metadata_array_destroy(&metadata);
+    grpc_metadata_array_destroy(&trailers);
+    free(token);
+    http2_connection_destroy(client);
+    http2_connection_destroy(server);
+    TEST_PASS();
+}
+
+void test_headers_over_limit_resets_stream(void) {
+    TEST_START("test_headers_over_limit_resets_stream");
+    
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    
+    http2_connection *client = http2_connection_create(NULL, true, NULL);
+    http2_connection *server = http2_connection_create(NULL, false, NULL);
+    client->socket_fd = fds[0];
+    server->socket_fd = fds[1];
+    http2_stream *stream = http2_stream_create(server, 1);
+    
+    char baggage[20000];
+    memset(baggage, 'b', sizeof(baggage) - 1);
+    baggage[sizeof(baggage) - 1] = '\0';
+    grpc_metadata_array metadata;
+    grpc_metadata_array_init(&metadata, 1);
+    grpc_metadata_array_add(&metadata, "baggage", baggage, strlen(baggage));
+    assert(http2_connection_send_headers(client, 1, &metadata, false) == 0);
+    
+    /* Over the default 16 KiB: the block is dropped and the stream reset */
+    assert(recv_and_process(server, HTTP2_FRAME_HEADERS) == 0);
+    assert(recv_and_process(server, HTTP2_FRAME_CONTINUATION) == 0);
+    assert(server->header_block == NULL && server->header_block_stream_id == 0);
+    assert(stream->status == GRPC_STATUS_RESOURCE_EXHAUSTED);
+    assert(stream->end_stream_received);
+    
+    http2_frame_header header;
+    uint8_t *payload = NULL;
+    assert(http2_connection_recv_frame(client, &header, &payload) == 0);
+    assert(header.type == HTTP2_FRAME_RST_STREAM && header.stream_id == 1);
+    assert(payload[3] == HTTP2_ENHANCE_YOUR_CALM);
+    free(payload);
+    
+    /* A frame between HEADERS and its CONTINUATION is a protocol error */
+    uint8_t fragment[3] = {0x00, 0x01, 'k'};
+    http2_frame_header open_block = {sizeof(fragment), HTTP2_FRAME_HEADERS, 0, 3};
+    assert(http2_connection_send_frame(client, &open_block, fragment) == 0);
+    assert(recv_and_process(server, HTTP2_FRAME_HEADERS) == 0);
+    assert(http2_connection_send_ping(client) == 0);
+    assert(recv_and_process(server, HTTP2_FRAME_PING) == -1);
+    
+    /* Once the peer advertises a limit, oversized blocks are not sent */
+    server->max_header_list_size = 1024;
+    assert(http2_connection_send_settings(server) == 0);
+    assert(recv_and_process(client, HTTP2_FRAME_SETTINGS) == 0);
+    assert(client->peer_max_header_list_size == 1024);
+    assert(http2_connection_send_headers(client, 3, &metadata, false) == -1);
+    
+    grpc_metadata_array_destroy(&metadata);
+    http2_connection_destroy(client);
+    http2_connection_destroy(server);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * In-Process Transport Tests
+ * ======================================================================== */
+
+static grpc_event next_event(grpc_completion_queue *cq) {
+    return grpc_completion_queue_next(cq, grpc_timeout_milliseconds_to_deadline(1000));
+}
+
+void test_inproc_unary_call(void) {
+    TEST_START("test_inproc_unary_call");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(server != NULL);
+    grpc_server_start(server);
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    assert(channel != NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    /* Server asks for a call before the client starts one */
+    grpc_call *scall = NULL;
+    grpc_call_details details;
+    grpc_call_details_init(&details);
+    assert(grpc_server_request_call(server, &scall, &details, scq, (void *)1) == GRPC_CALL_OK);
+    
+    grpc_call *call = grpc_channel_create_call(channel, NULL, 0, ccq, "/test.Echo/Say", NULL,
+                                               grpc_timeout_milliseconds_to_deadline(5000));
+    assert(call != NULL);
+    
+    /* Client ops not valid on a client call are rejected */
+    int dummy;
+    grpc_op bad;
+    memset(&bad, 0, sizeof(bad));
+    bad.op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    bad.data.recv_close_on_server.cancelled = &dummy;
+    assert(grpc_call_start_batch(call, &bad, 1, (void *)99) == GRPC_CALL_ERROR_NOT_ON_CLIENT);
+    
+    grpc_metadata client_md = {"x-client", "c1", 2};
+    grpc_byte_buffer *request = grpc_byte_buffer_create((const uint8_t *)"ping", 4);
+    grpc_metadata_array recv_initial, recv_trailing;
+    grpc_metadata_array_init(&recv_initial, 0);
+    grpc_metadata_array_init(&recv_trailing, 0);
+    grpc_byte_buffer *response = NULL;
+    grpc_status_code status = GRPC_STATUS_UNKNOWN;
+    char *status_details = NULL;
+    
+    grpc_op ops[6];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[0].data.send_initial_metadata.count = 1;
+    ops[0].data.send_initial_metadata.metadata = &client_md;
+    ops[1].op = GRPC_OP_SEND_MESSAGE;
+    ops[1].data.send_message.send_message = request;
+    ops[2].op = GRPC_OP_SEND_CLOSE_FROM_CLIENT;
+    ops[3].op = GRPC_OP_RECV_INITIAL_METADATA;
+    ops[3].data.recv_initial_metadata.recv_initial_metadata = &recv_initial;
+    ops[4].op = GRPC_OP_RECV_MESSAGE;
+    ops[4].data.recv_message.recv_message = &response;
+    ops[5].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    ops[5].data.recv_status_on_client.trailing_metadata = &recv_trailing;
+    ops[5].data.recv_status_on_client.status = &status;
+    ops[5].data.recv_status_on_client.status_details = &status_details;
+    assert(grpc_call_start_batch(call, ops, 6, (void *)2) == GRPC_CALL_OK);
+    
+    grpc_event ev = next_event(scq);
+    assert(ev.type == 1 && ev.success && ev.tag == (void *)1);
+    assert(scall != NULL);
+    assert(strcmp(details.method, "/test.Echo/Say") == 0);
+    
+    /* The server sees the client's buffer itself, not a copy */
+    grpc_metadata_array server_initial;
+    grpc_metadata_array_init(&server_initial, 0);
+    grpc_byte_buffer *server_request = NULL;
+    grpc_op sops[4];
+    memset(sops, 0, sizeof(sops));
+    sops[0].op = GRPC_OP_RECV_INITIAL_METADATA;
+    sops[0].data.recv_initial_metadata.recv_initial_metadata = &server_initial;
+    sops[1].op = GRPC_OP_RECV_MESSAGE;
+    sops[1].data.recv_message.recv_message = &server_request;
+    assert(grpc_call_start_batch(scall, sops, 2, (void *)3) == GRPC_CALL_OK);
+    ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)3);
+    assert(server_request == request);
+    assert(server_initial.count == 1 && strcmp(server_initial.metadata[0].key, "x-client") == 0);
+    
+    grpc_byte_buffer *reply = grpc_byte_buffer_create((const uint8_t *)"pong", 4);
+    grpc_metadata trailer = {"x-trailer", "t1", 2};
+    int cancelled = -1;
+    memset(sops, 0, sizeof(sops));
+    sops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    sops[1].op = GRPC_OP_SEND_MESSAGE;
+    sops[1].data.send_message.send_message = reply;
+    sops[2].op = GRPC_OP_SEND_STATUS_FROM_SERVER;
+    sops[2].data.send_status_from_server.status = GRPC_STATUS_OK;
+    sops[2].data.send_status_from_server.status_details = "done";
+    sops[2].data.send_status_from_server.trailing_metadata_count = 1;
+    sops[2].data.send_status_from_server.trailing_metadata = &trailer;
+    sops[3].op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    sops[3].data.recv_close_on_server.cancelled = &cancelled;
+    assert(grpc_call_start_batch(scall, sops, 4, (void *)4) == GRPC_CALL_OK);
+    ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)4);
+    assert(cancelled == 0);
+    
+    ev = next_event(ccq);
+    assert(ev.success && ev.tag == (void *)2);
+    assert(status == GRPC_STATUS_OK && strcmp(status_details, "done") == 0);
+    assert(response == reply && response->length == 4);
+    assert(recv_trailing.count == 1 && strcmp(recv_trailing.metadata[0].value, "t1") == 0);
+    
+    free(status_details);
+    grpc_metadata_array_destroy(&recv_initial);
+    grpc_metadata_array_destroy(&recv_trailing);
+    grpc_metadata_array_destroy(&server_initial);
+    grpc_byte_buffer_destroy(server_request);
+    grpc_byte_buffer_destroy(request);
+    grpc_byte_buffer_destroy(response);
+    grpc_byte_buffer_destroy(reply);
+    grpc_call_details_destroy(&details);
+    grpc_call_destroy(scall);
+    grpc_call_destroy(call);
+    grpc_channel_destroy(channel);
+    
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+void test_inproc_cancel_propagates(void) {
+    TEST_START("test_inproc_cancel_propagates");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    grpc_server_start(server);
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    grpc_call *call = grpc_channel_create_call(channel, NULL, 0, ccq, "/test.Echo/Slow", NULL,
+                                               grpc_timeout_milliseconds_to_deadline(5000));
+    assert(call != NULL);
+    grpc_status_code status = GRPC_STATUS_OK;
+    grpc_op ops[2];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[1].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    ops[1].data.recv_status_on_client.status = &status;
+    assert(grpc_call_start_batch(call, ops, 2, (void *)1) == GRPC_CALL_OK);
+    
+    /* The call was queued before anyone asked for it */
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_call(server, &scall, NULL, scq, (void *)2) == GRPC_CALL_OK);
+    grpc_event ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)2 && scall != NULL);
+    
+    int cancelled = 0;
+    grpc_op sop;
+    memset(&sop, 0, sizeof(sop));
+    sop.op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    sop.data.recv_close_on_server.cancelled = &cancelled;
+    assert(grpc_call_start_batch(scall, &sop, 1, (void *)3) == GRPC_CALL_OK);
+    
+    assert(grpc_call_cancel(call) == GRPC_CALL_OK);
+    ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)3 && cancelled == 1);
+    ev = next_event(ccq);
+    assert(ev.tag == (void *)1 && status == GRPC_STATUS_CANCELLED);
+    
+    grpc_call_destroy(scall);
+    grpc_call_destroy(call);
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+void test_inproc_server_shutdown(void) {
+    TEST_START("test_inproc_server_shutdown");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    grpc_server_start(server);
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    /* An outstanding request fails when the server shuts down */
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_call(server, &scall, NULL, scq, (void *)1) == GRPC_CALL_OK);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_event ev = next_event(scq);
+    assert(ev.type == 1 && !ev.success && ev.tag == (void *)1);
+    
+    /* New calls are refused with UNAVAILABLE */
+    grpc_call *call = grpc_channel_create_call(channel, NULL, 0, ccq, "/test.Echo/Say", NULL,
+                                               grpc_timeout_milliseconds_to_deadline(5000));
+    grpc_status_code status = GRPC_STATUS_OK;
+    grpc_op ops[2];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[1].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    ops[1].data.recv_status_on_client.status = &status;
+    assert(grpc_call_start_batch(call, ops, 2, (void *)2) == GRPC_CALL_OK);
+    ev = next_event(ccq);
+    assert(ev.tag == (void *)2 && status == GRPC_STATUS_UNAVAILABLE);
+    
+    grpc_call_destroy(call);
+    grpc_channel_destroy(channel);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Resource Quota Tests
+ * ======================================================================== */
+
+void test_resource_quota_limits(void) {
+    TEST_START("test_resource_quota_limits");
+    
+    grpc_resource_quota *global = grpc_resource_quota_global();
+    size_t global_before = grpc_resource_quota_get_usage(global);
+    
+    grpc_resource_quota *quota = grpc_resource_quota_create("test");
+    assert(quota != NULL);
+    grpc_resource_quota_resize(quota, 1000);
+    
+    assert(grpc_resource_quota_reserve(quota, 600) == 0);
+    assert(grpc_resource_quota_get_usage(quota) == 600);
+    assert(grpc_resource_quota_get_usage(global) == global_before + 600);
+    assert(!grpc_resource_quota_under_pressure(quota));
+    
+    /* A failed reservation charges nothing */
+    assert(grpc_resource_quota_reserve(quota, 500) == -1);
+    assert(grpc_resource_quota_get_usage(quota) == 600);
+    assert(grpc_resource_quota_get_usage(global) == global_before + 600);
+    
+    /* Bytes already received are charged even past the limit */
+    grpc_resource_quota_charge(quota, 500);
+    assert(grpc_resource_quota_under_pressure(quota));
+    assert(grpc_resource_quota_exhausted(quota));
+    grpc_resource_quota_release(quota, 1100);
+    assert(grpc_resource_quota_get_usage(quota) == 0);
+    
+    /* The global limit applies to every child */
+    grpc_resource_quota_resize(global, global_before + 100);
+    assert(grpc_resource_quota_reserve(quota, 200) == -1);
+    assert(grpc_resource_quota_get_usage(quota) == 0);
+    grpc_resource_quota_resize(global, 0);
+    assert(grpc_resource_quota_reserve(quota, 200) == 0);
+    grpc_resource_quota_release(quota, 200);
+    
+    grpc_resource_quota_unref(quota);
+    TEST_PASS();
+}
+
+void test_quota_pressure_withholds_window(void) {
+    TEST_START("test_quota_pressure_withholds_window");
+    
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    
+    grpc_resource_quota *quota = grpc_resource_quota_create("conn");
+    grpc_resource_quota_resize(quota, 1000);
+    
+    http2_connection *client = http2_connection_create(NULL, true, NULL);
+    http2_connection *server = http2_connection_create(NULL, false, NULL);
+    client->socket_fd = fds[0];
+    server->socket_fd = fds[1];
+    server->quota = quota;
+    http2_stream *stream = http2_stream_create(server, 1);
+    
+    /* Under pressure the connection window drains without a refill */
+    grpc_resource_quota_charge(quota, 950);
+    assert(http2_flow_control_consume_recv_window(server, stream, 40000) == 0);
+    assert(server->window_update_withheld);
+    
+    http2_frame_header header;
+    uint8_t *payload = NULL;
+    assert(http2_connection_recv_frame(client, &header, &payload) == 0);
+    assert(header.type == HTTP2_FRAME_WINDOW_UPDATE && header.stream_id == 1);
+    free(payload);
+    uint8_t byte;
+    assert(recv(fds[0], &byte, 1, MSG_DONTWAIT) == -1);
+    
+    /* At the limit the owner stops reading */
+    grpc_resource_quota_charge(quota, 50);
+    assert(!http2_connection_read_allowed(server));
+    assert(http2_flow_control_resume(server) == 0);
+    assert(recv(fds[0], &byte, 1, MSG_DONTWAIT) == -1);
+    
+    /* Once memory is released the withheld update goes out */
+    grpc_resource_quota_release(quota, 1000);
+    assert(http2_connection_read_allowed(server));
+    assert(http2_flow_control_resume(server) == 0);
+    assert(!server->window_update_withheld);
+    assert(http2_connection_recv_frame(client, &header, &payload) == 0);
+    assert(header.type == HTTP2_FRAME_WINDOW_UPDATE && header.stream_id == 0);
+    assert((((uint32_t)payload[2] << 8) | payload[3]) == 40000);
+    free(payload);
+    
+    http2_connection_destroy(client);
+    http2_connection_destroy(server);
+    grpc_resource_quota_unref(quota);
+    TEST_PASS();
+}
+
+void test_inproc_quota_rejects_calls(void) {
+    TEST_START("test_inproc_quota_rejects_calls");
+    
+    grpc_resource_quota *quota = grpc_resource_quota_create("server");
+    grpc_resource_quota_resize(quota, 64);
+    
+    grpc_server *server = grpc_server_create(NULL);
+    grpc_server_set_resource_quota(server, quota);
+    grpc_server_start(server);
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_call(server, &scall, NULL, scq, (void *)1) == GRPC_CALL_OK);
+    grpc_call *call = grpc_channel_create_call(channel, NULL, 0, ccq, "/test.Echo/Big", NULL,
+                                               grpc_timeout_milliseconds_to_deadline(5000));
+    
+    /* A message the server has not read yet is charged to its quota */
+    uint8_t body[100];
+    memset(body, 'x', sizeof(body));
+    grpc_byte_buffer *request = grpc_byte_buffer_create(body, sizeof(body));
+    grpc_op ops[2];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[1].op = GRPC_OP_SEND_MESSAGE;
+    ops[1].data.send_message.send_message = request;
+    assert(grpc_call_start_batch(call, ops, 2, (void *)2) == GRPC_CALL_OK);
+    assert(next_event(ccq).tag == (void *)2);
+    assert(next_event(scq).tag == (void *)1);
+    assert(grpc_resource_quota_get_usage(quota) == sizeof(body));
+    
+    /* The quota is exhausted: the next call is refused */
+    grpc_call *call2 = grpc_channel_create_call(channel, NULL, 0, ccq, "/test.Echo/Big", NULL,
+                                                grpc_timeout_milliseconds_to_deadline(5000));
+    grpc_status_code status = GRPC_STATUS_OK;
+    char *details = NULL;
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[1].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    ops[1].data.recv_status_on_client.status = &status;
+    ops[1].data.recv_status_on_client.status_details = &details;
+    assert(grpc_call_start_batch(call2, ops, 2, (void *)3) == GRPC_CALL_OK);
+    assert(next_event(ccq).tag == (void *)3);
+    assert(status == GRPC_STATUS_RESOURCE_EXHAUSTED);
+    free(details);
+    
+    /* Reading the message returns its bytes to the quota */
+    grpc_byte_buffer *received = NULL;
+    grpc_op sop;
+    memset(&sop, 0, sizeof(sop));
+    sop.op = GRPC_OP_RECV_MESSAGE;
+    sop.data.recv_message.recv_message = &received;
+    assert(grpc_call_start_batch(scall, &sop, 1, (void *)4) == GRPC_CALL_OK);
+    assert(next_event(scq).tag == (void *)4);
+    assert(received == request);
+    assert(grpc_resource_quota_get_usage(quota) == 0);
+    
+    grpc_byte_buffer_destroy(received);
+    grpc_byte_buffer_destroy(request);
+    grpc_call_destroy(call2);
+    grpc_call_destroy(scall);
+    grpc_call_destroy(call);
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_resource_quota_unref(quota);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Registered Method Tests
+ * ======================================================================== */
+
+void test_inproc_registered_method(void) {
+    TEST_START("test_inproc_registered_method");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    void *echo = grpc_server_register_method(server, "/pkg.Svc/Echo", NULL);
+    assert(echo != NULL);
+    assert(grpc_server_register_method(server, "/pkg.Svc/Echo", NULL) == NULL);
+    assert(grpc_server_register_method(server, "/pkg.Svc/Echo", "example.com") != NULL);
+    grpc_server_start(server);
+    assert(grpc_server_register_method(server, "/pkg.Svc/Late", NULL) == NULL);
+    
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    grpc_call *scall = NULL;
+    grpc_timespec deadline = {0, 0};
+    assert(grpc_server_request_registered_call(server, echo, &scall, &deadline, scq, (void *)1) ==
+           GRPC_CALL_OK);
+    
+    grpc_timespec client_deadline = grpc_timeout_milliseconds_to_deadline(5000);
+    grpc_call *call = grpc_channel_create_call(channel, NULL, 0, ccq, "/pkg.Svc/Echo", NULL,
+                                               client_deadline);
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_SEND_INITIAL_METADATA;
+    assert(grpc_call_start_batch(call, &op, 1, (void *)2) == GRPC_CALL_OK);
+    
+    grpc_event ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)1 && scall != NULL);
+    assert(deadline.tv_sec == client_deadline.tv_sec && deadline.tv_nsec == client_deadline.tv_nsec);
+    
+    /* Anything not registered is answered UNIMPLEMENTED without the application */
+    grpc_call *unknown = grpc_channel_create_call(channel, NULL, 0, ccq, "/pkg.Svc/Missing", NULL,
+                                                  client_deadline);
+    grpc_status_code status = GRPC_STATUS_OK;
+    grpc_op ops[2];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[1].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    ops[1].data.recv_status_on_client.status = &status;
+    assert(grpc_call_start_batch(unknown, ops, 2, (void *)3) == GRPC_CALL_OK);
+    do {
+        ev = next_event(ccq);
+    } while (ev.tag != (void *)3);
+    assert(status == GRPC_STATUS_UNIMPLEMENTED);
+    
+    grpc_call_destroy(unknown);
+    grpc_call_destroy(scall);
+    grpc_call_destroy(call);
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* Open a request stream on a raw client connection */
+static void send_request_headers(http2_connection *client, uint32_t stream_id, const char *path) {
+    grpc_metadata_array headers;
+    grpc_metadata_array_init(&headers, 6);
+    grpc_metadata_array_add(&headers, ":method", "POST", 4);
+    grpc_metadata_array_add(&headers, ":scheme", "http", 4);
+    grpc_metadata_array_add(&headers, ":path", path, strlen(path));
+    grpc_metadata_array_add(&headers, ":authority", "localhost", 9);
+    grpc_metadata_array_add(&headers, "content-type", "application/grpc", 16);
+    grpc_metadata_array_add(&headers, "grpc-timeout", "5S", 2);
+    assert(http2_stream_create(client, stream_id) != NULL);
+    assert(http2_connection_send_headers(client, stream_id, &headers, false) == 0);
+    grpc_metadata_array_destroy(&headers);
+}
+
+/* Read frames until the stream ends; copies the first DATA payload out */
+static http2_stream *read_response(http2_connection *client, uint32_t stream_id,
+                                   uint8_t *data, size_t *data_len) {
+    http2_stream *stream = NULL;
+    for (size_t i = 0; i < client->streams_count; i++) {
+        if (client->streams[i]->id == stream_id) {
+            stream = client->streams[i];
+        }
+    }
+    assert(stream != NULL);
+    
+    while (!stream->end_stream_received) {
+        http2_frame_header header;
+        uint8_t *payload = NULL;
+        assert(http2_connection_recv_frame(client, &header, &payload) == 0);
+        if (header.type == HTTP2_FRAME_DATA && data && *data_len == 0) {
+            memcpy(data, payload, header.length);
+            *data_len = header.length;
+        }
+        assert(http2_connection_process_frame(client, &header, payload) == 0);
+        free(payload);
+    }
+    return stream;
+}
+
+static const char *find_metadata(const grpc_metadata_array *md, const char *key) {
+    for (size_t i = 0; i < md->count; i++) {
+        if (strcmp(md->metadata[i].key, key) == 0) {
+            return md->metadata[i].value;
+        }
+    }
+    return NULL;
+}
+
+void test_http2_registered_method(void) {
+    TEST_START("test_http2_registered_method");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    void *echo = grpc_server_register_method(server, "/pkg.Svc/Echo", NULL);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50074") == 50074);
+    grpc_server_start(server);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:50074", true, NULL);
+    assert(http2_connection_connect(client, "127.0.0.1:50074") == 0);
+    assert(http2_connection_send_preface(client) == 0);
+    assert(http2_connection_send_settings(client) == 0);
+    
+    /* One length-prefixed message, then half-close */
+    send_request_headers(client, 1, "/pkg.Svc/Echo");
+    uint8_t message[5 + 4] = {0, 0, 0, 0, 4, 'p', 'i', 'n', 'g'};
+    http2_frame_header data_header = {sizeof(message), HTTP2_FRAME_DATA, 0x01, 1}; /* END_STREAM */
+    assert(http2_connection_send_frame(client, &data_header, message) == 0);
+    
+    grpc_call *scall = NULL;
+    grpc_timespec deadline = {0, 0};
+    assert(grpc_server_request_registered_call(server, echo, &scall, &deadline, scq, (void *)1) ==
+           GRPC_CALL_OK);
+    grpc_event ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)1 && scall != NULL);
+    assert(strcmp(scall->method, "/pkg.Svc/Echo") == 0);
+    assert(deadline.tv_sec > 0);
+    
+    grpc_byte_buffer *request = NULL;
+    grpc_op sops[4];
+    memset(sops, 0, sizeof(sops));
+    sops[0].op = GRPC_OP_RECV_MESSAGE;
+    sops[0].data.recv_message.recv_message = &request;
+    assert(grpc_call_start_batch(scall, sops, 1, (void *)2) == GRPC_CALL_OK);
+    ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)2);
+    assert(request != NULL && request->length == 4 && memcmp(request->data, "ping", 4) == 0);
+    
+    grpc_byte_buffer *reply = grpc_byte_buffer_create((const uint8_t *)"pong", 4);
+    int cancelled = -1;
+    memset(sops, 0, sizeof(sops));
+    sops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    sops[1].op = GRPC_OP_SEND_MESSAGE;
+    sops[1].data.send_message.send_message = reply;
+    sops[2].op = GRPC_OP_SEND_STATUS_FROM_SERVER;
+    sops[2].data.send_status_from_server.status = GRPC_STATUS_OK;
+    sops[3].op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    sops[3].data.recv_close_on_server.cancelled = &cancelled;
+    assert(grpc_call_start_batch(scall, sops, 4, (void *)3) == GRPC_CALL_OK);
+    ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)3 && cancelled == 0);
+    
+    uint8_t data[64];
+    size_t data_len = 0;
+    http2_stream *stream = read_response(client, 1, data, &data_len);
+    assert(strcmp(find_metadata(&stream->initial_metadata, ":status"), "200") == 0);
+    assert(data_len == 9 && data[4] == 4 && memcmp(data + 5, "pong", 4) == 0);
+    assert(strcmp(find_metadata(&stream->trailing_metadata, "grpc-status"), "0") == 0);
+    
+    /* An unknown :path gets a trailers-only UNIMPLEMENTED response */
+    send_request_headers(client, 3, "/pkg.Svc/Missing");
+    stream = read_response(client, 3, NULL, NULL);
+    assert(strcmp(find_metadata(&stream->initial_metadata, "grpc-status"), "12") == 0);
+    
+    grpc_byte_buffer_destroy(request);
+    grpc_byte_buffer_destroy(reply);
+    grpc_call_destroy(scall);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    http2_connection_destroy(client);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+void test_http2_large_reply_from_buffer(void) {
+    TEST_START("test_http2_large_reply_from_buffer");
+    
+    grpc_arg arg_values[2];
+    arg_values[0].key = GRPC_ARG_TCP_TX_ZEROCOPY_ENABLED;
+    arg_values[0].value.integer = 1;
+    arg_values[0].is_string = false;
+    arg_values[1].key = GRPC_ARG_TCP_TX_ZEROCOPY_SEND_BYTES_THRESHOLD;
+    arg_values[1].value.integer = 1024;
+    arg_values[1].is_string = false;
+    grpc_channel_args args = {2, arg_values};
+    
+    grpc_server *server = grpc_server_create(&args);
+    void *echo = grpc_server_register_method(server, "/pkg.Svc/Echo", NULL);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50082") == 50082);
+    grpc_server_start(server);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:50082", true, NULL);
+    assert(http2_connection_connect(client, "127.0.0.1:50082") == 0);
+    assert(http2_connection_send_preface(client) == 0);
+    assert(http2_connection_send_settings(client) == 0);
+    send_request_headers(client, 1, "/pkg.Svc/Echo");
+    
+    grpc_call *scall = NULL;
+    grpc_timespec deadline = {0, 0};
+    assert(grpc_server_request_registered_call(server, echo, &scall, &deadline, scq, (void *)1) ==
+           GRPC_CALL_OK);
+    grpc_event ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)1);
+    
+    /* Several frames' worth: the prefix leads the first, the rest comes
+     * from the buffer, zero-copy above the threshold */
+    size_t length = 40000;
+    uint8_t *body = (uint8_t *)malloc(length);
+    for (size_t i = 0; i < length; i++) {
+        body[i] = (uint8_t)(i * 7);
+    }
+    grpc_byte_buffer *reply = grpc_byte_buffer_create(body, length);
+    grpc_op sops[3];
+    memset(sops, 0, sizeof(sops));
+    sops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    sops[1].op = GRPC_OP_SEND_MESSAGE;
+    sops[1].data.send_message.send_message = reply;
+    sops[2].op = GRPC_OP_SEND_STATUS_FROM_SERVER;
+    sops[2].data.send_status_from_server.status = GRPC_STATUS_OK;
+    assert(grpc_call_start_batch(scall, sops, 3, (void *)2) == GRPC_CALL_OK);
+    ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)2);
+    
+    uint8_t *received = (uint8_t *)malloc(5 + length);
+    size_t received_len = 0;
+    int frames = 0;
+    bool ended = false;
+    while (!ended) {
+        http2_frame_header header;
+        uint8_t *payload = NULL;
+        assert(http2_connection_recv_frame(client, &header, &payload) == 0);
+        if (header.type == HTTP2_FRAME_DATA && header.length > 0) {
+            assert(received_len + header.length <= 5 + length);
+            memcpy(received + received_len, payload, header.length);
+            received_len += header.length;
+            frames++;
+        }
+        ended = header.type == HTTP2_FRAME_HEADERS && (header.flags & 0x01);
+        assert(http2_connection_process_frame(client, &header, payload) == 0);
+        free(payload);
+    }
+    assert(frames > 1 && received_len == 5 + length);
+    assert(received[0] == 0 && received[3] == (uint8_t)(length >> 8) && received[4] == (uint8_t)length);
+    assert(memcmp(received + 5, body, length) == 0);
+    
+    grpc_byte_buffer_destroy(reply);
+    grpc_call_destroy(scall);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    http2_connection_destroy(client);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    free(received);
+    free(body);
+    TEST_PASS();
+}
+
+void test_method_router_perfect_hash(void) {
+    TEST_START("test_method_router_perfect_hash");
+    
+    /* A gateway-sized method set */
+    size_t count = 5000;
+    char **paths = (char **)malloc(count * sizeof(char *));
+    void **values = (void **)malloc(count * sizeof(void *));
+    for (size_t i = 0; i < count; i++) {
+        paths[i] = (char *)malloc(64);
+        snprintf(paths[i], 64, "/pkg.Service%zu/Method%zu", i / 8, i % 8);
+        values[i] = (void *)(uintptr_t)(i + 1);
+    }
+    
+    grpc_method_router *router = grpc_method_router_create((const char *const *)paths, values, count);
+    assert(router != NULL);
+    assert(grpc_method_router_size(router) == count);
+    for (size_t i = 0; i < count; i++) {
+        assert(grpc_method_router_lookup(router, paths[i]) == values[i]);
+    }
+    assert(grpc_method_router_lookup(router, "/pkg.Service0/Method8") == NULL);
+    assert(grpc_method_router_lookup(router, "/pkg.Service0/Method") == NULL);
+    assert(grpc_method_router_lookup(router, "") == NULL);
+    grpc_method_router_destroy(router);
+    
+    /* Duplicate paths cannot be routed */
+    const char *dup_paths[3] = {"/a/X", "/b/Y", "/a/X"};
+    void *dup_values[3] = {values[0], values[1], values[2]};
+    assert(grpc_method_router_create(dup_paths, dup_values, 3) == NULL);
+    
+    router = grpc_method_router_create(NULL, NULL, 0);
+    assert(router != NULL && grpc_method_router_lookup(router, "/a/X") == NULL);
+    grpc_method_router_destroy(router);
+    
+    for (size_t i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    free(values);
+    TEST_PASS();
+}
+
+/* Start a call that sends optional metadata and message, half-closes and
+ * waits for its status; the tag is the status destination. A child of
+ * parent leaves its deadline to the propagation in mask. */
+static grpc_call *start_call(grpc_channel *channel, grpc_call *parent, uint32_t mask,
+                             grpc_completion_queue *cq, const char *method,
+                             grpc_metadata *metadata, const char *message,
+                             grpc_byte_buffer **response, grpc_status_code *status) {
+    grpc_timespec deadline = {INT64_MAX, 0};
+    if (!parent) {
+        deadline = grpc_timeout_milliseconds_to_deadline(5000);
+    }
+    grpc_call *call = grpc_channel_create_call(channel, parent, mask, cq, method, NULL, deadline);
+    grpc_byte_buffer *request = NULL;
+    grpc_op ops[5];
+    size_t nops = 0;
+    memset(ops, 0, sizeof(ops));
+    ops[nops].op = GRPC_OP_SEND_INITIAL_METADATA;
+    if (metadata) {
+        ops[nops].data.send_initial_metadata.count = 1;
+        ops[nops].data.send_initial_metadata.metadata = metadata;
+    }
+    nops++;
+    if (message) {
+        request = grpc_byte_buffer_create((const uint8_t *)message, strlen(message));
+        ops[nops].op = GRPC_OP_SEND_MESSAGE;
+        ops[nops++].data.send_message.send_message = request;
+    }
+    ops[nops++].op = GRPC_OP_SEND_CLOSE_FROM_CLIENT;
+    if (response) {
+        ops[nops].op = GRPC_OP_RECV_MESSAGE;
+        ops[nops++].data.recv_message.recv_message = response;
+    }
+    ops[nops].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    ops[nops++].data.recv_status_on_client.status = status;
+    assert(grpc_call_start_batch(call, ops, nops, status) == GRPC_CALL_OK);
+    if (request) {
+        grpc_byte_buffer_destroy(request);
+    }
+    return call;
+}
+
+void test_server_routes_reflection_registry(void) {
+    TEST_START("test_server_routes_reflection_registry");
+    
+    grpc_reflection_registry *registry = grpc_reflection_registry_create();
+    assert(grpc_reflection_registry_add_service(registry, "Greeter", "helloworld") == 0);
+    assert(grpc_reflection_registry_add_method(registry, "Greeter", "SayHello", "Req", "Resp",
+                                               false, false) == 0);
+    assert(grpc_reflection_registry_add_method(registry, "Greeter", "SayBye", "Req", "Resp",
+                                               false, false) == 0);
+    
+    grpc_server *server = grpc_server_create(NULL);
+    void *hello = grpc_server_register_method(server, "/helloworld.Greeter/SayHello", NULL);
+    assert(hello != NULL);
+    assert(grpc_server_set_reflection_registry(server, registry) == 0);
+    grpc_server_start(server);
+    assert(grpc_server_set_reflection_registry(server, registry) == -1);
+    
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    /* A registered method carries the registry's descriptor */
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_registered_call(server, hello, &scall, NULL, scq, (void *)1) ==
+           GRPC_CALL_OK);
+    grpc_call *call = NULL;
+    grpc_status_code status = GRPC_STATUS_UNKNOWN;
+    call = start_call(channel, NULL, 0, ccq, "/helloworld.Greeter/SayHello", NULL, NULL, NULL, &status);
+    grpc_event ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)1);
+    grpc_method_descriptor *descriptor = grpc_call_get_method_descriptor(scall);
+    assert(descriptor != NULL);
+    assert(strcmp(grpc_method_descriptor_get_path(descriptor), "/helloworld.Greeter/SayHello") == 0);
+    
+    /* A registry method nobody registered is served by request_call */
+    grpc_call *bye_scall = NULL;
+    grpc_call_details details;
+    grpc_call_details_init(&details);
+    assert(grpc_server_request_call(server, &bye_scall, &details, scq, (void *)2) == GRPC_CALL_OK);
+    grpc_call *bye = NULL;
+    grpc_status_code bye_status = GRPC_STATUS_UNKNOWN;
+    bye = start_call(channel, NULL, 0, ccq, "/helloworld.Greeter/SayBye", NULL, NULL, NULL, &bye_status);
+    ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)2);
+    assert(strcmp(details.method, "/helloworld.Greeter/SayBye") == 0);
+    assert(strcmp(grpc_method_descriptor_get_path(grpc_call_get_method_descriptor(bye_scall)),
+                  "/helloworld.Greeter/SayBye") == 0);
+    
+    /* Anything else is unknown */
+    grpc_call *missing = NULL;
+    grpc_status_code missing_status = GRPC_STATUS_OK;
+    const char *missing_method = "/helloworld.Greeter/SayNothing";
+    missing = start_call(channel, NULL, 0, ccq, missing_method, NULL, NULL, NULL, &missing_status);
+    do {
+        ev = next_event(ccq);
+    } while (ev.tag != (void *)&missing_status);
+    assert(missing_status == GRPC_STATUS_UNIMPLEMENTED);
+    
+    grpc_call_details_destroy(&details);
+    grpc_call_destroy(missing);
+    grpc_call_destroy(bye_scall);
+    grpc_call_destroy(bye);
+    grpc_call_destroy(scall);
+    grpc_call_destroy(call);
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_reflection_registry_destroy(registry);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Executor Tests
+ * ======================================================================== */
+
+typedef struct {
+    int count;
+    pthread_t threads[64];
+    int thread_count;
+    pthread_mutex_t mutex;
+} executor_tally;
+
+static void tally_task(void *arg) {
+    executor_tally *tally = (executor_tally *)arg;
+    __atomic_fetch_add(&tally->count, 1, __ATOMIC_RELAXED);
+}
+
+/* Slow child: records which thread ran it */
+static void tally_slow_task(void *arg) {
+    executor_tally *tally = (executor_tally *)arg;
+    usleep(1000);
+    pthread_mutex_lock(&tally->mutex);
+    bool seen = false;
+    for (int i = 0; i < tally->thread_count; i++) {
+        seen = seen || pthread_equal(tally->threads[i], pthread_self());
+    }
+    if (!seen && tally->thread_count < 64) {
+        tally->threads[tally->thread_count++] = pthread_self();
+    }
+    pthread_mutex_unlock(&tally->mutex);
+    __atomic_fetch_add(&tally->count, 1, __ATOMIC_RELAXED);
+}
+
+static grpc_executor *spawn_executor = NULL;
+
+/* Runs on a worker and pushes its children onto that worker's deque */
+static void spawn_children_task(void *arg) {
+    for (int i = 0; i < 64; i++) {
+        assert(grpc_executor_run(spawn_executor, tally_slow_task, arg) == 0);
+    }
+}
+
+void test_executor_runs_and_steals(void) {
+    TEST_START("test_executor_runs_and_steals");
+    
+    grpc_executor *executor = grpc_executor_create(4);
+    assert(executor != NULL);
+    assert(grpc_executor_thread_count(executor) == 4);
+    
+    /* Outside submissions, enough to grow the deques past their first size */
+    executor_tally tally;
+    memset(&tally, 0, sizeof(tally));
+    for (int i = 0; i < 20000; i++) {
+        assert(grpc_executor_run(executor, tally_task, &tally) == 0);
+    }
+    
+    /* Children spawned on one worker are stolen by the idle ones */
+    executor_tally stolen;
+    memset(&stolen, 0, sizeof(stolen));
+    pthread_mutex_init(&stolen.mutex, NULL);
+    spawn_executor = executor;
+    assert(grpc_executor_run(executor, spawn_children_task, &stolen) == 0);
+    
+    /* Destroy runs everything already submitted */
+    grpc_executor_destroy(executor);
+    assert(tally.count == 20000);
+    assert(stolen.count == 64);
+    assert(stolen.thread_count > 1);
+    pthread_mutex_destroy(&stolen.mutex);
+    
+    grpc_executor *one_per_cpu = grpc_executor_create(0);
+    assert(grpc_executor_thread_count(one_per_cpu) >= 1);
+    grpc_executor_destroy(one_per_cpu);
+    TEST_PASS();
+}
+
+typedef struct {
+    grpc_completion_queue_functor functor;
+    int ok;
+    bool ran;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} callback_handler;
+
+static void callback_handler_run(grpc_completion_queue_functor *functor, int ok) {
+    callback_handler *handler = (callback_handler *)functor;
+    pthread_mutex_lock(&handler->mutex);
+    handler->ok = ok;
+    handler->thread = pthread_self();
+    handler->ran = true;
+    pthread_cond_signal(&handler->cond);
+    pthread_mutex_unlock(&handler->mutex);
+}
+
+void test_callback_cq_offloads_handler(void) {
+    TEST_START("test_callback_cq_offloads_handler");
+    
+    grpc_executor *executor = grpc_executor_create(2);
+    grpc_completion_queue *scq = grpc_completion_queue_create_for_callback(executor);
+    assert(scq != NULL);
+    assert(grpc_completion_queue_create_for_callback(NULL) == NULL);
+    
+    grpc_server *server = grpc_server_create(NULL);
+    grpc_server_start(server);
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    callback_handler handler;
+    memset(&handler, 0, sizeof(handler));
+    handler.functor.functor_run = callback_handler_run;
+    pthread_mutex_init(&handler.mutex, NULL);
+    pthread_cond_init(&handler.cond, NULL);
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_call(server, &scall, NULL, scq, &handler.functor) == GRPC_CALL_OK);
+    
+    /* The call is published on this thread; the handler runs on the pool */
+    grpc_call *call = grpc_channel_create_call(channel, NULL, 0, ccq, "/test.Echo/Say", NULL,
+                                               grpc_timeout_milliseconds_to_deadline(5000));
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_SEND_INITIAL_METADATA;
+    assert(grpc_call_start_batch(call, &op, 1, (void *)1) == GRPC_CALL_OK);
+    
+    pthread_mutex_lock(&handler.mutex);
+    while (!handler.ran) {
+        pthread_cond_wait(&handler.cond, &handler.mutex);
+    }
+    pthread_mutex_unlock(&handler.mutex);
+    assert(handler.ok && scall != NULL);
+    assert(!pthread_equal(handler.thread, pthread_self()));
+    
+    grpc_call_destroy(scall);
+    grpc_call_destroy(call);
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    grpc_executor_destroy(executor);
+    pthread_mutex_destroy(&handler.mutex);
+    pthread_cond_destroy(&handler.cond);
+    TEST_PASS();
+}
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool released;
+} executor_gate;
+
+/* Holds a worker, and so the executor's destroy, until released */
+static void gate_task(void *arg) {
+    executor_gate *gate = (executor_gate *)arg;
+    pthread_mutex_lock(&gate->mutex);
+    while (!gate->released) {
+        pthread_cond_wait(&gate->cond, &gate->mutex);
+    }
+    pthread_mutex_unlock(&gate->mutex);
+}
+
+static void noop_task(void *arg) {
+    (void)arg;
+}
+
+static void *destroy_executor_thread(void *arg) {
+    grpc_executor_destroy((grpc_executor *)arg);
+    return NULL;
+}
+
+void test_callback_cq_after_executor_shutdown(void) {
+    TEST_START("test_callback_cq_after_executor_shutdown");
+    
+    grpc_executor *executor = grpc_executor_create(1);
+    grpc_completion_queue *cq = grpc_completion_queue_create_for_callback(executor);
+    executor_gate gate;
+    memset(&gate, 0, sizeof(gate));
+    pthread_mutex_init(&gate.mutex, NULL);
+    pthread_cond_init(&gate.cond, NULL);
+    assert(grpc_executor_run(executor, gate_task, &gate) == 0);
+    
+    /* Destroy stops taking outside work, then waits for the gated worker */
+    pthread_t destroyer;
+    assert(pthread_create(&destroyer, NULL, destroy_executor_thread, executor) == 0);
+    while (grpc_executor_run(executor, noop_task, NULL) == 0) {
+        usleep(1000);
+    }
+    
+    callback_handler handler;
+    memset(&handler, 0, sizeof(handler));
+    handler.functor.functor_run = callback_handler_run;
+    pthread_mutex_init(&handler.mutex, NULL);
+    pthread_cond_init(&handler.cond, NULL);
+    
+    /* Pushed under a lock the handler takes, as a call completes under its
+     * mutex: running the handler inline would deadlock. The queue keeps it. */
+    grpc_event event;
+    event.type = 1; /* GRPC_OP_COMPLETE */
+    event.success = 1;
+    event.tag = &handler.functor;
+    pthread_mutex_lock(&handler.mutex);
+    completion_queue_push_event(cq, event);
+    pthread_mutex_unlock(&handler.mutex);
+    
+    pthread_mutex_lock(&gate.mutex);
+    gate.released = true;
+    pthread_cond_signal(&gate.cond);
+    pthread_mutex_unlock(&gate.mutex);
+    pthread_join(destroyer, NULL);
+    assert(!handler.ran);
+    
+    /* Shutting the queue down runs it, failed */
+    grpc_completion_queue_shutdown(cq);
+    assert(handler.ran && !handler.ok);
+    assert(pthread_equal(handler.thread, pthread_self()));
+    grpc_completion_queue_destroy(cq);
+    pthread_mutex_destroy(&gate.mutex);
+    pthread_cond_destroy(&gate.cond);
+    pthread_mutex_destroy(&handler.mutex);
+    pthread_cond_destroy(&handler.cond);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Admission Control Tests
+ * ======================================================================== */
+
+void test_server_sheds_over_concurrency_limit(void) {
+    TEST_START("test_server_sheds_over_concurrency_limit");
+    
+    grpc_arg arg_values[2];
+    arg_values[0].key = GRPC_ARG_SERVER_CONCURRENCY_LIMIT;
+    arg_values[0].value.integer = 2;
+    arg_values[0].is_string = false;
+    arg_values[1].key = GRPC_ARG_SERVER_QUEUE_DELAY_INTERVAL_MS;
+    arg_values[1].value.integer = 60000;
+    arg_values[1].is_string = false;
+    grpc_channel_args args = {2, arg_values};
+    
+    grpc_metrics_registry *metrics = grpc_metrics_registry_create();
+    grpc_server *server = grpc_server_create(&args);
+    assert(grpc_server_set_metrics_registry(server, metrics) == 0);
+    grpc_server_start(server);
+    assert(grpc_server_set_metrics_registry(server, metrics) == -1);
+    assert(grpc_metrics_get(metrics, "grpc.server.concurrency_limit")->value == 2);
+    
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    /* Two calls wait for the application; the third is refused up front */
+    const char *method = "/test.Shed/Call";
+    grpc_call *calls[4];
+    grpc_status_code statuses[4] = {GRPC_STATUS_UNKNOWN, GRPC_STATUS_UNKNOWN,
+                                    GRPC_STATUS_UNKNOWN, GRPC_STATUS_UNKNOWN};
+    for (int i = 0; i < 3; i++) {
+        calls[i] = start_call(channel, NULL, 0, ccq, method, NULL, NULL, NULL, &statuses[i]);
+    }
+    assert(next_event(ccq).tag == (void *)&statuses[2]);
+    assert(statuses[0] == GRPC_STATUS_UNKNOWN && statuses[1] == GRPC_STATUS_UNKNOWN);
+    assert(statuses[2] == GRPC_STATUS_RESOURCE_EXHAUSTED);
+    assert(grpc_metrics_get(metrics, "grpc.server.calls_shed")->value == 1);
+    
+    /* A slot opens only when an admitted call is destroyed */
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_call(server, &scall, NULL, scq, (void *)1) == GRPC_CALL_OK);
+    assert(next_event(scq).tag == (void *)1);
+    grpc_call_destroy(scall);
+    assert(next_event(ccq).tag == (void *)&statuses[0]);
+    assert(statuses[0] == GRPC_STATUS_CANCELLED);
+    
+    calls[3] = start_call(channel, NULL, 0, ccq, method, NULL, NULL, NULL, &statuses[3]);
+    assert(grpc_metrics_get(metrics, "grpc.server.calls_shed")->value == 1);
+    
+    for (int i = 0; i < 4; i++) {
+        grpc_call_destroy(calls[i]);
+    }
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_metrics_registry_destroy(metrics);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+void test_concurrency_limit_tracks_queue_delay(void) {
+    TEST_START("test_concurrency_limit_tracks_queue_delay");
+    
+    grpc_arg arg_values[3];
+    arg_values[0].key = GRPC_ARG_SERVER_CONCURRENCY_LIMIT;
+    arg_values[0].value.integer = 8;
+    arg_values[0].is_string = false;
+    arg_values[1].key = GRPC_ARG_SERVER_QUEUE_DELAY_TARGET_MS;
+    arg_values[1].value.integer = 1;
+    arg_values[1].is_string = false;
+    arg_values[2].key = GRPC_ARG_SERVER_QUEUE_DELAY_INTERVAL_MS;
+    arg_values[2].value.integer = 10;
+    arg_values[2].is_string = false;
+    grpc_channel_args args = {3, arg_values};
+    
+    grpc_metrics_registry *metrics = grpc_metrics_registry_create();
+    grpc_server *server = grpc_server_create(&args);
+    void *rm = grpc_server_register_method(server, "/test.Shed/Slow", NULL);
+    assert(grpc_server_set_metrics_registry(server, metrics) == 0);
+    grpc_server_start(server);
+    const char *gauge = "grpc.server.concurrency_limit:/test.Shed/Slow";
+    assert(grpc_metrics_get(metrics, gauge)->value == 8);
+    
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    /* Calls that sit in the queue for a whole interval back the limit off */
+    const char *method = "/test.Shed/Slow";
+    double limit = 8;
+    for (int i = 0; i < 3; i++) {
+        grpc_call *call = NULL;
+        grpc_status_code status = GRPC_STATUS_UNKNOWN;
+        call = start_call(channel, NULL, 0, ccq, method, NULL, NULL, NULL, &status);
+        usleep(20000);
+        grpc_call *scall = NULL;
+        assert(grpc_server_request_registered_call(server, rm, &scall, NULL, scq, (void *)1) ==
+               GRPC_CALL_OK);
+        assert(next_event(scq).tag == (void *)1);
+        assert(grpc_metrics_get(metrics, gauge)->value < limit);
+        limit = grpc_metrics_get(metrics, gauge)->value;
+        grpc_call_destroy(scall);
+        assert(next_event(ccq).tag == (void *)&status);
+        grpc_call_destroy(call);
+    }
+    
+    /* Prompt pickup of a busy method grows it again */
+    usleep(20000);
+    grpc_call *scalls[4];
+    for (int i = 0; i < 4; i++) {
+        assert(grpc_server_request_registered_call(server, rm, &scalls[i], NULL, scq, (void *)2) ==
+               GRPC_CALL_OK);
+    }
+    grpc_call *calls[4];
+    grpc_status_code statuses[4];
+    for (int i = 0; i < 4; i++) {
+        calls[i] = start_call(channel, NULL, 0, ccq, method, NULL, NULL, NULL, &statuses[i]);
+        assert(next_event(scq).tag == (void *)2);
+    }
+    usleep(20000);
+    grpc_call *probe = NULL;
+    grpc_status_code probe_status = GRPC_STATUS_UNKNOWN;
+    probe = start_call(channel, NULL, 0, ccq, method, NULL, NULL, NULL, &probe_status);
+    assert(grpc_metrics_get(metrics, gauge)->value > limit);
+    
+    grpc_call_destroy(probe);
+    for (int i = 0; i < 4; i++) {
+        grpc_call_destroy(scalls[i]);
+        grpc_call_destroy(calls[i]);
+    }
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_metrics_registry_destroy(metrics);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Tenant Scheduling Tests
+ * ======================================================================== */
+
+/* Take the next waiting call and report which tenant's method it was */
+static grpc_call *take_tenant_call(grpc_server *server, grpc_completion_queue *cq, char *tenant) {
+    grpc_call *call = NULL;
+    grpc_call_details details;
+    grpc_call_details_init(&details);
+    assert(grpc_server_request_call(server, &call, &details, cq, (void *)1) == GRPC_CALL_OK);
+    grpc_event ev = next_event(cq);
+    assert(ev.success && ev.tag == (void *)1);
+    *tenant = details.method[strlen("/tenant.")];
+    grpc_call_details_destroy(&details);
+    return call;
+}
+
+void test_tenants_share_by_weight(void) {
+    TEST_START("test_tenants_share_by_weight");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(grpc_server_set_tenant_key(server, "x-tenant", 0) == 0);
+    assert(grpc_server_set_tenant_weight(server, "a", 3) == 0);
+    assert(grpc_server_set_tenant_weight(server, "b", 0) == -1);
+    grpc_server_start(server);
+    assert(grpc_server_set_tenant_weight(server, "b", 2) == -1);
+    
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    /* Tenant b floods the queue before tenant a shows up */
+    grpc_metadata tenant_a = {"x-tenant", "a", 1};
+    grpc_metadata tenant_b = {"x-tenant", "b", 1};
+    grpc_call *calls[16];
+    grpc_status_code statuses[16];
+    for (int i = 0; i < 8; i++) {
+        calls[i] = start_call(channel, NULL, 0, ccq, "/tenant.b/Call", &tenant_b, NULL, NULL, &statuses[i]);
+    }
+    for (int i = 8; i < 16; i++) {
+        calls[i] = start_call(channel, NULL, 0, ccq, "/tenant.a/Call", &tenant_a, NULL, NULL, &statuses[i]);
+    }
+    
+    /* Backlogged tenants are served 3:1, not in arrival order */
+    grpc_call *scalls[16];
+    int served_a = 0;
+    for (int i = 0; i < 8; i++) {
+        char tenant;
+        scalls[i] = take_tenant_call(server, scq, &tenant);
+        served_a += tenant == 'a';
+    }
+    assert(served_a == 6);
+    
+    /* a's last two go out within the next turn; then only b is left */
+    for (int i = 8; i < 16; i++) {
+        char tenant;
+        scalls[i] = take_tenant_call(server, scq, &tenant);
+        served_a += tenant == 'a';
+        assert(i < 11 || tenant == 'b');
+    }
+    assert(served_a == 8);
+    
+    for (int i = 0; i < 16; i++) {
+        grpc_call_destroy(scalls[i]);
+        grpc_call_destroy(calls[i]);
+    }
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+void test_tenant_inflight_bound(void) {
+    TEST_START("test_tenant_inflight_bound");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(grpc_server_set_tenant_key(server, "x-tenant", 1) == 0);
+    grpc_server_start(server);
+    
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    grpc_metadata tenant_a = {"x-tenant", "a", 1};
+    grpc_metadata tenant_b = {"x-tenant", "b", 1};
+    grpc_call *calls[3];
+    grpc_status_code statuses[3];
+    calls[0] = start_call(channel, NULL, 0, ccq, "/tenant.a/Call", &tenant_a, NULL, NULL, &statuses[0]);
+    calls[1] = start_call(channel, NULL, 0, ccq, "/tenant.a/Call", &tenant_a, NULL, NULL, &statuses[1]);
+    calls[2] = start_call(channel, NULL, 0, ccq, "/tenant.b/Call", &tenant_b, NULL, NULL, &statuses[2]);
+    
+    /* a holds its one call, so b goes next even though a queued first */
+    char tenant;
+    grpc_call *first = take_tenant_call(server, scq, &tenant);
+    assert(tenant == 'a');
+    grpc_call *second = take_tenant_call(server, scq, &tenant);
+    assert(tenant == 'b');
+    
+    /* The next request waits until a finishes its call */
+    grpc_call *third = NULL;
+    grpc_call_details details;
+    grpc_call_details_init(&details);
+    assert(grpc_server_request_call(server, &third, &details, scq, (void *)2) == GRPC_CALL_OK);
+    grpc_event ev = grpc_completion_queue_next(scq, grpc_timeout_milliseconds_to_deadline(50));
+    assert(ev.tag == NULL);
+    grpc_call_destroy(first);
+    ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)2);
+    assert(strcmp(details.method, "/tenant.a/Call") == 0);
+    
+    grpc_call_details_destroy(&details);
+    grpc_call_destroy(third);
+    grpc_call_destroy(second);
+    for (int i = 0; i < 3; i++) {
+        grpc_call_destroy(calls[i]);
+    }
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Listener Handoff Tests
+ * ======================================================================== */
+
+void test_server_listener_handoff(void) {
+    TEST_START("test_server_listener_handoff");
+    
+    char target[64];
+    snprintf(target, sizeof(target), "unix:/tmp/grpc_c_handoff_%d.sock", (int)getpid());
+    const char *path = target + strlen("unix:");
+    
+    grpc_server *old_server = grpc_server_create(NULL);
+    assert(grpc_server_add_insecure_http2_port(old_server, "127.0.0.1:50075") == 50075);
+    assert(grpc_server_add_insecure_http2_port(old_server, target) == 1);
+    grpc_server_start(old_server);
+    
+    int pair[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+    assert(grpc_server_export_listeners(old_server, pair[0]) == 0);
+    
+    /* The new server is serving before the old one stops */
+    grpc_server *new_server = grpc_server_create_from_listeners(NULL, pair[1]);
+    assert(new_server != NULL && new_server->ports_count == 2);
+    for (size_t i = 0; i < new_server->ports_count; i++) {
+        assert(fcntl(new_server->ports[i].socket_fd, F_GETFD) & FD_CLOEXEC);
+    }
+    void *echo = grpc_server_register_method(new_server, "/pkg.Svc/Echo", NULL);
+    grpc_server_start(new_server);
+    grpc_server_shutdown_and_notify(old_server, NULL, NULL);
+    grpc_server_destroy(old_server);
+    
+    /* The socket file outlives the old server */
+    assert(access(path, F_OK) == 0);
+    int unix_client = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un un;
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strcpy(un.sun_path, path);
+    assert(connect(unix_client, (struct sockaddr *)&un, sizeof(un)) == 0);
+    close(unix_client);
+    
+    /* The TCP port was never closed and now reaches the new server */
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    http2_connection *client = http2_connection_create("127.0.0.1:50075", true, NULL);
+    assert(http2_connection_connect(client, "127.0.0.1:50075") == 0);
+    assert(http2_connection_send_preface(client) == 0);
+    assert(http2_connection_send_settings(client) == 0);
+    send_request_headers(client, 1, "/pkg.Svc/Echo");
+    
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_registered_call(new_server, echo, &scall, NULL, scq, (void *)1) ==
+           GRPC_CALL_OK);
+    grpc_event ev = next_event(scq);
+    assert(ev.success && ev.tag == (void *)1);
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_SEND_STATUS_FROM_SERVER;
+    op.data.send_status_from_server.status = GRPC_STATUS_OK;
+    assert(grpc_call_start_batch(scall, &op, 1, (void *)2) == GRPC_CALL_OK);
+    assert(next_event(scq).tag == (void *)2);
+    http2_stream *stream = read_response(client, 1, NULL, NULL);
+    assert(strcmp(find_metadata(&stream->initial_metadata, "grpc-status"), "0") == 0);
+    
+    /* Nothing to adopt from a peer that sends no sockets */
+    assert(write(pair[0], "junk0000", 8) == 8);
+    assert(grpc_server_create_from_listeners(NULL, pair[1]) == NULL);
+    
+    grpc_call_destroy(scall);
+    grpc_server_shutdown_and_notify(new_server, NULL, NULL);
+    grpc_server_destroy(new_server);
+    assert(access(path, F_OK) != 0);
+    http2_connection_destroy(client);
+    close(pair[0]);
+    close(pair[1]);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Accept Tests
+ * ======================================================================== */
+
+void test_server_accepts_connection_burst(void) {
+    TEST_START("test_server_accepts_connection_burst");
+    
+    grpc_arg arg_values[1];
+    arg_values[0].key = GRPC_ARG_SERVER_LISTEN_BACKLOG;
+    arg_values[0].value.integer = 512;
+    arg_values[0].is_string = false;
+    grpc_channel_args args = {1, arg_values};
+    
+    grpc_server *server = grpc_server_create(&args);
+    assert(server->listen_backlog == 512);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50076") == 50076);
+    assert(fcntl(server->ports[0].socket_fd, F_GETFL) & O_NONBLOCK);
+    
+    /* A reconnect storm queues up before the server starts accepting */
+    enum { BURST = 64 };
+    int clients[BURST];
+    for (int i = 0; i < BURST; i++) {
+        clients[i] = connect_loopback(50076);
+        assert(clients[i] >= 0);
+    }
+    grpc_server_start(server);
+    
+    size_t accepted = 0;
+    for (int waited = 0; waited < 200 && accepted < BURST; waited++) {
+        usleep(10000);
+        pthread_mutex_lock(&server->mutex);
+        accepted = server->connection_count;
+        pthread_mutex_unlock(&server->mutex);
+    }
+    assert(accepted == BURST);
+    
+    /* Connections are blocking for their reader, and not inherited by exec */
+    pthread_mutex_lock(&server->mutex);
+    for (server_connection *sc = server->connections; sc; sc = sc->next) {
+        assert(fcntl(sc->conn->socket_fd, F_GETFD) & FD_CLOEXEC);
+        assert(!(fcntl(sc->conn->socket_fd, F_GETFL) & O_NONBLOCK));
+    }
+    pthread_mutex_unlock(&server->mutex);
+    
+    for (int i = 0; i < BURST; i++) {
+        close(clients[i]);
+    }
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * CPU Affinity Tests
+ * ======================================================================== */
+
+typedef struct {
+    int cpus[16];
+    int count;
+    pthread_mutex_t mutex;
+} cpu_record;
+
+static void record_cpu(void *arg) {
+    cpu_record *record = (cpu_record *)arg;
+    pthread_mutex_lock(&record->mutex);
+    record->cpus[record->count++] = sched_getcpu();
+    pthread_mutex_unlock(&record->mutex);
+}
+
+void test_executor_pinned_to_node(void) {
+    TEST_START("test_executor_pinned_to_node");
+    
+    int nodes = grpc_numa_node_count();
+    assert(nodes >= 1);
+    int cpus[1024];
+    int count = grpc_numa_node_cpus(0, cpus, 1024);
+    assert(count >= 1 && count <= 1024);
+    assert(grpc_numa_node_cpus(-1, cpus, 1024) == -1);
+    
+    int bad = -1;
+    assert(grpc_executor_create_pinned(2, cpus, 0) == NULL);
+    assert(grpc_executor_create_pinned(2, &bad, 1) == NULL);
+    
+    /* Every task runs on the one CPU the pool is pinned to */
+    int cpu = cpus[count - 1];
+    grpc_executor *executor = grpc_executor_create_pinned(2, &cpu, 1);
+    assert(executor != NULL && grpc_executor_thread_count(executor) == 2);
+    cpu_record record;
+    memset(&record, 0, sizeof(record));
+    pthread_mutex_init(&record.mutex, NULL);
+    for (int i = 0; i < 16; i++) {
+        assert(grpc_executor_run(executor, record_cpu, &record) == 0);
+    }
+    grpc_executor_destroy(executor);
+    assert(record.count == 16);
+    for (int i = 0; i < 16; i++) {
+        assert(record.cpus[i] == cpu);
+    }
+    pthread_mutex_destroy(&record.mutex);
+    TEST_PASS();
+}
+
+static bool thread_pinned_to(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    return pthread_getaffinity_np(thread, sizeof(set), &set) == 0 && CPU_COUNT(&set) == 1 &&
+           CPU_ISSET(cpu, &set);
+}
+
+void test_server_threads_pinned(void) {
+    TEST_START("test_server_threads_pinned");
+    
+    int cpus[1024];
+    int count = grpc_numa_node_cpus(0, cpus, 1024);
+    int cpu = cpus[count - 1];
+    
+    grpc_arg arg_values[1];
+    arg_values[0].key = GRPC_ARG_SERVER_NUMA_LOCAL_CONNECTIONS;
+    arg_values[0].value.integer = 1;
+    arg_values[0].is_string = false;
+    grpc_channel_args args = {1, arg_values};
+    
+    grpc_server *server = grpc_server_create(&args);
+    int bad = CPU_SETSIZE;
+    assert(grpc_server_set_cpu_affinity(server, &bad, 1) == -1);
+    assert(grpc_server_set_cpu_affinity(server, &cpu, 1) == 0);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50077") == 50077);
+    grpc_server_start(server);
+    assert(grpc_server_set_cpu_affinity(server, NULL, 0) == -1);
+    assert(thread_pinned_to(server->worker_threads[0], cpu));
+    
+    /* The reader stays in the server's set on the connection's node */
+    int client = connect_loopback(50077);
+    assert(client >= 0);
+    server_connection *sc = NULL;
+    for (int waited = 0; waited < 200 && !sc; waited++) {
+        usleep(10000);
+        pthread_mutex_lock(&server->mutex);
+        sc = server->connections;
+        pthread_mutex_unlock(&server->mutex);
+    }
+    assert(sc != NULL);
+    assert(thread_pinned_to(sc->reader, cpu));
+    
+    close(client);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Response Cache Tests
+ * ======================================================================== */
+
+static grpc_byte_buffer *cache_buffer(const char *text, size_t len) {
+    uint8_t data[1024];
+    memset(data, 'x', sizeof(data));
+    memcpy(data, text, strlen(text));
+    return grpc_byte_buffer_create(data, len);
+}
+
+static bool cache_lookup_hits(grpc_response_cache *cache, grpc_byte_buffer *request) {
+    grpc_byte_buffer *response = grpc_response_cache_lookup(cache, request);
+    if (!response) {
+        return false;
+    }
+    grpc_byte_buffer_destroy(response);
+    return true;
+}
+
+void test_response_cache_evicts_by_frequency(void) {
+    TEST_START("test_response_cache_evicts_by_frequency");
+    
+    /* Room for three of these entries, not four */
+    grpc_response_cache *cache = grpc_response_cache_create(900, 60000);
+    assert(cache != NULL);
+    grpc_byte_buffer *keys[4];
+    grpc_byte_buffer *values[4];
+    for (int i = 0; i < 4; i++) {
+        char name[8];
+        snprintf(name, sizeof(name), "key%d", i);
+        keys[i] = cache_buffer(name, 8);
+        snprintf(name, sizeof(name), "val%d", i);
+        values[i] = cache_buffer(name, 200);
+    }
+    
+    for (int i = 0; i < 3; i++) {
+        assert(!cache_lookup_hits(cache, keys[i]));
+        assert(grpc_response_cache_insert(cache, keys[i], values[i]) == 0);
+    }
+    assert(grpc_response_cache_size(cache) == 3);
+    grpc_byte_buffer *hit = grpc_response_cache_lookup(cache, keys[0]);
+    assert(hit && hit->length == 200 && memcmp(hit->data, "val0", 4) == 0);
+    grpc_byte_buffer_destroy(hit);
+    
+    /* A request seen once does not displace one seen as often */
+    assert(!cache_lookup_hits(cache, keys[3]));
+    assert(grpc_response_cache_insert(cache, keys[3], values[3]) == -1);
+    assert(grpc_response_cache_size(cache) == 3);
+    
+    /* Seen twice, it replaces the least recently used entry */
+    assert(!cache_lookup_hits(cache, keys[3]));
+    assert(grpc_response_cache_insert(cache, keys[3], values[3]) == 0);
+    assert(grpc_response_cache_size(cache) == 3);
+    assert(!cache_lookup_hits(cache, keys[1]));
+    assert(cache_lookup_hits(cache, keys[0]));
+    assert(cache_lookup_hits(cache, keys[2]));
+    assert(cache_lookup_hits(cache, keys[3]));
+    
+    /* Entries larger than the whole cache are refused */
+    grpc_byte_buffer *huge = cache_buffer("huge", 1000);
+    assert(grpc_response_cache_insert(cache, keys[1], huge) == -1);
+    grpc_byte_buffer_destroy(huge);
+    grpc_response_cache_destroy(cache);
+    
+    /* Entries expire */
+    cache = grpc_response_cache_create(900, 20);
+    assert(grpc_response_cache_insert(cache, keys[0], values[0]) == 0);
+    assert(cache_lookup_hits(cache, keys[0]));
+    usleep(40000);
+    assert(!cache_lookup_hits(cache, keys[0]));
+    assert(grpc_response_cache_size(cache) == 0);
+    grpc_response_cache_destroy(cache);
+    
+    for (int i = 0; i < 4; i++) {
+        grpc_byte_buffer_destroy(keys[i]);
+        grpc_byte_buffer_destroy(values[i]);
+    }
+    TEST_PASS();
+}
+
+/* Answer the next call to rm with the request echoed after a prefix */
+static void serve_unary_call(grpc_server *server, void *rm, grpc_completion_queue *cq,
+                             grpc_status_code code) {
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_registered_call(server, rm, &scall, NULL, cq, (void *)1) == GRPC_CALL_OK);
+    assert(next_event(cq).tag == (void *)1);
+    
+    grpc_byte_buffer *request = NULL;
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_RECV_MESSAGE;
+    op.data.recv_message.recv_message = &request;
+    assert(grpc_call_start_batch(scall, &op, 1, (void *)2) == GRPC_CALL_OK);
+    assert(next_event(cq).tag == (void *)2);
+    
+    char text[64];
+    int len = snprintf(text, sizeof(text), "re:%.*s", (int)request->length, (const char *)request->data);
+    grpc_byte_buffer *reply = grpc_byte_buffer_create((const uint8_t *)text, (size_t)len);
+    int cancelled = -1;
+    grpc_op ops[4];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[1].op = GRPC_OP_SEND_MESSAGE;
+    ops[1].data.send_message.send_message = reply;
+    ops[2].op = GRPC_OP_SEND_STATUS_FROM_SERVER;
+    ops[2].data.send_status_from_server.status = code;
+    ops[3].op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    ops[3].data.recv_close_on_server.cancelled = &cancelled;
+    assert(grpc_call_start_batch(scall, ops, 4, (void *)3) == GRPC_CALL_OK);
+    assert(next_event(cq).tag == (void *)3);
+    
+    grpc_byte_buffer_destroy(request);
+    grpc_byte_buffer_destroy(reply);
+    grpc_call_destroy(scall);
+}
+
+static void finish_unary_call(grpc_call *call, grpc_completion_queue *cq, grpc_byte_buffer **response,
+                              grpc_status_code *status, grpc_status_code expected, const char *text) {
+    grpc_event ev = next_event(cq);
+    assert(ev.success && ev.tag == (void *)status);
+    assert(*status == expected);
+    grpc_byte_buffer *message = *response;
+    assert(message && message->length == strlen(text) && memcmp(message->data, text, message->length) == 0);
+    grpc_byte_buffer_destroy(message);
+    *response = NULL;
+    grpc_call_destroy(call);
+}
+
+void test_server_answers_from_method_cache(void) {
+    TEST_START("test_server_answers_from_method_cache");
+    
+    grpc_metrics_registry *metrics = grpc_metrics_registry_create();
+    grpc_server *server = grpc_server_create(NULL);
+    void *rm = grpc_server_register_method(server, "/test.Cache/Get", NULL);
+    assert(grpc_server_set_method_cache(server, rm, 0, 4096) == -1);
+    assert(grpc_server_set_method_cache(server, rm, 60000, 4096) == 0);
+    assert(grpc_server_set_metrics_registry(server, metrics) == 0);
+    grpc_server_start(server);
+    assert(grpc_server_set_method_cache(server, rm, 60000, 4096) == -1);
+    
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    const char *method = "/test.Cache/Get";
+    grpc_byte_buffer *response = NULL;
+    grpc_status_code status = GRPC_STATUS_UNKNOWN;
+    
+    /* The first call runs the handler, which fills the cache */
+    grpc_call *call = start_call(channel, NULL, 0, ccq, method, NULL, "a", &response, &status);
+    serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+    finish_unary_call(call, ccq, &response, &status, GRPC_STATUS_OK, "re:a");
+    assert(grpc_metrics_get(metrics, "grpc.server.cache_misses")->value == 1);
+    
+    /* The same request is answered without the application */
+    call = start_call(channel, NULL, 0, ccq, method, NULL, "a", &response, &status);
+    finish_unary_call(call, ccq, &response, &status, GRPC_STATUS_OK, "re:a");
+    assert(grpc_metrics_get(metrics, "grpc.server.cache_hits")->value == 1);
+    
+    /* Failed responses are not stored */
+    for (int i = 0; i < 2; i++) {
+        call = start_call(channel, NULL, 0, ccq, method, NULL, "b", &response, &status);
+        serve_unary_call(server, rm, scq, GRPC_STATUS_NOT_FOUND);
+        finish_unary_call(call, ccq, &response, &status, GRPC_STATUS_NOT_FOUND, "re:b");
+    }
+    assert(grpc_metrics_get(metrics, "grpc.server.cache_misses")->value == 3);
+    assert(grpc_metrics_get(metrics, "grpc.server.cache_hits")->value == 1);
+    
+    /* A call still waiting for its request goes away with the server */
+    grpc_call *waiting = grpc_channel_create_call(channel, NULL, 0, ccq, method, NULL,
+                                                  grpc_timeout_milliseconds_to_deadline(5000));
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_SEND_INITIAL_METADATA;
+    assert(grpc_call_start_batch(waiting, &op, 1, (void *)4) == GRPC_CALL_OK);
+    assert(next_event(ccq).tag == (void *)4);
+    
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_call_destroy(waiting);
+    grpc_metrics_registry_destroy(metrics);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+void test_http2_answers_from_method_cache(void) {
+    TEST_START("test_http2_answers_from_method_cache");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    void *rm = grpc_server_register_method(server, "/test.Cache/Get", NULL);
+    assert(grpc_server_set_method_cache(server, rm, 60000, 4096) == 0);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50078") == 50078);
+    grpc_server_start(server);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    
+    http2_connection *client = http2_connection_create("127.0.0.1:50078", true, NULL);
+    assert(http2_connection_connect(client, "127.0.0.1:50078") == 0);
+    assert(http2_connection_send_preface(client) == 0);
+    assert(http2_connection_send_settings(client) == 0);
+    
+    uint8_t message[5 + 4] = {0, 0, 0, 0, 4, 'p', 'i', 'n', 'g'};
+    http2_frame_header data_header = {sizeof(message), HTTP2_FRAME_DATA, 0x01, 1}; /* END_STREAM */
+    uint8_t data[64];
+    size_t data_len = 0;
+    
+    /* Answered by the application on the first call, from the cache on the second */
+    for (uint32_t stream_id = 1; stream_id <= 3; stream_id += 2) {
+        send_request_headers(client, stream_id, "/test.Cache/Get");
+        data_header.stream_id = stream_id;
+        assert(http2_connection_send_frame(client, &data_header, message) == 0);
+        if (stream_id == 1) {
+            serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+        }
+        http2_stream *stream = read_response(client, stream_id, data, &data_len);
+        assert(strcmp(find_metadata(&stream->initial_metadata, ":status"), "200") == 0);
+        assert(data_len == 12 && data[4] == 7 && memcmp(data + 5, "re:ping", 7) == 0);
+        assert(strcmp(find_metadata(&stream->trailing_metadata, "grpc-status"), "0") == 0);
+    }
+    
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    http2_connection_destroy(client);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Request Coalescing Tests
+ * ======================================================================== */
+
+/* Wait until count calls to a method wait behind another one */
+static void wait_flight_waiters(grpc_server *server, void *rm, size_t count) {
+    size_t waiting = 0;
+    for (int i = 0; i < 200; i++) {
+        waiting = 0;
+        server_registered_method *method = (server_registered_method *)rm;
+        pthread_mutex_lock(&server->mutex);
+        for (size_t b = 0; method->flights && b <= method->flight_mask; b++) {
+            for (server_flight *flight = method->flights[b]; flight; flight = flight->next) {
+                for (server_pending_call *waiter = flight->waiters; waiter; waiter = waiter->next) {
+                    waiting++;
+                }
+            }
+        }
+        pthread_mutex_unlock(&server->mutex);
+        if (waiting >= count) {
+            break;
+        }
+        usleep(5000);
+    }
+    assert(waiting == count);
+}
+
+void test_server_coalesces_identical_calls(void) {
+    TEST_START("test_server_coalesces_identical_calls");
+    
+    grpc_metrics_registry *metrics = grpc_metrics_registry_create();
+    grpc_server *server = grpc_server_create(NULL);
+    void *rm = grpc_server_register_method(server, "/test.Coalesce/Get", NULL);
+    assert(grpc_server_set_method_coalescing(server, NULL, 1) == -1);
+    assert(grpc_server_set_method_coalescing(server, rm, 1) == 0);
+    assert(grpc_server_set_metrics_registry(server, metrics) == 0);
+    grpc_server_start(server);
+    assert(grpc_server_set_method_coalescing(server, rm, 0) == -1);
+    
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    const char *method = "/test.Coalesce/Get";
+    grpc_call *calls[3];
+    grpc_byte_buffer *responses[3] = {NULL, NULL, NULL};
+    grpc_status_code statuses[3];
+    
+    /* Three identical calls, one handler run */
+    for (int i = 0; i < 3; i++) {
+        statuses[i] = GRPC_STATUS_UNKNOWN;
+        calls[i] = start_call(channel, NULL, 0, ccq, method, NULL, "x", &responses[i], &statuses[i]);
+    }
+    wait_flight_waiters(server, rm, 2);
+    assert(grpc_metrics_get(metrics, "grpc.server.calls_coalesced")->value == 2);
+    serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+    for (int i = 0; i < 3; i++) {
+        grpc_event ev = next_event(ccq);
+        assert(ev.success);
+    }
+    for (int i = 0; i < 3; i++) {
+        assert(statuses[i] == GRPC_STATUS_OK);
+        assert(responses[i] && responses[i]->length == 4 && memcmp(responses[i]->data, "re:x", 4) == 0);
+        grpc_byte_buffer_destroy(responses[i]);
+        responses[i] = NULL;
+        grpc_call_destroy(calls[i]);
+    }
+    
+    /* A call whose leader goes away without a reply gets its own handler */
+    for (int i = 0; i < 2; i++) {
+        statuses[i] = GRPC_STATUS_UNKNOWN;
+        calls[i] = start_call(channel, NULL, 0, ccq, method, NULL, "z", &responses[i], &statuses[i]);
+    }
+    wait_flight_waiters(server, rm, 1);
+    assert(grpc_metrics_get(metrics, "grpc.server.calls_coalesced")->value == 3);
+    grpc_call *leader = NULL;
+    assert(grpc_server_request_registered_call(server, rm, &leader, NULL, scq, (void *)5) == GRPC_CALL_OK);
+    assert(next_event(scq).tag == (void *)5);
+    grpc_call_destroy(leader);
+    serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+    for (int i = 0; i < 2; i++) {
+        grpc_event ev = next_event(ccq);
+        assert(ev.success);
+    }
+    int answered = 0;
+    for (int i = 0; i < 2; i++) {
+        if (statuses[i] == GRPC_STATUS_OK) {
+            assert(responses[i] && memcmp(responses[i]->data, "re:z", 4) == 0);
+            answered++;
+        } else {
+            assert(statuses[i] == GRPC_STATUS_CANCELLED && !responses[i]);
+        }
+        grpc_byte_buffer_destroy(responses[i]);
+        grpc_call_destroy(calls[i]);
+    }
+    assert(answered == 1);
+    
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_metrics_registry_destroy(metrics);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Multi-Connection Channel Tests
+ * ======================================================================== */
+
+void test_channel_spreads_calls_over_connections(void) {
+    TEST_START("test_channel_spreads_calls_over_connections");
+    
+    grpc_arg arg_values[2];
+    arg_values[0].key = GRPC_ARG_CHANNEL_CONNECTIONS;
+    arg_values[0].value.integer = 3;
+    arg_values[0].is_string = false;
+    arg_values[1].key = GRPC_ARG_CHANNEL_MAX_CONNECTIONS;
+    arg_values[1].value.integer = 4;
+    arg_values[1].is_string = false;
+    grpc_channel_args args = {2, arg_values};
+    
+    grpc_channel *channel = grpc_insecure_channel_create("localhost:50051", &args);
+    grpc_completion_queue *cq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    assert(channel != NULL && cq != NULL);
+    assert(channel->subchannels[0].connection_count == 3 && channel->max_connections == 4);
+    grpc_timespec deadline = grpc_timeout_milliseconds_to_deadline(5000);
+    
+    /* Least outstanding streams: six calls land two per connection */
+    grpc_call *calls[8];
+    for (int i = 0; i < 6; i++) {
+        calls[i] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+        assert(calls[i] != NULL);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        assert(http2_connection_active_streams(channel->subchannels[0].connections[i].conn) == 2);
+    }
+    
+    /* A finished call frees a slot on its connection, which is picked next */
+    http2_connection *freed = calls[4]->stream->conn;
+    grpc_call_destroy(calls[4]);
+    calls[4] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(calls[4] != NULL && calls[4]->stream->conn == freed);
+    
+    /* Once every stream slot is taken the channel grows, up to its limit */
+    for (size_t i = 0; i < 3; i++) {
+        channel->subchannels[0].connections[i].conn->max_concurrent_streams = 2;
+    }
+    calls[6] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(calls[6] != NULL && channel->subchannels[0].connection_count == 4);
+    assert(calls[6]->stream->conn == channel->subchannels[0].connections[3].conn);
+    channel->subchannels[0].connections[3].conn->max_concurrent_streams = 1;
+    calls[7] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(calls[7] != NULL && calls[7]->stream == NULL);
+    
+    for (int i = 0; i < 8; i++) {
+        grpc_call_destroy(calls[i]);
+    }
+    grpc_channel_destroy(channel);
+    
+    /* Write lock contention grows a channel as well */
+    arg_values[0].value.integer = 1;
+    arg_values[1].value.integer = 2;
+    channel = grpc_insecure_channel_create("localhost:50051", &args);
+    assert(channel != NULL && channel->subchannels[0].connection_count == 1);
+    http2_connection *first = channel->subchannels[0].connections[0].conn;
+    first->write_locks = 256;
+    first->write_contended = 16;
+    calls[0] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(calls[0] != NULL && channel->subchannels[0].connection_count == 1);
+    first->write_locks = 512;
+    first->write_contended = 16 + 128;
+    calls[1] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(calls[1] != NULL && channel->subchannels[0].connection_count == 2);
+    assert(calls[1]->stream->conn == channel->subchannels[0].connections[1].conn);
+    
+    grpc_call_destroy(calls[0]);
+    grpc_call_destroy(calls[1]);
+    grpc_channel_destroy(channel);
+    grpc_completion_queue_shutdown(cq);
+    grpc_completion_queue_destroy(cq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Subchannel Tests
+ * ======================================================================== */
+
+/* Index of the subchannel a call's stream belongs to, or -1 */
+static int call_subchannel(grpc_channel *channel, grpc_call *call) {
+    for (size_t i = 0; i < channel->subchannel_count; i++) {
+        for (size_t j = 0; j < channel->subchannels[i].connection_count; j++) {
+            if (call->stream->conn == channel->subchannels[i].connections[j].conn) {
+                return (int)i;
+            }
+        }
+    }
+    return -1;
+}
+
+void test_channel_balances_over_subchannels(void) {
+    TEST_START("test_channel_balances_over_subchannels");
+    
+    grpc_arg arg_values[1];
+    arg_values[0].key = GRPC_ARG_LB_POLICY_NAME;
+    arg_values[0].value.string = "round_robin";
+    arg_values[0].is_string = true;
+    grpc_channel_args args = {1, arg_values};
+    
+    grpc_channel *channel = grpc_insecure_channel_create(
+        "ipv4:127.0.0.1:50051,127.0.0.2:50051,127.0.0.1:50051,127.0.0.3:50051", &args);
+    grpc_completion_queue *cq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    assert(channel != NULL && cq != NULL);
+    assert(channel->subchannel_count == 3);
+    assert(strcmp(channel->subchannels[1].address, "127.0.0.2:50051") == 0);
+    grpc_timespec deadline = grpc_timeout_milliseconds_to_deadline(5000);
+    
+    /* Round robin gives each resolved address every third call */
+    grpc_call *calls[12];
+    int per_subchannel[3] = {0, 0, 0};
+    for (int i = 0; i < 6; i++) {
+        calls[i] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+        assert(calls[i] != NULL);
+        per_subchannel[call_subchannel(channel, calls[i])]++;
+    }
+    assert(per_subchannel[0] == 2 && per_subchannel[1] == 2 && per_subchannel[2] == 2);
+    
+    /* A subchannel whose connection closed is marked unavailable and skipped */
+    http2_connection_shutdown(channel->subchannels[1].connections[0].conn);
+    for (int i = 6; i < 9; i++) {
+        calls[i] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+        assert(calls[i] != NULL && call_subchannel(channel, calls[i]) != 1);
+    }
+    assert(!channel->subchannels[1].available && channel->unavailable_count == 1);
+    
+    /* After its rest it reconnects and takes calls again */
+    channel->subchannels[1].retry_at_ms = 0;
+    int revived = 0;
+    for (int i = 9; i < 12; i++) {
+        calls[i] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+        assert(calls[i] != NULL);
+        revived += call_subchannel(channel, calls[i]) == 1;
+    }
+    assert(revived == 1 && channel->subchannels[1].available && channel->unavailable_count == 0);
+    
+    for (int i = 0; i < 12; i++) {
+        grpc_call_destroy(calls[i]);
+    }
+    grpc_channel_destroy(channel);
+    
+    /* Pick first keeps every call on the first address */
+    channel = grpc_insecure_channel_create("ipv4:127.0.0.1:50051,127.0.0.2:50051", NULL);
+    assert(channel != NULL && channel->subchannel_count == 2);
+    for (int i = 0; i < 3; i++) {
+        calls[i] = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+        assert(calls[i] != NULL && call_subchannel(channel, calls[i]) == 0);
+    }
+    for (int i = 0; i < 3; i++) {
+        grpc_call_destroy(calls[i]);
+    }
+    grpc_channel_destroy(channel);
+    
+    arg_values[0].value.string = "no_such_policy";
+    assert(grpc_insecure_channel_create("localhost:50051", &args) == NULL);
+    
+    grpc_completion_queue_shutdown(cq);
+    grpc_completion_queue_destroy(cq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Hedging Tests
+ * ======================================================================== */
+
+/* Request the next call to rm without answering it */
+static grpc_call *accept_unary_call(grpc_server *server, void *rm, grpc_completion_queue *cq) {
+    grpc_call *scall = NULL;
+    assert(grpc_server_request_registered_call(server, rm, &scall, NULL, cq, (void *)1) == GRPC_CALL_OK);
+    assert(next_event(cq).tag == (void *)1);
+    return scall;
+}
+
+/* Answer the next call to rm with a status alone */
+static void fail_unary_call(grpc_server *server, void *rm, grpc_completion_queue *cq, grpc_status_code code) {
+    grpc_call *scall = accept_unary_call(server, rm, cq);
+    int cancelled = -1;
+    grpc_op ops[2];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_STATUS_FROM_SERVER;
+    ops[0].data.send_status_from_server.status = code;
+    ops[1].op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    ops[1].data.recv_close_on_server.cancelled = &cancelled;
+    assert(grpc_call_start_batch(scall, ops, 2, (void *)2) == GRPC_CALL_OK);
+    assert(next_event(cq).tag == (void *)2);
+    grpc_call_destroy(scall);
+}
+
+void test_channel_hedges_slow_calls(void) {
+    TEST_START("test_channel_hedges_slow_calls");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    void *rm = grpc_server_register_method(server, "/test.Hedge/Get", NULL);
+    grpc_server_start(server);
+    grpc_arg arg_values[2];
+    arg_values[0].key = GRPC_ARG_RETRY_BUDGET_PERCENT;
+    arg_values[0].value.integer = 0;
+    arg_values[0].is_string = false;
+    arg_values[1].key = GRPC_ARG_RETRY_BUDGET_MAX_TOKENS;
+    arg_values[1].value.integer = 2;
+    arg_values[1].is_string = false;
+    grpc_channel_args args = {2, arg_values};
+    grpc_channel *channel = grpc_inproc_channel_create(server, &args);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    const char *method = "/test.Hedge/Get";
+    grpc_byte_buffer *response = NULL;
+    grpc_status_code status = GRPC_STATUS_UNKNOWN;
+    
+    grpc_hedging_policy policy = {0, 20, false, 1u << GRPC_STATUS_UNAVAILABLE};
+    assert(grpc_channel_set_method_hedging_policy(channel, method, &policy) == -1);
+    policy.max_attempts = 2;
+    assert(grpc_channel_set_method_hedging_policy(channel, method, &policy) == 0);
+    
+    /* The first attempt stalls; the hedge answers and the first is cancelled */
+    grpc_call *call = start_call(channel, NULL, 0, ccq, method, NULL, "x", &response, &status);
+    grpc_call *slow = accept_unary_call(server, rm, scq);
+    serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+    finish_unary_call(call, ccq, &response, &status, GRPC_STATUS_OK, "re:x");
+    int cancelled = -1;
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    op.data.recv_close_on_server.cancelled = &cancelled;
+    assert(grpc_call_start_batch(slow, &op, 1, (void *)4) == GRPC_CALL_OK);
+    assert(next_event(scq).tag == (void *)4);
+    assert(cancelled == 1);
+    grpc_call_destroy(slow);
+    
+    /* A non-fatal status starts the next attempt without waiting for the delay */
+    policy.hedging_delay_ms = 60000;
+    assert(grpc_channel_set_method_hedging_policy(channel, method, &policy) == 0);
+    call = start_call(channel, NULL, 0, ccq, method, NULL, "y", &response, &status);
+    fail_unary_call(server, rm, scq, GRPC_STATUS_UNAVAILABLE);
+    serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+    finish_unary_call(call, ccq, &response, &status, GRPC_STATUS_OK, "re:y");
+    
+    /* The budget is spent: the failure is the call's answer */
+    call = start_call(channel, NULL, 0, ccq, method, NULL, "z", &response, &status);
+    fail_unary_call(server, rm, scq, GRPC_STATUS_UNAVAILABLE);
+    grpc_event ev = next_event(ccq);
+    assert(ev.success && ev.tag == (void *)&status);
+    assert(status == GRPC_STATUS_UNAVAILABLE && response == NULL);
+    grpc_call_destroy(call);
+    
+    /* Without a policy calls make a single attempt */
+    assert(grpc_channel_set_method_hedging_policy(channel, method, NULL) == 0);
+    call = start_call(channel, NULL, 0, ccq, method, NULL, "w", &response, &status);
+    serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+    finish_unary_call(call, ccq, &response, &status, GRPC_STATUS_OK, "re:w");
+    
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Retry Tests
+ * ======================================================================== */
+
+void test_channel_retries_failed_calls(void) {
+    TEST_START("test_channel_retries_failed_calls");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    void *rm = grpc_server_register_method(server, "/test.Retry/Get", NULL);
+    grpc_arg arg_values[2];
+    arg_values[0].key = GRPC_ARG_RETRY_BUDGET_PERCENT;
+    arg_values[0].value.integer = 0;
+    arg_values[0].is_string = false;
+    arg_values[1].key = GRPC_ARG_RETRY_BUDGET_MAX_TOKENS;
+    arg_values[1].value.integer = 1;
+    arg_values[1].is_string = false;
+    grpc_channel_args args = {2, arg_values};
+    grpc_channel *channel = grpc_inproc_channel_create(server, &args);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    const char *method = "/test.Retry/Get";
+    grpc_byte_buffer *response = NULL;
+    grpc_status_code status = GRPC_STATUS_UNKNOWN;
+    
+    grpc_retry_policy policy = {1, 100, 100, 0.5, 1u << GRPC_STATUS_UNAVAILABLE};
+    assert(grpc_channel_set_method_retry_policy(channel, method, &policy) == -1);
+    policy.backoff_multiplier = 1.0;
+    assert(grpc_channel_set_method_retry_policy(channel, method, &policy) == 0);
+    
+    /* Refused by a server that is not serving yet: sent again without a retry or token */
+    grpc_call *call = start_call(channel, NULL, 0, ccq, method, NULL, "t", &response, &status);
+    grpc_server_start(server);
+    serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+    finish_unary_call(call, ccq, &response, &status, GRPC_STATUS_OK, "re:t");
+    assert(channel->retry_tokens == 1000);
+    
+    /* A retryable failure is retried after the backoff */
+    grpc_retry_policy retry = {3, 10, 50, 2.0, 1u << GRPC_STATUS_UNAVAILABLE};
+    assert(grpc_channel_set_method_retry_policy(channel, method, &retry) == 0);
+    call = start_call(channel, NULL, 0, ccq, method, NULL, "x", &response, &status);
+    fail_unary_call(server, rm, scq, GRPC_STATUS_UNAVAILABLE);
+    serve_unary_call(server, rm, scq, GRPC_STATUS_OK);
+    finish_unary_call(call, ccq, &response, &status, GRPC_STATUS_OK, "re:x");
+    assert(channel->retry_tokens == 0);
+    
+    /* Send buffers are dropped once a response starts to arrive */
+    grpc_byte_buffer *request = grpc_byte_buffer_create((const uint8_t *)"s", 1);
+    grpc_metadata_array initial;
+    grpc_metadata_array_init(&initial, 0);
+    call = grpc_channel_create_call(channel, NULL, 0, ccq, method, NULL,
+                                    grpc_timeout_milliseconds_to_deadline(5000));
+    grpc_op ops[3];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[1].op = GRPC_OP_SEND_MESSAGE;
+    ops[1].data.send_message.send_message = request;
+    ops[2].op = GRPC_OP_RECV_INITIAL_METADATA;
+    ops[2].data.recv_initial_metadata.recv_initial_metadata = &initial;
+    assert(grpc_call_start_batch(call, ops, 3, (void *)5) == GRPC_CALL_OK);
+    assert(request->refcount == 3); /* Ours, the buffered one and the server call's */
+    grpc_call *scall = accept_unary_call(server, rm, scq);
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_SEND_INITIAL_METADATA;
+    assert(grpc_call_start_batch(scall, &op, 1, (void *)6) == GRPC_CALL_OK);
+    assert(next_event(scq).tag == (void *)6);
+    assert(next_event(ccq).tag == (void *)5);
+    assert(request->refcount == 2);
+    grpc_call_destroy(call);
+    grpc_call_destroy(scall);
+    grpc_metadata_array_destroy(&initial);
+    grpc_byte_buffer_destroy(request);
+    
+    /* The budget is spent: the failure is the call's answer */
+    call = start_call(channel, NULL, 0, ccq, method, NULL, "y", &response, &status);
+    fail_unary_call(server, rm, scq, GRPC_STATUS_UNAVAILABLE);
+    grpc_event ev = next_event(ccq);
+    assert(ev.success && ev.tag == (void *)&status);
+    assert(status == GRPC_STATUS_UNAVAILABLE && response == NULL);
+    grpc_call_destroy(call);
+    
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Propagation Tests
+ * ======================================================================== */
+
+/* Wait for the calls whose tags are a and b to finish, in either order */
+static void wait_for_calls(grpc_completion_queue *cq, grpc_status_code *a, grpc_status_code *b) {
+    grpc_event first = next_event(cq);
+    grpc_event second = next_event(cq);
+    assert(first.success && second.success);
+    assert((first.tag == (void *)a && second.tag == (void *)b) ||
+           (first.tag == (void *)b && second.tag == (void *)a));
+}
+
+void test_child_calls_follow_parent(void) {
+    TEST_START("test_child_calls_follow_parent");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    void *front = grpc_server_register_method(server, "/test.Front/Get", NULL);
+    void *back = grpc_server_register_method(server, "/test.Back/Get", NULL);
+    grpc_server_start(server);
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_byte_buffer *response = NULL;
+    grpc_status_code status = GRPC_STATUS_UNKNOWN;
+    grpc_status_code child_status = GRPC_STATUS_UNKNOWN;
+    
+    /* The child takes the parent's deadline and is cancelled along with it */
+    grpc_call *call = start_call(channel, NULL, 0, ccq, "/test.Front/Get", NULL, "x", &response, &status);
+    grpc_call *parent = accept_unary_call(server, front, scq);
+    grpc_call *child = start_call(channel, parent, GRPC_PROPAGATE_DEFAULTS, ccq, "/test.Back/Get", NULL, NULL, NULL,
+                                  &child_status);
+    assert(child->deadline.tv_sec == parent->deadline.tv_sec && child->deadline.tv_nsec == parent->deadline.tv_nsec);
+    grpc_call *schild = accept_unary_call(server, back, scq);
+    assert(grpc_call_cancel(call) == GRPC_CALL_OK);
+    wait_for_calls(ccq, &status, &child_status);
+    assert(status == GRPC_STATUS_CANCELLED && child_status == GRPC_STATUS_CANCELLED);
+    int cancelled = -1;
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    op.data.recv_close_on_server.cancelled = &cancelled;
+    assert(grpc_call_start_batch(schild, &op, 1, (void *)4) == GRPC_CALL_OK);
+    assert(next_event(scq).tag == (void *)4);
+    assert(cancelled == 1);
+    grpc_call_destroy(schild);
+    grpc_call_destroy(child);
+    grpc_call_destroy(parent);
+    grpc_call_destroy(call);
+    
+    /* Without GRPC_PROPAGATE_CANCELLATION the child outlives its parent */
+    call = start_call(channel, NULL, 0, ccq, "/test.Front/Get", NULL, "y", &response, &status);
+    parent = accept_unary_call(server, front, scq);
+    child = start_call(channel, parent, GRPC_PROPAGATE_DEADLINE, ccq, "/test.Back/Get", NULL, NULL, NULL,
+                       &child_status);
+    assert(grpc_call_cancel(call) == GRPC_CALL_OK);
+    assert(next_event(ccq).tag == (void *)&status);
+    grpc_call_destroy(parent);
+    fail_unary_call(server, back, scq, GRPC_STATUS_OK);
+    assert(next_event(ccq).tag == (void *)&child_status);
+    assert(child_status == GRPC_STATUS_OK);
+    grpc_call_destroy(child);
+    grpc_call_destroy(call);
+    
+    /* The deadline expires the call, its parent on the server and the child */
+    call = grpc_channel_create_call(channel, NULL, 0, ccq, "/test.Front/Get", NULL,
+                                    grpc_timeout_milliseconds_to_deadline(100));
+    grpc_op ops[2];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_INITIAL_METADATA;
+    ops[1].op = GRPC_OP_RECV_STATUS_ON_CLIENT;
+    ops[1].data.recv_status_on_client.status = &status;
+    assert(grpc_call_start_batch(call, ops, 2, &status) == GRPC_CALL_OK);
+    parent = accept_unary_call(server, front, scq);
+    child = start_call(channel, parent, GRPC_PROPAGATE_DEFAULTS, ccq, "/test.Back/Get", NULL, NULL, NULL,
+                       &child_status);
+    wait_for_calls(ccq, &status, &child_status);
+    assert(status == GRPC_STATUS_DEADLINE_EXCEEDED && child_status == GRPC_STATUS_DEADLINE_EXCEEDED);
+    grpc_call_destroy(child);
+    grpc_call_destroy(parent);
+    grpc_call_destroy(call);
+    
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+void test_grpc_timeout_encoding(void) {
+    TEST_START("test_grpc_timeout_encoding");
+    
+    const struct {
+        int64_t ms;
+        const char *encoded;
+    } cases[] = {
+        {-5, "1n"}, {0, "1n"}, {1, "1m"}, {1234, "1240m"}, {5000, "5S"}, {5001, "5010m"},
+        {90000, "90S"}, {120000, "2M"}, {7200000, "2H"}, {123456789, "124000S"},
+    };
+    char buf[16];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        assert(http2_call_format_timeout(cases[i].ms, buf, sizeof(buf)) == 0);
+        assert(strcmp(buf, cases[i].encoded) == 0);
+    }
+    assert(http2_call_format_timeout(1234, buf, 5) == -1);
+    
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Micro-Batching Tests
+ * ======================================================================== */
+
+/* Answer the next batch call: echo the first `replies` requests in order,
+ * then end it with code. Returns the number of requests it carried. */
+static size_t serve_batch_call(grpc_server *server, void *rm, grpc_completion_queue *cq, size_t replies,
+                               grpc_status_code code) {
+    grpc_call *scall = accept_unary_call(server, rm, cq);
+    size_t count = 0;
+    for (;;) {
+        grpc_byte_buffer *request = NULL;
+        grpc_op op;
+        memset(&op, 0, sizeof(op));
+        op.op = GRPC_OP_RECV_MESSAGE;
+        op.data.recv_message.recv_message = &request;
+        assert(grpc_call_start_batch(scall, &op, 1, (void *)2) == GRPC_CALL_OK);
+        assert(next_event(cq).tag == (void *)2);
+        if (!request) {
+            break;
+        }
+        if (count++ < replies) {
+            char text[64];
+            int len = snprintf(text, sizeof(text), "re:%.*s", (int)request->length, (const char *)request->data);
+            grpc_byte_buffer *reply = grpc_byte_buffer_create((const uint8_t *)text, (size_t)len);
+            grpc_op ops[2];
+            memset(ops, 0, sizeof(ops));
+            size_t nops = 0;
+            if (count == 1) {
+                ops[nops++].op = GRPC_OP_SEND_INITIAL_METADATA;
+            }
+            ops[nops].op = GRPC_OP_SEND_MESSAGE;
+            ops[nops++].data.send_message.send_message = reply;
+            assert(grpc_call_start_batch(scall, ops, nops, (void *)3) == GRPC_CALL_OK);
+            assert(next_event(cq).tag == (void *)3);
+            grpc_byte_buffer_destroy(reply);
+        }
+        grpc_byte_buffer_destroy(request);
+    }
+    
+    int cancelled = -1;
+    grpc_op ops[2];
+    memset(ops, 0, sizeof(ops));
+    ops[0].op = GRPC_OP_SEND_STATUS_FROM_SERVER;
+    ops[0].data.send_status_from_server.status = code;
+    ops[1].op = GRPC_OP_RECV_CLOSE_ON_SERVER;
+    ops[1].data.recv_close_on_server.cancelled = &cancelled;
+    assert(grpc_call_start_batch(scall, ops, 2, (void *)4) == GRPC_CALL_OK);
+    assert(next_event(cq).tag == (void *)4);
+    grpc_call_destroy(scall);
+    return count;
+}
+
+/* Check a call started by start_call with a response and destroy it */
+static void check_unary_call(grpc_call *call, grpc_byte_buffer **response, grpc_status_code status,
+                             grpc_status_code expected, const char *text) {
+    assert(status == expected);
+    grpc_byte_buffer *message = *response;
+    if (text) {
+        assert(message && message->length == strlen(text) && memcmp(message->data, text, message->length) == 0);
+        grpc_byte_buffer_destroy(message);
+    } else {
+        assert(message == NULL);
+    }
+    *response = NULL;
+    grpc_call_destroy(call);
+}
+
+void test_channel_batches_small_calls(void) {
+    TEST_START("test_channel_batches_small_calls");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    void *single = grpc_server_register_method(server, "/test.Telemetry/Put", NULL);
+    void *batched = grpc_server_register_method(server, "/test.Telemetry/PutBatch", NULL);
+    grpc_server_start(server);
+    grpc_channel *channel = grpc_inproc_channel_create(server, NULL);
+    grpc_completion_queue *ccq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_completion_queue *scq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    const char *method = "/test.Telemetry/Put";
+    const char *batch_method = "/test.Telemetry/PutBatch";
+    grpc_call *calls[3];
+    grpc_byte_buffer *responses[3] = {NULL, NULL, NULL};
+    grpc_status_code statuses[3];
+    
+    grpc_batching_policy policy = {0, 0, 50};
+    assert(grpc_channel_set_method_batching_policy(channel, method, batch_method, &policy) == -1);
+    policy.max_calls = 3;
+    assert(grpc_channel_set_method_batching_policy(channel, method, NULL, &policy) == -1);
+    assert(grpc_channel_set_method_batching_policy(channel, method, batch_method, &policy) == 0);
+    
+    /* A full batch is sent at once as one call; each reply completes its own call */
+    calls[0] = start_call(channel, NULL, 0, ccq, method, NULL, "a", &responses[0], &statuses[0]);
+    calls[1] = start_call(channel, NULL, 0, ccq, method, NULL, "b", &responses[1], &statuses[1]);
+    calls[2] = start_call(channel, NULL, 0, ccq, method, NULL, "c", &responses[2], &statuses[2]);
+    assert(serve_batch_call(server, batched, scq, 3, GRPC_STATUS_OK) == 3);
+    for (int i = 0; i < 3; i++) {
+        assert(next_event(ccq).success);
+    }
+    check_unary_call(calls[0], &responses[0], statuses[0], GRPC_STATUS_OK, "re:a");
+    check_unary_call(calls[1], &responses[1], statuses[1], GRPC_STATUS_OK, "re:b");
+    check_unary_call(calls[2], &responses[2], statuses[2], GRPC_STATUS_OK, "re:c");
+    
+    /* Short of a full batch, calls wait out the window; a cancelled one is left out */
+    calls[0] = start_call(channel, NULL, 0, ccq, method, NULL, "d", &responses[0], &statuses[0]);
+    calls[1] = start_call(channel, NULL, 0, ccq, method, NULL, "e", &responses[1], &statuses[1]);
+    assert(grpc_call_cancel(calls[1]) == GRPC_CALL_OK);
+    assert(next_event(ccq).tag == (void *)&statuses[1]);
+    check_unary_call(calls[1], &responses[1], statuses[1], GRPC_STATUS_CANCELLED, NULL);
+    assert(serve_batch_call(server, batched, scq, 1, GRPC_STATUS_OK) == 1);
+    assert(next_event(ccq).tag == (void *)&statuses[0]);
+    check_unary_call(calls[0], &responses[0], statuses[0], GRPC_STATUS_OK, "re:d");
+    
+    /* The byte cap sends the batch; calls left without a reply fail */
+    grpc_batching_policy by_size = {10, 4, 60000};
+    assert(grpc_channel_set_method_batching_policy(channel, method, batch_method, &by_size) == 0);
+    calls[0] = start_call(channel, NULL, 0, ccq, method, NULL, "ff", &responses[0], &statuses[0]);
+    calls[1] = start_call(channel, NULL, 0, ccq, method, NULL, "gg", &responses[1], &statuses[1]);
+    assert(serve_batch_call(server, batched, scq, 1, GRPC_STATUS_OK) == 2);
+    for (int i = 0; i < 2; i++) {
+        assert(next_event(ccq).success);
+    }
+    check_unary_call(calls[0], &responses[0], statuses[0], GRPC_STATUS_OK, "re:ff");
+    check_unary_call(calls[1], &responses[1], statuses[1], GRPC_STATUS_INTERNAL, NULL);
+    
+    /* Without a policy calls go on their own */
+    assert(grpc_channel_set_method_batching_policy(channel, method, NULL, NULL) == 0);
+    calls[0] = start_call(channel, NULL, 0, ccq, method, NULL, "h", &responses[0], &statuses[0]);
+    serve_unary_call(server, single, scq, GRPC_STATUS_OK);
+    finish_unary_call(calls[0], ccq, &responses[0], &statuses[0], GRPC_STATUS_OK, "re:h");
+    
+    grpc_channel_destroy(channel);
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(ccq);
+    grpc_completion_queue_destroy(ccq);
+    grpc_completion_queue_shutdown(scq);
+    grpc_completion_queue_destroy(scq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Pre-warming Tests
+ * ======================================================================== */
+
+/* Start a batch on a call without a call transport */
+static void start_empty_batch(grpc_call *call, uint32_t flags, void *tag) {
+    grpc_op op;
+    memset(&op, 0, sizeof(op));
+    op.op = GRPC_OP_SEND_INITIAL_METADATA;
+    op.flags = flags;
+    assert(grpc_call_start_batch(call, &op, 1, tag) == GRPC_CALL_OK);
+}
+
+void test_channel_prewarm_and_wait_for_ready(void) {
+    TEST_START("test_channel_prewarm_and_wait_for_ready");
+    
+    grpc_server *server = grpc_server_create(NULL);
+    assert(grpc_server_add_insecure_http2_port(server, "127.0.0.1:50079") == 50079);
+    grpc_server_start(server);
+    grpc_completion_queue *cq = grpc_completion_queue_create(GRPC_CQ_NEXT);
+    grpc_timespec deadline = grpc_timeout_milliseconds_to_deadline(5000);
+    
+    /* The warm-up connects and exchanges SETTINGS before any call */
+    grpc_channel *channel = grpc_insecure_channel_create("127.0.0.1:50079", NULL);
+    assert(channel != NULL && channel->subchannel_count == 1);
+    http2_connection *conn = channel->subchannels[0].connections[0].conn;
+    assert(grpc_channel_prewarm(channel, 0, cq, (void *)1) == 0);
+    grpc_event ev = next_event(cq);
+    assert(ev.success && ev.tag == (void *)1);
+    assert(conn->socket_fd >= 0 && conn->peer_max_header_list_size != UINT32_MAX);
+    grpc_call *call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(call != NULL && call->stream != NULL && call->stream->conn == conn);
+    start_empty_batch(call, GRPC_INITIAL_METADATA_WAIT_FOR_READY, (void *)2);
+    ev = next_event(cq);
+    assert(ev.success && ev.tag == (void *)2 && call->stream->conn == conn);
+    grpc_call_destroy(call);
+    
+    /* Connected backends are ready right away */
+    assert(grpc_channel_prewarm(channel, 1, cq, (void *)3) == 0);
+    ev = next_event(cq);
+    assert(ev.success && ev.tag == (void *)3);
+    grpc_channel_destroy(channel);
+    
+    /* Without a server the warm-up fails; a wait-for-ready call is queued
+     * until the backend is tried again */
+    channel = grpc_insecure_channel_create("127.0.0.1:50080", NULL);
+    assert(channel != NULL);
+    assert(grpc_channel_prewarm(channel, 0, cq, (void *)4) == 0);
+    call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(call != NULL);
+    start_empty_batch(call, GRPC_INITIAL_METADATA_WAIT_FOR_READY, (void *)5);
+    ev = next_event(cq);
+    assert(!ev.success && ev.tag == (void *)4);
+    
+    /* Without the flag the call fails instead */
+    grpc_call *unsent = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(unsent != NULL && unsent->stream == NULL);
+    start_empty_batch(unsent, 0, (void *)8);
+    ev = next_event(cq);
+    assert(!ev.success && ev.tag == (void *)8 && unsent->status == GRPC_STATUS_UNAVAILABLE);
+    grpc_call_destroy(unsent);
+    ev = grpc_completion_queue_next(cq, grpc_timeout_milliseconds_to_deadline(3000));
+    assert(ev.success && ev.tag == (void *)5);
+    pthread_mutex_lock(&call->mutex);
+    assert(call->stream != NULL);
+    pthread_mutex_unlock(&call->mutex);
+    grpc_call_destroy(call);
+    
+    /* Calls that go without waiting are unaffected by a connecting backend;
+     * waiting ones fail at their deadline */
+    channel->subchannels[0].connecting = true;
+    call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    assert(call != NULL && call->stream != NULL);
+    grpc_call_destroy(call);
+    call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL,
+                                    grpc_timeout_milliseconds_to_deadline(100));
+    assert(call != NULL);
+    start_empty_batch(call, GRPC_INITIAL_METADATA_WAIT_FOR_READY, (void *)6);
+    pthread_mutex_lock(&call->mutex);
+    assert(call->stream == NULL);
+    pthread_mutex_unlock(&call->mutex);
+    ev = next_event(cq);
+    assert(!ev.success && ev.tag == (void *)6 && call->status == GRPC_STATUS_DEADLINE_EXCEEDED);
+    grpc_call_destroy(call);
+    
+    /* Destroying a waiting call fails the batches it held */
+    call = grpc_channel_create_call(channel, NULL, 0, cq, "/test.Service/A", NULL, deadline);
+    start_empty_batch(call, GRPC_INITIAL_METADATA_WAIT_FOR_READY, (void *)7);
+    grpc_call_destroy(call);
+    ev = next_event(cq);
+    assert(!ev.success && ev.tag == (void *)7);
+    channel->subchannels[0].connecting = false;
+    grpc_channel_destroy(channel);
+    
+    grpc_server_shutdown_and_notify(server, NULL, NULL);
+    grpc_server_destroy(server);
+    grpc_completion_queue_shutdown(cq);
+    grpc_completion_queue_destroy(cq);
+    TEST_PASS();
+}
+
+/* ========================================================================
+ * Main Test Runner
+ * ======================================================================== */
+
+int main(void) {
+    printf("=== gRPC-C Transport Tests ===\n\n");
+    
+    grpc_init();
+    
+    /* Zero-Copy Send Tests */
+    test_zerocopy_send_large_frame();
+    test_zerocopy_below_threshold_copies();
+    
+    /* GOAWAY Tests */
+    test_goaway_refuses_unprocessed_streams();
+    test_channel_migrates_after_goaway();
+    test_server_max_connection_age();
+    test_server_shutdown_sends_goaway();
+    test_channel_follows_server_drain();
+    
+    /* PING Keepalive Tests */
+    test_ping_ack_records_rtt();
+    test_ping_timeout_expires();
+    test_bdp_sample_grows_recv_window();
+    
+    /* Unix Domain Socket Tests */
+    test_address_parse_schemes();
+    test_unix_socket_peer_cred();
+    test_unix_abstract_peer_cred_filter();
+    
+    /* Shared-Memory Transport Tests */
+    test_shm_ring_frames();
+    test_shm_unix_server();
+    
+    /* Header Block Tests */
+    test_headers_split_into_continuation();
+    test_headers_over_limit_resets_stream();
+    
+    /* In-Process Transport Tests */
+    test_inproc_unary_call();
+    test_inproc_cancel_propagates();
+    test_inproc_server_shutdown();
+    
+    /* Resource Quota Tests */
+    test_resource_quota_limits();
+    test_quota_pressure_withholds_window();
+    test_inproc_quota_rejects_calls();
+    
+    /* Registered Method Tests */
+    test_inproc_registered_method();
+    test_http2_registered_method();
+    test_http2_large_reply_from_buffer();
+    test_method_router_perfect_hash();
+    test_server_routes_reflection_registry();
+    
+    /* Executor Tests */
+    test_executor_runs_and_steals();
+    test_callback_cq_offloads_handler();
+    test_callback_cq_after_executor_shutdown();
+    
+    /* Admission Control Tests */
+    test_server_sheds_over_concurrency_limit();
+    test_concurrency_limit_tracks_queue_delay();
+    
+    /* Tenant Scheduling Tests */
+    test_tenants_share_by_weight();
+    test_tenant_inflight_bound();
+    
+    /* Listener Handoff Tests */
+    test_server_listener_handoff();
+    
+    /* Accept Tests */
+    test_server_accepts_connection_burst();
+    
+    /* CPU Affinity Tests */
+    test_executor_pinned_to_node();
+    test_server_threads_pinned();
+    
+    /* Response Cache Tests */
+    test_response_cache_evicts_by_frequency();
+    test_server_answers_from_method_cache();
+    test_http2_answers_from_method_cache();
+    
+    /* Request Coalescing Tests */
+    test_server_coalesces_identical_calls();
+    
+    /* Multi-Connection Channel Tests */
+    test_channel_spreads_calls_over_connections();
+    
+    /* Subchannel Tests */
+    test_channel_balances_over_subchannels();
+    
+    /* Hedging Tests */
+    test_channel_hedges_slow_calls();
+    
+    /* Retry Tests */
+    test_channel_retries_failed_calls();
+    
+    /* Propagation Tests */
+    test_child_calls_follow_parent();
+    test_grpc_timeout_encoding();
+    
+    /* Micro-Batching Tests */
+    test_channel_batches_small_calls();
+    
+    /* Pre-warming Tests */
+    test_channel_prewarm_and_wait_for_ready();
+    
+    grpc_shutdown();
+    
+    printf("\n=== Test Results ===\n");
+    printf("Passed: %d\n", tests_passed);
+    printf("Failed: %d\n", tests_failed);
+    
+    if (tests_failed == 0) {
+        printf("\nAll tests PASSED!\n");
+        return 0;
+    } else {
+        printf("\nSome tests FAILED!\n");
+        return 1;
+    }
+}